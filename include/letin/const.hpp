@@ -109,6 +109,11 @@ namespace letin
   const int FORK_HANDLER_PRIO_NATIVE_FUN = 4;
   const int FORK_HANDLER_PRIO_VM =      5;
 
+  const int HEAP_SNAPSHOT_ROOT_GLOBAL_VARS = 0;
+  const int HEAP_SNAPSHOT_ROOT_MEMO_CACHES = 1;
+  const int HEAP_SNAPSHOT_ROOT_THREADS =     2;
+  const int MAX_HEAP_SNAPSHOT_ROOT =         2;
+
   const unsigned EVAL_STRATEGY_LAZY =   1 << 0;
   const unsigned EVAL_STRATEGY_MEMO =   1 << 1;
   const unsigned MAX_EVAL_STRATEGY =    1 << 1;
@@ -16,8 +16,10 @@
 #include <iostream>
 #include <limits>
 #include <list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 #include <vector>
 #include <letin/const.hpp>
@@ -42,6 +44,55 @@ namespace letin
     typedef format::Argument Argument;
     typedef format::Instruction Instruction;
 
+#ifdef LETIN_COMPRESSED_REFERENCES
+    // A compressed reference is a 32-bit offset of an object from the base of the heap
+    // region. The nil object lies in the first block of the heap region and the zero
+    // offset is the null pointer.
+    class Reference
+    {
+      static const std::uint32_t NIL_OFFSET = 16;
+      static char *_S_heap_base;
+
+      std::uint32_t _M_offset;
+
+      static std::uint32_t ptr_to_offset(Object *ptr)
+      { return ptr != nullptr ? static_cast<std::uint32_t>(reinterpret_cast<char *>(ptr) - _S_heap_base) : 0; }
+
+      static Object *offset_to_ptr(std::uint32_t offset)
+      { return offset != 0 ? reinterpret_cast<Object *>(_S_heap_base + offset) : nullptr; }
+    public:
+      Reference() : _M_offset(NIL_OFFSET) {}
+
+      Reference(Object *ptr) : _M_offset(ptr_to_offset(ptr)) {}
+
+      Reference &operator=(Object *ptr) { _M_offset = ptr_to_offset(ptr); return *this; }
+
+      void safely_assign_for_gc(Reference ref)
+      {
+        std::atomic_thread_fence(std::memory_order_release);
+        _M_offset = ref._M_offset;
+        std::atomic_thread_fence(std::memory_order_release);
+      }
+      
+      bool operator==(Reference ref) const { return _M_offset == ref._M_offset; }
+
+      bool operator!=(Reference ref) const { return _M_offset != ref._M_offset; }
+
+      Object &operator*() const { return *offset_to_ptr(_M_offset); }
+
+      Object *operator->() const { return offset_to_ptr(_M_offset); }
+      
+      bool has_nil() const { return _M_offset == NIL_OFFSET; }
+
+      bool is_null() const { return _M_offset == 0; }
+
+      Object *ptr() const { return offset_to_ptr(_M_offset); }
+
+      static char *heap_base() { return _S_heap_base; }
+
+      static std::size_t nil_offset() { return NIL_OFFSET; }
+    };
+#else
     class Reference
     {
       static Object _S_nil;
@@ -75,6 +126,7 @@ namespace letin
 
       Object *ptr() const { return _M_ptr; }
     };
+#endif
 
     class TupleElementType
     {
@@ -253,6 +305,11 @@ namespace letin
       bool operator!=(NativeObjectType type) const { return _M_ident != type._M_ident; }
     };
 
+    // A finalizer can be called by the finalization thread of the garbage collector
+    // after the collection. Then, the finalizer gets a copy of the bytes of its dead
+    // native object because the memory of this object can already be reused. Thus, the
+    // finalizer mustn't depend on the address of the native object and the native
+    // object should be trivially copyable.
     class NativeObjectFinalizator
     {
       void (*_M_fun)(const void *);
@@ -345,10 +402,16 @@ namespace letin
       void unlock();
     };
     
+#ifdef LETIN_COMPACT_OBJECT_HEADER
+    typedef std::uint32_t ObjectLength;
+#else
+    typedef std::size_t ObjectLength;
+#endif
+
     struct ObjectRaw
     {
       int type;
-      std::size_t length;
+      ObjectLength length;
       union
       {
         std::int8_t is8[1];
@@ -392,7 +455,7 @@ namespace letin
         struct
         {
           int _M_type;
-          std::size_t _M_length;
+          ObjectLength _M_length;
         };
         ObjectRaw _M_raw;
       };
@@ -781,6 +844,14 @@ namespace letin
       std::uint32_t instr() const { return _M_instr; }
     };
 
+    struct InstructionProfile
+    {
+      // The sequences are the bigrams and the trigrams of the instructions that were
+      // executed one after another in the same function call. An instruction of a
+      // sequence is represented by its opcode without the argument types.
+      std::map<std::vector<std::uint32_t>, std::uint64_t> seq_counts;
+    };
+
     class VirtualMachine
     {
     protected:
@@ -830,6 +901,15 @@ namespace letin
       int force_tuple_elem(ThreadContext *context, Object &object, std::size_t i);
 
       int fully_force_tuple_elem(ThreadContext *context, Object &object, std::size_t i);
+
+      // If the profiling flag is set before the loading, the virtual machine counts the
+      // executed instruction sequences instead of using the superinstructions.
+      virtual bool profiling_flag();
+
+      virtual void set_profiling_flag(bool flag);
+
+      // This method returns false if the virtual machine doesn't support the profiling.
+      virtual bool instr_profile(InstructionProfile &profile);
     };
 
     class Loader
@@ -854,19 +934,99 @@ namespace letin
       virtual void free(void *ptr) = 0;
     };
 
+    struct GarbageCollectorStatistics
+    {
+      static const std::size_t PAUSE_HISTOGRAM_SIZE = 24;
+
+      std::uint64_t collection_count;
+      // The emergency collections are started by the allocations that would exceed the
+      // maximal size of the heap.
+      std::uint64_t emergency_collection_count;
+      std::uint64_t total_stop_usecs;
+      std::uint64_t total_mark_usecs;
+      std::uint64_t total_sweep_usecs;
+      std::uint64_t total_pause_usecs;
+      std::uint64_t max_pause_usecs;
+      // The i-th element is the number of pauses that took from 2^i to 2^(i + 1)
+      // microseconds. The first element also counts shorter pauses and the last element
+      // also counts longer pauses.
+      std::uint64_t pause_histogram[PAUSE_HISTOGRAM_SIZE];
+      std::uint64_t allocated_byte_count;
+      std::uint64_t freed_byte_count;
+      std::uint64_t live_byte_count;
+      std::uint64_t immortal_byte_count;
+      // The live objects are counted by the last collection that visited all objects.
+      std::uint64_t live_object_counts[OBJECT_TYPE_NATIVE_OBJECT + 1];
+      std::uint64_t live_internal_object_count;
+    };
+
+    struct HeapSnapshotEntry
+    {
+      std::uint64_t object_count;
+      std::uint64_t byte_count;
+    };
+
+    struct HeapSnapshot
+    {
+      HeapSnapshotEntry type_entries[OBJECT_TYPE_NATIVE_OBJECT + 1];
+      HeapSnapshotEntry internal_entry;
+      // A live object is counted for the first kind of roots that reaches it. The kinds
+      // are visited in the order of their indices.
+      HeapSnapshotEntry root_entries[MAX_HEAP_SNAPSHOT_ROOT + 1];
+      // Only the sampled objects are counted for the functions that allocated them.
+      std::map<std::string, HeapSnapshotEntry> fun_entries;
+      std::size_t sampling_interval;
+
+      HeapSnapshot() : type_entries(), internal_entry(), root_entries(), sampling_interval(0) {}
+    };
+
     class GarbageCollector
     {
     protected:
       Allocator *_M_alloc;
+      std::atomic<std::size_t> _M_sampling_interval;
 
-      GarbageCollector(Allocator *alloc) : _M_alloc(alloc) {}
+      GarbageCollector(Allocator *alloc) : _M_alloc(alloc), _M_sampling_interval(0) {}
     public:
       virtual ~GarbageCollector();
 
       virtual void collect() = 0;
+
+      virtual void write_barrier(Object *object, ThreadContext *context = nullptr);
+
+      virtual void prepare_fork();
+
+      virtual GarbageCollectorStatistics statistics();
+
+      // If the safepoint flag is set, the garbage collector stops the threads at the
+      // safepoints instead of the signals.
+      virtual bool safepoint_flag();
+
+      virtual void set_safepoint_flag(bool flag);
+
+      // The maximal size of the heap is zero if the heap is unbounded. An allocation that
+      // would exceed this size fails if the heap still is too big after a collection.
+      virtual std::size_t max_heap_size();
+
+      virtual void set_max_heap_size(std::size_t size);
+
+      // An allocation from a function is sampled for the heap snapshots when the thread
+      // allocated this number of bytes since the last sample. The zero interval disables
+      // the sampling.
+      std::size_t sampling_interval() const
+      { return _M_sampling_interval.load(std::memory_order_relaxed); }
+
+      void set_sampling_interval(std::size_t byte_count)
+      { _M_sampling_interval.store(byte_count, std::memory_order_relaxed); }
+
+      // This method returns false if the garbage collector doesn't support the heap
+      // snapshots.
+      virtual bool heap_snapshot(HeapSnapshot &snapshot);
     protected:
       virtual void *allocate(std::size_t size, ThreadContext *context = nullptr) = 0;
 
+      virtual void sample_allocation(Object *object, ThreadContext *context);
+
       virtual void *allocate_immortal_area(std::size_t size) = 0;
     public:
       virtual void add_thread_context(ThreadContext *context) = 0;
@@ -1080,7 +1240,11 @@ namespace letin
 
     Allocator *new_allocator();
 
-    GarbageCollector *new_garbage_collector(Allocator *alloc);
+    GarbageCollector *new_garbage_collector(Allocator *alloc, unsigned int mark_thread_count = 1, bool is_concurrent = false, bool is_concurrent_sweep = false, double growth_factor = 0.0, unsigned int interval_usecs = 100000, bool is_freezing_before_fork = false);
+
+    GarbageCollector *new_generational_garbage_collector(Allocator *alloc, std::size_t nursery_size = 4 * 1024 * 1024, double growth_factor = 0.0, unsigned int interval_usecs = 100000, double compaction_threshold = 0.0);
+
+    GarbageCollector *new_bitmap_garbage_collector(Allocator *alloc, double growth_factor = 0.0, unsigned int interval_usecs = 100000);
 
     MemoizationCacheFactory *new_memoization_cache_factory(std::size_t bucket_count);
 
@@ -1088,6 +1252,8 @@ namespace letin
 
     VirtualMachine *new_virtual_machine(Loader *loader, GarbageCollector *gc, NativeFunctionHandler *native_fun_handler, EvaluationStrategy *eval_strategy, std::function<void ()> exit_fun = []() {});
 
+    VirtualMachine *new_jit_virtual_machine(Loader *loader, GarbageCollector *gc, NativeFunctionHandler *native_fun_handler, EvaluationStrategy *eval_strategy, std::function<void ()> exit_fun = []() {}, unsigned int compilation_threshold = 16);
+
     NativeFunctionHandlerLoader *new_native_function_handler_loader();
 
     EvaluationStrategy *new_eager_evaluation_strategy();
@@ -1147,6 +1313,10 @@ namespace letin
     
     const char *error_to_string(int error);
 
+    void write_heap_snapshot(std::ostream &os, const HeapSnapshot &snapshot);
+
+    bool read_heap_snapshot(std::istream &is, HeapSnapshot &snapshot);
+
     Reference user_exception_ref(ThreadContext *context);
   }
 }
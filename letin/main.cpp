@@ -9,17 +9,25 @@
 #include <sys/stat.h>
 #include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <unistd.h>
 #include <vector>
+#include <letin/opcode.hpp>
 #include <letin/vm.hpp>
 #include "path_util.hpp"
 
@@ -29,6 +37,43 @@ using namespace letin::vm;
 using namespace letin::util;
 
 const size_t DEFAULT_BUCKET_COUNT = 32 * 1024;
+const size_t DEFAULT_NURSERY_SIZE = 4 * 1024 * 1024;
+const unsigned DEFAULT_GC_INTERVAL_USECS = 100000;
+const size_t DEFAULT_SAMPLING_INTERVAL = 512 * 1024;
+const unsigned HEAP_SNAPSHOT_INTERVAL_MSECS = 1000;
+const size_t TOP_FUN_COUNT = 20;
+const size_t TOP_INSTR_SEQ_COUNT = 20;
+
+static const char *object_type_names[OBJECT_TYPE_NATIVE_OBJECT + 1] = {
+  "iarray8", "iarray16", "iarray32", "iarray64", "sfarray", "dfarray",
+  "rarray", "tuple", "io", "lazy value", "native object"
+};
+
+static const char *instr_names[opcode::INSTR_RETHROW + 1] = {
+  "let", "in", "ret", "jc", "jump", "arg", "retry", "lettuple", "throw", "push", "pop", "rethrow"
+};
+
+static const char *op_names[opcode::OP_STACKTRACE + 1] = {
+  "iload", "iload2", "ineg", "iadd", "isub", "imul", "idiv", "imod", "inot", "iand",
+  "ior", "ixor", "ishl", "ishr", "ishru", "ieq", "ine", "ilt", "ige", "igt", "ile",
+  "fload", "fload2", "fneg", "fadd", "fsub", "fmul", "fdiv", "feq", "fne", "flt",
+  "fge", "fgt", "fle", "rload", "req", "rne", "riarray8", "riarray16", "riarray32",
+  "riarray64", "rsfarray", "rdfarray", "rrarray", "rtuple", "rianth8", "rianth16",
+  "rianth32", "rianth64", "rsfanth", "rdfanth", "rranth", "rtnth", "rialen8",
+  "rialen16", "rialen32", "rialen64", "rsfalen", "rdfalen", "rralen", "rtlen",
+  "riacat8", "riacat16", "riacat32", "riacat64", "rsfacat", "rdfacat", "rracat",
+  "rtcat", "rtype", "icall", "fcall", "rcall", "itof", "ftoi", "incall", "fncall",
+  "rncall", "ruiafill8", "ruiafill16", "ruiafill32", "ruiafill64", "rusfafill",
+  "rudfafill", "rurafill", "rutfilli", "rutfillf", "rutfillr", "ruianth8",
+  "ruianth16", "ruianth32", "ruianth64", "rusfanth", "rudfanth", "ruranth", "rutnth",
+  "ruiasnth8", "ruiasnth16", "ruiasnth32", "ruiasnth64", "rusfasnth", "rudfasnth",
+  "rurasnth", "rutsnth", "ruialen8", "ruialen16", "ruialen32", "ruialen64",
+  "rusfalen", "rudfalen", "ruralen", "rutlen", "rutype", "ruiatoia8", "ruiatoia16",
+  "ruiatoia32", "ruiatoia64", "rusfatosfa", "rudfatodfa", "ruratora", "ruttot",
+  "fpow", "fsqrt", "fexp", "flog", "fcos", "fsin", "ftan", "facos", "fasin", "fatan",
+  "fceil", "ffloor", "fround", "ftrunc", "try", "iforce", "fforce", "rforce",
+  "stacktrace"
+};
 
 struct VirtualMachineFinalization
 {
@@ -192,6 +237,147 @@ EvaluationStrategy *parse_eval_strategy_string(const string &str, unique_ptr<Mem
   return fun();
 }
 
+bool parse_size(const string &str, size_t &size)
+{
+  istringstream iss(str);
+  iss >> size;
+  if(iss.fail()) return false;
+  size_t multiplier = 1;
+  char c;
+  if(iss >> c) {
+    switch(c) {
+      case 'k':
+        multiplier = 1024;
+        break;
+      case 'M':
+        multiplier = 1024 * 1024;
+        break;
+      case 'G':
+        multiplier = 1024 * 1024 * 1024;
+        break;
+      default:
+        return false;
+    }
+    if(!(iss >> c).fail()) return false;
+  }
+  if(size > numeric_limits<size_t>::max() / multiplier) return false;
+  size *= multiplier;
+  return true;
+}
+
+GarbageCollector *parse_gc_string(const string &str, Allocator *alloc)
+{
+  auto name_begin = str.begin();
+  auto name_end = find(str.begin(), str.end(), ':');
+  bool are_args = name_end != str.end();
+  size_t nursery_size = DEFAULT_NURSERY_SIZE;
+  unsigned mark_thread_count = 1;
+  bool is_concurrent = false;
+  bool is_concurrent_sweep = false;
+  bool is_freezing_before_fork = false;
+  double growth_factor = 0.0;
+  double compaction_threshold = 0.0;
+  bool has_safepoints = false;
+  size_t max_heap_size = 0;
+  unsigned interval_usecs = DEFAULT_GC_INTERVAL_USECS;
+  function<GarbageCollector *()> fun;
+  bool is_mark_sweep = false;
+  bool is_gen = false;
+  if(string(name_begin, name_end) == "marksweep") {
+    is_mark_sweep = true;
+    fun = [alloc, &mark_thread_count, &is_concurrent, &is_concurrent_sweep, &growth_factor, &interval_usecs, &is_freezing_before_fork]() {
+      return new_garbage_collector(alloc, mark_thread_count, is_concurrent, is_concurrent_sweep, growth_factor, interval_usecs, is_freezing_before_fork);
+    };
+  } else if(string(name_begin, name_end) == "gen") {
+    is_gen = true;
+    fun = [alloc, &nursery_size, &growth_factor, &interval_usecs, &compaction_threshold]() {
+      return new_generational_garbage_collector(alloc, nursery_size, growth_factor, interval_usecs, compaction_threshold);
+    };
+  } else if(string(name_begin, name_end) == "bitmap") {
+    fun = [alloc, &growth_factor, &interval_usecs]() {
+      return new_bitmap_garbage_collector(alloc, growth_factor, interval_usecs);
+    };
+  } else {
+    cerr << "error: incorrect garbage collector" << endl;
+    return nullptr;
+  }
+  if(are_args) {
+    auto arg_list_begin = name_end + 1;
+    auto arg_list_end = str.end();
+    auto arg_begin = arg_list_begin;
+    while(true) {
+      auto arg_end = find(arg_begin, arg_list_end, ',');
+      auto arg_name_end = find(arg_begin, arg_end, '=');
+      bool is_arg_value = (arg_name_end != arg_end);
+      auto arg_value_begin = (is_arg_value ? arg_name_end + 1 : arg_name_end);
+      if(string(arg_begin, arg_name_end) == "mark_threads" && is_arg_value && is_mark_sweep) {
+        istringstream iss(string(arg_value_begin, arg_end));
+        iss >> mark_thread_count;
+        if(iss.fail() || !iss.eof() || mark_thread_count == 0) {
+          cerr << "error: incorrect number of mark threads" << endl;
+          return nullptr;
+        }
+      } else if(string(arg_begin, arg_name_end) == "concurrent" && !is_arg_value && is_mark_sweep) {
+        is_concurrent = true;
+      } else if(string(arg_begin, arg_name_end) == "concurrent_sweep" && !is_arg_value && is_mark_sweep) {
+        is_concurrent_sweep = true;
+      } else if(string(arg_begin, arg_name_end) == "freeze_before_fork" && !is_arg_value && is_mark_sweep) {
+        is_freezing_before_fork = true;
+      } else if(string(arg_begin, arg_name_end) == "growth_factor" && is_arg_value) {
+        istringstream iss(string(arg_value_begin, arg_end));
+        iss >> growth_factor;
+        if(iss.fail() || !iss.eof() || growth_factor <= 1.0) {
+          cerr << "error: incorrect growth factor" << endl;
+          return nullptr;
+        }
+      } else if(string(arg_begin, arg_name_end) == "interval" && is_arg_value) {
+        istringstream iss(string(arg_value_begin, arg_end));
+        iss >> interval_usecs;
+        if(iss.fail() || !iss.eof()) {
+          cerr << "error: incorrect interval of garbage collector" << endl;
+          return nullptr;
+        }
+      } else if(string(arg_begin, arg_name_end) == "safepoints" && !is_arg_value) {
+        has_safepoints = true;
+      } else if(string(arg_begin, arg_name_end) == "max_heap_size" && is_arg_value) {
+        if(!parse_size(string(arg_value_begin, arg_end), max_heap_size) || max_heap_size == 0) {
+          cerr << "error: incorrect maximal size of heap" << endl;
+          return nullptr;
+        }
+      } else if(string(arg_begin, arg_name_end) == "nursery_size" && is_arg_value && is_gen) {
+        istringstream iss(string(arg_value_begin, arg_end));
+        iss >> nursery_size;
+        if(iss.fail() || !iss.eof() || nursery_size == 0) {
+          cerr << "error: incorrect size of nursery" << endl;
+          return nullptr;
+        }
+      } else if(string(arg_begin, arg_name_end) == "compaction_threshold" && is_arg_value && is_gen) {
+        istringstream iss(string(arg_value_begin, arg_end));
+        iss >> compaction_threshold;
+        if(iss.fail() || !iss.eof() || compaction_threshold <= 0.0 || compaction_threshold >= 1.0) {
+          cerr << "error: incorrect compaction threshold" << endl;
+          return nullptr;
+        }
+      } else {
+        cerr << "error: incorrect argument of garbage collector" << endl;
+        return nullptr;
+      }
+      if(arg_end != arg_list_end)
+        arg_begin = arg_end + 1;
+      else
+        break;
+    }
+  }
+  if(interval_usecs == 0 && growth_factor == 0.0) {
+    cerr << "error: interval of garbage collector can be zero only with growth factor" << endl;
+    return nullptr;
+  }
+  GarbageCollector *gc = fun();
+  if(gc != nullptr && has_safepoints) gc->set_safepoint_flag(true);
+  if(gc != nullptr && max_heap_size != 0) gc->set_max_heap_size(max_heap_size);
+  return gc;
+}
+
 void print_stack_trace(ostream &os, const vector<StackTraceElement> &stack_trace)
 {
   for(auto &stack_trace_elem : stack_trace) {
@@ -199,6 +385,164 @@ void print_stack_trace(ostream &os, const vector<StackTraceElement> &stack_trace
   }
 }
 
+void print_gc_statistics(ostream &os, const GarbageCollectorStatistics &stats)
+{
+  os << "gc: collections: " << stats.collection_count << endl;
+  os << "gc: emergency collections: " << stats.emergency_collection_count << endl;
+  os << "gc: pause time: total " << stats.total_pause_usecs << "us, max " << stats.max_pause_usecs << "us" << endl;
+  os << "gc: stop time: " << stats.total_stop_usecs << "us" << endl;
+  os << "gc: mark time: " << stats.total_mark_usecs << "us" << endl;
+  os << "gc: sweep time: " << stats.total_sweep_usecs << "us" << endl;
+  for(size_t i = 0; i < GarbageCollectorStatistics::PAUSE_HISTOGRAM_SIZE; i++) {
+    if(stats.pause_histogram[i] != 0)
+      os << "gc: pauses from " << (i != 0 ? (UINT64_C(1) << i) : 0) << "us: " << stats.pause_histogram[i] << endl;
+  }
+  os << "gc: allocated bytes: " << stats.allocated_byte_count << endl;
+  os << "gc: freed bytes: " << stats.freed_byte_count << endl;
+  os << "gc: live bytes: " << stats.live_byte_count << endl;
+  os << "gc: immortal bytes: " << stats.immortal_byte_count << endl;
+  for(int i = 0; i <= OBJECT_TYPE_NATIVE_OBJECT; i++) {
+    if(stats.live_object_counts[i] != 0)
+      os << "gc: live " << object_type_names[i] << " objects: " << stats.live_object_counts[i] << endl;
+  }
+  if(stats.live_internal_object_count != 0)
+    os << "gc: live internal objects: " << stats.live_internal_object_count << endl;
+}
+
+static void print_instr_seq(ostream &os, const vector<uint32_t> &seq)
+{
+  for(size_t i = 0; i < seq.size(); i++) {
+    if(i != 0) os << ", ";
+    uint32_t instr = opcode::opcode_to_instr(seq[i]);
+    uint32_t op = opcode::opcode_to_op(seq[i]);
+    os << (instr <= opcode::INSTR_RETHROW ? instr_names[instr] : "?");
+    switch(instr) {
+      case opcode::INSTR_LET:
+      case opcode::INSTR_RET:
+      case opcode::INSTR_ARG:
+      case opcode::INSTR_LETTUPLE:
+      case opcode::INSTR_PUSH:
+        os << " " << (op <= opcode::OP_STACKTRACE ? op_names[op] : "?");
+        break;
+    }
+  }
+}
+
+void print_instr_profile(ostream &os, const InstructionProfile &profile)
+{
+  vector<pair<vector<uint32_t>, uint64_t>> entries(profile.seq_counts.begin(), profile.seq_counts.end());
+  stable_sort(entries.begin(), entries.end(), [](const pair<vector<uint32_t>, uint64_t> &pair1, const pair<vector<uint32_t>, uint64_t> &pair2) {
+    return pair1.second > pair2.second;
+  });
+  if(entries.size() > TOP_INSTR_SEQ_COUNT) entries.resize(TOP_INSTR_SEQ_COUNT);
+  for(auto &pair : entries) {
+    os << "instrs: ";
+    print_instr_seq(os, pair.first);
+    os << ": " << pair.second << endl;
+  }
+}
+
+// The heap profiler periodically takes the heap snapshots and writes the snapshot with
+// the most live bytes to the file.
+class HeapProfiler
+{
+  GarbageCollector *_M_gc;
+  string _M_file_name;
+  uint64_t _M_max_byte_count;
+  mutex _M_snapshot_mutex;
+  mutex _M_thread_mutex;
+  condition_variable _M_thread_cv;
+  bool _M_is_stopped;
+  thread _M_thread;
+public:
+  HeapProfiler(GarbageCollector *gc, const string &file_name) :
+    _M_gc(gc), _M_file_name(file_name), _M_max_byte_count(0), _M_is_stopped(true) {}
+
+  ~HeapProfiler() { stop(); }
+
+  void start();
+
+  void stop();
+
+  bool take_snapshot();
+};
+
+void HeapProfiler::start()
+{
+  _M_is_stopped = false;
+  _M_thread = thread([this]() {
+    unique_lock<mutex> lock(_M_thread_mutex);
+    while(!_M_is_stopped) {
+      if(_M_thread_cv.wait_for(lock, chrono::milliseconds(HEAP_SNAPSHOT_INTERVAL_MSECS)) == cv_status::timeout)
+        take_snapshot();
+    }
+  });
+}
+
+void HeapProfiler::stop()
+{
+  {
+    lock_guard<mutex> guard(_M_thread_mutex);
+    _M_is_stopped = true;
+    _M_thread_cv.notify_one();
+  }
+  if(_M_thread.joinable()) _M_thread.join();
+}
+
+bool HeapProfiler::take_snapshot()
+{
+  lock_guard<mutex> guard(_M_snapshot_mutex);
+  HeapSnapshot snapshot;
+  if(!_M_gc->heap_snapshot(snapshot)) return false;
+  uint64_t byte_count = snapshot.internal_entry.byte_count;
+  for(int i = 0; i <= OBJECT_TYPE_NATIVE_OBJECT; i++) byte_count += snapshot.type_entries[i].byte_count;
+  if(byte_count <= _M_max_byte_count && _M_max_byte_count != 0) return true;
+  _M_max_byte_count = byte_count;
+  ofstream ofs(_M_file_name);
+  if(!ofs.good()) return false;
+  write_heap_snapshot(ofs, snapshot);
+  return ofs.good();
+}
+
+static void print_heap_snapshot_entry(ostream &os, const string &name, const HeapSnapshotEntry &entry)
+{
+  os << "  " << name << ": " << entry.object_count << " objects, " << entry.byte_count << " bytes" << endl;
+}
+
+void print_heap_snapshot(ostream &os, const HeapSnapshot &snapshot)
+{
+  static const char *root_names[MAX_HEAP_SNAPSHOT_ROOT + 1] = {
+    "global variables", "memoization caches", "threads"
+  };
+  HeapSnapshotEntry total_entry = snapshot.internal_entry;
+  for(int i = 0; i <= OBJECT_TYPE_NATIVE_OBJECT; i++) {
+    total_entry.object_count += snapshot.type_entries[i].object_count;
+    total_entry.byte_count += snapshot.type_entries[i].byte_count;
+  }
+  os << "live objects: " << total_entry.object_count << " objects, " << total_entry.byte_count << " bytes" << endl;
+  os << "types:" << endl;
+  vector<pair<string, HeapSnapshotEntry>> entries;
+  for(int i = 0; i <= OBJECT_TYPE_NATIVE_OBJECT; i++) {
+    if(snapshot.type_entries[i].object_count != 0)
+      entries.push_back(make_pair(string(object_type_names[i]), snapshot.type_entries[i]));
+  }
+  if(snapshot.internal_entry.object_count != 0)
+    entries.push_back(make_pair(string("internal"), snapshot.internal_entry));
+  auto compare = [](const pair<string, HeapSnapshotEntry> &pair1, const pair<string, HeapSnapshotEntry> &pair2) {
+    return pair1.second.byte_count > pair2.second.byte_count;
+  };
+  stable_sort(entries.begin(), entries.end(), compare);
+  for(auto &pair : entries) print_heap_snapshot_entry(os, pair.first, pair.second);
+  os << "roots:" << endl;
+  for(int i = 0; i <= MAX_HEAP_SNAPSHOT_ROOT; i++)
+    print_heap_snapshot_entry(os, root_names[i], snapshot.root_entries[i]);
+  os << "functions (sampled every " << snapshot.sampling_interval << " bytes):" << endl;
+  entries.assign(snapshot.fun_entries.begin(), snapshot.fun_entries.end());
+  stable_sort(entries.begin(), entries.end(), compare);
+  if(entries.size() > TOP_FUN_COUNT) entries.resize(TOP_FUN_COUNT);
+  for(auto &pair : entries) print_heap_snapshot_entry(os, pair.first, pair.second);
+}
+
 int main(int argc, char **argv)
 {
   try {
@@ -207,24 +551,40 @@ int main(int argc, char **argv)
     vector<string> native_lib_dirs;
     list<string> native_lib_names;
     string eval_strategy_string("fun");
+    string gc_string("marksweep");
     bool is_default_native_fun_handler = true;
+    bool is_gc_stats = false;
+    bool is_instr_profile = false;
+    bool is_jit = false;
+    string heap_snapshot_file_name;
     int c;
     opterr = 0;
-    while((c = getopt(argc, argv, "e:hl:L:n:N:x")) != -1) {
+    while((c = getopt(argc, argv, "e:g:hijl:L:n:N:p:P:sx")) != -1) {
       switch(c) {
         case 'e':
           eval_strategy_string = string(optarg);
           break;
+        case 'g':
+          gc_string = string(optarg);
+          break;
         case 'h':
           cout << "Usage: " << argv[0] << " [<option> ...] <program file> [<argument> ...]" << endl;
           cout << endl;
           cout << "Options:" << endl;
           cout << "  -e <evaluation strategy>      set the evaluation strategy" << endl;
+          cout << "  -g <garbage collector>        set the garbage collector" << endl;
           cout << "  -h                            display this text" << endl;
+          cout << "  -i                            print the most executed instruction sequences at exit" << endl;
+          cout << "  -j                            use the JIT compiler" << endl;
           cout << "  -l <library>                  add the library" << endl;
           cout << "  -L <directory>                add the directory to library directories" << endl;
           cout << "  -n <native library>           add the native library" << endl;
           cout << "  -N <directory>                add the directory to native library directories" << endl;
+          cout << "  -p <file>                     write the heap snapshot with the most live bytes" << endl;
+          cout << "                                to the file" << endl;
+          cout << "  -P <file>                     print the top consumers from the heap snapshot" << endl;
+          cout << "                                file" << endl;
+          cout << "  -s                            print statistics of the garbage collector at exit" << endl;
           cout << "  -x                            don't use the default native function handler" << endl;
           cout << endl;
           cout << "Evaluation strategies:" << endl;
@@ -245,10 +605,49 @@ int main(int argc, char **argv)
           cout << "Features of evaluation strategy:" << endl;
           cout << "  eager, lazy, memo" << endl;
           cout << endl;
+          cout << "Garbage collectors:" << endl;
+          cout << "  bitmap[:<argument>,...]       use the mark-sweep garbage collector with mark" << endl;
+          cout << "                                bitmaps" << endl;
+          cout << "  gen[:<argument>,...]          use the generational garbage collector" << endl;
+          cout << "  marksweep[:<argument>,...]    use the mark-sweep garbage collector (default)" << endl;
+          cout << endl;
+          cout << "Arguments for all garbage collectors:" << endl;
+          cout << "  growth_factor=<number>        start the collection when the heap grows by" << endl;
+          cout << "                                this factor since the last collection" << endl;
+          cout << "  interval=<microseconds>       the interval of the collection timer; zero" << endl;
+          cout << "                                disables the timer for the growth factor" << endl;
+          cout << "                                (default: " << DEFAULT_GC_INTERVAL_USECS << ")" << endl;
+          cout << "  max_heap_size=<size>          the maximal size of heap in bytes with an" << endl;
+          cout << "                                optional suffix k, M or G; the allocation" << endl;
+          cout << "                                fails after an emergency collection if the" << endl;
+          cout << "                                heap would exceed this size" << endl;
+          cout << "  safepoints                    stop threads at safepoints instead of" << endl;
+          cout << "                                signals" << endl;
+          cout << endl;
+          cout << "Arguments for the mark-sweep garbage collector:" << endl;
+          cout << "  concurrent                    mark objects while threads are running" << endl;
+          cout << "  concurrent_sweep              sweep objects while threads are running" << endl;
+          cout << "  freeze_before_fork            freeze live objects before the fork so that" << endl;
+          cout << "                                forked processes share their pages" << endl;
+          cout << "  mark_threads=<number>         the number of threads that mark objects" << endl;
+          cout << "                                (default: 1)" << endl;
+          cout << endl;
+          cout << "Arguments for the generational garbage collector:" << endl;
+          cout << "  compaction_threshold=<number> compact the old generation when this fraction" << endl;
+          cout << "                                of its pages is free after the major collection" << endl;
+          cout << "  nursery_size=<number>         the size of nursery in bytes" << endl;
+          cout << "                                (default: " << DEFAULT_NURSERY_SIZE << ")" << endl;
+          cout << endl;
           cout << "Environment variables:" << endl;
           cout << "  LETIN_LIB_PATH                library directories" << endl;
           cout << "  LETIN_NATIVE_LIB_PATH         native library directories" << endl;
           return 0;
+        case 'i':
+          is_instr_profile = true;
+          break;
+        case 'j':
+          is_jit = true;
+          break;
         case 'l':
           lib_names.push_back(string(optarg));
           break;
@@ -261,6 +660,27 @@ int main(int argc, char **argv)
         case 'N':
           native_lib_dirs.push_back(string(optarg));
           break;
+        case 'p':
+          heap_snapshot_file_name = string(optarg);
+          break;
+        case 'P':
+        {
+          ifstream ifs(optarg);
+          if(!ifs.good()) {
+            cerr << "error: can't open heap snapshot file " << optarg << endl;
+            return 1;
+          }
+          HeapSnapshot snapshot;
+          if(!read_heap_snapshot(ifs, snapshot)) {
+            cerr << "error: incorrect heap snapshot file " << optarg << endl;
+            return 1;
+          }
+          print_heap_snapshot(cout, snapshot);
+          return 0;
+        }
+        case 's':
+          is_gc_stats = true;
+          break;
         case 'x':
           is_default_native_fun_handler = false;
           break;
@@ -296,18 +716,53 @@ int main(int argc, char **argv)
     }
     initialize_vm();
     static int status = 0;
+    static GarbageCollector *stats_gc = nullptr;
+    static HeapProfiler *heap_profiler = nullptr;
+    static VirtualMachine *profiled_vm = nullptr;
     VirtualMachineFinalization final;
     unique_ptr<NativeFunctionHandlerLoader> native_fun_handler_loader(new_native_function_handler_loader());
     vector<NativeFunctionHandler *> native_fun_handlers;
     if(!load_native_fun_handlers(native_fun_handler_loader.get(), native_lib_file_names, native_fun_handlers, is_default_native_fun_handler)) return 1;
     unique_ptr<Loader> loader(new_loader());
     unique_ptr<Allocator> alloc(new_allocator());
-    unique_ptr<GarbageCollector> gc(new_garbage_collector(alloc.get()));
+    unique_ptr<GarbageCollector> gc(parse_gc_string(gc_string, alloc.get()));
+    if(gc.get() == nullptr) return 1;
+    if(is_gc_stats) stats_gc = gc.get();
+    unique_ptr<HeapProfiler> heap_profiler_ptr;
+    if(!heap_snapshot_file_name.empty()) {
+      gc->set_sampling_interval(DEFAULT_SAMPLING_INTERVAL);
+      heap_profiler_ptr = unique_ptr<HeapProfiler>(new HeapProfiler(gc.get(), heap_snapshot_file_name));
+      heap_profiler = heap_profiler_ptr.get();
+    }
     unique_ptr<NativeFunctionHandler> native_fun_handler(new MultiNativeFunctionHandler(native_fun_handlers));
     unique_ptr<MemoizationCacheFactory> memo_cache_factory;
     unique_ptr<EvaluationStrategy> eval_strategy(parse_eval_strategy_string(eval_strategy_string, memo_cache_factory));
     if(eval_strategy.get() == nullptr) return 1;
-    unique_ptr<VirtualMachine> vm = unique_ptr<VirtualMachine>(new_virtual_machine(loader.get(), gc.get(), native_fun_handler.get(), eval_strategy.get(), []() { exit(status);}));
+    function<void ()> exit_fun = []() {
+      if(heap_profiler != nullptr) {
+        heap_profiler->stop();
+        if(!heap_profiler->take_snapshot()) cerr << "error: can't write heap snapshot" << endl;
+      }
+      if(stats_gc != nullptr) print_gc_statistics(cerr, stats_gc->statistics());
+      if(profiled_vm != nullptr) {
+        InstructionProfile profile;
+        if(profiled_vm->instr_profile(profile)) print_instr_profile(cerr, profile);
+      }
+      exit(status);
+    };
+    unique_ptr<VirtualMachine> vm;
+    if(is_jit)
+      vm = unique_ptr<VirtualMachine>(new_jit_virtual_machine(loader.get(), gc.get(), native_fun_handler.get(), eval_strategy.get(), exit_fun));
+    else
+      vm = unique_ptr<VirtualMachine>(new_virtual_machine(loader.get(), gc.get(), native_fun_handler.get(), eval_strategy.get(), exit_fun));
+    if(is_instr_profile) {
+      vm->set_profiling_flag(true);
+      if(!vm->profiling_flag()) {
+        cerr << "error: virtual machine doesn't support instruction profiling" << endl;
+        return 1;
+      }
+      profiled_vm = vm.get();
+    }
     list<LoadingError> errors;
     if(!vm->load(file_names, &errors)) {
       for(auto error : errors)
@@ -328,6 +783,7 @@ int main(int argc, char **argv)
     vector<Value> args;
     args.push_back(Value(ref));
     gc->start();
+    if(heap_profiler != nullptr) heap_profiler->start();
     bool is_unique_result = false;
     if(vm->env().fun(vm->entry()).arg_count() == 2) {
       Reference unique_io_ref(vm->gc()->new_immortal_object(OBJECT_TYPE_IO | OBJECT_TYPE_UNIQUE, 0));
@@ -394,7 +850,13 @@ int main(int argc, char **argv)
       }
     });
     thread.system_thread().join();
+    if(heap_profiler != nullptr) heap_profiler->stop();
     gc->stop();
+    if(is_gc_stats) print_gc_statistics(cerr, gc->statistics());
+    if(is_instr_profile) {
+      InstructionProfile profile;
+      if(vm->instr_profile(profile)) print_instr_profile(cerr, profile);
+    }
     return status;
   } catch(bad_alloc &) {
     cerr << "error: out of memory" << endl;
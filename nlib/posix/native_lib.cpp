@@ -1387,6 +1387,7 @@ extern "C" {
             Value &io_v = args[0];
 #if defined(__unix__)
             Pid pid;
+            vm->gc()->prepare_fork();
             {
               ForkAround fork_around;
               pid = ::fork();
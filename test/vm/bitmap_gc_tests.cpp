@@ -0,0 +1,249 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "bitmap_gc.hpp"
+#include "bitmap_gc_tests.hpp"
+#include "new_alloc.hpp"
+
+using namespace std;
+using namespace letin::vm;
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace test
+    {
+      CPPUNIT_TEST_SUITE_REGISTRATION(BitmapGarbageCollectorTests);
+
+      static NativeObjectTypeIdentity int_ptr_ident;
+
+      static void finalize_int_ptr(const void *ptr)
+      {
+        int * const *tmp = reinterpret_cast<int * const *>(ptr);
+        **tmp = 1;
+      }
+
+      static NativeObjectFunctions int_ptr_funs(finalize_int_ptr, nullptr, nullptr);
+
+      // The live native objects are finalized by tearDown so the integers of their
+      // finalizers can't be local variables of the tests.
+      static int finalized_ints[3];
+
+      static Reference new_int_ptr_object(GarbageCollector *gc, int *i, size_t length = sizeof(int *))
+      {
+        Reference ref(gc->new_object(OBJECT_TYPE_NATIVE_OBJECT, length));
+        ref->raw().ntvo.type = NativeObjectType(&int_ptr_ident);
+        ref->raw().ntvo.clazz = NativeObjectClass(&int_ptr_funs);
+        *reinterpret_cast<int **>(ref->raw().ntvo.bs) = i;
+        return ref;
+      }
+
+      void BitmapGarbageCollectorTests::setUp()
+      {
+        _M_alloc = new impl::NewAllocator();
+        _M_gc = new impl::BitmapGarbageCollector(_M_alloc);
+        _M_thread_context_mutex = new mutex();
+        _M_thread_context_mutex->lock();
+      }
+
+      void BitmapGarbageCollectorTests::tearDown()
+      {
+        delete _M_thread_context_mutex;
+        delete _M_gc;
+        delete _M_alloc;
+      }
+
+      void BitmapGarbageCollectorTests::test_bitmap_gc_does_not_collect_live_objects()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), _M_gc->header_size());
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 5));
+        strcpy(reinterpret_cast<char *>(ref1->raw().is8), "test");
+        Reference ref2(_M_gc->new_object(OBJECT_TYPE_TUPLE, 3));
+        ref2->set_elem(0, Value(ref1));
+        ref2->set_elem(1, Value(1));
+        ref2->set_elem(2, Value(ref1));
+        thread_context->regs().rv.raw().r = ref2;
+        for(int i = 0; i < 2; i++) {
+          _M_gc->collect();
+          Reference ref3 = thread_context->regs().rv.raw().r;
+          CPPUNIT_ASSERT(ref2 == ref3);
+          CPPUNIT_ASSERT_EQUAL(OBJECT_TYPE_TUPLE, ref3->type());
+          CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), ref3->length());
+          CPPUNIT_ASSERT_EQUAL(1, static_cast<int>(ref3->elem(1).raw().i));
+          CPPUNIT_ASSERT(ref1 == ref3->elem(0).raw().r);
+          CPPUNIT_ASSERT(ref1 == ref3->elem(2).raw().r);
+          CPPUNIT_ASSERT_EQUAL(string("test"), string(reinterpret_cast<char *>(ref1->raw().is8)));
+        }
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void BitmapGarbageCollectorTests::test_bitmap_gc_finalizes_unreachable_native_objects()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        int &i1 = finalized_ints[0], &i2 = finalized_ints[1], &i3 = finalized_ints[2];
+        i1 = i2 = i3 = 0;
+        Reference ref1 = new_int_ptr_object(_M_gc, &i1);
+        new_int_ptr_object(_M_gc, &i2);
+        thread_context->regs().rv.raw().r = ref1;
+        _M_gc->collect();
+        CPPUNIT_ASSERT_EQUAL(0, i1);
+        CPPUNIT_ASSERT_EQUAL(1, i2);
+        new_int_ptr_object(_M_gc, &i3);
+        thread_context->regs().rv.raw().r = Reference();
+        _M_gc->collect();
+        CPPUNIT_ASSERT_EQUAL(1, i1);
+        CPPUNIT_ASSERT_EQUAL(1, i3);
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void BitmapGarbageCollectorTests::test_bitmap_gc_collects_large_objects()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        int &i1 = finalized_ints[0], &i2 = finalized_ints[1];
+        i1 = i2 = 0;
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 10000));
+        for(size_t j = 0; j < 10000; j++) ref1->raw().is8[j] = static_cast<int8_t>(j);
+        Reference ref2 = new_int_ptr_object(_M_gc, &i1, 10000);
+        new_int_ptr_object(_M_gc, &i2, 10000);
+        Reference ref3(_M_gc->new_object(OBJECT_TYPE_TUPLE, 2));
+        ref3->set_elem(0, Value(ref1));
+        ref3->set_elem(1, Value(ref2));
+        thread_context->regs().rv.raw().r = ref3;
+        for(int j = 0; j < 2; j++) {
+          _M_gc->collect();
+          CPPUNIT_ASSERT_EQUAL(0, i1);
+          CPPUNIT_ASSERT_EQUAL(1, i2);
+          Reference ref4 = thread_context->regs().rv.raw().r->elem(0).raw().r;
+          CPPUNIT_ASSERT(ref1 == ref4);
+          CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(10000), ref4->length());
+          for(size_t k = 0; k < 10000; k++)
+            CPPUNIT_ASSERT_EQUAL(static_cast<int8_t>(k), ref4->raw().is8[k]);
+        }
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void BitmapGarbageCollectorTests::test_bitmap_gc_reuses_cells_of_unreachable_objects()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_TUPLE, 2));
+        Object *object = _M_gc->new_object(OBJECT_TYPE_TUPLE, 2);
+        Reference ref2(_M_gc->new_object(OBJECT_TYPE_TUPLE, 2));
+        ref1->set_elem(0, Value(1));
+        ref1->set_elem(1, Value(ref2));
+        ref2->set_elem(0, Value(2));
+        ref2->set_elem(1, Value(3));
+        thread_context->regs().rv.raw().r = ref1;
+        _M_gc->collect();
+        Reference ref3(_M_gc->new_object(OBJECT_TYPE_TUPLE, 2));
+        CPPUNIT_ASSERT(object == ref3.ptr());
+        CPPUNIT_ASSERT_EQUAL(OBJECT_TYPE_TUPLE, ref3->type());
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), ref3->length());
+        CPPUNIT_ASSERT_EQUAL(1, static_cast<int>(ref1->elem(0).raw().i));
+        CPPUNIT_ASSERT(ref2 == ref1->elem(1).raw().r);
+        CPPUNIT_ASSERT_EQUAL(2, static_cast<int>(ref2->elem(0).raw().i));
+        CPPUNIT_ASSERT_EQUAL(3, static_cast<int>(ref2->elem(1).raw().i));
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void BitmapGarbageCollectorTests::test_bitmap_gc_marks_objects_after_mark_stack_overflow()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        vector<int> is(100000, 0);
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_TUPLE, 100000));
+        thread_context->regs().rv.raw().r = ref1;
+        for(size_t j = 0; j < 100000; j++) {
+          Reference ref2(_M_gc->new_object(OBJECT_TYPE_TUPLE, 1));
+          ref2->set_elem(0, Value(new_int_ptr_object(_M_gc, &(is[j]))));
+          ref1->set_elem(j, Value(ref2));
+        }
+        for(int j = 0; j < 2; j++) {
+          _M_gc->collect();
+          for(size_t k = 0; k < 100000; k++) CPPUNIT_ASSERT_EQUAL(0, is[k]);
+        }
+        thread_context->regs().rv.raw().r = Reference();
+        _M_gc->collect();
+        for(size_t k = 0; k < 100000; k++) CPPUNIT_ASSERT_EQUAL(1, is[k]);
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void BitmapGarbageCollectorTests::test_bitmap_gc_reports_statistics()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        _M_gc->new_immortal_object(OBJECT_TYPE_IARRAY8, 10);
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_TUPLE, 2));
+        ref1->set_elem(0, Value(Reference(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 10))));
+        ref1->set_elem(1, Value(Reference(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 10000))));
+        _M_gc->new_object(OBJECT_TYPE_IARRAY64, 10);
+        _M_gc->new_object(OBJECT_TYPE_IARRAY64, 10000);
+        thread_context->regs().rv.raw().r = ref1;
+        _M_gc->collect();
+        GarbageCollectorStatistics stats = _M_gc->statistics();
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), stats.collection_count);
+        CPPUNIT_ASSERT(stats.freed_byte_count >= 10010 * sizeof(int64_t));
+        CPPUNIT_ASSERT(stats.live_byte_count >= 10010);
+        CPPUNIT_ASSERT(stats.immortal_byte_count >= 10);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), stats.live_object_counts[OBJECT_TYPE_TUPLE]);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(2), stats.live_object_counts[OBJECT_TYPE_IARRAY8]);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(0), stats.live_object_counts[OBJECT_TYPE_IARRAY64]);
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void BitmapGarbageCollectorTests::test_bitmap_gc_destructor_finalizes_all_objects()
+      {
+        int i1 = 0, i2 = 0, i3 = 0;
+        {
+          unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+          unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+          _M_gc->add_vm_context(vm_context.get());
+          _M_gc->add_thread_context(thread_context.get());
+          thread_context->regs().rv.raw().r = new_int_ptr_object(_M_gc, &i1);
+          _M_gc->collect();
+          new_int_ptr_object(_M_gc, &i2);
+          new_int_ptr_object(_M_gc, &i3, 10000);
+          _M_thread_context_mutex->unlock();
+          thread_context->system_thread().join();
+          _M_gc->delete_thread_context(thread_context.get());
+          _M_gc->delete_vm_context(vm_context.get());
+        }
+        delete _M_gc;
+        _M_gc = nullptr;
+        CPPUNIT_ASSERT_EQUAL(1, i1);
+        CPPUNIT_ASSERT_EQUAL(1, i2);
+        CPPUNIT_ASSERT_EQUAL(1, i3);
+      }
+    }
+  }
+}
@@ -6,8 +6,13 @@
  *   the full licensing terms.                                              *
  ****************************************************************************/
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <limits>
 #include <new>
+#include <sstream>
+#include <thread>
 #include "gc_tests.hpp"
 #include "hash_table.hpp"
 #include "mark_sweep_gc.hpp"
@@ -50,6 +55,23 @@ namespace letin
       static NativeObjectFunctions int_ptr_funs2(finalize_int_ptr2, nullptr, nullptr);
       static NativeObjectFunctions int_ptr_funs3(finalize_int_ptr3, nullptr, nullptr);
 
+      struct Finalization
+      {
+        atomic<bool> is_finalized;
+        thread::id thread_id;
+      };
+
+      static NativeObjectTypeIdentity finalization_ptr_ident;
+
+      static void finalize_finalization_ptr(const void *ptr)
+      {
+        Finalization * const *tmp = reinterpret_cast<Finalization * const *>(ptr);
+        (*tmp)->thread_id = this_thread::get_id();
+        (*tmp)->is_finalized.store(true);
+      }
+
+      static NativeObjectFunctions finalization_ptr_funs(finalize_finalization_ptr, nullptr, nullptr);
+
       void GarbageCollectorTests::setUp()
       {
         _M_alloc = new AllocatorWrapper(new impl::NewAllocator());
@@ -205,7 +227,7 @@ namespace letin
         strcpy(reinterpret_cast<char *>(ref2->raw().is8), "test2");
         Reference ref3(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 6));
         strcpy(reinterpret_cast<char *>(ref3->raw().is8), "test3");
-        Reference ref4(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 6, thread_context3.get()));
+        Reference ref4(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 6));
         strcpy(reinterpret_cast<char *>(ref4->raw().is8), "test4");
         Reference ref5(_M_gc->new_object(OBJECT_TYPE_RARRAY, 1));
         ref5->raw().rs[0] = ref2;
@@ -650,7 +672,6 @@ namespace letin
         raw4->next_r = Reference();
         CPPUNIT_ASSERT(raw4->key.set_key(args1, *thread_context));
         CPPUNIT_ASSERT(raw4->value.set_value(static_cast<int64_t>(1), *thread_context));
-        Reference key_ref4 = raw4->key.key_ref();
         Reference ref5(_M_gc->new_object(OBJECT_TYPE_ALF_HASH_TABLE_ENTRY, sizeof(HashTableEntryRaw<ArgumentList, double>)));
         thread_context->regs().gc_tmp_ptr = nullptr;
         HashTableEntryRaw<ArgumentList, double> *raw5 = reinterpret_cast<HashTableEntryRaw<ArgumentList, double> *>(ref5->raw().bs);
@@ -658,7 +679,6 @@ namespace letin
         raw5->next_r = Reference();
         CPPUNIT_ASSERT(raw5->key.set_key(args2, *thread_context));
         CPPUNIT_ASSERT(raw5->value.set_value(2.0, *thread_context));
-        Reference key_ref5 = raw5->key.key_ref();
         Reference ref6(_M_gc->new_object(OBJECT_TYPE_ALR_HASH_TABLE_ENTRY, sizeof(HashTableEntryRaw<ArgumentList, Reference>)));
         thread_context->regs().gc_tmp_ptr = nullptr;
         HashTableEntryRaw<ArgumentList, Reference> *raw6 = reinterpret_cast<HashTableEntryRaw<ArgumentList, Reference> *>(ref6->raw().bs);
@@ -672,36 +692,35 @@ namespace letin
         ref7->set_elem(1, Value(ref5));
         ref7->set_elem(2, Value(ref6));
         thread_context->regs().rv.raw().r = ref7;
-        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(10), _M_alloc->alloc_ops().size());
+        // The keys are allocated for the thread so they are allocated from one chunk.
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(8), _M_alloc->alloc_ops().size());
         CPPUNIT_ASSERT(make_alloc(ref1) == _M_alloc->alloc_ops()[0]);
         CPPUNIT_ASSERT(make_alloc(ref2) == _M_alloc->alloc_ops()[1]);
         CPPUNIT_ASSERT(make_alloc(ref3) == _M_alloc->alloc_ops()[2]);
         CPPUNIT_ASSERT(make_alloc(ref4) == _M_alloc->alloc_ops()[3]);
-        CPPUNIT_ASSERT(make_alloc(key_ref4) == _M_alloc->alloc_ops()[4]);
         CPPUNIT_ASSERT(make_alloc(ref5) == _M_alloc->alloc_ops()[5]);
-        CPPUNIT_ASSERT(make_alloc(key_ref5) == _M_alloc->alloc_ops()[6]);
-        CPPUNIT_ASSERT(make_alloc(ref6) == _M_alloc->alloc_ops()[7]);
-        CPPUNIT_ASSERT(make_alloc(key_ref6) == _M_alloc->alloc_ops()[8]);
-        CPPUNIT_ASSERT(make_alloc(ref7) == _M_alloc->alloc_ops()[9]);
+        CPPUNIT_ASSERT(make_alloc(ref6) == _M_alloc->alloc_ops()[6]);
+        CPPUNIT_ASSERT(make_alloc(ref7) == _M_alloc->alloc_ops()[7]);
         _M_gc->collect();
-        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(10), _M_alloc->alloc_ops().size());
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(8), _M_alloc->alloc_ops().size());
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(4), _M_gc->statistics().live_object_counts[OBJECT_TYPE_TUPLE]);
         ref7->set_elem(0, Value());
         ref7->set_elem(1, Value());
         _M_gc->collect();
         const vector<AllocatorOperation> &alloc_ops = _M_alloc->alloc_ops();
-        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(15), _M_alloc->alloc_ops().size());
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(11), _M_alloc->alloc_ops().size());
         CPPUNIT_ASSERT(count(alloc_ops.begin(), alloc_ops.end(), make_free(ref1)) == 1);
         CPPUNIT_ASSERT(count(alloc_ops.begin(), alloc_ops.end(), make_free(ref4)) == 1);
-        CPPUNIT_ASSERT(count(alloc_ops.begin(), alloc_ops.end(), make_free(key_ref4)) == 1);
         CPPUNIT_ASSERT(count(alloc_ops.begin(), alloc_ops.end(), make_free(ref5)) == 1);
-        CPPUNIT_ASSERT(count(alloc_ops.begin(), alloc_ops.end(), make_free(key_ref5)) == 1);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(2), _M_gc->statistics().live_object_counts[OBJECT_TYPE_TUPLE]);
+        CPPUNIT_ASSERT(key_ref6 == raw6->key.key_ref());
         ref7->set_elem(2, Value());
         _M_gc->collect();
-        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(19), _M_alloc->alloc_ops().size());
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(14), _M_alloc->alloc_ops().size());
         CPPUNIT_ASSERT(count(alloc_ops.begin(), alloc_ops.end(), make_free(ref2)) == 1);
         CPPUNIT_ASSERT(count(alloc_ops.begin(), alloc_ops.end(), make_free(ref3)) == 1);
         CPPUNIT_ASSERT(count(alloc_ops.begin(), alloc_ops.end(), make_free(ref6)) == 1);
-        CPPUNIT_ASSERT(count(alloc_ops.begin(), alloc_ops.end(), make_free(key_ref6)) == 1);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), _M_gc->statistics().live_object_counts[OBJECT_TYPE_TUPLE]);
         _M_thread_context_mutex->unlock();
         thread_context->system_thread().join();
       }
@@ -749,7 +768,423 @@ namespace letin
         thread_context->system_thread().join();
       }
 
+      void GarbageCollectorTests::test_gc_collects_objects_allocated_for_thread_contexts()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        vector<Reference> refs;
+        for(size_t i = 0; i < 100; i++) {
+          Reference ref(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 6, thread_context.get()));
+          thread_context->regs().gc_tmp_ptr = nullptr;
+          strcpy(reinterpret_cast<char *>(ref->raw().is8), "test1");
+          refs.push_back(ref);
+        }
+        thread_context->regs().rv.raw().r = refs[50];
+        // The small objects of the thread are allocated from one chunk.
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), _M_alloc->alloc_ops().size());
+        void *chunk_ptr = _M_alloc->alloc_ops()[0].ptr;
+        Reference ref(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 1000, thread_context.get()));
+        thread_context->regs().gc_tmp_ptr = nullptr;
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), _M_alloc->alloc_ops().size());
+        CPPUNIT_ASSERT(make_alloc(ref) == _M_alloc->alloc_ops()[1]);
+        _M_gc->collect();
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), _M_alloc->alloc_ops().size());
+        CPPUNIT_ASSERT(make_free(ref) == _M_alloc->alloc_ops()[2]);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), _M_gc->statistics().live_object_counts[OBJECT_TYPE_IARRAY8]);
+        CPPUNIT_ASSERT_EQUAL(string("test1"), string(reinterpret_cast<char *>(refs[50]->raw().is8)));
+        thread_context->regs().rv.raw().r = Reference();
+        _M_gc->collect();
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(0), _M_gc->statistics().live_object_counts[OBJECT_TYPE_IARRAY8]);
+        // The chunk is freed after the thread context is deleted.
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), _M_alloc->alloc_ops().size());
+        _M_gc->delete_thread_context(thread_context.get());
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(4), _M_alloc->alloc_ops().size());
+        CPPUNIT_ASSERT(AllocatorOperation(FREE, chunk_ptr) == _M_alloc->alloc_ops()[3]);
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void GarbageCollectorTests::test_gc_counts_chunks_fragmented_by_sparse_survivors()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        _M_gc->set_max_heap_size(256 * 1024);
+        Reference survivors_ref(_M_gc->new_object(OBJECT_TYPE_RARRAY, 1000));
+        for(size_t i = 0; i < 1000; i++) survivors_ref->raw().rs[i] = Reference();
+        thread_context->regs().rv.raw().r = survivors_ref;
+        // Each survivor keeps the memory of its chunk so the heap is full long before the
+        // survivors fill it.
+        size_t i;
+        for(i = 0; i < 100000; i++) {
+          Reference ref(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 100, thread_context.get()));
+          thread_context->regs().gc_tmp_ptr = nullptr;
+          if(ref.is_null()) break;
+          if(i % 100 == 0) survivors_ref->raw().rs[i / 100] = ref;
+        }
+        CPPUNIT_ASSERT(i < 100000);
+        size_t survivor_byte_count = (i / 100 + 1) * (_M_gc->header_size() + priv::object_size(*(survivors_ref->raw().rs[0])));
+        CPPUNIT_ASSERT(survivor_byte_count < 64 * 1024);
+        GarbageCollectorStatistics stats = _M_gc->statistics();
+        CPPUNIT_ASSERT(stats.live_byte_count > 128 * 1024);
+        CPPUNIT_ASSERT(stats.emergency_collection_count > 0);
+        thread_context->regs().rv.raw().r = Reference();
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void GarbageCollectorTests::test_gc_collects_many_object_lists()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_RARRAY, 1000));
+        for(size_t i = 0; i < 1000; i++) {
+          Reference ref2 = Reference();
+          for(size_t j = 0; j < 10; j++) {
+            Reference ref3(_M_gc->new_object(OBJECT_TYPE_TUPLE, 2));
+            ref3->set_elem(0, Value(static_cast<int64_t>(j)));
+            ref3->set_elem(1, Value(ref2));
+            ref2 = ref3;
+          }
+          ref1->raw().rs[i] = ref2;
+        }
+        thread_context->regs().rv.raw().r = ref1;
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(10001), _M_alloc->alloc_ops().size());
+        _M_gc->collect();
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(10001), _M_alloc->alloc_ops().size());
+        for(size_t i = 1; i < 1000; i += 2) ref1->raw().rs[i] = Reference();
+        _M_gc->collect();
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(15001), _M_alloc->alloc_ops().size());
+        for(size_t i = 0; i < 1000; i += 2) {
+          Reference ref2 = ref1->raw().rs[i];
+          for(size_t j = 10; j > 0; j--) {
+            CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(j - 1), ref2->elem(0).i());
+            ref2 = ref2->elem(1).r();
+          }
+          CPPUNIT_ASSERT(ref2.has_nil());
+        }
+        thread_context->regs().rv.raw().r = Reference();
+        _M_gc->collect();
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(20002), _M_alloc->alloc_ops().size());
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void GarbageCollectorTests::test_gc_reports_statistics()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        GarbageCollectorStatistics stats = _M_gc->statistics();
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(0), stats.collection_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(0), stats.allocated_byte_count);
+        _M_gc->new_immortal_object(OBJECT_TYPE_IARRAY8, 10);
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_TUPLE, 2));
+        ref1->set_elem(0, Value(Reference(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 10))));
+        ref1->set_elem(1, Value(Reference(_M_gc->new_object(OBJECT_TYPE_RARRAY, 0))));
+        for(size_t i = 0; i < 3; i++) _M_gc->new_object(OBJECT_TYPE_IARRAY64, 10);
+        thread_context->regs().rv.raw().r = ref1;
+        _M_gc->collect();
+        _M_gc->collect();
+        stats = _M_gc->statistics();
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(2), stats.collection_count);
+        CPPUNIT_ASSERT(stats.total_pause_usecs >= stats.max_pause_usecs);
+        uint64_t pause_count = 0;
+        for(size_t i = 0; i < GarbageCollectorStatistics::PAUSE_HISTOGRAM_SIZE; i++)
+          pause_count += stats.pause_histogram[i];
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(2), pause_count);
+        CPPUNIT_ASSERT(stats.freed_byte_count >= 3 * 10 * sizeof(int64_t));
+        CPPUNIT_ASSERT_EQUAL(stats.allocated_byte_count, stats.freed_byte_count + stats.live_byte_count);
+        CPPUNIT_ASSERT(stats.immortal_byte_count >= 10);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), stats.live_object_counts[OBJECT_TYPE_TUPLE]);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), stats.live_object_counts[OBJECT_TYPE_IARRAY8]);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), stats.live_object_counts[OBJECT_TYPE_RARRAY]);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(0), stats.live_object_counts[OBJECT_TYPE_IARRAY64]);
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void GarbageCollectorTests::test_gc_reuses_consumed_unique_tuples()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        thread_context->set_gc(_M_gc);
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE, 2, thread_context.get()));
+        Reference ref2(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 4, thread_context.get()));
+        ref1->set_elem(0, Value(1));
+        ref1->set_elem(1, Value(ref2));
+        thread_context->add_reusable_unique_tuple(ref1.ptr());
+        thread_context->regs().gc_tmp_ptr = nullptr;
+        _M_gc->collect();
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(0), _M_gc->statistics().live_object_counts[OBJECT_TYPE_IARRAY8]);
+        Reference ref3(_M_gc->new_object(OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE, 3, thread_context.get()));
+        CPPUNIT_ASSERT(ref1 != ref3);
+        Reference ref4(_M_gc->new_object(OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE, 2, thread_context.get()));
+        CPPUNIT_ASSERT(ref1 == ref4);
+        CPPUNIT_ASSERT_EQUAL(VALUE_TYPE_INT, static_cast<int>(ref4->elem(0).type()));
+        CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(0), ref4->elem(0).i());
+        CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(0), ref4->elem(1).i());
+        Reference ref5(_M_gc->new_object(OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE, 2, thread_context.get()));
+        CPPUNIT_ASSERT(ref1 != ref5);
+        thread_context->regs().gc_tmp_ptr = nullptr;
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void GarbageCollectorTests::test_gc_collects_objects_when_heap_reaches_max_size()
+      {
+        _M_gc->set_max_heap_size(4096);
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(4096), _M_gc->max_heap_size());
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 1000));
+        Reference ref2(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 1000));
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), _M_alloc->alloc_ops().size());
+        Reference ref3(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 3000));
+        CPPUNIT_ASSERT(!ref3.is_null());
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(5), _M_alloc->alloc_ops().size());
+        CPPUNIT_ASSERT(make_free(ref1) == _M_alloc->alloc_ops()[2] || make_free(ref1) == _M_alloc->alloc_ops()[3]);
+        CPPUNIT_ASSERT(make_free(ref2) == _M_alloc->alloc_ops()[2] || make_free(ref2) == _M_alloc->alloc_ops()[3]);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), _M_gc->statistics().emergency_collection_count);
+        Reference ref4(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 5000));
+        CPPUNIT_ASSERT(ref4.is_null());
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(6), _M_alloc->alloc_ops().size());
+        CPPUNIT_ASSERT(make_free(ref3) == _M_alloc->alloc_ops()[5]);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(2), _M_gc->statistics().emergency_collection_count);
+      }
+
+      void GarbageCollectorTests::test_gc_takes_heap_snapshot()
+      {
+        unique_ptr<impl::ImplEnvironment> impl_env(new_impl_env());
+        impl_env->add_fun_index("f", 1);
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*impl_env));
+        _M_gc->add_vm_context(impl_env.get());
+        _M_gc->add_thread_context(thread_context.get());
+        _M_gc->set_sampling_interval(1);
+        thread_context->regs().fp = 1;
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 6, thread_context.get()));
+        strcpy(reinterpret_cast<char *>(ref1->raw().is8), "test1");
+        thread_context->regs().fp = 2;
+        Reference ref2(_M_gc->new_object(OBJECT_TYPE_TUPLE, 2, thread_context.get()));
+        ref2->set_elem(0, Value(ref1));
+        ref2->set_elem(1, Value(1));
+        Reference ref3(_M_gc->new_object(OBJECT_TYPE_RARRAY, 1));
+        ref3->raw().rs[0] = ref1;
+        Reference ref4(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 6));
+        thread_context->regs().gc_tmp_ptr = nullptr;
+        impl_env->set_var_count(1);
+        impl_env->set_var(0, Value(ref2));
+        thread_context->regs().rv.raw().r = ref3;
+        HeapSnapshot snapshot;
+        CPPUNIT_ASSERT(_M_gc->heap_snapshot(snapshot));
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), snapshot.sampling_interval);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), snapshot.type_entries[OBJECT_TYPE_IARRAY8].object_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(priv::object_size(*ref1)), snapshot.type_entries[OBJECT_TYPE_IARRAY8].byte_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), snapshot.type_entries[OBJECT_TYPE_TUPLE].object_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), snapshot.type_entries[OBJECT_TYPE_RARRAY].object_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(2), snapshot.root_entries[HEAP_SNAPSHOT_ROOT_GLOBAL_VARS].object_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(0), snapshot.root_entries[HEAP_SNAPSHOT_ROOT_MEMO_CACHES].object_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), snapshot.root_entries[HEAP_SNAPSHOT_ROOT_THREADS].object_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(priv::object_size(*ref3)), snapshot.root_entries[HEAP_SNAPSHOT_ROOT_THREADS].byte_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), snapshot.fun_entries.size());
+        CPPUNIT_ASSERT(snapshot.fun_entries.find("f") != snapshot.fun_entries.end());
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), snapshot.fun_entries["f"].object_count);
+        CPPUNIT_ASSERT(snapshot.fun_entries.find("<0x00000002>") != snapshot.fun_entries.end());
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(priv::object_size(*ref2)), snapshot.fun_entries["<0x00000002>"].byte_count);
+        ostringstream oss;
+        write_heap_snapshot(oss, snapshot);
+        istringstream iss(oss.str());
+        HeapSnapshot snapshot2;
+        CPPUNIT_ASSERT(read_heap_snapshot(iss, snapshot2));
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), snapshot2.type_entries[OBJECT_TYPE_TUPLE].object_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), snapshot2.root_entries[HEAP_SNAPSHOT_ROOT_THREADS].object_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), snapshot2.fun_entries["f"].object_count);
+        thread_context->regs().rv.raw().r = Reference();
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void GarbageCollectorTests::test_gc_takes_heap_snapshot_of_many_objects()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        Reference ref(_M_gc->new_object(OBJECT_TYPE_RARRAY, 10000));
+        thread_context->regs().rv.raw().r = ref;
+        for(size_t i = 0; i < 10000; i++) ref->raw().rs[i] = Reference();
+        for(size_t i = 0; i < 10000; i++) ref->raw().rs[i] = Reference(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 1));
+        _M_gc->collect();
+        for(size_t i = 0; i < 10000; i++) ref->raw().rs[i] = Reference(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 1));
+        HeapSnapshot snapshot;
+        CPPUNIT_ASSERT(_M_gc->heap_snapshot(snapshot));
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(10000), snapshot.type_entries[OBJECT_TYPE_IARRAY8].object_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), snapshot.type_entries[OBJECT_TYPE_RARRAY].object_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(10001), snapshot.root_entries[HEAP_SNAPSHOT_ROOT_THREADS].object_count);
+        thread_context->regs().rv.raw().r = Reference();
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void GarbageCollectorTests::test_gc_finalizes_native_objects_in_finalization_thread()
+      {
+        Finalization finalization;
+        finalization.is_finalized.store(false);
+        _M_gc->start();
+        Reference ref(_M_gc->new_object(OBJECT_TYPE_NATIVE_OBJECT, sizeof(Finalization *)));
+        ref->raw().ntvo.type = NativeObjectType(&finalization_ptr_ident);
+        ref->raw().ntvo.clazz = NativeObjectClass(&finalization_ptr_funs);
+        *reinterpret_cast<Finalization **>(ref->raw().ntvo.bs) = &finalization;
+        _M_gc->collect();
+        for(int i = 0; i < 1000 && !finalization.is_finalized.load(); i++)
+          this_thread::sleep_for(chrono::milliseconds(1));
+        _M_gc->stop();
+        CPPUNIT_ASSERT(finalization.is_finalized.load());
+        CPPUNIT_ASSERT(finalization.thread_id != this_thread::get_id());
+      }
+
+      void GarbageCollectorTests::test_gc_does_not_allocate_objects_with_too_large_lengths()
+      {
+#ifdef LETIN_COMPACT_OBJECT_HEADER
+        // The object length of the compact object header is a 32-bit integer.
+        size_t length = static_cast<size_t>(numeric_limits<uint32_t>::max()) + 1;
+#else
+        size_t length = static_cast<size_t>(numeric_limits<int64_t>::max()) + 1;
+#endif
+        CPPUNIT_ASSERT(nullptr == _M_gc->new_object(OBJECT_TYPE_IARRAY8, length));
+        CPPUNIT_ASSERT(nullptr == _M_gc->new_immortal_object(OBJECT_TYPE_IARRAY8, length));
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), _M_alloc->alloc_ops().size());
+      }
+
       DEF_IMPL_GC_TESTS(MarkSweepGarbageCollector);
+
+      CPPUNIT_TEST_SUITE_REGISTRATION(ParallelMarkSweepGarbageCollectorTests);
+
+      GarbageCollector *ParallelMarkSweepGarbageCollectorTests::new_gc(Allocator *alloc)
+      { return new impl::MarkSweepGarbageCollector(alloc, 100000, 4); }
+
+      CPPUNIT_TEST_SUITE_REGISTRATION(ConcurrentMarkSweepGarbageCollectorTests);
+
+      GarbageCollector *ConcurrentMarkSweepGarbageCollectorTests::new_gc(Allocator *alloc)
+      { return new impl::MarkSweepGarbageCollector(alloc, 100000, 1, true); }
+
+      CPPUNIT_TEST_SUITE_REGISTRATION(ConcurrentSweepMarkSweepGarbageCollectorTests);
+
+      GarbageCollector *ConcurrentSweepMarkSweepGarbageCollectorTests::new_gc(Allocator *alloc)
+      { return new impl::MarkSweepGarbageCollector(alloc, 100000, 1, false, true); }
+
+      void ConcurrentSweepMarkSweepGarbageCollectorTests::test_gc_measures_collection_times()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(0), _M_gc->statistics().collection_count);
+        for(size_t i = 0; i < 1000; i++) _M_gc->new_object(OBJECT_TYPE_IARRAY8, 100);
+        _M_gc->collect();
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2000), _M_alloc->alloc_ops().size());
+        _M_gc->collect();
+        GarbageCollectorStatistics stats = _M_gc->statistics();
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(2), stats.collection_count);
+        CPPUNIT_ASSERT(stats.total_pause_usecs >= stats.total_stop_usecs + stats.total_mark_usecs);
+        CPPUNIT_ASSERT(stats.total_pause_usecs >= stats.max_pause_usecs);
+        uint64_t pause_count = 0;
+        for(size_t i = 0; i < GarbageCollectorStatistics::PAUSE_HISTOGRAM_SIZE; i++)
+          pause_count += stats.pause_histogram[i];
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(2), pause_count);
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      CPPUNIT_TEST_SUITE_REGISTRATION(PacedMarkSweepGarbageCollectorTests);
+
+      GarbageCollector *PacedMarkSweepGarbageCollectorTests::new_gc(Allocator *alloc)
+      { return new impl::MarkSweepGarbageCollector(alloc, 0, 1, false, false, 2.0); }
+
+      void PacedMarkSweepGarbageCollectorTests::test_gc_collects_objects_when_heap_grows()
+      {
+        impl::MarkSweepGarbageCollector *gc = dynamic_cast<impl::MarkSweepGarbageCollector *>(_M_gc);
+        _M_gc->start();
+        _M_gc->new_object(OBJECT_TYPE_IARRAY8, 1000);
+        this_thread::sleep_for(chrono::milliseconds(50));
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(0), _M_gc->statistics().collection_count);
+        {
+          // The collection is requested before the object is allocated so the garbage
+          // collector thread can't collect until the object is added to the heap.
+          lock_guard<GarbageCollector> guard(*_M_gc);
+          _M_gc->new_object(OBJECT_TYPE_IARRAY8, 5 * 1024 * 1024);
+        }
+        for(int i = 0; i < 1000 && _M_gc->statistics().collection_count == 0; i++)
+          this_thread::sleep_for(chrono::milliseconds(10));
+        _M_gc->stop();
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), _M_gc->statistics().collection_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(4), _M_alloc->alloc_ops().size());
+        CPPUNIT_ASSERT(gc->allocated_byte_count() == 0);
+      }
+
+      CPPUNIT_TEST_SUITE_REGISTRATION(FreezingMarkSweepGarbageCollectorTests);
+
+      GarbageCollector *FreezingMarkSweepGarbageCollectorTests::new_gc(Allocator *alloc)
+      { return new impl::MarkSweepGarbageCollector(alloc, 100000, 1, false, false, 0.0, true); }
+
+      void FreezingMarkSweepGarbageCollectorTests::test_gc_does_not_collect_frozen_objects()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 5));
+        strcpy(reinterpret_cast<char *>(ref1->raw().is8), "test");
+        Reference ref2(_M_gc->new_object(OBJECT_TYPE_TUPLE, 2));
+        ref2->set_elem(0, Value(ref1));
+        ref2->set_elem(1, Value(1));
+        Reference ref3(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 5));
+        thread_context->regs().rv.raw().r = ref2;
+        _M_gc->prepare_fork();
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(4), _M_alloc->alloc_ops().size());
+        CPPUNIT_ASSERT(make_free(ref3) == _M_alloc->alloc_ops()[3]);
+        thread_context->regs().rv.raw().r = Reference();
+        _M_gc->collect();
+        _M_gc->collect();
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(4), _M_alloc->alloc_ops().size());
+        CPPUNIT_ASSERT(ref1 == ref2->elem(0).raw().r);
+        CPPUNIT_ASSERT_EQUAL(string("test"), string(reinterpret_cast<char *>(ref1->raw().is8)));
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void FreezingMarkSweepGarbageCollectorTests::test_gc_does_not_collect_objects_referenced_from_written_frozen_objects()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE, 2));
+        ref1->set_elem(0, Value(1));
+        ref1->set_elem(1, Value(2));
+        thread_context->regs().rv.raw().r = ref1;
+        _M_gc->prepare_fork();
+        Reference ref2(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 5));
+        strcpy(reinterpret_cast<char *>(ref2->raw().is8), "test");
+        Reference ref3(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 5));
+        _M_gc->write_barrier(ref1.ptr(), thread_context.get());
+        ref1->set_elem(0, Value(ref2));
+        thread_context->regs().rv.raw().r = Reference();
+        _M_gc->collect();
+        _M_gc->collect();
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(4), _M_alloc->alloc_ops().size());
+        CPPUNIT_ASSERT(make_free(ref3) == _M_alloc->alloc_ops()[3]);
+        CPPUNIT_ASSERT(ref2 == ref1->elem(0).raw().r);
+        CPPUNIT_ASSERT_EQUAL(string("test"), string(reinterpret_cast<char *>(ref2->raw().is8)));
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
     }
   }
 }
@@ -56,8 +56,18 @@ namespace letin
         CPPUNIT_TEST(test_gc_collects_hash_table_objects);
         CPPUNIT_TEST(test_gc_collects_special_hash_table_entry_objects);
         CPPUNIT_TEST(test_gc_collects_registered_references);
+        CPPUNIT_TEST(test_gc_collects_objects_allocated_for_thread_contexts);
+        CPPUNIT_TEST(test_gc_counts_chunks_fragmented_by_sparse_survivors);
+        CPPUNIT_TEST(test_gc_collects_many_object_lists);
+        CPPUNIT_TEST(test_gc_reports_statistics);
+        CPPUNIT_TEST(test_gc_reuses_consumed_unique_tuples);
+        CPPUNIT_TEST(test_gc_collects_objects_when_heap_reaches_max_size);
+        CPPUNIT_TEST(test_gc_takes_heap_snapshot);
+        CPPUNIT_TEST(test_gc_takes_heap_snapshot_of_many_objects);
+        CPPUNIT_TEST(test_gc_finalizes_native_objects_in_finalization_thread);
+        CPPUNIT_TEST(test_gc_does_not_allocate_objects_with_too_large_lengths);
         CPPUNIT_TEST_SUITE_END_ABSTRACT();
-
+      protected:
         AllocatorWrapper *_M_alloc;
         GarbageCollector *_M_gc;
         std::mutex *_M_thread_context_mutex;
@@ -109,9 +119,70 @@ namespace letin
         void test_gc_collects_hash_table_objects();
         void test_gc_collects_special_hash_table_entry_objects();
         void test_gc_collects_registered_references();
+        void test_gc_collects_objects_allocated_for_thread_contexts();
+        void test_gc_counts_chunks_fragmented_by_sparse_survivors();
+        void test_gc_collects_many_object_lists();
+        void test_gc_reports_statistics();
+        void test_gc_reuses_consumed_unique_tuples();
+        void test_gc_collects_objects_when_heap_reaches_max_size();
+        void test_gc_takes_heap_snapshot();
+        void test_gc_takes_heap_snapshot_of_many_objects();
+        void test_gc_finalizes_native_objects_in_finalization_thread();
+        void test_gc_does_not_allocate_objects_with_too_large_lengths();
       };
 
       DECL_IMPL_GC_TESTS(MarkSweepGarbageCollector);
+
+      class ParallelMarkSweepGarbageCollectorTests : public GarbageCollectorTests
+      {
+        CPPUNIT_TEST_SUB_SUITE(ParallelMarkSweepGarbageCollectorTests, GarbageCollectorTests);
+        CPPUNIT_TEST_SUITE_END();
+      public:
+        GarbageCollector *new_gc(Allocator *alloc);
+      };
+
+      class ConcurrentMarkSweepGarbageCollectorTests : public GarbageCollectorTests
+      {
+        CPPUNIT_TEST_SUB_SUITE(ConcurrentMarkSweepGarbageCollectorTests, GarbageCollectorTests);
+        CPPUNIT_TEST_SUITE_END();
+      public:
+        GarbageCollector *new_gc(Allocator *alloc);
+      };
+
+      class ConcurrentSweepMarkSweepGarbageCollectorTests : public GarbageCollectorTests
+      {
+        CPPUNIT_TEST_SUB_SUITE(ConcurrentSweepMarkSweepGarbageCollectorTests, GarbageCollectorTests);
+        CPPUNIT_TEST(test_gc_measures_collection_times);
+        CPPUNIT_TEST_SUITE_END();
+      public:
+        GarbageCollector *new_gc(Allocator *alloc);
+
+        void test_gc_measures_collection_times();
+      };
+
+      class PacedMarkSweepGarbageCollectorTests : public GarbageCollectorTests
+      {
+        CPPUNIT_TEST_SUB_SUITE(PacedMarkSweepGarbageCollectorTests, GarbageCollectorTests);
+        CPPUNIT_TEST(test_gc_collects_objects_when_heap_grows);
+        CPPUNIT_TEST_SUITE_END();
+      public:
+        GarbageCollector *new_gc(Allocator *alloc);
+
+        void test_gc_collects_objects_when_heap_grows();
+      };
+
+      class FreezingMarkSweepGarbageCollectorTests : public GarbageCollectorTests
+      {
+        CPPUNIT_TEST_SUB_SUITE(FreezingMarkSweepGarbageCollectorTests, GarbageCollectorTests);
+        CPPUNIT_TEST(test_gc_does_not_collect_frozen_objects);
+        CPPUNIT_TEST(test_gc_does_not_collect_objects_referenced_from_written_frozen_objects);
+        CPPUNIT_TEST_SUITE_END();
+      public:
+        GarbageCollector *new_gc(Allocator *alloc);
+
+        void test_gc_does_not_collect_frozen_objects();
+        void test_gc_does_not_collect_objects_referenced_from_written_frozen_objects();
+      };
     }
   }
 }
@@ -0,0 +1,336 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "gen_gc.hpp"
+#include "gen_gc_tests.hpp"
+#include "new_alloc.hpp"
+
+using namespace std;
+using namespace letin::vm;
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace test
+    {
+      CPPUNIT_TEST_SUITE_REGISTRATION(GenerationalGarbageCollectorTests);
+
+      static NativeObjectTypeIdentity int_ptr_ident;
+
+      static void finalize_int_ptr(const void *ptr)
+      {
+        int * const *tmp = reinterpret_cast<int * const *>(ptr);
+        **tmp = 1;
+      }
+
+      static NativeObjectFunctions int_ptr_funs(finalize_int_ptr, nullptr, nullptr);
+
+      // The live native objects are finalized by tearDown so the integers of their
+      // finalizers can't be local variables of the tests.
+      static int finalized_ints[3];
+
+      static Reference new_int_ptr_object(GarbageCollector *gc, int *i, size_t length = sizeof(int *))
+      {
+        Reference ref(gc->new_object(OBJECT_TYPE_NATIVE_OBJECT, length));
+        ref->raw().ntvo.type = NativeObjectType(&int_ptr_ident);
+        ref->raw().ntvo.clazz = NativeObjectClass(&int_ptr_funs);
+        *reinterpret_cast<int **>(ref->raw().ntvo.bs) = i;
+        return ref;
+      }
+
+      void GenerationalGarbageCollectorTests::setUp()
+      {
+        _M_alloc = new impl::NewAllocator();
+        _M_gc = new impl::GenerationalGarbageCollector(_M_alloc, 100000, 64 * 1024);
+        _M_thread_context_mutex = new mutex();
+        _M_thread_context_mutex->lock();
+      }
+
+      void GenerationalGarbageCollectorTests::tearDown()
+      {
+        delete _M_thread_context_mutex;
+        delete _M_gc;
+        delete _M_alloc;
+      }
+
+      void GenerationalGarbageCollectorTests::test_gen_gc_moves_live_objects_to_old_generation()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 5));
+        strcpy(reinterpret_cast<char *>(ref1->raw().is8), "test");
+        Reference ref2(_M_gc->new_object(OBJECT_TYPE_TUPLE, 3));
+        ref2->set_elem(0, Value(ref1));
+        ref2->set_elem(1, Value(1));
+        ref2->set_elem(2, Value(ref1));
+        thread_context->regs().rv.raw().r = ref2;
+        for(int i = 0; i < 2; i++) {
+          _M_gc->collect();
+          Reference ref3 = thread_context->regs().rv.raw().r;
+          CPPUNIT_ASSERT_EQUAL(OBJECT_TYPE_TUPLE, ref3->type());
+          CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), ref3->length());
+          CPPUNIT_ASSERT_EQUAL(VALUE_TYPE_REF, ref3->elem(0).type());
+          CPPUNIT_ASSERT_EQUAL(1, static_cast<int>(ref3->elem(1).raw().i));
+          CPPUNIT_ASSERT(ref3->elem(0).raw().r == ref3->elem(2).raw().r);
+          Reference ref4 = ref3->elem(0).raw().r;
+          CPPUNIT_ASSERT_EQUAL(OBJECT_TYPE_IARRAY8, ref4->type());
+          CPPUNIT_ASSERT_EQUAL(string("test"), string(reinterpret_cast<char *>(ref4->raw().is8)));
+        }
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void GenerationalGarbageCollectorTests::test_gen_gc_finalizes_unreachable_native_objects()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        int &i1 = finalized_ints[0], &i2 = finalized_ints[1], &i3 = finalized_ints[2];
+        i1 = i2 = i3 = 0;
+        Reference ref1 = new_int_ptr_object(_M_gc, &i1);
+        new_int_ptr_object(_M_gc, &i2);
+        thread_context->regs().rv.raw().r = ref1;
+        _M_gc->collect();
+        CPPUNIT_ASSERT_EQUAL(0, i1);
+        CPPUNIT_ASSERT_EQUAL(1, i2);
+        new_int_ptr_object(_M_gc, &i3);
+        thread_context->regs().rv.raw().r = Reference();
+        _M_gc->collect();
+        CPPUNIT_ASSERT_EQUAL(1, i3);
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void GenerationalGarbageCollectorTests::test_gen_gc_does_not_collect_young_objects_referenced_from_old_objects()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        int &i = finalized_ints[0];
+        i = 0;
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE, 2));
+        ref1->set_elem(0, Value(1));
+        ref1->set_elem(1, Value(2));
+        thread_context->regs().rv.raw().r = ref1;
+        _M_gc->collect();
+        Reference ref2 = thread_context->regs().rv.raw().r;
+        Reference ref3 = new_int_ptr_object(_M_gc, &i);
+        Reference ref4(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 5));
+        strcpy(reinterpret_cast<char *>(ref4->raw().is8), "test");
+        ref2->set_elem(0, Value(ref3));
+        ref2->set_elem(1, Value(ref4));
+        _M_gc->write_barrier(ref2.ptr(), thread_context.get());
+        for(int j = 0; j < 2; j++) {
+          _M_gc->collect();
+          CPPUNIT_ASSERT_EQUAL(0, i);
+          Reference ref5 = thread_context->regs().rv.raw().r;
+          CPPUNIT_ASSERT(ref2 == ref5);
+          Reference ref6 = ref5->elem(0).raw().r;
+          CPPUNIT_ASSERT_EQUAL(OBJECT_TYPE_NATIVE_OBJECT, ref6->type());
+          Reference ref7 = ref5->elem(1).raw().r;
+          CPPUNIT_ASSERT_EQUAL(OBJECT_TYPE_IARRAY8, ref7->type());
+          CPPUNIT_ASSERT_EQUAL(string("test"), string(reinterpret_cast<char *>(ref7->raw().is8)));
+        }
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void GenerationalGarbageCollectorTests::test_gen_gc_collects_large_objects()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        int &i1 = finalized_ints[0], &i2 = finalized_ints[1];
+        i1 = i2 = 0;
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 10000));
+        for(size_t j = 0; j < 10000; j++) ref1->raw().is8[j] = static_cast<int8_t>(j);
+        Reference ref2 = new_int_ptr_object(_M_gc, &i1, 10000);
+        new_int_ptr_object(_M_gc, &i2, 10000);
+        Reference ref3(_M_gc->new_object(OBJECT_TYPE_TUPLE, 2));
+        ref3->set_elem(0, Value(ref1));
+        ref3->set_elem(1, Value(ref2));
+        thread_context->regs().rv.raw().r = ref3;
+        for(int j = 0; j < 2; j++) {
+          _M_gc->collect();
+          CPPUNIT_ASSERT_EQUAL(0, i1);
+          CPPUNIT_ASSERT_EQUAL(1, i2);
+          Reference ref4 = thread_context->regs().rv.raw().r->elem(0).raw().r;
+          CPPUNIT_ASSERT(ref1 == ref4);
+          CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(10000), ref4->length());
+          for(size_t k = 0; k < 10000; k++)
+            CPPUNIT_ASSERT_EQUAL(static_cast<int8_t>(k), ref4->raw().is8[k]);
+        }
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void GenerationalGarbageCollectorTests::test_gen_gc_allocates_more_objects_than_nursery_size()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        for(int j = 0; j < 3; j++) {
+          Reference ref1 = thread_context->regs().rv.raw().r;
+          for(int k = 0; k < 10000; k++) {
+            Reference ref2(_M_gc->new_object(OBJECT_TYPE_TUPLE, 2));
+            ref2->set_elem(0, Value(j * 10000 + k));
+            ref2->set_elem(1, Value(ref1));
+            ref1 = ref2;
+          }
+          thread_context->regs().rv.raw().r = ref1;
+          _M_gc->collect();
+          Reference ref3 = thread_context->regs().rv.raw().r;
+          for(int k = (j + 1) * 10000 - 1; k >= 0; k--) {
+            CPPUNIT_ASSERT_EQUAL(OBJECT_TYPE_TUPLE, ref3->type());
+            CPPUNIT_ASSERT_EQUAL(k, static_cast<int>(ref3->elem(0).raw().i));
+            ref3 = ref3->elem(1).raw().r;
+          }
+          CPPUNIT_ASSERT(ref3.has_nil());
+        }
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+
+      void GenerationalGarbageCollectorTests::test_gen_gc_compacts_old_generation()
+      {
+        delete _M_gc;
+        _M_gc = new impl::GenerationalGarbageCollector(_M_alloc, 100000, 64 * 1024, 0.0, 0.5);
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        // The thread context hasn't a thread because a word on its system stack could pin
+        // the large object if the references are compressed.
+        unique_ptr<ThreadContext> thread_context(new ThreadContext(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        thread_context->regs().rv.raw().r = Reference(_M_gc->new_object(OBJECT_TYPE_RARRAY, 5000));
+        for(int j = 0; j < 5000; j++) {
+          Reference ref1(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 2000));
+          memset(ref1->raw().is8, 0, 2000);
+          memcpy(ref1->raw().is8, &j, sizeof(int));
+          Reference ref2 = thread_context->regs().rv.raw().r;
+          _M_gc->write_barrier(ref2.ptr());
+          ref2->raw().rs[j] = ref1;
+          if(j % 16 == 15) _M_gc->collect();
+        }
+        _M_gc->collect();
+        vector<Object *> objects;
+        {
+          Reference ref1 = thread_context->regs().rv.raw().r;
+          Reference ref2(_M_gc->new_object(OBJECT_TYPE_RARRAY, 1251));
+          for(int j = 0; j < 1250; j++) {
+            ref2->raw().rs[j] = ref1->raw().rs[j * 4];
+            objects.push_back(ref2->raw().rs[j].ptr());
+          }
+          // The large object forces the major collection.
+          ref2->raw().rs[1250] = Reference(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 16 * 1024 * 1024));
+          thread_context->regs().rv.raw().r = ref2;
+        }
+        _M_gc->collect();
+        Reference ref3 = thread_context->regs().rv.raw().r;
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1251), ref3->length());
+        size_t moved_object_count = 0;
+        for(int j = 0; j < 1250; j++) {
+          Reference ref4 = ref3->raw().rs[j];
+          CPPUNIT_ASSERT_EQUAL(OBJECT_TYPE_IARRAY8, ref4->type());
+          CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2000), ref4->length());
+          int k;
+          memcpy(&k, ref4->raw().is8, sizeof(int));
+          CPPUNIT_ASSERT_EQUAL(j * 4, k);
+          if(ref4.ptr() != objects[j]) moved_object_count++;
+        }
+        CPPUNIT_ASSERT(moved_object_count > 0);
+      }
+
+      void GenerationalGarbageCollectorTests::test_gen_gc_reports_statistics()
+      {
+        unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+        // The thread context hasn't a thread because a word on its system stack could pin
+        // the large object if the references are compressed.
+        unique_ptr<ThreadContext> thread_context(new ThreadContext(*vm_context));
+        _M_gc->add_vm_context(vm_context.get());
+        _M_gc->add_thread_context(thread_context.get());
+        _M_gc->new_immortal_object(OBJECT_TYPE_IARRAY8, 10);
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_TUPLE, 2));
+        ref1->set_elem(0, Value(Reference(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 10))));
+        ref1->set_elem(1, Value(Reference(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 16 * 1024 * 1024))));
+        for(size_t i = 0; i < 3; i++) _M_gc->new_object(OBJECT_TYPE_IARRAY64, 10);
+        thread_context->regs().rv.raw().r = ref1;
+        // The large object is promoted to the old generation and starts the major collection.
+        _M_gc->collect();
+        GarbageCollectorStatistics stats = _M_gc->statistics();
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), stats.collection_count);
+        uint64_t pause_count = 0;
+        for(size_t i = 0; i < GarbageCollectorStatistics::PAUSE_HISTOGRAM_SIZE; i++)
+          pause_count += stats.pause_histogram[i];
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), pause_count);
+        CPPUNIT_ASSERT(stats.allocated_byte_count >= 16 * 1024 * 1024);
+        CPPUNIT_ASSERT(stats.freed_byte_count >= 3 * 10 * sizeof(int64_t));
+        CPPUNIT_ASSERT(stats.live_byte_count >= 16 * 1024 * 1024);
+        CPPUNIT_ASSERT(stats.immortal_byte_count >= 10);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), stats.live_object_counts[OBJECT_TYPE_TUPLE]);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(2), stats.live_object_counts[OBJECT_TYPE_IARRAY8]);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(0), stats.live_object_counts[OBJECT_TYPE_IARRAY64]);
+      }
+
+      void GenerationalGarbageCollectorTests::test_gen_gc_destructor_finalizes_all_objects()
+      {
+        int i1 = 0, i2 = 0, i3 = 0;
+        {
+          unique_ptr<VirtualMachineContext> vm_context(new_vm_context());
+          unique_ptr<ThreadContext> thread_context(new_thread_context(*vm_context));
+          _M_gc->add_vm_context(vm_context.get());
+          _M_gc->add_thread_context(thread_context.get());
+          thread_context->regs().rv.raw().r = new_int_ptr_object(_M_gc, &i1);
+          _M_gc->collect();
+          new_int_ptr_object(_M_gc, &i2);
+          new_int_ptr_object(_M_gc, &i3, 10000);
+          _M_thread_context_mutex->unlock();
+          thread_context->system_thread().join();
+          _M_gc->delete_thread_context(thread_context.get());
+          _M_gc->delete_vm_context(vm_context.get());
+        }
+        delete _M_gc;
+        _M_gc = nullptr;
+        CPPUNIT_ASSERT_EQUAL(1, i1);
+        CPPUNIT_ASSERT_EQUAL(1, i2);
+        CPPUNIT_ASSERT_EQUAL(1, i3);
+      }
+
+      void GenerationalGarbageCollectorTests::test_gen_gc_moves_allocation_samples_with_objects()
+      {
+        unique_ptr<impl::ImplEnvironment> impl_env(new impl::ImplEnvironment());
+        impl_env->add_fun_index("f", 1);
+        unique_ptr<ThreadContext> thread_context(new_thread_context(*impl_env));
+        _M_gc->add_vm_context(impl_env.get());
+        _M_gc->add_thread_context(thread_context.get());
+        _M_gc->set_sampling_interval(1);
+        thread_context->regs().fp = 1;
+        Reference ref1(_M_gc->new_object(OBJECT_TYPE_IARRAY8, 5, thread_context.get()));
+        strcpy(reinterpret_cast<char *>(ref1->raw().is8), "test");
+        thread_context->regs().gc_tmp_ptr = nullptr;
+        thread_context->regs().rv.raw().r = ref1;
+        _M_gc->collect();
+        CPPUNIT_ASSERT(thread_context->regs().rv.raw().r != ref1);
+        HeapSnapshot snapshot;
+        CPPUNIT_ASSERT(_M_gc->heap_snapshot(snapshot));
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), snapshot.type_entries[OBJECT_TYPE_IARRAY8].object_count);
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(1), snapshot.fun_entries["f"].object_count);
+        _M_thread_context_mutex->unlock();
+        thread_context->system_thread().join();
+      }
+    }
+  }
+}
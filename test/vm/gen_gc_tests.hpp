@@ -0,0 +1,74 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#ifndef _GEN_GC_TESTS_HPP
+#define _GEN_GC_TESTS_HPP
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestAssert.h>
+#include <mutex>
+#include <letin/vm.hpp>
+#include "impl_env.hpp"
+#include "vm.hpp"
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace test
+    {
+      class GenerationalGarbageCollectorTests : public CppUnit::TestFixture
+      {
+        CPPUNIT_TEST_SUITE(GenerationalGarbageCollectorTests);
+        CPPUNIT_TEST(test_gen_gc_moves_live_objects_to_old_generation);
+        CPPUNIT_TEST(test_gen_gc_finalizes_unreachable_native_objects);
+        CPPUNIT_TEST(test_gen_gc_does_not_collect_young_objects_referenced_from_old_objects);
+        CPPUNIT_TEST(test_gen_gc_collects_large_objects);
+        CPPUNIT_TEST(test_gen_gc_allocates_more_objects_than_nursery_size);
+        CPPUNIT_TEST(test_gen_gc_compacts_old_generation);
+        CPPUNIT_TEST(test_gen_gc_reports_statistics);
+        CPPUNIT_TEST(test_gen_gc_destructor_finalizes_all_objects);
+        CPPUNIT_TEST(test_gen_gc_moves_allocation_samples_with_objects);
+        CPPUNIT_TEST_SUITE_END();
+
+        Allocator *_M_alloc;
+        GarbageCollector *_M_gc;
+        std::mutex *_M_thread_context_mutex;
+      public:
+        ThreadContext *new_thread_context(const VirtualMachineContext &vm_context)
+        {
+          ThreadContext *context = new ThreadContext(vm_context);
+          context->start([this]() {
+            _M_thread_context_mutex->lock();
+            _M_thread_context_mutex->unlock();
+          });
+          return context;
+        }
+
+        VirtualMachineContext *new_vm_context()
+        { return new impl::ImplEnvironment(); }
+
+        void setUp();
+
+        void tearDown();
+
+        void test_gen_gc_moves_live_objects_to_old_generation();
+        void test_gen_gc_finalizes_unreachable_native_objects();
+        void test_gen_gc_does_not_collect_young_objects_referenced_from_old_objects();
+        void test_gen_gc_collects_large_objects();
+        void test_gen_gc_allocates_more_objects_than_nursery_size();
+        void test_gen_gc_compacts_old_generation();
+        void test_gen_gc_reports_statistics();
+        void test_gen_gc_destructor_finalizes_all_objects();
+        void test_gen_gc_moves_allocation_samples_with_objects();
+      };
+    }
+  }
+}
+
+#endif
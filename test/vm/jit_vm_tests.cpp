@@ -0,0 +1,186 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#include <memory>
+#include <vector>
+#include "impl_loader.hpp"
+#include "eager_eval_strategy.hpp"
+#include "mark_sweep_gc.hpp"
+#include "new_alloc.hpp"
+#include "jit_vm_tests.hpp"
+#include "helper.hpp"
+
+using namespace std;
+using namespace letin::vm;
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace test
+    {
+      CPPUNIT_TEST_SUITE_REGISTRATION(JitVirtualMachineTests);
+
+      // The function is compiled at the first retry because the first call is
+      // counted.
+      static const unsigned int COMPILATION_THRESHOLD = 1;
+
+      static size_t expected_compiled_fun_count(size_t count)
+      {
+#if defined(_VM_JIT_VM_X86_64)
+        return count;
+#else
+        return 0;
+#endif
+      }
+
+      void JitVirtualMachineTests::setUp()
+      {
+        _M_loader = new impl::ImplLoader();
+        _M_alloc = new impl::NewAllocator();
+        _M_gc = new impl::MarkSweepGarbageCollector(_M_alloc);
+        _M_native_fun_handler = new DefaultNativeFunctionHandler();
+        _M_eval_strategy = new impl::EagerEvaluationStrategy();
+        _M_jit_vm = new impl::JitVirtualMachine(_M_loader, _M_gc, _M_native_fun_handler, _M_eval_strategy, []() {}, COMPILATION_THRESHOLD);
+        _M_vm = _M_jit_vm;
+      }
+
+      void JitVirtualMachineTests::tearDown()
+      {
+        delete _M_vm;
+        delete _M_eval_strategy;
+        delete _M_native_fun_handler;
+        delete _M_gc;
+        delete _M_alloc;
+        delete _M_loader;
+      }
+
+      void JitVirtualMachineTests::test_jit_vm_compiles_function_with_loop()
+      {
+        PROG(prog_helper, 0);
+        FUN(2);
+        LET(IEQ, A(0), IMM(0));
+        IN();
+        JC(LV(0), 3);
+        ARG(ISUB, A(0), IMM(1));
+        ARG(IADD, A(1), A(0));
+        RETRY();
+        RET(ILOAD, A(1), NA());
+        END_FUN();
+        END_PROG();
+        unique_ptr<void, ProgramDelete> ptr(prog_helper.ptr());
+        bool is_loaded = _M_vm->load(ptr.get(), prog_helper.size());
+        CPPUNIT_ASSERT(is_loaded);
+        bool is_success = false;
+        bool is_expected = false;
+        vector<Value> args;
+        args.push_back(Value(100000));
+        args.push_back(Value(0));
+        Thread thread = _M_vm->start(args, [&is_success, &is_expected](const ReturnValue &value) {
+          is_success = (ERROR_SUCCESS == value.error());
+          is_expected = (5000050000LL == value.i());
+        });
+        thread.system_thread().join();
+        CPPUNIT_ASSERT(is_success);
+        CPPUNIT_ASSERT(is_expected);
+        CPPUNIT_ASSERT_EQUAL(expected_compiled_fun_count(1), _M_jit_vm->compiled_fun_count());
+      }
+
+      void JitVirtualMachineTests::test_jit_vm_does_not_compile_function_before_threshold()
+      {
+        PROG(prog_helper, 0);
+        FUN(2);
+        LET(IADD, A(0), A(1));
+        IN();
+        RET(IMUL, LV(0), IMM(2));
+        END_FUN();
+        END_PROG();
+        unique_ptr<void, ProgramDelete> ptr(prog_helper.ptr());
+        bool is_loaded = _M_vm->load(ptr.get(), prog_helper.size());
+        CPPUNIT_ASSERT(is_loaded);
+        bool is_success = false;
+        bool is_expected = false;
+        vector<Value> args;
+        args.push_back(Value(2));
+        args.push_back(Value(3));
+        Thread thread = _M_vm->start(args, [&is_success, &is_expected](const ReturnValue &value) {
+          is_success = (ERROR_SUCCESS == value.error());
+          is_expected = (10 == value.i());
+        });
+        thread.system_thread().join();
+        CPPUNIT_ASSERT(is_success);
+        CPPUNIT_ASSERT(is_expected);
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), _M_jit_vm->compiled_fun_count());
+      }
+
+      void JitVirtualMachineTests::test_jit_vm_complains_on_division_by_zero_after_compilation()
+      {
+        PROG(prog_helper, 0);
+        FUN(2);
+        LET(IEQ, A(0), IMM(0));
+        IN();
+        JC(LV(0), 3);
+        ARG(ISUB, A(0), IMM(1));
+        ARG(ILOAD, A(1), NA());
+        RETRY();
+        LET(IDIV, IMM(10), A(1));
+        IN();
+        RET(ILOAD, LV(1), NA());
+        END_FUN();
+        END_PROG();
+        unique_ptr<void, ProgramDelete> ptr(prog_helper.ptr());
+        bool is_loaded = _M_vm->load(ptr.get(), prog_helper.size());
+        CPPUNIT_ASSERT(is_loaded);
+        bool is_expected_error = false;
+        vector<Value> args;
+        args.push_back(Value(10));
+        args.push_back(Value(0));
+        Thread thread = _M_vm->start(args, [&is_expected_error](const ReturnValue &value) {
+          is_expected_error = (ERROR_DIV_BY_ZERO == value.error());
+        });
+        thread.system_thread().join();
+        CPPUNIT_ASSERT(is_expected_error);
+        CPPUNIT_ASSERT_EQUAL(expected_compiled_fun_count(1), _M_jit_vm->compiled_fun_count());
+      }
+
+      void JitVirtualMachineTests::test_jit_vm_executes_floating_point_operations_after_compilation()
+      {
+        PROG(prog_helper, 0);
+        FUN(2);
+        LET(IEQ, A(0), IMM(0));
+        IN();
+        JC(LV(0), 3);
+        ARG(ISUB, A(0), IMM(1));
+        ARG(FMUL, A(1), IMM(1.5f));
+        RETRY();
+        LET(FLT, A(1), IMM(0.0f));
+        IN();
+        JC(LV(1), 1);
+        RET(FLOAD, A(1), NA());
+        RET(FLOAD, IMM(0.0f), NA());
+        END_FUN();
+        END_PROG();
+        unique_ptr<void, ProgramDelete> ptr(prog_helper.ptr());
+        bool is_loaded = _M_vm->load(ptr.get(), prog_helper.size());
+        CPPUNIT_ASSERT(is_loaded);
+        bool is_success = false;
+        double f = 0.0;
+        vector<Value> args;
+        args.push_back(Value(3));
+        args.push_back(Value(2.0));
+        Thread thread = _M_vm->start(args, [&is_success, &f](const ReturnValue &value) {
+          is_success = (ERROR_SUCCESS == value.error());
+          f = value.f();
+        });
+        thread.system_thread().join();
+        CPPUNIT_ASSERT(is_success);
+        CPPUNIT_ASSERT_EQUAL(6.75, f);
+        CPPUNIT_ASSERT_EQUAL(expected_compiled_fun_count(1), _M_jit_vm->compiled_fun_count());
+      }
+    }
+  }
+}
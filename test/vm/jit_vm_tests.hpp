@@ -0,0 +1,53 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#ifndef _JIT_VM_TESTS_HPP
+#define _JIT_VM_TESTS_HPP
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestAssert.h>
+#include <letin/vm.hpp>
+#include "jit_vm.hpp"
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace test
+    {
+      class JitVirtualMachineTests : public CppUnit::TestFixture
+      {
+        CPPUNIT_TEST_SUITE(JitVirtualMachineTests);
+        CPPUNIT_TEST(test_jit_vm_compiles_function_with_loop);
+        CPPUNIT_TEST(test_jit_vm_does_not_compile_function_before_threshold);
+        CPPUNIT_TEST(test_jit_vm_complains_on_division_by_zero_after_compilation);
+        CPPUNIT_TEST(test_jit_vm_executes_floating_point_operations_after_compilation);
+        CPPUNIT_TEST_SUITE_END();
+
+        Loader *_M_loader;
+        Allocator *_M_alloc;
+        GarbageCollector *_M_gc;
+        NativeFunctionHandler *_M_native_fun_handler;
+        EvaluationStrategy *_M_eval_strategy;
+        impl::JitVirtualMachine *_M_jit_vm;
+        VirtualMachine *_M_vm;
+      public:
+        void setUp();
+
+        void tearDown();
+
+        void test_jit_vm_compiles_function_with_loop();
+        void test_jit_vm_does_not_compile_function_before_threshold();
+        void test_jit_vm_complains_on_division_by_zero_after_compilation();
+        void test_jit_vm_executes_floating_point_operations_after_compilation();
+      };
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,167 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "heap_region.hpp"
+#include "pool_alloc.hpp"
+#include "pool_alloc_tests.hpp"
+
+using namespace std;
+using namespace letin::vm;
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace test
+    {
+      CPPUNIT_TEST_SUITE_REGISTRATION(PoolAllocatorTests);
+
+      void PoolAllocatorTests::setUp() { _M_alloc = new impl::PoolAllocator(); }
+
+      void PoolAllocatorTests::tearDown() { delete _M_alloc; }
+
+      void PoolAllocatorTests::test_pool_alloc_allocates_aligned_blocks()
+      {
+        vector<void *> ptrs;
+        for(size_t size = 1; size <= 5000; size += 7) {
+          void *ptr = _M_alloc->allocate(size);
+          CPPUNIT_ASSERT(ptr != nullptr);
+          CPPUNIT_ASSERT_EQUAL(static_cast<uintptr_t>(0), reinterpret_cast<uintptr_t>(ptr) & 15);
+          memset(ptr, 0xaa, size);
+          ptrs.push_back(ptr);
+        }
+        for(auto ptr : ptrs) _M_alloc->free(ptr);
+      }
+
+      void PoolAllocatorTests::test_pool_alloc_reuses_freed_blocks()
+      {
+        void *ptr1 = _M_alloc->allocate(48);
+        void *ptr2 = _M_alloc->allocate(48);
+        CPPUNIT_ASSERT(ptr1 != ptr2);
+        _M_alloc->free(ptr1);
+        void *ptr3 = _M_alloc->allocate(40);
+        CPPUNIT_ASSERT(ptr1 == ptr3);
+        _M_alloc->free(ptr2);
+        _M_alloc->free(ptr3);
+      }
+
+      void PoolAllocatorTests::test_pool_alloc_allocates_many_blocks()
+      {
+        vector<int64_t *> ptrs;
+        for(int64_t i = 0; i < 100000; i++) {
+          int64_t *ptr = reinterpret_cast<int64_t *>(_M_alloc->allocate(sizeof(int64_t) * 4));
+          CPPUNIT_ASSERT(ptr != nullptr);
+          for(int64_t j = 0; j < 4; j++) ptr[j] = i * 4 + j;
+          ptrs.push_back(ptr);
+        }
+        for(size_t i = 0; i < ptrs.size(); i += 2) _M_alloc->free(ptrs[i]);
+        for(size_t i = 1; i < ptrs.size(); i += 2) {
+          for(int64_t j = 0; j < 4; j++) CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(i * 4 + j), ptrs[i][j]);
+        }
+        for(size_t i = 0; i < ptrs.size(); i += 2) {
+          ptrs[i] = reinterpret_cast<int64_t *>(_M_alloc->allocate(sizeof(int64_t) * 4));
+          CPPUNIT_ASSERT(ptrs[i] != nullptr);
+        }
+        sort(ptrs.begin(), ptrs.end());
+        CPPUNIT_ASSERT(adjacent_find(ptrs.begin(), ptrs.end()) == ptrs.end());
+        for(auto ptr : ptrs) _M_alloc->free(ptr);
+      }
+
+      void PoolAllocatorTests::test_pool_alloc_allocates_large_blocks()
+      {
+        char *ptr1 = reinterpret_cast<char *>(_M_alloc->allocate(100000));
+        char *ptr2 = reinterpret_cast<char *>(_M_alloc->allocate(1000000));
+        CPPUNIT_ASSERT(ptr1 != nullptr);
+        CPPUNIT_ASSERT(ptr2 != nullptr);
+        for(size_t i = 0; i < 100000; i++) ptr1[i] = static_cast<char>(i);
+        for(size_t i = 0; i < 1000000; i++) ptr2[i] = static_cast<char>(i + 1);
+        for(size_t i = 0; i < 100000; i++) CPPUNIT_ASSERT_EQUAL(static_cast<char>(i), ptr1[i]);
+        _M_alloc->free(ptr1);
+        for(size_t i = 0; i < 1000000; i++) CPPUNIT_ASSERT_EQUAL(static_cast<char>(i + 1), ptr2[i]);
+        _M_alloc->free(ptr2);
+      }
+
+      void PoolAllocatorTests::test_pool_alloc_maps_huge_blocks()
+      {
+        impl::PoolAllocator *alloc = dynamic_cast<impl::PoolAllocator *>(_M_alloc);
+        void *ptr1 = _M_alloc->allocate(10000);
+        CPPUNIT_ASSERT(ptr1 != nullptr);
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), alloc->mapped_byte_count());
+        vector<char *> ptrs;
+        for(size_t i = 0; i < 10; i++) {
+          char *ptr2 = reinterpret_cast<char *>(_M_alloc->allocate(1000000 + i));
+          CPPUNIT_ASSERT(ptr2 != nullptr);
+          memset(ptr2, static_cast<int>(i), 1000000 + i);
+          ptrs.push_back(ptr2);
+        }
+        CPPUNIT_ASSERT(alloc->mapped_byte_count() >= 10 * 1000000);
+        for(size_t i = 0; i < 10; i++) {
+          CPPUNIT_ASSERT_EQUAL(static_cast<char>(i), ptrs[i][0]);
+          CPPUNIT_ASSERT_EQUAL(static_cast<char>(i), ptrs[i][1000000 + i - 1]);
+          _M_alloc->free(ptrs[i]);
+        }
+        CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(0), alloc->mapped_byte_count());
+        _M_alloc->free(ptr1);
+      }
+
+      void PoolAllocatorTests::test_pool_alloc_allocates_blocks_in_many_threads()
+      {
+        vector<thread> threads;
+        bool results[4] = { false, false, false, false };
+        for(size_t i = 0; i < 4; i++) {
+          threads.push_back(thread([this, i, &results]() {
+            vector<size_t *> ptrs;
+            for(size_t j = 0; j < 10000; j++) {
+              size_t *ptr = reinterpret_cast<size_t *>(_M_alloc->allocate(sizeof(size_t) * (j % 20 + 1)));
+              if(ptr == nullptr) return;
+              *ptr = i * 10000 + j;
+              ptrs.push_back(ptr);
+              if(j % 3 == 0) {
+                _M_alloc->free(ptrs.back());
+                ptrs.pop_back();
+              }
+            }
+            for(auto ptr : ptrs) {
+              if(*ptr / 10000 != i) return;
+              _M_alloc->free(ptr);
+            }
+            results[i] = true;
+          }));
+        }
+        for(auto &thread : threads) thread.join();
+        for(size_t i = 0; i < 4; i++) CPPUNIT_ASSERT(results[i]);
+      }
+
+      void PoolAllocatorTests::test_pool_alloc_allocates_blocks_for_references()
+      {
+        size_t sizes[3] = { 32, 10000, 1000000 };
+        for(auto size : sizes) {
+          void *ptr = _M_alloc->allocate(size);
+          CPPUNIT_ASSERT(ptr != nullptr);
+          Reference ref(reinterpret_cast<Object *>(ptr));
+          CPPUNIT_ASSERT(ptr == reinterpret_cast<void *>(ref.ptr()));
+          CPPUNIT_ASSERT(!ref.has_nil());
+          CPPUNIT_ASSERT(!ref.is_null());
+#ifdef LETIN_COMPRESSED_REFERENCES
+          char *heap_base = Reference::heap_base();
+          CPPUNIT_ASSERT_EQUAL(static_cast<uintptr_t>(0), reinterpret_cast<uintptr_t>(heap_base) & (priv::HEAP_REGION_BLOCK_SIZE - 1));
+          CPPUNIT_ASSERT(reinterpret_cast<char *>(ptr) >= heap_base + priv::HEAP_REGION_FIRST_BLOCK_OFFSET);
+          CPPUNIT_ASSERT(reinterpret_cast<char *>(ptr) + size <= heap_base + priv::HEAP_REGION_SIZE);
+#endif
+          _M_alloc->free(ptr);
+        }
+        CPPUNIT_ASSERT(Reference().ptr()->is_error());
+        CPPUNIT_ASSERT(Reference(nullptr).is_null());
+      }
+    }
+  }
+}
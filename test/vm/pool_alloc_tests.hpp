@@ -0,0 +1,52 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#ifndef _POOL_ALLOC_TESTS_HPP
+#define _POOL_ALLOC_TESTS_HPP
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestAssert.h>
+#include <letin/vm.hpp>
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace test
+    {
+      class PoolAllocatorTests : public CppUnit::TestFixture
+      {
+        CPPUNIT_TEST_SUITE(PoolAllocatorTests);
+        CPPUNIT_TEST(test_pool_alloc_allocates_aligned_blocks);
+        CPPUNIT_TEST(test_pool_alloc_reuses_freed_blocks);
+        CPPUNIT_TEST(test_pool_alloc_allocates_many_blocks);
+        CPPUNIT_TEST(test_pool_alloc_allocates_large_blocks);
+        CPPUNIT_TEST(test_pool_alloc_maps_huge_blocks);
+        CPPUNIT_TEST(test_pool_alloc_allocates_blocks_in_many_threads);
+        CPPUNIT_TEST(test_pool_alloc_allocates_blocks_for_references);
+        CPPUNIT_TEST_SUITE_END();
+
+        Allocator *_M_alloc;
+      public:
+        void setUp();
+
+        void tearDown();
+
+        void test_pool_alloc_allocates_aligned_blocks();
+        void test_pool_alloc_reuses_freed_blocks();
+        void test_pool_alloc_allocates_many_blocks();
+        void test_pool_alloc_allocates_large_blocks();
+        void test_pool_alloc_maps_huge_blocks();
+        void test_pool_alloc_allocates_blocks_in_many_threads();
+        void test_pool_alloc_allocates_blocks_for_references();
+      };
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,165 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#include <vector>
+#include <letin/opcode.hpp>
+#include "verifier.hpp"
+#include "verifier_tests.hpp"
+#include "helper.hpp"
+
+using namespace std;
+using namespace letin::opcode;
+using namespace letin::vm;
+using namespace letin::vm::priv;
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace test
+    {
+      CPPUNIT_TEST_SUITE_REGISTRATION(VerifierTests);
+
+      static Instruction make_instr(uint32_t instr, uint32_t op, const Argument &arg1, const Argument &arg2, uint32_t local_var_count = 2)
+      {
+        Instruction tmp_instr;
+        tmp_instr.opcode = opcode::opcode(instr, op, arg1.type, arg2.type, local_var_count);
+        tmp_instr.arg1 = arg1.format_arg;
+        tmp_instr.arg2 = arg2.format_arg;
+        return tmp_instr;
+      }
+
+      static bool verify_instrs(size_t arg_count, vector<Instruction> &instrs, size_t global_var_count = 0)
+      { return verify_fun(Function(arg_count, instrs.data(), instrs.size()), global_var_count); }
+
+      void VerifierTests::setUp() {}
+
+      void VerifierTests::tearDown() {}
+
+      void VerifierTests::test_verifier_verifies_function_with_local_variables_and_arguments()
+      {
+        vector<Instruction> instrs {
+          make_instr(INSTR_LET, OP_IADD, A(0), A(1)),
+          make_instr(INSTR_LETTUPLE, OP_RTUPLE, GV(1), NA(), 3),
+          make_instr(INSTR_IN, 0, NA(), NA()),
+          make_instr(INSTR_LET, OP_IMUL, LV(0), LV(3)),
+          make_instr(INSTR_IN, 0, NA(), NA()),
+          make_instr(INSTR_RET, OP_IADD, LV(4), A(1))
+        };
+        CPPUNIT_ASSERT(verify_instrs(2, instrs, 2));
+      }
+
+      void VerifierTests::test_verifier_does_not_verify_function_with_non_existent_local_variable()
+      {
+        vector<Instruction> instrs {
+          make_instr(INSTR_LET, OP_IADD, A(0), A(1)),
+          make_instr(INSTR_LET, OP_IADD, LV(0), IMM(1)),
+          make_instr(INSTR_IN, 0, NA(), NA()),
+          make_instr(INSTR_RET, OP_IADD, LV(0), LV(1))
+        };
+        CPPUNIT_ASSERT(!verify_instrs(2, instrs));
+      }
+
+      void VerifierTests::test_verifier_does_not_verify_function_with_non_existent_argument()
+      {
+        vector<Instruction> instrs {
+          make_instr(INSTR_LET, OP_IADD, A(0), A(1)),
+          make_instr(INSTR_IN, 0, NA(), NA()),
+          make_instr(INSTR_RET, OP_IADD, LV(0), A(2))
+        };
+        CPPUNIT_ASSERT(!verify_instrs(2, instrs));
+      }
+
+      void VerifierTests::test_verifier_does_not_verify_function_with_non_existent_global_variable()
+      {
+        vector<Instruction> instrs {
+          make_instr(INSTR_RET, OP_ILOAD, GV(3), NA())
+        };
+        CPPUNIT_ASSERT(!verify_instrs(0, instrs, 3));
+      }
+
+      void VerifierTests::test_verifier_verifies_function_with_jumps()
+      {
+        vector<Instruction> instrs {
+          make_instr(INSTR_LET, OP_ILT, A(0), IMM(10)),
+          make_instr(INSTR_IN, 0, NA(), NA()),
+          make_instr(INSTR_JC, 0, LV(0), IMM(3)),
+          make_instr(INSTR_LET, OP_ISUB, A(0), IMM(1)),
+          make_instr(INSTR_IN, 0, NA(), NA()),
+          make_instr(INSTR_JUMP, 0, IMM(2), NA()),
+          make_instr(INSTR_LET, OP_IADD, A(0), IMM(1)),
+          make_instr(INSTR_IN, 0, NA(), NA()),
+          make_instr(INSTR_JC, 0, A(1), IMM(2)),
+          make_instr(INSTR_ARG, OP_ILOAD, LV(1), NA()),
+          make_instr(INSTR_RETRY, 0, NA(), NA()),
+          make_instr(INSTR_RET, OP_ILOAD, LV(1), NA())
+        };
+        CPPUNIT_ASSERT(verify_instrs(2, instrs));
+      }
+
+      void VerifierTests::test_verifier_does_not_verify_function_with_local_variable_only_for_one_path()
+      {
+        vector<Instruction> instrs {
+          make_instr(INSTR_JC, 0, A(0), IMM(2)),
+          make_instr(INSTR_LET, OP_ILOAD, IMM(1), NA()),
+          make_instr(INSTR_IN, 0, NA(), NA()),
+          make_instr(INSTR_RET, OP_ILOAD, LV(0), NA())
+        };
+        CPPUNIT_ASSERT(!verify_instrs(1, instrs));
+      }
+
+      void VerifierTests::test_verifier_does_not_verify_function_with_jump_outside_function()
+      {
+        vector<Instruction> instrs1 {
+          make_instr(INSTR_JC, 0, A(0), IMM(2)),
+          make_instr(INSTR_RET, OP_ILOAD, IMM(1), NA())
+        };
+        CPPUNIT_ASSERT(!verify_instrs(1, instrs1));
+        vector<Instruction> instrs2 {
+          make_instr(INSTR_JC, 0, A(0), IMM(1)),
+          make_instr(INSTR_RET, OP_ILOAD, IMM(1), NA()),
+          make_instr(INSTR_JUMP, 0, IMM(-4), NA())
+        };
+        CPPUNIT_ASSERT(!verify_instrs(1, instrs2));
+      }
+
+      void VerifierTests::test_verifier_verifies_function_with_expression_values()
+      {
+        vector<Instruction> instrs {
+          make_instr(INSTR_PUSH, OP_ILOAD, A(0), NA()),
+          make_instr(INSTR_PUSH, OP_ILOAD, A(1), NA()),
+          make_instr(INSTR_PUSH, OP_IADD, PP(), EV(0)),
+          make_instr(INSTR_LET, OP_IMUL, PP(), PP()),
+          make_instr(INSTR_POP, 0, IMM(0), NA()),
+          make_instr(INSTR_IN, 0, NA(), NA()),
+          make_instr(INSTR_RET, OP_ILOAD, LV(0), NA())
+        };
+        CPPUNIT_ASSERT(verify_instrs(2, instrs));
+      }
+
+      void VerifierTests::test_verifier_does_not_verify_function_with_non_existent_expression_value()
+      {
+        vector<Instruction> instrs1 {
+          make_instr(INSTR_PUSH, OP_ILOAD, A(0), NA()),
+          make_instr(INSTR_RET, OP_IADD, PP(), PP())
+        };
+        CPPUNIT_ASSERT(!verify_instrs(1, instrs1));
+        vector<Instruction> instrs2 {
+          make_instr(INSTR_PUSH, OP_ILOAD, A(0), NA()),
+          make_instr(INSTR_RET, OP_IADD, PP(), EV(0))
+        };
+        CPPUNIT_ASSERT(!verify_instrs(1, instrs2));
+        vector<Instruction> instrs3 {
+          make_instr(INSTR_PUSH, OP_ILOAD, A(0), NA()),
+          make_instr(INSTR_POP, 0, IMM(2), NA()),
+          make_instr(INSTR_RET, OP_ILOAD, A(0), NA())
+        };
+        CPPUNIT_ASSERT(!verify_instrs(1, instrs3));
+      }
+    }
+  }
+}
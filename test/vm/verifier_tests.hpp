@@ -0,0 +1,53 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#ifndef _VERIFIER_TESTS_HPP
+#define _VERIFIER_TESTS_HPP
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestAssert.h>
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace test
+    {
+      class VerifierTests : public CppUnit::TestFixture
+      {
+        CPPUNIT_TEST_SUITE(VerifierTests);
+        CPPUNIT_TEST(test_verifier_verifies_function_with_local_variables_and_arguments);
+        CPPUNIT_TEST(test_verifier_does_not_verify_function_with_non_existent_local_variable);
+        CPPUNIT_TEST(test_verifier_does_not_verify_function_with_non_existent_argument);
+        CPPUNIT_TEST(test_verifier_does_not_verify_function_with_non_existent_global_variable);
+        CPPUNIT_TEST(test_verifier_verifies_function_with_jumps);
+        CPPUNIT_TEST(test_verifier_does_not_verify_function_with_local_variable_only_for_one_path);
+        CPPUNIT_TEST(test_verifier_does_not_verify_function_with_jump_outside_function);
+        CPPUNIT_TEST(test_verifier_verifies_function_with_expression_values);
+        CPPUNIT_TEST(test_verifier_does_not_verify_function_with_non_existent_expression_value);
+        CPPUNIT_TEST_SUITE_END();
+      public:
+        void setUp();
+
+        void tearDown();
+
+        void test_verifier_verifies_function_with_local_variables_and_arguments();
+        void test_verifier_does_not_verify_function_with_non_existent_local_variable();
+        void test_verifier_does_not_verify_function_with_non_existent_argument();
+        void test_verifier_does_not_verify_function_with_non_existent_global_variable();
+        void test_verifier_verifies_function_with_jumps();
+        void test_verifier_does_not_verify_function_with_local_variable_only_for_one_path();
+        void test_verifier_does_not_verify_function_with_jump_outside_function();
+        void test_verifier_verifies_function_with_expression_values();
+        void test_verifier_does_not_verify_function_with_non_existent_expression_value();
+      };
+    }
+  }
+}
+
+#endif
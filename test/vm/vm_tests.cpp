@@ -5,11 +5,13 @@
  *   License v3 or later. See the LICENSE file and the GPL file for         *
  *   the full licensing terms.                                              *
  ****************************************************************************/
+#include <atomic>
 #include <cstring>
 #include "impl_loader.hpp"
 #include "eager_eval_strategy.hpp"
 #include "ht_memo_cache.hpp"
 #include "interp_vm.hpp"
+#include "jit_vm.hpp"
 #include "lazy_eval_strategy.hpp"
 #include "mark_sweep_gc.hpp"
 #include "memo_eval_strategy.hpp"
@@ -520,6 +522,62 @@ namespace letin
         CPPUNIT_ASSERT(is_expected3);
       }
 
+      void VirtualMachineTests::test_vm_stops_threads_at_safepoints()
+      {
+        _M_gc->set_safepoint_flag(true);
+        CPPUNIT_ASSERT(_M_gc->safepoint_flag());
+        PROG(prog_helper, 0);
+        FUN(3);
+        LET(IGT, A(1), A(0));
+        IN();
+        JC(LV(0), 7);
+        ARG(ILOAD, A(1), NA());
+        LET(RIARRAY8, NA(), NA());
+        IN();
+        ARG(ILOAD, A(0), NA());
+        ARG(IADD, A(1), IMM(1));
+        ARG(IADD, A(2), A(1));
+        RETRY();
+        RET(ILOAD, A(2), NA());
+        END_FUN();
+        END_PROG();
+        unique_ptr<void, ProgramDelete> ptr(prog_helper.ptr());
+        bool is_loaded = _M_vm->load(ptr.get(), prog_helper.size());
+        CPPUNIT_ASSERT(is_loaded);
+        atomic<int> finished_thread_count(0);
+        bool is_success1 = false;
+        bool is_expected1 = false;
+        vector<Value> args1;
+        args1.push_back(Value(20000));
+        args1.push_back(Value(1));
+        args1.push_back(Value(0));
+        Thread thread1 = _M_vm->start(0, args1, [&is_success1, &is_expected1, &finished_thread_count](const ReturnValue &value) {
+          is_success1 = (ERROR_SUCCESS == value.error());
+          is_expected1 = (200010000 == value.i());
+          finished_thread_count++;
+        });
+        bool is_success2 = false;
+        bool is_expected2 = false;
+        vector<Value> args2;
+        args2.push_back(Value(10000));
+        args2.push_back(Value(1));
+        args2.push_back(Value(0));
+        Thread thread2 = _M_vm->start(0, args2, [&is_success2, &is_expected2, &finished_thread_count](const ReturnValue &value) {
+          is_success2 = (ERROR_SUCCESS == value.error());
+          is_expected2 = (50005000 == value.i());
+          finished_thread_count++;
+        });
+        do {
+          _M_gc->collect();
+        } while(finished_thread_count.load() < 2);
+        thread1.system_thread().join();
+        thread2.system_thread().join();
+        CPPUNIT_ASSERT(is_success1);
+        CPPUNIT_ASSERT(is_expected1);
+        CPPUNIT_ASSERT(is_success2);
+        CPPUNIT_ASSERT(is_expected2);
+      }
+
       void VirtualMachineTests::test_vm_complains_on_non_existent_local_variable()
       {
         PROG(prog_helper, 0);
@@ -2785,6 +2843,138 @@ namespace letin
         CPPUNIT_ASSERT(is_expected_error);
       }
 
+      void VirtualMachineTests::test_vm_complains_on_jump_to_non_existent_instruction()
+      {
+        PROG(prog_helper, 0);
+        FUN(1);
+        LET(ILT, A(0), IMM(10));
+        IN();
+        JC(LV(0), 2);
+        RET(ILOAD, A(0), NA());
+        END_FUN();
+        END_PROG();
+        unique_ptr<void, ProgramDelete> ptr(prog_helper.ptr());
+        bool is_loaded = _M_vm->load(ptr.get(), prog_helper.size());
+        CPPUNIT_ASSERT(is_loaded);
+        bool is_expected_error = false;
+        vector<Value> args;
+        args.push_back(Value(1));
+        Thread thread = _M_vm->start(args, [&is_expected_error](const ReturnValue &value) {
+          is_expected_error = (ERROR_NO_INSTR == value.error());
+        });
+        thread.system_thread().join();
+        CPPUNIT_ASSERT(is_expected_error);
+      }
+
+      void VirtualMachineTests::test_vm_complains_on_function_without_return()
+      {
+        PROG(prog_helper, 0);
+        FUN(0);
+        LET(IADD, IMM(1), IMM(2));
+        IN();
+        END_FUN();
+        END_PROG();
+        unique_ptr<void, ProgramDelete> ptr(prog_helper.ptr());
+        bool is_loaded = _M_vm->load(ptr.get(), prog_helper.size());
+        CPPUNIT_ASSERT(is_loaded);
+        bool is_expected_error = false;
+        Thread thread = _M_vm->start(vector<Value>(), [&is_expected_error](const ReturnValue &value) {
+          is_expected_error = (ERROR_NO_INSTR == value.error());
+        });
+        thread.system_thread().join();
+        CPPUNIT_ASSERT(is_expected_error);
+      }
+
+      void VirtualMachineTests::test_vm_executes_jumps_to_instructions_of_superinstructions()
+      {
+        PROG(prog_helper, 0);
+        FUN(2);
+        LET(ILOAD, A(0), NA());
+        JC(A(1), 3);
+        LET(IADD, A(0), IMM(1));
+        ARG(ILOAD, IMM(1), NA());
+        ARG(ILOAD, IMM(2), NA());
+        IN();
+        JC(A(1), 1);
+        ARG(ILOAD, IMM(3), NA());
+        RET(ILOAD, LV(0), NA());
+        END_FUN();
+        END_PROG();
+        unique_ptr<void, ProgramDelete> ptr(prog_helper.ptr());
+        bool is_loaded = _M_vm->load(ptr.get(), prog_helper.size());
+        CPPUNIT_ASSERT(is_loaded);
+        bool is_success1 = false;
+        bool is_expected1 = false;
+        vector<Value> args1;
+        args1.push_back(Value(5));
+        args1.push_back(Value(0));
+        Thread thread1 = _M_vm->start(args1, [&is_success1, &is_expected1](const ReturnValue &value) {
+          is_success1 = (ERROR_SUCCESS == value.error());
+          is_expected1 = (5 == value.i());
+        });
+        thread1.system_thread().join();
+        CPPUNIT_ASSERT(is_success1);
+        CPPUNIT_ASSERT(is_expected1);
+        bool is_success2 = false;
+        bool is_expected2 = false;
+        vector<Value> args2;
+        args2.push_back(Value(5));
+        args2.push_back(Value(1));
+        Thread thread2 = _M_vm->start(args2, [&is_success2, &is_expected2](const ReturnValue &value) {
+          is_success2 = (ERROR_SUCCESS == value.error());
+          is_expected2 = (5 == value.i());
+        });
+        thread2.system_thread().join();
+        CPPUNIT_ASSERT(is_success2);
+        CPPUNIT_ASSERT(is_expected2);
+      }
+
+      void VirtualMachineTests::test_vm_counts_instruction_sequences_in_profiling_mode()
+      {
+        PROG(prog_helper, 0);
+        FUN(2);
+        LET(IEQ, A(0), IMM(0));
+        IN();
+        JC(LV(0), 3);
+        ARG(ISUB, A(0), IMM(1));
+        ARG(IADD, A(1), A(0));
+        RETRY();
+        RET(ILOAD, A(1), NA());
+        END_FUN();
+        END_PROG();
+        _M_vm->set_profiling_flag(true);
+        unique_ptr<void, ProgramDelete> ptr(prog_helper.ptr());
+        bool is_loaded = _M_vm->load(ptr.get(), prog_helper.size());
+        CPPUNIT_ASSERT(is_loaded);
+        bool is_success = false;
+        bool is_expected = false;
+        vector<Value> args;
+        args.push_back(Value(10));
+        args.push_back(Value(0));
+        Thread thread = _M_vm->start(args, [&is_success, &is_expected](const ReturnValue &value) {
+          is_success = (ERROR_SUCCESS == value.error());
+          is_expected = (55 == value.i());
+        });
+        thread.system_thread().join();
+        CPPUNIT_ASSERT(is_success);
+        CPPUNIT_ASSERT(is_expected);
+        InstructionProfile profile;
+        CPPUNIT_ASSERT(_M_vm->instr_profile(profile));
+        vector<uint32_t> let_in_jc_seq { opcode::opcode(opcode::INSTR_LET, opcode::OP_IEQ), opcode::opcode(opcode::INSTR_IN, 0), opcode::opcode(opcode::INSTR_JC, 0) };
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(11), profile.seq_counts[let_in_jc_seq]);
+        vector<uint32_t> arg_arg_seq { opcode::opcode(opcode::INSTR_ARG, opcode::OP_ISUB), opcode::opcode(opcode::INSTR_ARG, opcode::OP_IADD) };
+        CPPUNIT_ASSERT_EQUAL(static_cast<uint64_t>(10), profile.seq_counts[arg_arg_seq]);
+        // The instructions after the jumps aren't counted with the jump instructions.
+        vector<uint32_t> retry_let_seq { opcode::opcode(opcode::INSTR_RETRY, 0), opcode::opcode(opcode::INSTR_LET, opcode::OP_IEQ) };
+        CPPUNIT_ASSERT(profile.seq_counts.find(retry_let_seq) == profile.seq_counts.end());
+      }
+
+      // The functions are compiled at the first call so that the native code is tested
+      // by all tests.
+      template<>
+      VirtualMachine *new_impl_vm<impl::JitVirtualMachine>(Loader *loader, GarbageCollector *gc, NativeFunctionHandler *native_fun_handler, EvaluationStrategy *eval_strategy)
+      { return new impl::JitVirtualMachine(loader, gc, native_fun_handler, eval_strategy, []() {}, 0); }
+
       DEF_IMPL_VM_TESTS(Eager, InterpreterVirtualMachine);
 
       DEF_IMPL_VM_TESTS(Lazy, InterpreterVirtualMachine);
@@ -2792,6 +2982,14 @@ namespace letin
       DEF_IMPL_VM_TESTS_WITH_MEMO_CACHE(HashTable, Memoization, InterpreterVirtualMachine, 32 * 1024);
 
       DEF_IMPL_VM_TESTS_WITH_MEMO_CACHE(HashTable, MemoizationLazy, InterpreterVirtualMachine, 32 * 1024);
+
+      DEF_IMPL_VM_TESTS(Eager, JitVirtualMachine);
+
+      DEF_IMPL_VM_TESTS(Lazy, JitVirtualMachine);
+
+      DEF_IMPL_VM_TESTS_WITH_MEMO_CACHE(HashTable, Memoization, JitVirtualMachine, 32 * 1024);
+
+      DEF_IMPL_VM_TESTS_WITH_MEMO_CACHE(HashTable, MemoizationLazy, JitVirtualMachine, 32 * 1024);
     }
   }
 }
@@ -38,7 +38,7 @@ VirtualMachine *prefix##clazz##Tests::new_vm(Loader *loader,
                                              GarbageCollector *gc,              \
                                              NativeFunctionHandler *native_fun_handler, \
                                              EvaluationStrategy *eval_strategy) \
-{ return new impl::clazz(loader, gc, native_fun_handler, eval_strategy); }      \
+{ return new_impl_vm<impl::clazz>(loader, gc, native_fun_handler, eval_strategy); } \
 class prefix##clazz##Tests
 
 #define DEF_IMPL_VM_TESTS(prefix, clazz)                                        \
@@ -54,7 +54,7 @@ VirtualMachine *prefix##clazz##Tests::new_vm(Loader *loader,
                                              GarbageCollector *gc,              \
                                              NativeFunctionHandler *native_fun_handler, \
                                              EvaluationStrategy *eval_strategy) \
-{ return new impl::clazz(loader, gc, native_fun_handler, eval_strategy); }      \
+{ return new_impl_vm<impl::clazz>(loader, gc, native_fun_handler, eval_strategy); } \
 class prefix##clazz##Tests
 
 #define DECL_IMPL_VM_TESTS_WITH_MEMO_CACHE(prefix1, prefix2, clazz)             \
@@ -69,6 +69,10 @@ namespace letin
   {
     namespace test
     {
+      template<typename _VM>
+      VirtualMachine *new_impl_vm(Loader *loader, GarbageCollector *gc, NativeFunctionHandler *native_fun_handler, EvaluationStrategy *eval_strategy)
+      { return new _VM(loader, gc, native_fun_handler, eval_strategy); }
+
       class VirtualMachineTests : public CppUnit::TestFixture
       {
         CPPUNIT_TEST_SUITE(VirtualMachineTests);
@@ -83,6 +87,7 @@ namespace letin
         CPPUNIT_TEST(test_vm_executes_recursion);
         CPPUNIT_TEST(test_vm_executes_tail_recursion);
         CPPUNIT_TEST(test_vm_executes_many_threads);
+        CPPUNIT_TEST(test_vm_stops_threads_at_safepoints);
         CPPUNIT_TEST(test_vm_complains_on_non_existent_local_variable);
         CPPUNIT_TEST(test_vm_complains_on_non_existent_argument);
         CPPUNIT_TEST(test_vm_complains_on_division_by_zero);
@@ -136,6 +141,10 @@ namespace letin
         CPPUNIT_TEST(test_vm_executes_rethrow_for_division_by_zero);
         CPPUNIT_TEST(test_vm_executes_rethrow_for_user_exception);
         CPPUNIT_TEST(test_vm_complains_on_non_existent_error_for_rethrow);
+        CPPUNIT_TEST(test_vm_complains_on_jump_to_non_existent_instruction);
+        CPPUNIT_TEST(test_vm_complains_on_function_without_return);
+        CPPUNIT_TEST(test_vm_executes_jumps_to_instructions_of_superinstructions);
+        CPPUNIT_TEST(test_vm_counts_instruction_sequences_in_profiling_mode);
         CPPUNIT_TEST_SUITE_END_ABSTRACT();
 
         Loader *_M_loader;
@@ -169,6 +178,7 @@ namespace letin
         void test_vm_executes_recursion();
         void test_vm_executes_tail_recursion();
         void test_vm_executes_many_threads();
+        void test_vm_stops_threads_at_safepoints();
         void test_vm_complains_on_non_existent_local_variable();
         void test_vm_complains_on_non_existent_argument();
         void test_vm_complains_on_division_by_zero();
@@ -222,6 +232,10 @@ namespace letin
         void test_vm_executes_rethrow_for_division_by_zero();
         void test_vm_executes_rethrow_for_user_exception();
         void test_vm_complains_on_non_existent_error_for_rethrow();
+        void test_vm_complains_on_jump_to_non_existent_instruction();
+        void test_vm_complains_on_function_without_return();
+        void test_vm_executes_jumps_to_instructions_of_superinstructions();
+        void test_vm_counts_instruction_sequences_in_profiling_mode();
       };
 
       DECL_IMPL_VM_TESTS(Eager, InterpreterVirtualMachine);
@@ -231,6 +245,14 @@ namespace letin
       DECL_IMPL_VM_TESTS_WITH_MEMO_CACHE(HashTable, Memoization, InterpreterVirtualMachine);
 
       DECL_IMPL_VM_TESTS_WITH_MEMO_CACHE(HashTable, MemoizationLazy, InterpreterVirtualMachine);
+
+      DECL_IMPL_VM_TESTS(Eager, JitVirtualMachine);
+
+      DECL_IMPL_VM_TESTS(Lazy, JitVirtualMachine);
+
+      DECL_IMPL_VM_TESTS_WITH_MEMO_CACHE(HashTable, Memoization, JitVirtualMachine);
+
+      DECL_IMPL_VM_TESTS_WITH_MEMO_CACHE(HashTable, MemoizationLazy, JitVirtualMachine);
     }
   }
 }
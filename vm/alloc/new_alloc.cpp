@@ -1,5 +1,5 @@
 /****************************************************************************
- *   Copyright (C) 2014 Łukasz Szpakowski.                                  *
+ *   Copyright (C) 2014, 2019 Łukasz Szpakowski.                            *
  *                                                                          *
  *   This software is licensed under the GNU Lesser General Public          *
  *   License v3 or later. See the LICENSE file and the GPL file for         *
@@ -17,11 +17,19 @@ namespace letin
     {
       NewAllocator::~NewAllocator() {}
         
+#ifdef LETIN_COMPRESSED_REFERENCES
+      void *NewAllocator::allocate(size_t size)
+      { return _M_pool_alloc.allocate(size); }
+
+      void NewAllocator::free(void *ptr)
+      { _M_pool_alloc.free(ptr); }
+#else
       void *NewAllocator::allocate(size_t size)
       { try { return reinterpret_cast<void *>(new char[size]); } catch(...) { return nullptr; } }
 
       void NewAllocator::free(void *ptr)
       { delete[] (reinterpret_cast<char *>(ptr)); }
+#endif
     }
   }
 }
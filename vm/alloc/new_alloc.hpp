@@ -1,5 +1,5 @@
 /****************************************************************************
- *   Copyright (C) 2014 Łukasz Szpakowski.                                  *
+ *   Copyright (C) 2014, 2019 Łukasz Szpakowski.                            *
  *                                                                          *
  *   This software is licensed under the GNU Lesser General Public          *
  *   License v3 or later. See the LICENSE file and the GPL file for         *
@@ -9,6 +9,9 @@
 #define _ALLOC_NEW_ALLOC_HPP
 
 #include <letin/vm.hpp>
+#ifdef LETIN_COMPRESSED_REFERENCES
+#include "pool_alloc.hpp"
+#endif
 
 namespace letin
 {
@@ -18,6 +21,10 @@ namespace letin
     {
       class NewAllocator : public Allocator
       {
+#ifdef LETIN_COMPRESSED_REFERENCES
+        // The objects must be allocated from the heap region.
+        PoolAllocator _M_pool_alloc;
+#endif
       public:
         NewAllocator() {}
         
@@ -0,0 +1,267 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#if defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#elif defined(_WIN32) || defined(_WIN64)
+#include <malloc.h>
+#endif
+#include <cstdlib>
+#include <mutex>
+#include <letin/const.hpp>
+#include "heap_region.hpp"
+#include "pool_alloc.hpp"
+
+using namespace std;
+using namespace letin::vm::priv;
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace impl
+    {
+      PoolAllocator::PoolAllocator() :
+        _M_empty_slabs(nullptr), _M_empty_slab_count(0), _M_page_size(4096), _M_mapped_byte_count(0)
+      {
+#if defined(__unix__)
+        long page_size = sysconf(_SC_PAGESIZE);
+        if(page_size > 0) _M_page_size = page_size;
+#endif
+        // The size classes are spaced by 16 bytes to 256 bytes and then there are four
+        // size classes for each power of two.
+        size_t cell_size = ALIGNMENT;
+        size_t step = ALIGNMENT;
+        for(size_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+          _M_size_classes[i].cell_size = cell_size;
+          _M_size_classes[i].cell_count = (SLAB_SIZE - SLAB_HEADER_SIZE) / cell_size;
+          _M_size_classes[i].available_slabs = nullptr;
+          if(cell_size >= 256 && (cell_size & (cell_size - 1)) == 0) step = cell_size / 4;
+          cell_size += step;
+        }
+        size_t j = 0;
+        for(size_t i = 0; i <= MAX_SMALL_SIZE / ALIGNMENT; i++) {
+          while(_M_size_classes[j].cell_size < i * ALIGNMENT) j++;
+          _M_size_class_indices[i] = static_cast<uint8_t>(j);
+        }
+        for(size_t i = 0; i < SIZE_CLASS_COUNT; i++)
+          _M_fork_handler.mutexes().push_back(&(_M_size_classes[i].mutex));
+        _M_fork_handler.mutexes().push_back(&_M_empty_slab_mutex);
+        add_fork_handler(FORK_HANDLER_PRIO_ALLOC, &_M_fork_handler);
+      }
+
+      PoolAllocator::~PoolAllocator()
+      {
+        delete_fork_handler(FORK_HANDLER_PRIO_ALLOC, &_M_fork_handler);
+        for(size_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+          while(_M_size_classes[i].available_slabs != nullptr) {
+            Slab *slab = _M_size_classes[i].available_slabs;
+            delete_slab(_M_size_classes[i].available_slabs, slab);
+            free_aligned_block(reinterpret_cast<void *>(slab));
+          }
+        }
+        while(_M_empty_slabs != nullptr) {
+          Slab *slab = _M_empty_slabs;
+          delete_slab(_M_empty_slabs, slab);
+          free_aligned_block(reinterpret_cast<void *>(slab));
+        }
+      }
+
+      void *PoolAllocator::allocate(size_t size)
+      {
+        if(size > MAX_SMALL_SIZE) {
+          if(size > static_cast<size_t>(-1) - SLAB_HEADER_SIZE - SLAB_SIZE - _M_page_size) return nullptr;
+          size_t block_size = SLAB_HEADER_SIZE + size;
+          void *block;
+          size_t mapped_size = 0;
+          if(block_size >= MIN_MAPPED_SIZE) {
+            mapped_size = (block_size + _M_page_size - 1) & ~(_M_page_size - 1);
+            block = map_aligned_block(mapped_size);
+          } else
+            block = allocate_aligned_block(block_size);
+          if(block == nullptr) return nullptr;
+          Slab *slab = reinterpret_cast<Slab *>(block);
+          slab->prev = slab->next = nullptr;
+          slab->free_cell = nullptr;
+          slab->bump = 0;
+          slab->size_class = (mapped_size != 0 ? MAPPED_SIZE_CLASS : LARGE_SIZE_CLASS);
+          slab->live_cell_count = 1;
+          slab->mapped_size = mapped_size;
+          slab->is_available = false;
+          return reinterpret_cast<void *>(slab_cells(slab));
+        }
+        size_t i = _M_size_class_indices[(size + ALIGNMENT - 1) / ALIGNMENT];
+        SizeClass &size_class = _M_size_classes[i];
+        lock_guard<mutex> guard(size_class.mutex);
+        Slab *slab = size_class.available_slabs;
+        if(slab == nullptr) {
+          slab = new_slab(i);
+          if(slab == nullptr) return nullptr;
+          add_slab(size_class.available_slabs, slab);
+          slab->is_available = true;
+        }
+        void *ptr;
+        if(slab->free_cell != nullptr) {
+          ptr = reinterpret_cast<void *>(slab->free_cell);
+          slab->free_cell = slab->free_cell->next;
+        } else {
+          ptr = reinterpret_cast<void *>(slab_cells(slab) + slab->bump * size_class.cell_size);
+          slab->bump++;
+        }
+        slab->live_cell_count++;
+        if(slab->live_cell_count >= size_class.cell_count) {
+          delete_slab(size_class.available_slabs, slab);
+          slab->is_available = false;
+        }
+        return ptr;
+      }
+
+      void PoolAllocator::free(void *ptr)
+      {
+        if(ptr == nullptr) return;
+        Slab *slab = ptr_to_slab(ptr);
+        if(slab->size_class == LARGE_SIZE_CLASS) {
+          free_aligned_block(reinterpret_cast<void *>(slab));
+          return;
+        }
+        if(slab->size_class == MAPPED_SIZE_CLASS) {
+          unmap_aligned_block(reinterpret_cast<void *>(slab), slab->mapped_size);
+          return;
+        }
+        SizeClass &size_class = _M_size_classes[slab->size_class];
+        bool is_empty_slab;
+        {
+          lock_guard<mutex> guard(size_class.mutex);
+          Cell *cell = reinterpret_cast<Cell *>(ptr);
+          cell->next = slab->free_cell;
+          slab->free_cell = cell;
+          slab->live_cell_count--;
+          if(!slab->is_available) {
+            add_slab(size_class.available_slabs, slab);
+            slab->is_available = true;
+          }
+          // One empty slab is left for the size class.
+          is_empty_slab = (slab->live_cell_count == 0 && (slab->prev != nullptr || slab->next != nullptr));
+          if(is_empty_slab) delete_slab(size_class.available_slabs, slab);
+        }
+        if(is_empty_slab) delete_empty_slab(slab);
+      }
+
+      void *PoolAllocator::allocate_aligned_block(size_t size)
+      {
+#if defined(LETIN_COMPRESSED_REFERENCES)
+        return allocate_heap_region_block(size);
+#elif defined(_WIN32) || defined(_WIN64)
+        return _aligned_malloc(size, SLAB_SIZE);
+#else
+        void *ptr;
+        if(posix_memalign(&ptr, SLAB_SIZE, size) != 0) return nullptr;
+        return ptr;
+#endif
+      }
+
+      void PoolAllocator::free_aligned_block(void *ptr)
+      {
+#if defined(LETIN_COMPRESSED_REFERENCES)
+        free_heap_region_block(ptr);
+#elif defined(_WIN32) || defined(_WIN64)
+        _aligned_free(ptr);
+#else
+        std::free(ptr);
+#endif
+      }
+
+      void *PoolAllocator::map_aligned_block(size_t size)
+      {
+#if defined(__unix__) && !defined(LETIN_COMPRESSED_REFERENCES)
+        // The region is mapped with a margin and is trimmed to be aligned to the slab size.
+        size_t region_size = size + SLAB_SIZE;
+        void *region = mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(region == MAP_FAILED) return nullptr;
+        uintptr_t region_begin = reinterpret_cast<uintptr_t>(region);
+        uintptr_t begin = (region_begin + SLAB_SIZE - 1) & ~static_cast<uintptr_t>(SLAB_SIZE - 1);
+        uintptr_t end = begin + size;
+        if(begin > region_begin) munmap(region, begin - region_begin);
+        if(region_begin + region_size > end) munmap(reinterpret_cast<void *>(end), region_begin + region_size - end);
+        _M_mapped_byte_count.fetch_add(size, memory_order_relaxed);
+        return reinterpret_cast<void *>(begin);
+#else
+        void *ptr = allocate_aligned_block(size);
+        if(ptr != nullptr) _M_mapped_byte_count.fetch_add(size, memory_order_relaxed);
+        return ptr;
+#endif
+      }
+
+      void PoolAllocator::unmap_aligned_block(void *ptr, size_t size)
+      {
+        _M_mapped_byte_count.fetch_sub(size, memory_order_relaxed);
+#if defined(__unix__) && !defined(LETIN_COMPRESSED_REFERENCES)
+        munmap(ptr, size);
+#else
+        free_aligned_block(ptr);
+#endif
+      }
+
+      void PoolAllocator::add_slab(Slab *&list, Slab *slab)
+      {
+        slab->prev = nullptr;
+        slab->next = list;
+        if(list != nullptr) list->prev = slab;
+        list = slab;
+      }
+
+      void PoolAllocator::delete_slab(Slab *&list, Slab *slab)
+      {
+        if(slab->prev != nullptr)
+          slab->prev->next = slab->next;
+        else
+          list = slab->next;
+        if(slab->next != nullptr) slab->next->prev = slab->prev;
+        slab->prev = slab->next = nullptr;
+      }
+
+      PoolAllocator::Slab *PoolAllocator::new_slab(size_t size_class)
+      {
+        Slab *slab = nullptr;
+        {
+          lock_guard<mutex> guard(_M_empty_slab_mutex);
+          if(_M_empty_slabs != nullptr) {
+            slab = _M_empty_slabs;
+            delete_slab(_M_empty_slabs, slab);
+            _M_empty_slab_count--;
+          }
+        }
+        if(slab == nullptr) {
+          slab = reinterpret_cast<Slab *>(allocate_aligned_block(SLAB_SIZE));
+          if(slab == nullptr) return nullptr;
+        }
+        slab->prev = slab->next = nullptr;
+        slab->free_cell = nullptr;
+        slab->bump = 0;
+        slab->size_class = size_class;
+        slab->live_cell_count = 0;
+        slab->mapped_size = 0;
+        slab->is_available = false;
+        return slab;
+      }
+
+      void PoolAllocator::delete_empty_slab(Slab *slab)
+      {
+        {
+          lock_guard<mutex> guard(_M_empty_slab_mutex);
+          if(_M_empty_slab_count < MAX_EMPTY_SLAB_COUNT) {
+            add_slab(_M_empty_slabs, slab);
+            _M_empty_slab_count++;
+            return;
+          }
+        }
+        free_aligned_block(reinterpret_cast<void *>(slab));
+      }
+    }
+  }
+}
@@ -0,0 +1,114 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#ifndef _ALLOC_POOL_ALLOC_HPP
+#define _ALLOC_POOL_ALLOC_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <letin/vm.hpp>
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace impl
+    {
+      //
+      // The pool allocator divides slabs into cells of one size class. The slabs are
+      // aligned to their size so a slab of a cell is found by masking a cell address.
+      // Freed cells are added to a free list of their slab and are reused by next
+      // allocations. A big block is allocated as a large slab with one cell. A large slab
+      // of a huge block is mapped by mmap and is unmapped when the block is freed, so
+      // memory of huge objects is returned to the operating system. If the references are
+      // compressed, all blocks are allocated from the heap region.
+      //
+      class PoolAllocator : public Allocator
+      {
+        static const std::size_t ALIGNMENT = 16;
+        static const std::size_t SLAB_SIZE = 64 * 1024;
+        static const std::size_t SLAB_HEADER_SIZE = 64;
+        static const std::size_t MAX_SMALL_SIZE = 4096;
+        static const std::size_t SIZE_CLASS_COUNT = 32;
+        static const std::size_t MAX_EMPTY_SLAB_COUNT = 16;
+        static const std::size_t MIN_MAPPED_SIZE = 128 * 1024;
+        static const std::size_t LARGE_SIZE_CLASS = static_cast<std::size_t>(-1);
+        static const std::size_t MAPPED_SIZE_CLASS = static_cast<std::size_t>(-2);
+
+        struct Cell
+        {
+          Cell *next;
+        };
+
+        struct Slab
+        {
+          Slab *prev;
+          Slab *next;
+          Cell *free_cell;
+          std::size_t bump;
+          std::size_t size_class;
+          std::size_t live_cell_count;
+          std::size_t mapped_size;
+          bool is_available;
+        };
+
+        struct SizeClass
+        {
+          std::mutex mutex;
+          std::size_t cell_size;
+          std::size_t cell_count;
+          Slab *available_slabs;
+        };
+
+        SizeClass _M_size_classes[SIZE_CLASS_COUNT];
+        std::uint8_t _M_size_class_indices[MAX_SMALL_SIZE / ALIGNMENT + 1];
+        std::mutex _M_empty_slab_mutex;
+        Slab *_M_empty_slabs;
+        std::size_t _M_empty_slab_count;
+        std::size_t _M_page_size;
+        std::atomic<std::size_t> _M_mapped_byte_count;
+        MutexForkHandler _M_fork_handler;
+      public:
+        PoolAllocator();
+
+        ~PoolAllocator();
+
+        void *allocate(std::size_t size);
+
+        void free(void *ptr);
+
+        std::size_t mapped_byte_count() const
+        { return _M_mapped_byte_count.load(std::memory_order_relaxed); }
+      private:
+        static Slab *ptr_to_slab(void *ptr)
+        { return reinterpret_cast<Slab *>(reinterpret_cast<std::uintptr_t>(ptr) & ~(SLAB_SIZE - 1)); }
+
+        static char *slab_cells(Slab *slab)
+        { return reinterpret_cast<char *>(slab) + SLAB_HEADER_SIZE; }
+
+        static void *allocate_aligned_block(std::size_t size);
+
+        static void free_aligned_block(void *ptr);
+
+        void *map_aligned_block(std::size_t size);
+
+        void unmap_aligned_block(void *ptr, std::size_t size);
+
+        static void add_slab(Slab *&list, Slab *slab);
+
+        static void delete_slab(Slab *&list, Slab *slab);
+
+        Slab *new_slab(std::size_t size_class);
+
+        void delete_empty_slab(Slab *slab);
+      };
+    }
+  }
+}
+
+#endif
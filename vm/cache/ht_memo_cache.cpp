@@ -85,6 +85,15 @@ namespace letin
         }
       }
 
+      void HashTableMemoizationCache::traverse_root_refs(function<void (int, Reference &)> fun)
+      {
+        for(size_t i = 0; i < _M_fun_count; i++) {
+          fun(VALUE_TYPE_REF, _M_fun_results.get()[i].is.unsafe_ref());
+          fun(VALUE_TYPE_REF, _M_fun_results.get()[i].fs.unsafe_ref());
+          fun(VALUE_TYPE_REF, _M_fun_results.get()[i].rs.unsafe_ref());
+        }
+      }
+
       ForkHandler *HashTableMemoizationCache::fork_handler() { return this; }
 
       void HashTableMemoizationCache::pre_fork()
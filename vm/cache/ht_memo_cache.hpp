@@ -41,6 +41,8 @@ namespace letin
         bool add_fun_result(std::size_t i, int value_type, const ArgumentList &args, const Value &fun_result, ThreadContext &context);
 
         void traverse_root_objects(std::function<void (Object *)> fun);
+
+        void traverse_root_refs(std::function<void (int, Reference &)> fun);
         
         ForkHandler *fork_handler();
 
@@ -0,0 +1,439 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <letin/vm.hpp>
+#include "bitmap_gc.hpp"
+#include "traverse.hpp"
+#include "vm.hpp"
+
+using namespace std;
+using namespace letin::vm::priv;
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace impl
+    {
+      BitmapGarbageCollector::BitmapGarbageCollector(Allocator *alloc, unsigned int interval_usecs, double growth_factor) :
+        ImplGarbageCollectorBase(alloc, interval_usecs, growth_factor),
+        _M_free_pages(nullptr),
+        _M_is_mark_stack_overflowed(false),
+        _M_gc_fork_handler(this)
+      {
+        static_assert(sizeof(LargeHeader) % ALIGNMENT == 0, "size of large header isn't multiple of alignment");
+        for(size_t i = 0; i < SIZE_CLASS_COUNT; i++) _M_partial_pages[i] = nullptr;
+        init_large_list(&_M_large_list);
+        init_large_list(&_M_immortal_list);
+        // The mark stack never grows because the threads are stopped in the mark phase
+        // and a stopped thread can hold a lock of the allocator.
+        _M_mark_stack.reserve(MARK_STACK_SIZE);
+        add_impl_fork_handler(&_M_gc_fork_handler);
+      }
+
+      BitmapGarbageCollector::~BitmapGarbageCollector()
+      {
+        for(auto arena : _M_arenas) {
+          for(auto &page : arena->pages) {
+            if(!page.is_used) continue;
+            for(size_t i = 0; i < page.bump; i++) {
+              if(test_bit(page.alloc_bits, i))
+                finalize_object(reinterpret_cast<Object *>(page.begin + i * page.cell_size));
+            }
+          }
+          _M_alloc->free(arena->area);
+          delete arena;
+        }
+        LargeHeader *lists[2] = { &_M_large_list, &_M_immortal_list };
+        for(auto list : lists) {
+          LargeHeader *header = list->next;
+          while(header != list) {
+            LargeHeader *next = header->next;
+            finalize_object(large_header_to_object(header));
+            _M_alloc->free(reinterpret_cast<void *>(header));
+            header = next;
+          }
+        }
+      }
+
+      void BitmapGarbageCollector::collect()
+      {
+        lock_guard<GarbageCollector> guard(*this);
+        CollectionTimes times = { 0, 0, 0, 0, 0 };
+        auto pause_start = chrono::high_resolution_clock::now();
+        {
+          lock_guard<Threads> guard2(_M_threads);
+          times.stop_usecs = usecs_since(pause_start);
+          auto mark_start = chrono::high_resolution_clock::now();
+          mark_all_objects();
+          times.mark_usecs = usecs_since(mark_start);
+        }
+        times.pause_usecs = usecs_since(pause_start);
+        auto sweep_start = chrono::high_resolution_clock::now();
+        LiveObjectCounts live_object_counts;
+        size_t live_byte_count = sweep_pages(live_object_counts);
+        live_byte_count += sweep_large_objects(live_object_counts);
+        clear_immortal_marks();
+        free_empty_arenas();
+        times.sweep_usecs = usecs_since(sweep_start);
+        set_live_byte_count(live_byte_count);
+        set_live_object_counts(live_object_counts);
+        add_collection_times(times);
+      }
+
+      void *BitmapGarbageCollector::allocate(size_t size, ThreadContext *context)
+      {
+        if(!add_allocated_byte_count(size)) return nullptr;
+        lock_guard<GarbageCollector> guard(*this);
+        void *ptr;
+        if(size <= MAX_CELL_SIZE) {
+          ptr = allocate_cell(size);
+          if(ptr == nullptr) return nullptr;
+        } else {
+          if(size > static_cast<size_t>(-1) - sizeof(LargeHeader)) return nullptr;
+          void *orig_ptr = _M_alloc->allocate(sizeof(LargeHeader) + size);
+          if(orig_ptr == nullptr) return nullptr;
+          memset(orig_ptr, 0, sizeof(LargeHeader) + size);
+          LargeHeader *header = reinterpret_cast<LargeHeader *>(orig_ptr);
+          header->size = size;
+          header->is_marked = false;
+          add_large_header(&_M_large_list, header);
+          ptr = reinterpret_cast<void *>(large_header_to_object(header));
+        }
+        if(context != nullptr) context->safely_set_gc_tmp_ptr_for_gc(ptr);
+        return ptr;
+      }
+
+      void *BitmapGarbageCollector::allocate_immortal_area(size_t size)
+      {
+        if(size > static_cast<size_t>(-1) - sizeof(LargeHeader)) return nullptr;
+        void *orig_ptr = _M_alloc->allocate(sizeof(LargeHeader) + size);
+        if(orig_ptr == nullptr) return nullptr;
+        add_immortal_byte_count(sizeof(LargeHeader) + size);
+        memset(orig_ptr, 0, sizeof(LargeHeader) + size);
+        LargeHeader *header = reinterpret_cast<LargeHeader *>(orig_ptr);
+        header->size = size;
+        header->is_marked = false;
+        {
+          lock_guard<GarbageCollector> guard(*this);
+          add_large_header(&_M_immortal_list, header);
+        }
+        return reinterpret_cast<void *>(large_header_to_object(header));
+      }
+
+      size_t BitmapGarbageCollector::header_size() { return 0; }
+
+      size_t BitmapGarbageCollector::size_class(size_t size)
+      {
+        if(size <= 256) return (size > 0 ? (size + 15) / 16 - 1 : 0);
+        size_t i = 16;
+        size_t base = 256;
+        while(size > base * 2) {
+          base *= 2;
+          i += 4;
+        }
+        return i + (size - base - 1) / (base / 4);
+      }
+
+      size_t BitmapGarbageCollector::size_class_cell_size(size_t size_class)
+      {
+        if(size_class < 16) return (size_class + 1) * 16;
+        size_t base = static_cast<size_t>(256) << ((size_class - 16) / 4);
+        return base + ((size_class - 16) % 4 + 1) * (base / 4);
+      }
+
+      BitmapGarbageCollector::Page *BitmapGarbageCollector::ptr_to_page(const void *ptr) const
+      {
+        uintptr_t tmp_ptr = reinterpret_cast<uintptr_t>(ptr);
+        auto iter = upper_bound(_M_arenas.begin(), _M_arenas.end(), tmp_ptr, [](uintptr_t ptr, const Arena *arena) {
+          return ptr < reinterpret_cast<uintptr_t>(arena->begin);
+        });
+        if(iter == _M_arenas.begin()) return nullptr;
+        Arena *arena = *(iter - 1);
+        uintptr_t arena_begin = reinterpret_cast<uintptr_t>(arena->begin);
+        if(tmp_ptr >= arena_begin + ARENA_PAGE_COUNT * PAGE_SIZE) return nullptr;
+        return &(arena->pages[(tmp_ptr - arena_begin) / PAGE_SIZE]);
+      }
+
+      void *BitmapGarbageCollector::allocate_cell(size_t size)
+      {
+        size_t i = size_class(size);
+        Page *page = _M_partial_pages[i];
+        if(page == nullptr) {
+          if(_M_free_pages == nullptr && !add_arena()) return nullptr;
+          page = _M_free_pages;
+          _M_free_pages = page->next;
+          page->free_cell = nullptr;
+          page->bump = 0;
+          page->cell_size = size_class_cell_size(i);
+          page->size_class = i;
+          page->live_cell_count = 0;
+          page->is_used = true;
+          memset(page->alloc_bits, 0, sizeof(page->alloc_bits));
+          memset(page->mark_bits, 0, sizeof(page->mark_bits));
+          add_partial_page(page);
+        }
+        Cell *cell;
+        size_t j;
+        if(page->free_cell != nullptr) {
+          cell = page->free_cell;
+          page->free_cell = cell->next;
+          j = static_cast<size_t>(reinterpret_cast<char *>(cell) - page->begin) / page->cell_size;
+        } else {
+          j = page->bump;
+          cell = reinterpret_cast<Cell *>(page->begin + j * page->cell_size);
+          page->bump++;
+        }
+        set_bit(page->alloc_bits, j);
+        page->live_cell_count++;
+        if(page->free_cell == nullptr && page->bump >= PAGE_SIZE / page->cell_size)
+          delete_partial_page(page);
+        memset(reinterpret_cast<void *>(cell), 0, page->cell_size);
+        return reinterpret_cast<void *>(cell);
+      }
+
+      bool BitmapGarbageCollector::add_arena()
+      {
+        Arena *arena = new(nothrow) Arena;
+        if(arena == nullptr) return false;
+        arena->area = _M_alloc->allocate(ARENA_PAGE_COUNT * PAGE_SIZE + ALIGNMENT);
+        if(arena->area == nullptr) {
+          delete arena;
+          return false;
+        }
+        uintptr_t begin = (reinterpret_cast<uintptr_t>(arena->area) + ALIGNMENT - 1) & ~static_cast<uintptr_t>(ALIGNMENT - 1);
+        arena->begin = reinterpret_cast<char *>(begin);
+        try {
+          auto iter = upper_bound(_M_arenas.begin(), _M_arenas.end(), arena, [](const Arena *arena1, const Arena *arena2) {
+            return reinterpret_cast<uintptr_t>(arena1->begin) < reinterpret_cast<uintptr_t>(arena2->begin);
+          });
+          _M_arenas.insert(iter, arena);
+        } catch(bad_alloc &) {
+          _M_alloc->free(arena->area);
+          delete arena;
+          return false;
+        }
+        for(size_t i = ARENA_PAGE_COUNT; i > 0; i--) {
+          Page *page = &(arena->pages[i - 1]);
+          page->prev = nullptr;
+          page->begin = arena->begin + (i - 1) * PAGE_SIZE;
+          page->cell_size = 0;
+          page->is_used = false;
+          page->is_partial = false;
+          page->next = _M_free_pages;
+          _M_free_pages = page;
+        }
+        return true;
+      }
+
+      void BitmapGarbageCollector::add_partial_page(Page *page)
+      {
+        Page *&first_page = _M_partial_pages[page->size_class];
+        page->prev = nullptr;
+        page->next = first_page;
+        if(first_page != nullptr) first_page->prev = page;
+        first_page = page;
+        page->is_partial = true;
+      }
+
+      void BitmapGarbageCollector::delete_partial_page(Page *page)
+      {
+        if(page->prev != nullptr)
+          page->prev->next = page->next;
+        else
+          _M_partial_pages[page->size_class] = page->next;
+        if(page->next != nullptr) page->next->prev = page->prev;
+        page->prev = page->next = nullptr;
+        page->is_partial = false;
+      }
+
+      void BitmapGarbageCollector::mark_object(Object *object)
+      {
+        Page *page = ptr_to_page(object);
+        if(page != nullptr) {
+          size_t i = static_cast<size_t>(reinterpret_cast<char *>(object) - page->begin) / page->cell_size;
+          if(test_bit(page->mark_bits, i)) return;
+          set_bit(page->mark_bits, i);
+        } else {
+          LargeHeader *header = object_to_large_header(object);
+          if(header->is_marked) return;
+          header->is_marked = true;
+        }
+        // The children of the object are marked by rescanning the marked objects if the
+        // mark stack is full.
+        if(_M_mark_stack.size() < _M_mark_stack.capacity())
+          _M_mark_stack.push_back(object);
+        else
+          _M_is_mark_stack_overflowed = true;
+      }
+
+      void BitmapGarbageCollector::mark_children(Object *object)
+      { for_each_child_object<false>(*object, [this](Object *child_object) { mark_object(child_object); }); }
+
+      void BitmapGarbageCollector::mark_objects_from_stack()
+      {
+        while(!_M_mark_stack.empty()) {
+          Object *object = _M_mark_stack.back();
+          _M_mark_stack.pop_back();
+          mark_children(object);
+        }
+      }
+
+      void BitmapGarbageCollector::mark_overflowed_objects()
+      {
+        for(auto arena : _M_arenas) {
+          for(auto &page : arena->pages) {
+            if(!page.is_used) continue;
+            for(size_t i = 0; i < page.bump; i++) {
+              if(test_bit(page.mark_bits, i)) {
+                mark_children(reinterpret_cast<Object *>(page.begin + i * page.cell_size));
+                mark_objects_from_stack();
+              }
+            }
+          }
+        }
+        LargeHeader *lists[2] = { &_M_large_list, &_M_immortal_list };
+        for(auto list : lists) {
+          for(LargeHeader *header = list->next; header != list; header = header->next) {
+            if(header->is_marked) {
+              mark_children(large_header_to_object(header));
+              mark_objects_from_stack();
+            }
+          }
+        }
+      }
+
+      void BitmapGarbageCollector::mark_all_objects()
+      {
+        _M_is_mark_stack_overflowed = false;
+        function<void (Object *)> fun = [this](Object *object) {
+          mark_object(object);
+          mark_objects_from_stack();
+        };
+        for(auto context : _M_thread_contexts) {
+          context->traverse_root_objects(fun);
+          // The object of the gc_tmp_ptr register can be uninitialized so its children
+          // aren't marked.
+          void *tmp_ptr = context->regs().gc_tmp_ptr;
+          if(tmp_ptr != nullptr) {
+            Page *page = ptr_to_page(tmp_ptr);
+            if(page != nullptr)
+              set_bit(page->mark_bits, static_cast<size_t>(reinterpret_cast<char *>(tmp_ptr) - page->begin) / page->cell_size);
+            else
+              object_to_large_header(reinterpret_cast<Object *>(tmp_ptr))->is_marked = true;
+          }
+        }
+        for(auto context : _M_vm_contexts) context->traverse_root_objects(fun);
+        while(_M_is_mark_stack_overflowed) {
+          _M_is_mark_stack_overflowed = false;
+          mark_overflowed_objects();
+        }
+      }
+
+      size_t BitmapGarbageCollector::sweep_pages(LiveObjectCounts &live_object_counts)
+      {
+        size_t live_byte_count = 0;
+        for(auto arena : _M_arenas) {
+          for(auto &page : arena->pages) {
+            if(!page.is_used) continue;
+            page.free_cell = nullptr;
+            page.live_cell_count = 0;
+            for(size_t i = page.bump; i > 0; i--) {
+              size_t j = i - 1;
+              Cell *cell = reinterpret_cast<Cell *>(page.begin + j * page.cell_size);
+              if(test_bit(page.alloc_bits, j)) {
+                if(test_bit(page.mark_bits, j)) {
+                  page.live_cell_count++;
+                  live_object_counts.add(reinterpret_cast<Object *>(cell));
+                  continue;
+                }
+                finalize_object(reinterpret_cast<Object *>(cell));
+                add_freed_byte_count(page.cell_size);
+                clear_bit(page.alloc_bits, j);
+              }
+              cell->next = page.free_cell;
+              page.free_cell = cell;
+            }
+            memset(page.mark_bits, 0, sizeof(page.mark_bits));
+            live_byte_count += page.live_cell_count * page.cell_size;
+            if(page.live_cell_count == 0) {
+              if(page.is_partial) delete_partial_page(&page);
+              page.is_used = false;
+              page.next = _M_free_pages;
+              _M_free_pages = &page;
+            } else if(page.free_cell != nullptr && !page.is_partial) {
+              add_partial_page(&page);
+            }
+          }
+        }
+        return live_byte_count;
+      }
+
+      size_t BitmapGarbageCollector::sweep_large_objects(LiveObjectCounts &live_object_counts)
+      {
+        size_t live_byte_count = 0;
+        LargeHeader *header = _M_large_list.next;
+        while(header != &_M_large_list) {
+          LargeHeader *next = header->next;
+          if(header->is_marked) {
+            header->is_marked = false;
+            live_byte_count += sizeof(LargeHeader) + header->size;
+            live_object_counts.add(large_header_to_object(header));
+          } else {
+            finalize_object(large_header_to_object(header));
+            add_freed_byte_count(sizeof(LargeHeader) + header->size);
+            delete_large_header(header);
+            _M_alloc->free(reinterpret_cast<void *>(header));
+          }
+          header = next;
+        }
+        return live_byte_count;
+      }
+
+      void BitmapGarbageCollector::clear_immortal_marks()
+      {
+        for(LargeHeader *header = _M_immortal_list.next; header != &_M_immortal_list; header = header->next)
+          header->is_marked = false;
+      }
+
+      void BitmapGarbageCollector::free_empty_arenas()
+      {
+        if(_M_arenas.size() <= 1) return;
+        bool is_freed = false;
+        for(size_t i = 0; i < _M_arenas.size(); ) {
+          Arena *arena = _M_arenas[i];
+          bool is_empty = all_of(begin(arena->pages), end(arena->pages), [](const Page &page) { return !page.is_used; });
+          if(is_empty && _M_arenas.size() > 1) {
+            _M_alloc->free(arena->area);
+            delete arena;
+            _M_arenas.erase(_M_arenas.begin() + i);
+            is_freed = true;
+          } else
+            i++;
+        }
+        if(is_freed) {
+          _M_free_pages = nullptr;
+          for(auto arena : _M_arenas) {
+            for(size_t i = ARENA_PAGE_COUNT; i > 0; i--) {
+              Page *page = &(arena->pages[i - 1]);
+              if(!page->is_used) {
+                page->next = _M_free_pages;
+                _M_free_pages = page;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,164 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#ifndef _GC_BITMAP_GC_HPP
+#define _GC_BITMAP_GC_HPP
+
+#include <cstdint>
+#include <vector>
+#include "impl_gc_base.hpp"
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace impl
+    {
+      //
+      // The bitmap garbage collector is a mark-sweep garbage collector without object
+      // headers for small objects. Small objects are allocated in cells of pages and the
+      // pages are grouped in arenas. The allocation bits and the mark bits of cells are
+      // held in a side table of the arena, so the collector finds objects by walking
+      // pages and the mark phase doesn't write to the pages of objects. Large objects
+      // have a header with a list link and a mark flag.
+      //
+      class BitmapGarbageCollector : public ImplGarbageCollectorBase
+      {
+        static const std::size_t ALIGNMENT = 16;
+        static const std::size_t PAGE_SIZE = 32 * 1024;
+        static const std::size_t ARENA_PAGE_COUNT = 32;
+        static const std::size_t MAX_CELL_SIZE = 2048;
+        static const std::size_t SIZE_CLASS_COUNT = 28;
+        static const std::size_t BITMAP_WORD_COUNT = PAGE_SIZE / ALIGNMENT / 64;
+        static const std::size_t MARK_STACK_SIZE = 64 * 1024;
+
+        struct Cell
+        {
+          Cell *next;
+        };
+
+        struct Page
+        {
+          Page *prev;
+          Page *next;
+          char *begin;
+          Cell *free_cell;
+          std::size_t bump;
+          std::size_t cell_size;
+          std::size_t size_class;
+          std::size_t live_cell_count;
+          bool is_used;
+          bool is_partial;
+          std::uint64_t alloc_bits[BITMAP_WORD_COUNT];
+          std::uint64_t mark_bits[BITMAP_WORD_COUNT];
+        };
+
+        struct Arena
+        {
+          void *area;
+          char *begin;
+          Page pages[ARENA_PAGE_COUNT];
+        };
+
+        struct LargeHeader
+        {
+          LargeHeader *prev;
+          LargeHeader *next;
+          std::size_t size;
+          bool is_marked;
+        };
+
+        std::vector<Arena *> _M_arenas;
+        Page *_M_free_pages;
+        Page *_M_partial_pages[SIZE_CLASS_COUNT];
+        LargeHeader _M_large_list;
+        LargeHeader _M_immortal_list;
+        std::vector<Object *> _M_mark_stack;
+        bool _M_is_mark_stack_overflowed;
+        ImplForkHandler _M_gc_fork_handler;
+      public:
+        BitmapGarbageCollector(Allocator *alloc, unsigned int interval_usecs = 100000, double growth_factor = 0.0);
+
+        ~BitmapGarbageCollector();
+
+        void collect();
+
+        void *allocate(std::size_t size, ThreadContext *context);
+
+        void *allocate_immortal_area(std::size_t size);
+
+        std::size_t header_size();
+      private:
+        static std::size_t size_class(std::size_t size);
+
+        static std::size_t size_class_cell_size(std::size_t size_class);
+
+        static Object *large_header_to_object(LargeHeader *header)
+        { return reinterpret_cast<Object *>(reinterpret_cast<char *>(header) + sizeof(LargeHeader)); }
+
+        static LargeHeader *object_to_large_header(Object *object)
+        { return reinterpret_cast<LargeHeader *>(reinterpret_cast<char *>(object) - sizeof(LargeHeader)); }
+
+        static void init_large_list(LargeHeader *list)
+        { list->prev = list->next = list; }
+
+        static void add_large_header(LargeHeader *list, LargeHeader *header)
+        {
+          header->prev = list->prev;
+          header->next = list;
+          list->prev->next = header;
+          list->prev = header;
+        }
+
+        static void delete_large_header(LargeHeader *header)
+        {
+          header->prev->next = header->next;
+          header->next->prev = header->prev;
+        }
+
+        static bool test_bit(const std::uint64_t *bits, std::size_t i)
+        { return (bits[i >> 6] & (static_cast<std::uint64_t>(1) << (i & 63))) != 0; }
+
+        static void set_bit(std::uint64_t *bits, std::size_t i)
+        { bits[i >> 6] |= static_cast<std::uint64_t>(1) << (i & 63); }
+
+        static void clear_bit(std::uint64_t *bits, std::size_t i)
+        { bits[i >> 6] &= ~(static_cast<std::uint64_t>(1) << (i & 63)); }
+
+        Page *ptr_to_page(const void *ptr) const;
+
+        void *allocate_cell(std::size_t size);
+
+        bool add_arena();
+
+        void add_partial_page(Page *page);
+
+        void delete_partial_page(Page *page);
+
+        void mark_object(Object *object);
+
+        void mark_children(Object *object);
+
+        void mark_objects_from_stack();
+
+        void mark_overflowed_objects();
+
+        void mark_all_objects();
+
+        std::size_t sweep_pages(LiveObjectCounts &live_object_counts);
+
+        std::size_t sweep_large_objects(LiveObjectCounts &live_object_counts);
+
+        void clear_immortal_marks();
+
+        void free_empty_arenas();
+      };
+    }
+  }
+}
+
+#endif
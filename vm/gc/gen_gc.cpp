@@ -0,0 +1,933 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <csetjmp>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <letin/vm.hpp>
+#include "gen_gc.hpp"
+#include "traverse.hpp"
+#include "vm.hpp"
+
+// The system stacks are scanned conservatively so their reads can't be checked by the
+// address sanitizer.
+#if defined(__GNUC__) || defined(__clang__)
+#define _GC_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#else
+#define _GC_NO_SANITIZE_ADDRESS
+#endif
+
+using namespace std;
+using namespace letin::vm::priv;
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace impl
+    {
+      GenerationalGarbageCollector::GenerationalGarbageCollector(Allocator *alloc,
+          unsigned int interval_usecs, size_t nursery_size, double growth_factor, double compaction_threshold) :
+        ImplGarbageCollectorBase(alloc, interval_usecs, growth_factor),
+        _M_chunk_count(max<size_t>((nursery_size + CHUNK_SIZE - 1) / CHUNK_SIZE, 1)),
+        _M_current_chunk(NO_CHUNK),
+        _M_free_pages(nullptr),
+        _M_free_page_count(0),
+        _M_young_large_count(0),
+        _M_stack_top(nullptr),
+        _M_has_young_child(false),
+        _M_is_promotion_disabled(false),
+        _M_old_size(0),
+        _M_major_threshold(MIN_MAJOR_THRESHOLD),
+        _M_compaction_threshold(compaction_threshold),
+        _M_is_compacting(false),
+        _M_lock_count(0),
+        _M_gc_fork_handler(this)
+      {
+        static_assert(sizeof(Header) == ALIGNMENT, "size of header isn't equal to alignment");
+        static_assert(sizeof(LargeLink) == ALIGNMENT, "size of large link isn't equal to alignment");
+        static_assert(sizeof(Page) <= PAGE_HEADER_SIZE, "size of page is greater than size of page header");
+        _M_nursery_area = _M_alloc->allocate(_M_chunk_count * CHUNK_SIZE + CHUNK_SIZE);
+        if(_M_nursery_area == nullptr) throw bad_alloc();
+        uintptr_t nursery_begin = reinterpret_cast<uintptr_t>(_M_nursery_area);
+        nursery_begin = (nursery_begin + CHUNK_SIZE - 1) & ~static_cast<uintptr_t>(CHUNK_SIZE - 1);
+        _M_nursery_begin = reinterpret_cast<char *>(nursery_begin);
+        _M_nursery_end = _M_nursery_begin + _M_chunk_count * CHUNK_SIZE;
+        Chunk chunk;
+        chunk.top = 0;
+        chunk.is_used = false;
+        chunk.is_pinned = false;
+        _M_chunks.resize(_M_chunk_count, chunk);
+        _M_free_chunks.reserve(_M_chunk_count);
+        for(size_t i = _M_chunk_count; i > 0; i--) _M_free_chunks.push_back(i - 1);
+        for(size_t i = 0; i < SIZE_CLASS_COUNT; i++) _M_partial_pages[i] = nullptr;
+        init_large_list(&_M_young_large_list);
+        init_large_list(&_M_old_large_list);
+        init_large_list(&_M_immortal_list);
+        init_large_list(&_M_dead_large_list);
+        add_impl_fork_handler(&_M_gc_fork_handler);
+      }
+
+      GenerationalGarbageCollector::~GenerationalGarbageCollector()
+      {
+        for(size_t i = 0; i < _M_chunk_count; i++) {
+          if(!_M_chunks[i].is_used) continue;
+          char *ptr = chunk_begin(i);
+          char *end = ptr + _M_chunks[i].top;
+          while(ptr < end) {
+            Header *header = reinterpret_cast<Header *>(ptr);
+            if(!header->has(FLAG_FORWARDED | FLAG_DEAD)) finalize_object(header_to_object(header));
+            ptr += header->size();
+          }
+        }
+        for(auto area : _M_arenas) {
+          for(size_t i = 0; i < ARENA_PAGE_COUNT; i++) {
+            Page *page = arena_page(area, i);
+            if(page->cell_size == 0) continue;
+            for(size_t j = PAGE_HEADER_SIZE; j < page->bump; j += page->cell_size) {
+              Header *header = reinterpret_cast<Header *>(reinterpret_cast<char *>(page) + j);
+              if(header->bits != 0) finalize_object(header_to_object(header));
+            }
+          }
+          _M_alloc->free(area);
+        }
+        LargeLink *lists[3] = { &_M_young_large_list, &_M_old_large_list, &_M_immortal_list };
+        for(auto list : lists) {
+          LargeLink *link = list->next;
+          while(link != list) {
+            LargeLink *next = link->next;
+            finalize_object(header_to_object(large_link_to_header(link)));
+            _M_alloc->free(reinterpret_cast<void *>(link));
+            link = next;
+          }
+        }
+        _M_alloc->free(_M_nursery_area);
+      }
+
+      void GenerationalGarbageCollector::collect()
+      {
+        lock_guard<GarbageCollector> guard(*this);
+        ThreadContext *current_context = nullptr;
+        for(auto context : _M_thread_contexts) {
+          if(context->system_thread().get_id() == this_thread::get_id()) current_context = context;
+        }
+        collect_in_lock(current_context);
+      }
+
+      void GenerationalGarbageCollector::write_barrier(Object *object, ThreadContext *context)
+      {
+        if(object == nullptr || object == Reference().ptr()) return;
+        Header *header = object_to_header(object);
+        if(header->is_young() || header->kind() == KIND_IMMORTAL) return;
+        if(context != nullptr) context->regs().gc_written_object = object;
+        if(header->has(FLAG_REMEMBERED)) return;
+        lock_guard<GarbageCollector> guard(*this);
+        if(!header->has(FLAG_REMEMBERED)) {
+          _M_remembered.push_back(header);
+          header->set(FLAG_REMEMBERED);
+        }
+      }
+
+      void *GenerationalGarbageCollector::allocate(size_t size, ThreadContext *context)
+      {
+        size_t block_size = align(sizeof(Header) + size);
+        if(!add_allocated_byte_count(block_size)) return nullptr;
+        lock_guard<GarbageCollector> guard(*this);
+        Header *header = nullptr;
+        if(block_size <= MAX_NURSERY_BLOCK_SIZE) {
+          header = allocate_from_nursery(block_size);
+          if(header == nullptr && can_collect_in_allocation(context)) {
+            collect_in_lock(context);
+            header = allocate_from_nursery(block_size);
+          }
+        }
+        if(header == nullptr) {
+          header = allocate_large(&_M_young_large_list, block_size);
+          if(header == nullptr) return nullptr;
+          header->bits = (block_size << FLAG_SHIFT) | KIND_LARGE | FLAG_YOUNG;
+          _M_young_large_count++;
+        }
+        void *ptr = reinterpret_cast<void *>(header_to_object(header));
+        if(context != nullptr) context->safely_set_gc_tmp_ptr_for_gc(ptr);
+        return ptr;
+      }
+
+      void *GenerationalGarbageCollector::allocate_immortal_area(size_t size)
+      {
+        size_t block_size = align(sizeof(Header) + size);
+        lock_guard<GarbageCollector> guard(*this);
+        Header *header = allocate_large(&_M_immortal_list, block_size);
+        if(header == nullptr) return nullptr;
+        add_immortal_byte_count(block_size);
+        header->bits = (block_size << FLAG_SHIFT) | KIND_IMMORTAL;
+        return reinterpret_cast<void *>(header_to_object(header));
+      }
+
+      size_t GenerationalGarbageCollector::header_size() { return sizeof(Header); }
+
+      void GenerationalGarbageCollector::lock()
+      {
+        ImplGarbageCollectorBase::lock();
+        _M_lock_count++;
+      }
+
+      void GenerationalGarbageCollector::unlock()
+      {
+        _M_lock_count--;
+        ImplGarbageCollectorBase::unlock();
+      }
+
+      size_t GenerationalGarbageCollector::size_class(size_t size)
+      {
+        if(size <= 256) return (size - 1) / 16 - 1;
+        size_t i = 15;
+        size_t base = 256;
+        while(size > base * 2) {
+          base *= 2;
+          i += 4;
+        }
+        return i + (size - base - 1) / (base / 4);
+      }
+
+      size_t GenerationalGarbageCollector::size_class_cell_size(size_t size_class)
+      {
+        if(size_class < 15) return (size_class + 2) * 16;
+        size_t base = static_cast<size_t>(256) << ((size_class - 15) / 4);
+        return base + ((size_class - 15) % 4 + 1) * (base / 4);
+      }
+
+      GenerationalGarbageCollector::Header *GenerationalGarbageCollector::allocate_from_nursery(size_t block_size)
+      {
+        if(_M_current_chunk == NO_CHUNK || _M_chunks[_M_current_chunk].top + block_size > CHUNK_SIZE) {
+          if(_M_free_chunks.empty()) return nullptr;
+          _M_current_chunk = _M_free_chunks.back();
+          _M_free_chunks.pop_back();
+          _M_chunks[_M_current_chunk].top = 0;
+          _M_chunks[_M_current_chunk].is_used = true;
+          memset(chunk_begin(_M_current_chunk), 0, CHUNK_SIZE);
+        }
+        Chunk &chunk = _M_chunks[_M_current_chunk];
+        Header *header = reinterpret_cast<Header *>(chunk_begin(_M_current_chunk) + chunk.top);
+        chunk.top += block_size;
+        header->bits = (block_size << FLAG_SHIFT) | KIND_NURSERY;
+        header->link = nullptr;
+        return header;
+      }
+
+      GenerationalGarbageCollector::Header *GenerationalGarbageCollector::allocate_large(LargeLink *list, size_t block_size)
+      {
+        void *ptr = _M_alloc->allocate(sizeof(LargeLink) + block_size);
+        if(ptr == nullptr) return nullptr;
+        memset(ptr, 0, sizeof(LargeLink) + block_size);
+        LargeLink *link = reinterpret_cast<LargeLink *>(ptr);
+        add_large_link(list, link);
+        return large_link_to_header(link);
+      }
+
+      bool GenerationalGarbageCollector::can_collect_in_allocation(ThreadContext *context)
+      {
+        return _M_lock_count == 1 && context != nullptr &&
+          _M_thread_contexts.find(context) != _M_thread_contexts.end() &&
+          context->system_thread().get_id() == this_thread::get_id() &&
+          context->system_stack_bottom() != nullptr &&
+          !context->interruptible_fun_flag();
+      }
+
+      GenerationalGarbageCollector::Header *GenerationalGarbageCollector::allocate_cell(size_t block_size)
+      {
+        size_t i = size_class(block_size);
+        Page *page = _M_partial_pages[i];
+        if(page == nullptr) {
+          if(_M_free_pages == nullptr) return nullptr;
+          page = _M_free_pages;
+          _M_free_pages = page->next;
+          _M_free_page_count--;
+          page->free_cell = nullptr;
+          page->bump = PAGE_HEADER_SIZE;
+          page->cell_size = size_class_cell_size(i);
+          page->size_class = i;
+          page->live_cell_count = 0;
+          page->is_partial = false;
+          add_partial_page(page);
+        }
+        Header *header;
+        if(page->free_cell != nullptr) {
+          header = page->free_cell;
+          page->free_cell = header->link;
+        } else {
+          header = reinterpret_cast<Header *>(reinterpret_cast<char *>(page) + page->bump);
+          page->bump += page->cell_size;
+        }
+        page->live_cell_count++;
+        if(page->free_cell == nullptr && page->bump + page->cell_size > PAGE_SIZE)
+          delete_partial_page(page);
+        return header;
+      }
+
+      void GenerationalGarbageCollector::free_cell(Page *page, Header *header)
+      {
+        header->bits = 0;
+        header->link = page->free_cell;
+        page->free_cell = header;
+        page->live_cell_count--;
+      }
+
+      bool GenerationalGarbageCollector::add_arena()
+      {
+        void *area = _M_alloc->allocate(ARENA_PAGE_COUNT * PAGE_SIZE + PAGE_SIZE);
+        if(area == nullptr) return false;
+        try {
+          // The arenas are sorted for finding a page of a pointer.
+          _M_arenas.insert(upper_bound(_M_arenas.begin(), _M_arenas.end(), area), area);
+        } catch(bad_alloc &) {
+          _M_alloc->free(area);
+          return false;
+        }
+        for(size_t i = ARENA_PAGE_COUNT; i > 0; i--) {
+          Page *page = arena_page(area, i - 1);
+          page->cell_size = 0;
+          page->is_pinned = false;
+          page->is_evacuated = false;
+          page->next = _M_free_pages;
+          _M_free_pages = page;
+          _M_free_page_count++;
+        }
+        return true;
+      }
+
+      void GenerationalGarbageCollector::add_partial_page(Page *page)
+      {
+        Page *&first_page = _M_partial_pages[page->size_class];
+        page->prev = nullptr;
+        page->next = first_page;
+        if(first_page != nullptr) first_page->prev = page;
+        first_page = page;
+        page->is_partial = true;
+      }
+
+      void GenerationalGarbageCollector::delete_partial_page(Page *page)
+      {
+        if(page->prev != nullptr)
+          page->prev->next = page->next;
+        else
+          _M_partial_pages[page->size_class] = page->next;
+        if(page->next != nullptr) page->next->prev = page->prev;
+        page->prev = page->next = nullptr;
+        page->is_partial = false;
+      }
+
+      GenerationalGarbageCollector::Page *GenerationalGarbageCollector::ptr_to_page(const void *ptr) const
+      {
+        auto iter = upper_bound(_M_arenas.begin(), _M_arenas.end(), ptr, [](const void *ptr, void *area) {
+          return reinterpret_cast<uintptr_t>(ptr) < reinterpret_cast<uintptr_t>(area);
+        });
+        if(iter == _M_arenas.begin()) return nullptr;
+        uintptr_t tmp_ptr = reinterpret_cast<uintptr_t>(ptr);
+        uintptr_t begin = arena_begin(*(iter - 1));
+        if(tmp_ptr < begin || tmp_ptr >= begin + ARENA_PAGE_COUNT * PAGE_SIZE) return nullptr;
+        return reinterpret_cast<Page *>(tmp_ptr & ~static_cast<uintptr_t>(PAGE_SIZE - 1));
+      }
+
+      void GenerationalGarbageCollector::prepare_for_collection()
+      {
+        // Memory for the collection is allocated before stopping the threads because a
+        // stopped thread can hold a lock of the allocator.
+        size_t nursery_size = 0;
+        for(auto &chunk : _M_chunks) {
+          if(chunk.is_used) nursery_size += chunk.top;
+        }
+        prepare_sample_moves();
+        size_t page_count = nursery_size / 2 / (PAGE_SIZE - PAGE_HEADER_SIZE) + SIZE_CLASS_COUNT;
+        while(_M_free_page_count < page_count) {
+          if(!add_arena()) break;
+        }
+        try {
+          _M_remembered.reserve(_M_remembered.size() + nursery_size / (2 * ALIGNMENT) + _M_young_large_count);
+          _M_young_large_headers.clear();
+          _M_young_large_headers.reserve(_M_young_large_count);
+          for(LargeLink *link = _M_young_large_list.next; link != &_M_young_large_list; link = link->next)
+            _M_young_large_headers.push_back(large_link_to_header(link));
+          sort(_M_young_large_headers.begin(), _M_young_large_headers.end());
+          _M_is_promotion_disabled = false;
+        } catch(bad_alloc &) {
+          _M_young_large_headers.clear();
+          _M_is_promotion_disabled = true;
+        }
+      }
+
+      void GenerationalGarbageCollector::collect_in_lock(ThreadContext *current_context)
+      {
+        prepare_for_collection();
+        CollectionTimes times = { 0, 0, 0, 0, 0 };
+        bool is_major;
+        auto pause_start = chrono::high_resolution_clock::now();
+        {
+          lock_guard<Threads> guard(_M_threads);
+          times.stop_usecs = usecs_since(pause_start);
+          auto mark_start = chrono::high_resolution_clock::now();
+          jmp_buf saved_regs;
+          setjmp(saved_regs);
+          pin_objects(current_context, reinterpret_cast<void *>(&saved_regs));
+          evacuate_young_objects();
+          promote_young_large_objects();
+          is_major = (_M_old_size >= _M_major_threshold);
+          if(is_major) mark_all_objects();
+          times.mark_usecs = usecs_since(mark_start);
+        }
+        times.pause_usecs = usecs_since(pause_start);
+        // The samples are moved after continuing the threads because the moving allocates
+        // memory.
+        apply_sample_moves();
+        auto sweep_start = chrono::high_resolution_clock::now();
+        LiveObjectCounts live_object_counts;
+        finalize_young_objects(live_object_counts);
+        LargeLink *link = _M_dead_large_list.next;
+        while(link != &_M_dead_large_list) {
+          LargeLink *next = link->next;
+          Header *header = large_link_to_header(link);
+          finalize_object(header_to_object(header));
+          add_freed_byte_count(header->size());
+          _M_alloc->free(reinterpret_cast<void *>(link));
+          link = next;
+        }
+        init_large_list(&_M_dead_large_list);
+        if(is_major) {
+          sweep_old_objects(live_object_counts);
+          if(_M_compaction_threshold != 0.0) compact_old_objects(current_context, times);
+          _M_major_threshold = max(static_cast<size_t>(MIN_MAJOR_THRESHOLD), _M_old_size * 2);
+          // Only the major collection visits all objects.
+          set_live_object_counts(live_object_counts);
+        }
+        times.sweep_usecs = usecs_since(sweep_start);
+        set_live_byte_count(_M_old_size);
+        add_collection_times(times);
+      }
+
+      void GenerationalGarbageCollector::pin_ptr(const void *ptr)
+      {
+        if(_M_is_compacting) {
+          Page *page = ptr_to_page(ptr);
+          if(page != nullptr) page->is_pinned = true;
+          return;
+        }
+        if(is_in_nursery(ptr)) {
+          _M_chunks[chunk_index(ptr)].is_pinned = true;
+        } else if(!_M_young_large_headers.empty()) {
+          const Header *header_ptr = reinterpret_cast<const Header *>(ptr);
+          auto iter = upper_bound(_M_young_large_headers.begin(), _M_young_large_headers.end(), header_ptr);
+          if(iter == _M_young_large_headers.begin()) return;
+          Header *header = *(iter - 1);
+          if(reinterpret_cast<const char *>(ptr) < reinterpret_cast<const char *>(header) + header->size())
+            header->set(FLAG_PINNED);
+        }
+      }
+
+      _GC_NO_SANITIZE_ADDRESS void GenerationalGarbageCollector::pin_system_stack(void *top, void *bottom)
+      {
+        uintptr_t begin = reinterpret_cast<uintptr_t>(top);
+        uintptr_t end = reinterpret_cast<uintptr_t>(bottom);
+        if(begin > end) swap(begin, end);
+        begin = (begin + sizeof(void *) - 1) & ~static_cast<uintptr_t>(sizeof(void *) - 1);
+        for(uintptr_t ptr = begin; ptr + sizeof(void *) <= end; ptr += sizeof(void *))
+          pin_ptr(*reinterpret_cast<void *const volatile *>(ptr));
+#ifdef LETIN_COMPRESSED_REFERENCES
+        // The system stack also can contain compressed references. A compressed reference
+        // is an offset of an object so it is aligned.
+        for(uintptr_t ptr = begin; ptr + sizeof(uint32_t) <= end; ptr += sizeof(uint32_t)) {
+          uint32_t offset = *reinterpret_cast<const volatile uint32_t *>(ptr);
+          if(offset != 0 && (offset & (sizeof(void *) - 1)) == 0)
+            pin_ptr(reinterpret_cast<void *>(Reference::heap_base() + offset));
+        }
+#endif
+      }
+
+      void GenerationalGarbageCollector::pin_objects(ThreadContext *current_context, void *current_stack_top)
+      {
+        if(!_M_is_compacting) {
+          for(auto &chunk : _M_chunks) chunk.is_pinned = false;
+          if(_M_is_promotion_disabled) {
+            for(auto &chunk : _M_chunks) chunk.is_pinned = chunk.is_used;
+            return;
+          }
+        }
+        for(auto context : _M_thread_contexts) {
+          // Objects that are referenced by pointers on the system stack can't be moved.
+          void *stack_bottom = context->system_stack_bottom();
+          if(stack_bottom != nullptr) {
+            if(context == current_context)
+              pin_system_stack(current_stack_top, stack_bottom);
+            else if(context->system_stack_top() != nullptr)
+              pin_system_stack(context->system_stack_top(), stack_bottom);
+          }
+          if(context->regs().gc_tmp_ptr != nullptr) pin_ptr(context->regs().gc_tmp_ptr);
+          // A thread can write to the old object after the write barrier.
+          if(_M_is_compacting && context->regs().gc_written_object != nullptr)
+            pin_ptr(context->regs().gc_written_object);
+          for(size_t i = 0; i < context->regs().cutc; i++)
+            pin_ptr(context->regs().cancelation_undo_types[i]);
+          // Values that are being assigned can have a type that isn't a reference type.
+          size_t stack_elem_count = min(context->regs().sec + MAX_SCANNED_STACK_ELEM_COUNT, context->stack_size());
+          for(size_t i = 0; i < stack_elem_count; i++) {
+            const Value &value = context->stack_elem(i);
+            if(i >= context->regs().sec || !is_ref_value_type_for_gc(value.type()) || value.type() == VALUE_TYPE_LOCKED_LAZY_VALUE_REF)
+              pin_ptr(value.raw().r.ptr());
+          }
+          size_t expr_stack_elem_count = min(context->regs().esec + MAX_SCANNED_STACK_ELEM_COUNT, context->expr_stack_size());
+          for(size_t i = 0; i < expr_stack_elem_count; i++) {
+            const Value &value = context->expr_stack_elem(i);
+            if(i >= context->regs().esec || !is_ref_value_type_for_gc(value.type()) || value.type() == VALUE_TYPE_LOCKED_LAZY_VALUE_REF)
+              pin_ptr(value.raw().r.ptr());
+          }
+          if(context->interruptible_fun_flag()) {
+            context->traverse_root_refs([this](int type, Reference &ref) {
+              pin_ptr(ref.ptr());
+            });
+          }
+        }
+      }
+
+      void GenerationalGarbageCollector::evacuate(int type, Reference &ref)
+      {
+        if(!is_ref_value_type_for_gc(type) || ref.ptr() == nullptr || ref.has_nil()) return;
+        Header *header = object_to_header(ref.ptr());
+        switch(header->kind()) {
+          case KIND_NURSERY:
+          {
+            if(header->has(FLAG_FORWARDED)) {
+              ref = header_to_object(header->link);
+              return;
+            }
+            Chunk &chunk = _M_chunks[chunk_index(header)];
+            if(!chunk.is_pinned) {
+              Header *new_header = allocate_cell(header->size());
+              if(new_header != nullptr) {
+                memcpy(new_header, header, header->size());
+                new_header->bits = (header->size() << FLAG_SHIFT) | KIND_CELL;
+                new_header->link = nullptr;
+                header->set(FLAG_FORWARDED);
+                header->link = new_header;
+                move_sample(header_to_object(header), header_to_object(new_header));
+                _M_old_size += header->size();
+                ref = header_to_object(new_header);
+                push_header(new_header);
+                return;
+              }
+              // The chunk is pinned because the old generation hasn't free cells.
+              chunk.is_pinned = true;
+            }
+            if(!header->has(FLAG_VISITED)) {
+              header->set(FLAG_VISITED);
+              push_header(header);
+            }
+            _M_has_young_child = true;
+            return;
+          }
+          case KIND_LARGE:
+            if(header->has(FLAG_YOUNG)) {
+              if(!header->has(FLAG_VISITED)) {
+                header->set(FLAG_VISITED);
+                push_header(header);
+              }
+              if(header->has(FLAG_PINNED) || _M_is_promotion_disabled) _M_has_young_child = true;
+            }
+            return;
+          default:
+            return;
+        }
+      }
+
+      void GenerationalGarbageCollector::scan_gray_objects()
+      {
+        auto fun = [this](int type, Reference &ref) { evacuate(type, ref); };
+        while(!is_empty_stack()) {
+          Header *header = pop_header();
+          _M_has_young_child = false;
+          for_each_child_ref(*header_to_object(header), fun);
+          bool is_promoted = header->kind() == KIND_CELL ||
+            (header->kind() == KIND_LARGE && !header->has(FLAG_PINNED) && !_M_is_promotion_disabled);
+          if(is_promoted && _M_has_young_child && !header->has(FLAG_REMEMBERED)) {
+            header->set(FLAG_REMEMBERED);
+            _M_remembered.push_back(header);
+          }
+        }
+      }
+
+      void GenerationalGarbageCollector::evacuate_young_objects()
+      {
+        auto fun = [this](int type, Reference &ref) { evacuate(type, ref); };
+        _M_stack_top = nullptr;
+        for(auto context : _M_thread_contexts) {
+          context->traverse_root_refs(fun);
+          if(context->regs().gc_tmp_ptr != nullptr) {
+            Reference tmp_ref(reinterpret_cast<Object *>(context->regs().gc_tmp_ptr));
+            evacuate(VALUE_TYPE_REF, tmp_ref);
+          }
+        }
+        for(auto context : _M_vm_contexts) context->traverse_root_refs(fun);
+        for(LargeLink *link = _M_immortal_list.next; link != &_M_immortal_list; link = link->next)
+          for_each_child_ref(*header_to_object(large_link_to_header(link)), fun);
+        size_t j = 0;
+        for(size_t i = 0; i < _M_remembered.size(); i++) {
+          Header *header = _M_remembered[i];
+          _M_has_young_child = false;
+          for_each_child_ref(*header_to_object(header), fun);
+          if(_M_has_young_child || is_written_object(header))
+            _M_remembered[j++] = header;
+          else
+            header->clear(FLAG_REMEMBERED);
+        }
+        _M_remembered.resize(j);
+        scan_gray_objects();
+      }
+
+      void GenerationalGarbageCollector::promote_young_large_objects()
+      {
+        LargeLink *link = _M_young_large_list.next;
+        while(link != &_M_young_large_list) {
+          LargeLink *next = link->next;
+          Header *header = large_link_to_header(link);
+          if(header->has(FLAG_VISITED)) {
+            if(!header->has(FLAG_PINNED) && !_M_is_promotion_disabled) {
+              delete_large_link(link);
+              add_large_link(&_M_old_large_list, link);
+              header->clear(FLAG_YOUNG);
+              _M_old_size += header->size();
+              _M_young_large_count--;
+            }
+          } else {
+            delete_large_link(link);
+            add_large_link(&_M_dead_large_list, link);
+            _M_young_large_count--;
+          }
+          header->clear(FLAG_VISITED | FLAG_PINNED);
+          link = next;
+        }
+      }
+
+      void GenerationalGarbageCollector::mark(int type, Reference &ref)
+      {
+        if(!is_ref_value_type_for_gc(type) || ref.ptr() == nullptr || ref.has_nil()) return;
+        Header *header = object_to_header(ref.ptr());
+        if(header->kind() != KIND_IMMORTAL && !header->has(FLAG_MARKED)) {
+          header->set(FLAG_MARKED);
+          push_header(header);
+        }
+      }
+
+      void GenerationalGarbageCollector::mark_all_objects()
+      {
+        auto fun = [this](int type, Reference &ref) { mark(type, ref); };
+        _M_stack_top = nullptr;
+        for(auto context : _M_thread_contexts) {
+          context->traverse_root_refs(fun);
+          if(context->regs().gc_tmp_ptr != nullptr) {
+            Reference tmp_ref(reinterpret_cast<Object *>(context->regs().gc_tmp_ptr));
+            mark(VALUE_TYPE_REF, tmp_ref);
+          }
+          if(context->regs().gc_written_object != nullptr) {
+            Reference tmp_ref(context->regs().gc_written_object);
+            mark(VALUE_TYPE_REF, tmp_ref);
+          }
+        }
+        for(auto context : _M_vm_contexts) context->traverse_root_refs(fun);
+        for(LargeLink *link = _M_immortal_list.next; link != &_M_immortal_list; link = link->next)
+          for_each_child_ref(*header_to_object(large_link_to_header(link)), fun);
+        while(!is_empty_stack()) for_each_child_ref(*header_to_object(pop_header()), fun);
+        size_t j = 0;
+        for(size_t i = 0; i < _M_remembered.size(); i++) {
+          Header *header = _M_remembered[i];
+          if(header->has(FLAG_MARKED))
+            _M_remembered[j++] = header;
+          else
+            header->clear(FLAG_REMEMBERED);
+        }
+        _M_remembered.resize(j);
+      }
+
+      void GenerationalGarbageCollector::finalize_young_objects(LiveObjectCounts &live_object_counts)
+      {
+        for(size_t i = 0; i < _M_chunk_count; i++) {
+          Chunk &chunk = _M_chunks[i];
+          if(!chunk.is_used) continue;
+          char *ptr = chunk_begin(i);
+          char *end = ptr + chunk.top;
+          while(ptr < end) {
+            Header *header = reinterpret_cast<Header *>(ptr);
+            if(!header->has(FLAG_FORWARDED)) {
+              if(header->has(FLAG_VISITED | FLAG_MARKED)) {
+                header->clear(FLAG_VISITED | FLAG_MARKED);
+                live_object_counts.add(header_to_object(header));
+              } else if(!header->has(FLAG_DEAD)) {
+                finalize_object(header_to_object(header));
+                add_freed_byte_count(header->size());
+                header->set(FLAG_DEAD);
+              }
+            }
+            ptr += header->size();
+          }
+          if(!chunk.is_pinned) {
+            chunk.top = 0;
+            chunk.is_used = false;
+            _M_free_chunks.push_back(i);
+            if(_M_current_chunk == i) _M_current_chunk = NO_CHUNK;
+          }
+        }
+        for(LargeLink *link = _M_young_large_list.next; link != &_M_young_large_list; link = link->next) {
+          large_link_to_header(link)->clear(FLAG_MARKED);
+          live_object_counts.add(header_to_object(large_link_to_header(link)));
+        }
+      }
+
+      void GenerationalGarbageCollector::sweep_old_objects(LiveObjectCounts &live_object_counts)
+      {
+        for(auto area : _M_arenas) {
+          for(size_t i = 0; i < ARENA_PAGE_COUNT; i++) {
+            Page *page = arena_page(area, i);
+            if(page->cell_size == 0) continue;
+            for(size_t j = PAGE_HEADER_SIZE; j < page->bump; j += page->cell_size) {
+              Header *header = reinterpret_cast<Header *>(reinterpret_cast<char *>(page) + j);
+              if(header->bits == 0) continue;
+              if(header->has(FLAG_MARKED)) {
+                header->clear(FLAG_MARKED);
+                live_object_counts.add(header_to_object(header));
+              } else {
+                finalize_object(header_to_object(header));
+                _M_old_size -= header->size();
+                add_freed_byte_count(header->size());
+                free_cell(page, header);
+              }
+            }
+            if(page->live_cell_count == 0) {
+              if(page->is_partial) delete_partial_page(page);
+              page->cell_size = 0;
+              page->next = _M_free_pages;
+              _M_free_pages = page;
+              _M_free_page_count++;
+            } else if(!page->is_partial && (page->free_cell != nullptr || page->bump + page->cell_size <= PAGE_SIZE)) {
+              add_partial_page(page);
+            }
+          }
+        }
+        LargeLink *link = _M_old_large_list.next;
+        while(link != &_M_old_large_list) {
+          LargeLink *next = link->next;
+          Header *header = large_link_to_header(link);
+          if(header->has(FLAG_MARKED)) {
+            header->clear(FLAG_MARKED);
+            live_object_counts.add(header_to_object(header));
+          } else {
+            finalize_object(header_to_object(header));
+            _M_old_size -= header->size();
+            add_freed_byte_count(header->size());
+            delete_large_link(link);
+            _M_alloc->free(reinterpret_cast<void *>(link));
+          }
+          link = next;
+        }
+      }
+
+      bool GenerationalGarbageCollector::is_written_object(Header *header)
+      {
+        Object *object = header_to_object(header);
+        for(auto context : _M_thread_contexts) {
+          if(context->regs().gc_written_object == object) return true;
+        }
+        return false;
+      }
+
+      bool GenerationalGarbageCollector::select_evacuated_pages()
+      {
+        _M_evacuated_pages.clear();
+        size_t used_size = 0;
+        size_t live_size = 0;
+        vector<Page *> pages;
+        try {
+          for(auto area : _M_arenas) {
+            for(size_t i = 0; i < ARENA_PAGE_COUNT; i++) {
+              Page *page = arena_page(area, i);
+              if(page->cell_size == 0) continue;
+              used_size += PAGE_SIZE - PAGE_HEADER_SIZE;
+              live_size += page->live_cell_count * page->cell_size;
+              pages.push_back(page);
+            }
+          }
+          if(used_size == 0 || static_cast<double>(used_size - live_size) < _M_compaction_threshold * used_size)
+            return false;
+          _M_evacuated_pages.reserve(pages.size());
+        } catch(bad_alloc &) {
+          return false;
+        }
+        sort(pages.begin(), pages.end(), [](const Page *page1, const Page *page2) {
+          if(page1->size_class != page2->size_class) return page1->size_class < page2->size_class;
+          return page1->live_cell_count < page2->live_cell_count;
+        });
+        // The sparsest pages of each size class are evacuated while the other pages of
+        // the size class have enough free cells for their live objects.
+        auto iter = pages.begin();
+        while(iter != pages.end()) {
+          auto end = find_if(iter, pages.end(), [iter](const Page *page) { return page->size_class != (*iter)->size_class; });
+          size_t free_cell_count = 0;
+          for(auto iter2 = iter; iter2 != end; iter2++)
+            free_cell_count += page_cell_count(*iter2) - (*iter2)->live_cell_count;
+          size_t moved_cell_count = 0;
+          for(; iter != end; iter++) {
+            size_t page_free_cell_count = page_cell_count(*iter) - (*iter)->live_cell_count;
+            if(free_cell_count - page_free_cell_count < moved_cell_count + (*iter)->live_cell_count) break;
+            free_cell_count -= page_free_cell_count;
+            moved_cell_count += (*iter)->live_cell_count;
+            (*iter)->is_pinned = false;
+            _M_evacuated_pages.push_back(*iter);
+          }
+          iter = end;
+        }
+        return !_M_evacuated_pages.empty();
+      }
+
+      void GenerationalGarbageCollector::compact_old_objects(ThreadContext *current_context, CollectionTimes &times)
+      {
+        if(!select_evacuated_pages()) return;
+        prepare_sample_moves();
+        auto pause_start = chrono::high_resolution_clock::now();
+        {
+          lock_guard<Threads> guard(_M_threads);
+          times.stop_usecs += usecs_since(pause_start);
+          jmp_buf saved_regs;
+          setjmp(saved_regs);
+          _M_is_compacting = true;
+          pin_objects(current_context, reinterpret_cast<void *>(&saved_regs));
+          _M_is_compacting = false;
+          evacuate_old_pages();
+          update_all_refs();
+        }
+        times.pause_usecs += usecs_since(pause_start);
+        apply_sample_moves();
+        free_evacuated_cells();
+        free_empty_arenas();
+      }
+
+      void GenerationalGarbageCollector::evacuate_old_pages()
+      {
+        for(auto page : _M_evacuated_pages) {
+          if(page->is_pinned) continue;
+          if(page->is_partial) delete_partial_page(page);
+          page->is_evacuated = true;
+        }
+        for(auto page : _M_evacuated_pages) {
+          if(!page->is_evacuated) continue;
+          for(size_t j = PAGE_HEADER_SIZE; j < page->bump; j += page->cell_size) {
+            Header *header = reinterpret_cast<Header *>(reinterpret_cast<char *>(page) + j);
+            if(header->bits == 0) continue;
+            Header *new_header = allocate_cell(header->size());
+            if(new_header == nullptr) return;
+            memcpy(new_header, header, header->size());
+            new_header->link = nullptr;
+            header->set(FLAG_FORWARDED);
+            header->link = new_header;
+            move_sample(header_to_object(header), header_to_object(new_header));
+          }
+        }
+      }
+
+      void GenerationalGarbageCollector::update_ref(int type, Reference &ref)
+      {
+        if(!is_ref_value_type_for_gc(type) || ref.ptr() == nullptr || ref.has_nil()) return;
+        Header *header = object_to_header(ref.ptr());
+        if(header->kind() == KIND_CELL && header->has(FLAG_FORWARDED)) ref = header_to_object(header->link);
+      }
+
+      void GenerationalGarbageCollector::update_all_refs()
+      {
+        auto fun = [this](int type, Reference &ref) { update_ref(type, ref); };
+        for(auto context : _M_thread_contexts) context->traverse_root_refs(fun);
+        for(auto context : _M_vm_contexts) context->traverse_root_refs(fun);
+        LargeLink *lists[3] = { &_M_young_large_list, &_M_old_large_list, &_M_immortal_list };
+        for(auto list : lists) {
+          for(LargeLink *link = list->next; link != list; link = link->next)
+            for_each_child_ref(*header_to_object(large_link_to_header(link)), fun);
+        }
+        for(size_t i = 0; i < _M_chunk_count; i++) {
+          if(!_M_chunks[i].is_used) continue;
+          char *ptr = chunk_begin(i);
+          char *end = ptr + _M_chunks[i].top;
+          while(ptr < end) {
+            Header *header = reinterpret_cast<Header *>(ptr);
+            if(!header->has(FLAG_FORWARDED | FLAG_DEAD)) for_each_child_ref(*header_to_object(header), fun);
+            ptr += header->size();
+          }
+        }
+        for(auto area : _M_arenas) {
+          for(size_t i = 0; i < ARENA_PAGE_COUNT; i++) {
+            Page *page = arena_page(area, i);
+            if(page->cell_size == 0) continue;
+            for(size_t j = PAGE_HEADER_SIZE; j < page->bump; j += page->cell_size) {
+              Header *header = reinterpret_cast<Header *>(reinterpret_cast<char *>(page) + j);
+              if(header->bits != 0 && !header->has(FLAG_FORWARDED)) for_each_child_ref(*header_to_object(header), fun);
+            }
+          }
+        }
+        for(auto &header : _M_remembered) {
+          if(header->kind() == KIND_CELL && header->has(FLAG_FORWARDED)) header = header->link;
+        }
+      }
+
+      void GenerationalGarbageCollector::free_evacuated_cells()
+      {
+        for(auto page : _M_evacuated_pages) {
+          if(!page->is_evacuated) continue;
+          for(size_t j = PAGE_HEADER_SIZE; j < page->bump; j += page->cell_size) {
+            Header *header = reinterpret_cast<Header *>(reinterpret_cast<char *>(page) + j);
+            if(header->bits != 0 && header->has(FLAG_FORWARDED)) free_cell(page, header);
+          }
+          page->is_evacuated = false;
+          if(page->live_cell_count == 0) {
+            page->cell_size = 0;
+            page->next = _M_free_pages;
+            _M_free_pages = page;
+            _M_free_page_count++;
+          } else if(page->free_cell != nullptr || page->bump + page->cell_size <= PAGE_SIZE) {
+            add_partial_page(page);
+          }
+        }
+        _M_evacuated_pages.clear();
+      }
+
+      void GenerationalGarbageCollector::free_empty_arenas()
+      {
+        // The empty arenas are returned to the allocator so that the memory of the
+        // compacted old generation can be released.
+        size_t j = 0;
+        for(size_t i = 0; i < _M_arenas.size(); i++) {
+          bool is_empty = true;
+          for(size_t k = 0; k < ARENA_PAGE_COUNT && is_empty; k++) is_empty = (arena_page(_M_arenas[i], k)->cell_size == 0);
+          if(is_empty)
+            _M_alloc->free(_M_arenas[i]);
+          else
+            _M_arenas[j++] = _M_arenas[i];
+        }
+        if(j == _M_arenas.size()) return;
+        _M_arenas.resize(j);
+        _M_free_pages = nullptr;
+        _M_free_page_count = 0;
+        for(auto iter = _M_arenas.rbegin(); iter != _M_arenas.rend(); iter++) {
+          for(size_t k = ARENA_PAGE_COUNT; k > 0; k--) {
+            Page *page = arena_page(*iter, k - 1);
+            if(page->cell_size == 0) {
+              page->next = _M_free_pages;
+              _M_free_pages = page;
+              _M_free_page_count++;
+            }
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,296 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#ifndef _GC_GEN_GC_HPP
+#define _GC_GEN_GC_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "impl_gc_base.hpp"
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace impl
+    {
+      //
+      // The generational garbage collector has a young generation (nursery) and an old
+      // generation. Objects are allocated in the nursery by bumping a pointer. A minor
+      // collection copies the live young objects to the old generation. The old generation
+      // is collected by marking and sweeping when its size exceeds a threshold.
+      //
+      // The nursery is divided into chunks. A chunk that is referenced from a system stack
+      // of a thread is pinned and its objects aren't moved by the minor collection.
+      // References from old objects to young objects are remembered by the write barrier.
+      //
+      // The old generation can be compacted after the major collection if its
+      // fragmentation exceeds a threshold. Live objects of the sparse pages are moved to
+      // other pages of their size class and references to them are updated. Pages that
+      // are referenced from a system stack and large objects aren't moved.
+      //
+      class GenerationalGarbageCollector : public ImplGarbageCollectorBase
+      {
+        static const std::size_t ALIGNMENT = 16;
+        static const std::size_t CHUNK_SIZE = 32 * 1024;
+        static const std::size_t MAX_NURSERY_BLOCK_SIZE = 4096;
+        static const std::size_t PAGE_SIZE = 32 * 1024;
+        static const std::size_t PAGE_HEADER_SIZE = 64;
+        static const std::size_t ARENA_PAGE_COUNT = 32;
+        static const std::size_t SIZE_CLASS_COUNT = 31;
+        static const std::size_t MIN_MAJOR_THRESHOLD = 8 * 1024 * 1024;
+        static const std::size_t MAX_SCANNED_STACK_ELEM_COUNT = 16;
+        static const std::size_t NO_CHUNK = static_cast<std::size_t>(-1);
+
+        enum
+        {
+          KIND_NURSERY = 0,
+          KIND_CELL = 1,
+          KIND_LARGE = 2,
+          KIND_IMMORTAL = 3,
+          KIND_MASK = 3,
+          FLAG_YOUNG = 4,
+          FLAG_PINNED = 8,
+          FLAG_FORWARDED = 16,
+          FLAG_VISITED = 32,
+          FLAG_MARKED = 64,
+          FLAG_REMEMBERED = 128,
+          FLAG_DEAD = 256,
+          FLAG_SHIFT = 16
+        };
+
+        struct Header
+        {
+          std::size_t bits;
+          Header *link;
+
+          std::size_t size() const { return bits >> FLAG_SHIFT; }
+
+          unsigned kind() const { return bits & KIND_MASK; }
+
+          bool has(std::size_t flags) const { return (bits & flags) != 0; }
+
+          void set(std::size_t flags) { bits |= flags; }
+
+          void clear(std::size_t flags) { bits &= ~flags; }
+
+          bool is_young() const { return kind() == KIND_NURSERY || has(FLAG_YOUNG); }
+        };
+
+        struct LargeLink
+        {
+          LargeLink *prev;
+          LargeLink *next;
+        };
+
+        struct Chunk
+        {
+          std::size_t top;
+          bool is_used;
+          bool is_pinned;
+        };
+
+        struct Page
+        {
+          Page *prev;
+          Page *next;
+          Header *free_cell;
+          std::size_t bump;
+          std::size_t cell_size;
+          std::size_t size_class;
+          std::size_t live_cell_count;
+          bool is_partial;
+          bool is_pinned;
+          bool is_evacuated;
+        };
+
+        std::size_t _M_chunk_count;
+        void *_M_nursery_area;
+        char *_M_nursery_begin;
+        char *_M_nursery_end;
+        std::vector<Chunk> _M_chunks;
+        std::vector<std::size_t> _M_free_chunks;
+        std::size_t _M_current_chunk;
+        std::vector<void *> _M_arenas;
+        Page *_M_free_pages;
+        std::size_t _M_free_page_count;
+        Page *_M_partial_pages[SIZE_CLASS_COUNT];
+        LargeLink _M_young_large_list;
+        LargeLink _M_old_large_list;
+        LargeLink _M_immortal_list;
+        LargeLink _M_dead_large_list;
+        std::size_t _M_young_large_count;
+        std::vector<Header *> _M_young_large_headers;
+        std::vector<Header *> _M_remembered;
+        Header *_M_stack_top;
+        bool _M_has_young_child;
+        bool _M_is_promotion_disabled;
+        std::size_t _M_old_size;
+        std::size_t _M_major_threshold;
+        double _M_compaction_threshold;
+        bool _M_is_compacting;
+        std::vector<Page *> _M_evacuated_pages;
+        unsigned _M_lock_count;
+        ImplForkHandler _M_gc_fork_handler;
+      public:
+        GenerationalGarbageCollector(Allocator *alloc, unsigned int interval_usecs = 100000, std::size_t nursery_size = 4 * 1024 * 1024, double growth_factor = 0.0, double compaction_threshold = 0.0);
+
+        ~GenerationalGarbageCollector();
+
+        void collect();
+
+        void write_barrier(Object *object, ThreadContext *context = nullptr);
+
+        void *allocate(std::size_t size, ThreadContext *context);
+
+        void *allocate_immortal_area(std::size_t size);
+
+        std::size_t header_size();
+
+        void lock();
+
+        void unlock();
+      private:
+        static std::size_t align(std::size_t size)
+        { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+        static Header *object_to_header(Object *object)
+        { return reinterpret_cast<Header *>(reinterpret_cast<char *>(object) - sizeof(Header)); }
+
+        static Object *header_to_object(Header *header)
+        { return reinterpret_cast<Object *>(reinterpret_cast<char *>(header) + sizeof(Header)); }
+
+        static LargeLink *header_to_large_link(Header *header)
+        { return reinterpret_cast<LargeLink *>(reinterpret_cast<char *>(header) - sizeof(LargeLink)); }
+
+        static Header *large_link_to_header(LargeLink *link)
+        { return reinterpret_cast<Header *>(reinterpret_cast<char *>(link) + sizeof(LargeLink)); }
+
+        static void init_large_list(LargeLink *list)
+        { list->prev = list->next = list; }
+
+        static bool is_empty_large_list(LargeLink *list)
+        { return list->next == list; }
+
+        static void add_large_link(LargeLink *list, LargeLink *link)
+        {
+          link->prev = list->prev;
+          link->next = list;
+          list->prev->next = link;
+          list->prev = link;
+        }
+
+        static void delete_large_link(LargeLink *link)
+        {
+          link->prev->next = link->next;
+          link->next->prev = link->prev;
+        }
+
+        static std::uintptr_t arena_begin(void *area)
+        { return (reinterpret_cast<std::uintptr_t>(area) + PAGE_SIZE - 1) & ~static_cast<std::uintptr_t>(PAGE_SIZE - 1); }
+
+        static Page *arena_page(void *area, std::size_t i)
+        { return reinterpret_cast<Page *>(arena_begin(area) + i * PAGE_SIZE); }
+
+        static std::size_t page_cell_count(const Page *page)
+        { return (PAGE_SIZE - PAGE_HEADER_SIZE) / page->cell_size; }
+
+        static std::size_t size_class(std::size_t size);
+
+        static std::size_t size_class_cell_size(std::size_t size_class);
+
+        bool is_in_nursery(const void *ptr) const
+        {
+          const char *tmp_ptr = reinterpret_cast<const char *>(ptr);
+          return tmp_ptr >= _M_nursery_begin && tmp_ptr < _M_nursery_end;
+        }
+
+        std::size_t chunk_index(const void *ptr) const
+        { return static_cast<std::size_t>(reinterpret_cast<const char *>(ptr) - _M_nursery_begin) / CHUNK_SIZE; }
+
+        char *chunk_begin(std::size_t i) const
+        { return _M_nursery_begin + i * CHUNK_SIZE; }
+
+        void push_header(Header *header)
+        { header->link = _M_stack_top; _M_stack_top = header; }
+
+        Header *pop_header()
+        {
+          Header *header = _M_stack_top;
+          _M_stack_top = header->link;
+          header->link = nullptr;
+          return header;
+        }
+
+        bool is_empty_stack() const { return _M_stack_top == nullptr; }
+
+        Header *allocate_from_nursery(std::size_t block_size);
+
+        Header *allocate_large(LargeLink *list, std::size_t block_size);
+
+        bool can_collect_in_allocation(ThreadContext *context);
+
+        Header *allocate_cell(std::size_t block_size);
+
+        void free_cell(Page *page, Header *header);
+
+        bool add_arena();
+
+        void add_partial_page(Page *page);
+
+        void delete_partial_page(Page *page);
+
+        Page *ptr_to_page(const void *ptr) const;
+
+        void prepare_for_collection();
+
+        void collect_in_lock(ThreadContext *current_context);
+
+        void pin_ptr(const void *ptr);
+
+        void pin_system_stack(void *top, void *bottom);
+
+        void pin_objects(ThreadContext *current_context, void *current_stack_top);
+
+        void evacuate(int type, Reference &ref);
+
+        void scan_gray_objects();
+
+        void evacuate_young_objects();
+
+        void promote_young_large_objects();
+
+        void mark(int type, Reference &ref);
+
+        void mark_all_objects();
+
+        void finalize_young_objects(LiveObjectCounts &live_object_counts);
+
+        void sweep_old_objects(LiveObjectCounts &live_object_counts);
+
+        bool is_written_object(Header *header);
+
+        bool select_evacuated_pages();
+
+        void compact_old_objects(ThreadContext *current_context, CollectionTimes &times);
+
+        void evacuate_old_pages();
+
+        void update_ref(int type, Reference &ref);
+
+        void update_all_refs();
+
+        void free_evacuated_cells();
+
+        void free_empty_arenas();
+      };
+    }
+  }
+}
+
+#endif
@@ -5,11 +5,15 @@
  *   License v3 or later. See the LICENSE file and the GPL file for         *
  *   the full licensing terms.                                              *
  ****************************************************************************/
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <functional>
 #include <mutex>
+#include <system_error>
 #include <letin/vm.hpp>
 #include "mark_sweep_gc.hpp"
+#include "traverse.hpp"
 #include "vm.hpp"
 
 using namespace std;
@@ -23,43 +27,148 @@ namespace letin
     namespace impl
     {
       MarkSweepGarbageCollector::Header MarkSweepGarbageCollector::_S_nil;
+      MarkSweepGarbageCollector::Header MarkSweepGarbageCollector::_S_frozen;
+      MarkSweepGarbageCollector::Header MarkSweepGarbageCollector::_S_written_frozen;
+
+      MarkSweepGarbageCollector::MarkThreadForkHandler::~MarkThreadForkHandler() {}
+
+      void MarkSweepGarbageCollector::MarkThreadForkHandler::pre_fork()
+      { _M_gc->_M_mark_start_mutex.lock(); }
+
+      void MarkSweepGarbageCollector::MarkThreadForkHandler::post_fork(bool is_child)
+      {
+        if(is_child) {
+          // The mark threads don't exist in the child process so they are started again
+          // by the next collection.
+          for(auto &mark_thread : _M_gc->_M_mark_threads) new (&mark_thread) thread;
+          _M_gc->_M_mark_threads.clear();
+          _M_gc->_M_mark_worker_count = 1;
+          new (&(_M_gc->_M_mark_start_mutex)) mutex;
+          new (&(_M_gc->_M_mark_start_cv)) condition_variable;
+          new (&(_M_gc->_M_mark_end_cv)) condition_variable;
+        } else
+          _M_gc->_M_mark_start_mutex.unlock();
+      }
 
       MarkSweepGarbageCollector::MarkSweepGarbageCollector(Allocator *alloc,
-          unsigned int interval_usecs) :
-        ImplGarbageCollectorBase(alloc, interval_usecs),
+          unsigned int interval_usecs, unsigned int mark_thread_count, bool is_concurrent,
+          bool is_concurrent_sweep, double growth_factor, bool is_freezing_before_fork) :
+        ImplGarbageCollectorBase(alloc, interval_usecs, growth_factor),
         _M_list_first(&_S_nil),
         _M_stack_top(&_S_nil),
         _M_immortal_list_first(&_S_nil),
-        _M_gc_fork_handler(this)
-      { add_impl_fork_handler(&_M_gc_fork_handler); }
+        _M_frozen_list_first(&_S_nil),
+        _M_written_frozen_list_first(&_S_nil),
+        _M_is_freezing_before_fork(is_freezing_before_fork),
+        _M_gc_fork_handler(this),
+        _M_mark_thread_count(max(mark_thread_count, 1U)),
+        _M_mark_workers(new MarkWorker[_M_mark_thread_count]),
+        _M_mark_worker_count(1),
+        _M_idle_mark_worker_count(0),
+        _M_shared_header_count(0),
+        _M_mark_number(0),
+        _M_running_mark_thread_count(0),
+        _M_are_mark_threads_stopped(false),
+        _M_mark_thread_fork_handler(this),
+        _M_is_concurrent(is_concurrent),
+        _M_is_concurrent_sweep(is_concurrent_sweep),
+        _M_is_marking(false),
+        _M_marking_list_first(&_S_nil),
+        _M_used_chunk_count(0)
+      {
+        add_impl_fork_handler(&_M_gc_fork_handler);
+        add_fork_handler(FORK_HANDLER_PRIO_GC, &_M_mark_thread_fork_handler);
+      }
 
       MarkSweepGarbageCollector::~MarkSweepGarbageCollector()
       {
+        delete_fork_handler(FORK_HANDLER_PRIO_GC, &_M_mark_thread_fork_handler);
+        stop_mark_threads();
+        // The thread contexts can be already destroyed so their local lists are only
+        // moved to the list of the garbage collector by the delete_thread_context method.
         free_list(_M_list_first);
         free_list(_M_immortal_list_first);
+        free_list(_M_frozen_list_first);
+        free_list(_M_written_frozen_list_first);
+        for(auto &arena : _M_arenas) _M_alloc->free(arena.block);
       }
 
       void MarkSweepGarbageCollector::collect()
       {
-        lock_guard<GarbageCollector> guard(*this);
-        {
-          lock_guard<Threads> guard2(_M_threads);
-          mark();
+        lock_guard<mutex> guard(_M_collection_mutex);
+        CollectionTimes times = { 0, 0, 0, 0, 0 };
+        unique_lock<GarbageCollector> lock(*this);
+        if(_M_is_concurrent)
+          mark_concurrently(lock, times);
+        else
+          mark_in_stopped_threads(times);
+        auto sweep_start = chrono::high_resolution_clock::now();
+        if(_M_is_concurrent_sweep)
+          sweep_concurrently(lock);
+        else
+          sweep();
+        times.sweep_usecs = usecs_since(sweep_start);
+        add_collection_times(times);
+      }
+
+      void MarkSweepGarbageCollector::write_barrier(Object *object, ThreadContext *context)
+      {
+        // A written frozen object can refer to new objects so its children are marked
+        // by each collection.
+        Header *header = object_to_header(object);
+        if(header->stack_prev.load(memory_order_relaxed) == &_S_frozen) {
+          lock_guard<GarbageCollector> guard(*this);
+          if(header->stack_prev.load(memory_order_relaxed) == &_S_frozen) {
+            _M_written_frozen_headers.push_back(header);
+            header->stack_prev.store(&_S_written_frozen, memory_order_relaxed);
+          }
         }
-        sweep();
+        if(!_M_is_marking.load(memory_order_relaxed)) return;
+        if(context != nullptr) {
+          if(context->regs().gc_written_object == object) return;
+          context->regs().gc_written_object = object;
+        }
+        lock_guard<GarbageCollector> guard(*this);
+        if(_M_is_marking.load(memory_order_relaxed)) _M_written_objects.push_back(object);
+      }
+
+      void MarkSweepGarbageCollector::prepare_fork()
+      { if(_M_is_freezing_before_fork) collect_and_freeze(); }
+
+      void MarkSweepGarbageCollector::delete_thread_context(ThreadContext *context)
+      {
+        lock_guard<GarbageCollector> guard(*this);
+        add_local_headers(context);
+        release_local_chunk(context);
+        ImplGarbageCollectorBase::delete_thread_context(context);
       }
 
       void *MarkSweepGarbageCollector::allocate(size_t size, ThreadContext *context)
       {
-        void *orig_ptr = _M_alloc->allocate(sizeof(Header) + size);
+        void *orig_ptr;
+        if(context != nullptr && sizeof(Header) + size <= MAX_CHUNK_BLOCK_SIZE) {
+          orig_ptr = allocate_from_local_chunk(sizeof(Header) + size, context);
+        } else {
+          if(!add_allocated_byte_count(sizeof(Header) + size)) return nullptr;
+          orig_ptr = _M_alloc->allocate(sizeof(Header) + size);
+        }
         if(orig_ptr == nullptr) return nullptr;
         Header *header = reinterpret_cast<Header *>(orig_ptr);
         new(header) Header();
         void *ptr = reinterpret_cast<char *>(orig_ptr) + sizeof(Header);
-        atomic_thread_fence(memory_order_release);
-        if(context != nullptr) context->regs().gc_tmp_ptr = ptr;
-        atomic_thread_fence(memory_order_release);
-        {
+        if(context != nullptr) {
+          // Objects of the thread are added to the local list without the lock. The local
+          // list is moved to the list of the garbage collector when it is full or the
+          // thread is stopped by the collection.
+          add_local_header(context, header);
+          atomic_thread_fence(memory_order_release);
+          context->regs().gc_tmp_ptr = ptr;
+          atomic_thread_fence(memory_order_release);
+          if(context->regs().gc_local_count >= MAX_LOCAL_HEADER_COUNT) {
+            lock_guard<GarbageCollector> guard(*this);
+            add_local_headers(context);
+          }
+        } else {
           lock_guard<GarbageCollector> guard(*this);
           add_header(header);
         }
@@ -70,6 +179,7 @@ namespace letin
       {
         void *orig_ptr = _M_alloc->allocate(sizeof(Header) + size);
         if(orig_ptr == nullptr) return nullptr;
+        add_immortal_byte_count(sizeof(Header) + size);
         Header *header = reinterpret_cast<Header *>(orig_ptr);
         new(header) Header();
         void *ptr = reinterpret_cast<char *>(orig_ptr) + sizeof(Header);
@@ -80,6 +190,95 @@ namespace letin
         return ptr;
       }
 
+      MarkSweepGarbageCollector::ChunkArena *MarkSweepGarbageCollector::ptr_to_arena(vector<ChunkArena> &arenas, const void *ptr)
+      {
+        uintptr_t tmp_ptr = reinterpret_cast<uintptr_t>(ptr);
+        auto iter = upper_bound(arenas.begin(), arenas.end(), tmp_ptr, [](uintptr_t ptr, const ChunkArena &arena) {
+          return ptr < arena.begin;
+        });
+        if(iter == arenas.begin()) return nullptr;
+        ChunkArena &arena = *(iter - 1);
+        if(tmp_ptr >= arena.begin + arena.chunk_count * CHUNK_SIZE) return nullptr;
+        return &arena;
+      }
+
+      MarkSweepGarbageCollector::Chunk *MarkSweepGarbageCollector::allocate_chunk()
+      {
+        ChunkArena *arena = nullptr;
+        for(auto &tmp_arena : _M_arenas) {
+          if(tmp_arena.used_chunk_count < tmp_arena.chunk_count) {
+            arena = &tmp_arena;
+            break;
+          }
+        }
+        if(arena == nullptr) {
+          void *block = _M_alloc->allocate(ARENA_SIZE);
+          if(block == nullptr) return nullptr;
+          ChunkArena new_arena;
+          new_arena.block = block;
+          new_arena.begin = (reinterpret_cast<uintptr_t>(block) + CHUNK_SIZE - 1) & ~static_cast<uintptr_t>(CHUNK_SIZE - 1);
+          new_arena.chunk_count = (reinterpret_cast<uintptr_t>(block) + ARENA_SIZE - new_arena.begin) / CHUNK_SIZE;
+          new_arena.initialized_chunk_count = 0;
+          new_arena.used_chunk_count = 0;
+          new_arena.free_chunk_first = nullptr;
+          auto iter = upper_bound(_M_arenas.begin(), _M_arenas.end(), new_arena.begin, [](uintptr_t begin, const ChunkArena &arena) {
+            return begin < arena.begin;
+          });
+          arena = &*_M_arenas.insert(iter, new_arena);
+        }
+        void *ptr;
+        if(arena->free_chunk_first != nullptr) {
+          ptr = reinterpret_cast<void *>(arena->free_chunk_first);
+          arena->free_chunk_first = arena->free_chunk_first->next_free;
+        } else {
+          ptr = reinterpret_cast<void *>(arena->begin + arena->initialized_chunk_count * CHUNK_SIZE);
+          arena->initialized_chunk_count++;
+        }
+        arena->used_chunk_count++;
+        _M_used_chunk_count++;
+        return new(ptr) Chunk();
+      }
+
+      void MarkSweepGarbageCollector::free_chunk(Chunk *chunk)
+      {
+        ChunkArena *arena = ptr_to_arena(_M_arenas, chunk);
+        chunk->~Chunk();
+        chunk->next_free = arena->free_chunk_first;
+        arena->free_chunk_first = chunk;
+        arena->used_chunk_count--;
+        _M_used_chunk_count--;
+        add_freed_byte_count(CHUNK_SIZE);
+        if(arena->used_chunk_count == 0) {
+          _M_alloc->free(arena->block);
+          _M_arenas.erase(_M_arenas.begin() + (arena - _M_arenas.data()));
+        }
+      }
+
+      void *MarkSweepGarbageCollector::allocate_from_local_chunk(size_t size, ThreadContext *context)
+      {
+        // Small objects of the thread are carved from its chunk without the lock. Each
+        // object holds a reference to the chunk so the chunk is freed when the sweep has
+        // freed all objects of the chunk and the thread has moved to a new chunk. A chunk
+        // is charged to the heap as a whole because its memory is only reused after it
+        // is freed.
+        Registers &regs = context->regs();
+        size = (size + CHUNK_ALIGNMENT - 1) & ~(CHUNK_ALIGNMENT - 1);
+        char *chunk_ptr = reinterpret_cast<char *>(regs.gc_chunk_ptr);
+        if(regs.gc_chunk == nullptr || static_cast<size_t>(reinterpret_cast<char *>(regs.gc_chunk_end) - chunk_ptr) < size) {
+          if(!add_allocated_byte_count(CHUNK_SIZE)) return nullptr;
+          lock_guard<GarbageCollector> guard(*this);
+          Chunk *chunk = allocate_chunk();
+          if(chunk == nullptr) return nullptr;
+          release_local_chunk(context);
+          chunk_ptr = reinterpret_cast<char *>(chunk) + CHUNK_HEADER_SIZE;
+          regs.gc_chunk = reinterpret_cast<void *>(chunk);
+          regs.gc_chunk_end = reinterpret_cast<char *>(chunk) + CHUNK_SIZE;
+        }
+        reinterpret_cast<Chunk *>(regs.gc_chunk)->ref_count.fetch_add(1, memory_order_relaxed);
+        regs.gc_chunk_ptr = chunk_ptr + size;
+        return reinterpret_cast<void *>(chunk_ptr);
+      }
+
       void MarkSweepGarbageCollector::mark()
       {
         for(auto context : _M_thread_contexts) {
@@ -90,41 +289,457 @@ namespace letin
         for(auto context : _M_vm_contexts) {
           context->traverse_root_objects(bind(&MarkSweepGarbageCollector::mark_from_object, this, _1));
         }
+        mark_written_frozen_objects();
+        mark_objects_from_stack();
+      }
+
+      void MarkSweepGarbageCollector::add_all_local_headers()
+      {
+        for(auto context : _M_thread_contexts) {
+          if(!context->interruptible_fun_flag() && !context->regs().gc_local_adding_flag)
+            add_local_headers(context);
+        }
+      }
+
+      void MarkSweepGarbageCollector::unmark_local_headers()
+      {
+        for(auto context : _M_thread_contexts) {
+          Header *header = reinterpret_cast<Header *>(context->regs().gc_local_first);
+          for(; header != nullptr; header = header->list_next) header->stack_prev.store(nullptr, memory_order_relaxed);
+        }
       }
 
       void MarkSweepGarbageCollector::sweep()
       {
-        Header **header_ptr = &_M_list_first;
+        Header *last_header;
+        size_t live_byte_count = 0;
+        LiveObjectCounts live_object_counts;
+        _M_swept_arenas = _M_arenas;
+        _M_list_first = sweep_list(_M_list_first, last_header, live_byte_count, live_object_counts);
+        free_empty_chunks();
+        set_live_byte_count(live_byte_count + _M_used_chunk_count * CHUNK_SIZE);
+        set_live_object_counts(live_object_counts);
+      }
+
+      void MarkSweepGarbageCollector::mark_from_object(Object *object)
+      {
+        Header *header = object_to_header(object);
+        if(!header->is_marked()) {
+          mark_and_push_header(header);
+          mark_objects_from_stack();
+        }
+      }
+
+      size_t MarkSweepGarbageCollector::header_size() { return sizeof(Header); }
+
+      void MarkSweepGarbageCollector::mark_in_stopped_threads(CollectionTimes &times)
+      {
+        // The mark threads are started before stopping the threads because a stopped
+        // thread can hold a lock of the memory allocator.
+        if(_M_mark_thread_count > 1) start_mark_threads();
+        auto pause_start = chrono::high_resolution_clock::now();
+        {
+          lock_guard<Threads> guard(_M_threads);
+          times.stop_usecs = usecs_since(pause_start);
+          auto mark_start = chrono::high_resolution_clock::now();
+          add_all_local_headers();
+          if(_M_mark_threads.empty())
+            mark();
+          else
+            mark_in_parallel();
+          unmark_local_headers();
+          times.mark_usecs = usecs_since(mark_start);
+        }
+        times.pause_usecs = usecs_since(pause_start);
+      }
+
+      void MarkSweepGarbageCollector::mark_concurrently(unique_lock<GarbageCollector> &lock, CollectionTimes &times)
+      {
+        auto pause_start = chrono::high_resolution_clock::now();
+        {
+          lock_guard<Threads> guard(_M_threads);
+          times.stop_usecs = usecs_since(pause_start);
+          add_all_local_headers();
+          _M_marking_list_first = _M_list_first;
+          _M_written_objects.clear();
+          _M_deferred_headers.clear();
+          for(auto context : _M_thread_contexts) context->regs().gc_written_object = nullptr;
+          _M_is_marking.store(true, memory_order_relaxed);
+          mark_roots();
+        }
+        times.pause_usecs = usecs_since(pause_start);
+        lock.unlock();
+        // The objects are marked while the threads are running. The threads only are
+        // stopped for marking the roots again and the written objects.
+        auto mark_start = chrono::high_resolution_clock::now();
+        mark_objects_from_stack_concurrently();
+        times.mark_usecs = usecs_since(mark_start);
+        lock.lock();
+        pause_start = chrono::high_resolution_clock::now();
+        {
+          lock_guard<Threads> guard(_M_threads);
+          times.stop_usecs += usecs_since(pause_start);
+          auto remark_start = chrono::high_resolution_clock::now();
+          add_all_local_headers();
+          remark();
+          _M_is_marking.store(false, memory_order_relaxed);
+          unmark_local_headers();
+          times.remark_usecs = usecs_since(remark_start);
+        }
+        times.pause_usecs += usecs_since(pause_start);
+        _M_written_objects.clear();
+        _M_deferred_headers.clear();
+      }
+
+      void MarkSweepGarbageCollector::sweep_concurrently(unique_lock<GarbageCollector> &lock)
+      {
+        // The list of objects is detached before the threads can add new objects so the
+        // swept objects can be freed without the lock. The unmarked objects of the detached
+        // list are unreachable and the threads never use them.
+        Header *header = _M_list_first;
+        _M_list_first = &_S_nil;
+        _M_swept_arenas = _M_arenas;
+        lock.unlock();
+        Header *last_header;
+        size_t live_byte_count = 0;
+        LiveObjectCounts live_object_counts;
+        header = sweep_list(header, last_header, live_byte_count, live_object_counts);
+        lock.lock();
+        free_empty_chunks();
+        set_live_byte_count(live_byte_count + _M_used_chunk_count * CHUNK_SIZE);
+        set_live_object_counts(live_object_counts);
+        if(header != &_S_nil) {
+          last_header->list_next = _M_list_first;
+          atomic_thread_fence(memory_order_release);
+          _M_list_first = header;
+        }
+      }
+
+      MarkSweepGarbageCollector::Header *MarkSweepGarbageCollector::sweep_list(Header *header, Header *&last_header, size_t &live_byte_count, LiveObjectCounts &live_object_counts)
+      {
+        Header *first_header = header;
+        Header **header_ptr = &first_header;
+        last_header = &_S_nil;
         while(*header_ptr != &_S_nil) {
+          // The objects of the chunks aren't counted because the chunks are counted.
+          Chunk *chunk = header_to_chunk(_M_swept_arenas, *header_ptr);
           if(!(*header_ptr)->is_marked()) {
             Object *object = header_to_object(*header_ptr);
+            if(chunk == nullptr) add_freed_byte_count(sizeof(Header) + object_size(*object));
             finalize_object(object);
             Header *next = (*header_ptr)->list_next;
-            _M_alloc->free(reinterpret_cast<void *>(*header_ptr));
+            free_header(*header_ptr, chunk);
             *header_ptr = next;
           } else {
-            (*header_ptr)->stack_prev = nullptr;
+            (*header_ptr)->stack_prev.store(nullptr, memory_order_relaxed);
+            if(chunk == nullptr) live_byte_count += sizeof(Header) + object_size(*header_to_object(*header_ptr));
+            live_object_counts.add(header_to_object(*header_ptr));
+            last_header = *header_ptr;
             header_ptr = &((*header_ptr)->list_next);
           }
         }
+        return first_header;
       }
 
-      void MarkSweepGarbageCollector::mark_from_object(Object *object)
+      void MarkSweepGarbageCollector::collect_and_freeze()
       {
-        Header *header = object_to_header(object);
-        if(!header->is_marked()) {
-          mark_and_push_header(header);
-          while(!is_empty_stack()) {
-            Object *top_object = header_to_object(pop_header());
-            traverse_child_objects(*top_object, [this](Object *child_object) {
-              Header *child_header = object_to_header(child_object);
-              if(!child_header->is_marked()) mark_and_push_header(child_header);
+        lock_guard<mutex> guard(_M_collection_mutex);
+        lock_guard<GarbageCollector> guard2(*this);
+        CollectionTimes times = { 0, 0, 0, 0, 0 };
+        mark_in_stopped_threads(times);
+        auto sweep_start = chrono::high_resolution_clock::now();
+        sweep();
+        times.sweep_usecs = usecs_since(sweep_start);
+        add_collection_times(times);
+        // The threads are stopped again because the frozen objects are checked for
+        // references to unfrozen objects.
+        lock_guard<Threads> guard3(_M_threads);
+        freeze_live_objects();
+      }
+
+      void MarkSweepGarbageCollector::freeze_live_objects()
+      {
+        // The live objects are frozen before the fork so that the collections after the
+        // fork never write to their headers and the forked processes share their pages.
+        // A frozen object is never marked and never freed by the sweep. Only frozen
+        // objects that refer to unfrozen objects have marked children. The objects of
+        // the gc_tmp_ptr registers aren't frozen because they can be uninitialized.
+        Header *frozen_list_first = &_S_nil;
+        Header **header_ptr = &_M_list_first;
+        size_t live_byte_count = 0;
+        while(*header_ptr != &_S_nil) {
+          Header *header = *header_ptr;
+          if(!is_tmp_header(header)) {
+            *header_ptr = header->list_next;
+            header->stack_prev.store(&_S_frozen, memory_order_relaxed);
+            header->list_next = frozen_list_first;
+            frozen_list_first = header;
+          } else {
+            if(ptr_to_arena(_M_arenas, header) == nullptr)
+              live_byte_count += sizeof(Header) + object_size(*header_to_object(header));
+            header_ptr = &(header->list_next);
+          }
+        }
+        for(Header *header = _M_immortal_list_first; header != &_S_nil; header = header->list_next) {
+          if(!is_frozen_header(header)) header->stack_prev.store(&_S_frozen, memory_order_relaxed);
+        }
+        while(frozen_list_first != &_S_nil) {
+          Header *header = frozen_list_first;
+          frozen_list_first = header->list_next;
+          bool has_unfrozen_child = false;
+          for_each_child_object(*header_to_object(header), [&has_unfrozen_child](Object *child_object) {
+            if(!is_frozen_header(object_to_header(child_object))) has_unfrozen_child = true;
+          });
+          if(has_unfrozen_child) {
+            header->stack_prev.store(&_S_written_frozen, memory_order_relaxed);
+            header->list_next = _M_written_frozen_list_first;
+            _M_written_frozen_list_first = header;
+          } else {
+            header->list_next = _M_frozen_list_first;
+            _M_frozen_list_first = header;
+          }
+        }
+        // The chunks are still charged to the heap because the frozen objects keep
+        // their chunks.
+        set_live_byte_count(live_byte_count + _M_used_chunk_count * CHUNK_SIZE);
+      }
+
+      bool MarkSweepGarbageCollector::is_tmp_header(Header *header)
+      {
+        for(auto context : _M_thread_contexts) {
+          if(context->regs().gc_tmp_ptr != nullptr && ptr_to_header(context->regs().gc_tmp_ptr) == header)
+            return true;
+        }
+        return false;
+      }
+
+      void MarkSweepGarbageCollector::mark_written_frozen_objects()
+      {
+        for(Header *header = _M_written_frozen_list_first; header != &_S_nil; header = header->list_next)
+          mark_children(header);
+        for(auto header : _M_written_frozen_headers) mark_children(header);
+      }
+
+      void MarkSweepGarbageCollector::mark_roots()
+      {
+        function<void (Object *)> fun = [this](Object *object) {
+          Header *header = object_to_header(object);
+          if(!header->is_marked()) mark_and_push_header(header);
+        };
+        for(auto context : _M_thread_contexts) context->traverse_root_objects(fun);
+        for(auto context : _M_vm_contexts) context->traverse_root_objects(fun);
+        mark_written_frozen_objects();
+      }
+
+      void MarkSweepGarbageCollector::mark_tmp_objects()
+      {
+        for(auto context : _M_thread_contexts) {
+          if(context->regs().gc_tmp_ptr != nullptr) {
+            Header *header = ptr_to_header(context->regs().gc_tmp_ptr);
+            if(!header->is_marked()) header->stack_prev = &_S_nil;
+          }
+        }
+      }
+
+      void MarkSweepGarbageCollector::mark_children(Header *header)
+      {
+        for_each_child_object(*header_to_object(header), [this](Object *child_object) {
+          Header *child_header = object_to_header(child_object);
+          if(!child_header->is_marked()) mark_and_push_header(child_header);
+        });
+      }
+
+      void MarkSweepGarbageCollector::mark_objects_from_stack()
+      {
+        while(!is_empty_stack()) mark_children(pop_header());
+      }
+
+      void MarkSweepGarbageCollector::mark_objects_from_stack_concurrently()
+      {
+        // The threads update the unique objects and the lazy values in place so the types
+        // and the values of their elements can't be read consistently while the threads
+        // are running. The children of these objects are marked by the remark.
+        while(!is_empty_stack()) {
+          Header *header = pop_header();
+          int type = header_to_object(header)->type();
+          if((type & OBJECT_TYPE_UNIQUE) != 0 || type == OBJECT_TYPE_LAZY_VALUE)
+            _M_deferred_headers.push_back(header);
+          else
+            mark_children(header);
+        }
+      }
+
+      void MarkSweepGarbageCollector::remark()
+      {
+        mark_roots();
+        for(auto header : _M_deferred_headers) mark_children(header);
+        // The written objects and the marked new objects can have references that
+        // were stored after marking them.
+        for(auto object : _M_written_objects) {
+          Header *header = object_to_header(object);
+          if(header->is_marked()) mark_children(header);
+        }
+        for(Header *header = _M_list_first; header != _M_marking_list_first; header = header->list_next) {
+          if(header->is_marked()) mark_children(header);
+        }
+        for(auto context : _M_thread_contexts) {
+          Header *header = reinterpret_cast<Header *>(context->regs().gc_local_first);
+          for(; header != nullptr; header = header->list_next) {
+            if(header->is_marked()) mark_children(header);
+          }
+        }
+        mark_objects_from_stack();
+        mark_tmp_objects();
+      }
+
+      void MarkSweepGarbageCollector::start_mark_threads()
+      {
+        _M_mark_thread_contexts.assign(_M_thread_contexts.begin(), _M_thread_contexts.end());
+        _M_mark_vm_contexts.assign(_M_vm_contexts.begin(), _M_vm_contexts.end());
+        // The mark threads are started by the first collection and they wait for next
+        // collections.
+        if(!_M_mark_threads.empty()) return;
+        _M_mark_threads.reserve(_M_mark_thread_count - 1);
+        for(size_t i = 1; i < _M_mark_thread_count; i++) {
+          try {
+            uint64_t mark_number = _M_mark_number;
+            _M_mark_threads.push_back(thread([this, i, mark_number]() { mark_in_thread(i, mark_number); }));
+          } catch(system_error &) {
+            break;
+          }
+        }
+        _M_mark_worker_count = _M_mark_threads.size() + 1;
+      }
+
+      void MarkSweepGarbageCollector::stop_mark_threads()
+      {
+        {
+          lock_guard<mutex> guard(_M_mark_start_mutex);
+          _M_are_mark_threads_stopped = true;
+        }
+        _M_mark_start_cv.notify_all();
+        for(auto &mark_thread : _M_mark_threads) mark_thread.join();
+        _M_mark_threads.clear();
+      }
+
+      void MarkSweepGarbageCollector::mark_in_thread(size_t i, uint64_t mark_number)
+      {
+        while(true) {
+          {
+            unique_lock<mutex> lock(_M_mark_start_mutex);
+            _M_mark_start_cv.wait(lock, [this, mark_number]() {
+              return _M_mark_number != mark_number || _M_are_mark_threads_stopped;
             });
+            if(_M_are_mark_threads_stopped) return;
+            mark_number = _M_mark_number;
+          }
+          mark_in_worker(i);
+          {
+            lock_guard<mutex> guard(_M_mark_start_mutex);
+            _M_running_mark_thread_count--;
           }
+          _M_mark_end_cv.notify_one();
         }
       }
 
-      size_t MarkSweepGarbageCollector::header_size() { return sizeof(Header); }
+      void MarkSweepGarbageCollector::mark_in_parallel()
+      {
+        for(size_t i = 0; i < _M_mark_worker_count; i++) {
+          MarkWorker &worker = _M_mark_workers[i];
+          worker.stack_top = worker.shared_stack_top = &_S_nil;
+          worker.stack_size = worker.shared_stack_size = 0;
+        }
+        _M_idle_mark_worker_count = 0;
+        _M_shared_header_count = 0;
+        {
+          lock_guard<mutex> guard(_M_mark_start_mutex);
+          _M_mark_number++;
+          _M_running_mark_thread_count = _M_mark_threads.size();
+        }
+        _M_mark_start_cv.notify_all();
+        mark_in_worker(0);
+        {
+          // The mark threads can still read the counters of the workers after the last
+          // object is marked so the next collection can't reset them earlier.
+          unique_lock<mutex> lock(_M_mark_start_mutex);
+          _M_mark_end_cv.wait(lock, [this]() { return _M_running_mark_thread_count == 0; });
+        }
+        for(auto context : _M_thread_contexts) {
+          if(context->regs().gc_tmp_ptr != nullptr)
+            ptr_to_header(context->regs().gc_tmp_ptr)->stack_prev = &_S_nil;
+        }
+      }
+
+      void MarkSweepGarbageCollector::mark_in_worker(size_t i)
+      {
+        MarkWorker &worker = _M_mark_workers[i];
+        auto fun = [&worker](Object *object) {
+          mark_and_push_worker_header(worker, object_to_header(object));
+        };
+        for(size_t j = i; j < _M_mark_thread_contexts.size(); j += _M_mark_worker_count)
+          _M_mark_thread_contexts[j]->traverse_root_objects(fun);
+        for(size_t j = i; j < _M_mark_vm_contexts.size(); j += _M_mark_worker_count)
+          _M_mark_vm_contexts[j]->traverse_root_objects(fun);
+        if(i == 0) {
+          for(Header *header = _M_written_frozen_list_first; header != &_S_nil; header = header->list_next)
+            for_each_child_object(*header_to_object(header), fun);
+          for(auto header : _M_written_frozen_headers) for_each_child_object(*header_to_object(header), fun);
+        }
+        while(true) {
+          while(worker.stack_top != &_S_nil) {
+            Header *header = pop_worker_header(worker);
+            for_each_child_object(*header_to_object(header), fun);
+            // Other workers can only take objects from the shared stack.
+            if(worker.stack_size >= MIN_SHARED_HEADER_COUNT * 2 && _M_idle_mark_worker_count.load() > 0)
+              share_worker_headers(worker);
+          }
+          if(steal_worker_headers(worker, i)) continue;
+          _M_idle_mark_worker_count++;
+          while(true) {
+            if(_M_idle_mark_worker_count.load() == _M_mark_worker_count) return;
+            if(_M_shared_header_count.load() > 0) {
+              _M_idle_mark_worker_count--;
+              break;
+            }
+            this_thread::yield();
+          }
+        }
+      }
+
+      void MarkSweepGarbageCollector::share_worker_headers(MarkWorker &worker)
+      {
+        lock_guard<mutex> guard(worker.shared_stack_mutex);
+        size_t count = worker.stack_size / 2;
+        for(size_t j = 0; j < count; j++) {
+          Header *header = pop_worker_header(worker);
+          header->stack_prev.store(worker.shared_stack_top, memory_order_relaxed);
+          worker.shared_stack_top = header;
+        }
+        worker.shared_stack_size += count;
+        _M_shared_header_count += count;
+      }
+
+      bool MarkSweepGarbageCollector::steal_worker_headers(MarkWorker &worker, size_t i)
+      {
+        for(size_t j = 0; j < _M_mark_worker_count; j++) {
+          if(_M_shared_header_count.load() == 0) return false;
+          MarkWorker &victim = _M_mark_workers[(i + j) % _M_mark_worker_count];
+          lock_guard<mutex> guard(victim.shared_stack_mutex);
+          if(victim.shared_stack_size == 0) continue;
+          size_t count = (victim.shared_stack_size + 1) / 2;
+          for(size_t k = 0; k < count; k++) {
+            Header *header = victim.shared_stack_top;
+            victim.shared_stack_top = header->stack_prev.load(memory_order_relaxed);
+            header->stack_prev.store(worker.stack_top, memory_order_relaxed);
+            worker.stack_top = header;
+          }
+          victim.shared_stack_size -= count;
+          worker.stack_size += count;
+          _M_shared_header_count -= count;
+          return true;
+        }
+        return false;
+      }
     }
   }
 }
@@ -9,7 +9,13 @@
 #define _GC_MARK_SWEEP_GC_HPP
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 #include "impl_gc_base.hpp"
 
 namespace letin
@@ -20,22 +26,106 @@ namespace letin
     {
       class MarkSweepGarbageCollector : public ImplGarbageCollectorBase
       {
+        struct Chunk
+        {
+          // The thread that allocates objects from the chunk holds one reference.
+          std::atomic<std::size_t> ref_count;
+          Chunk *next_free;
+
+          Chunk() : ref_count(1), next_free(nullptr) {}
+        };
+
+        // The chunks are carved from the arenas that are allocated by the allocator. The
+        // chunks are aligned to their size so the chunk of an object is found by masking
+        // the object address.
+        struct ChunkArena
+        {
+          void *block;
+          std::uintptr_t begin;
+          std::size_t chunk_count;
+          std::size_t initialized_chunk_count;
+          std::size_t used_chunk_count;
+          Chunk *free_chunk_first;
+        };
+
         struct Header
         {
           Header *list_next;
-          Header *stack_prev;
+          std::atomic<Header *> stack_prev;
 
           constexpr Header() : list_next(nullptr), stack_prev(nullptr) {}
 
-          bool is_marked() const { return stack_prev != nullptr; }
+          bool is_marked() const { return stack_prev.load(std::memory_order_relaxed) != nullptr; }
+        };
+
+        struct MarkWorker
+        {
+          Header *stack_top;
+          std::size_t stack_size;
+          std::mutex shared_stack_mutex;
+          Header *shared_stack_top;
+          std::size_t shared_stack_size;
+        };
+
+        class MarkThreadForkHandler : public ForkHandler
+        {
+          MarkSweepGarbageCollector *_M_gc;
+        public:
+          MarkThreadForkHandler(MarkSweepGarbageCollector *gc) : _M_gc(gc) {}
+
+          ~MarkThreadForkHandler();
+
+          void pre_fork();
+
+          void post_fork(bool is_child);
         };
         
+        static const std::size_t MAX_LOCAL_HEADER_COUNT = 64;
+        static const std::size_t MIN_SHARED_HEADER_COUNT = 32;
+        static const std::size_t CHUNK_SIZE = 16 * 1024;
+        static const std::size_t ARENA_SIZE = 64 * CHUNK_SIZE;
+        static const std::size_t CHUNK_ALIGNMENT = 8;
+        static const std::size_t CHUNK_HEADER_SIZE = (sizeof(Chunk) + CHUNK_ALIGNMENT - 1) & ~(CHUNK_ALIGNMENT - 1);
+        static const std::size_t MAX_CHUNK_BLOCK_SIZE = 512;
+
         static Header _S_nil;
+        static Header _S_frozen;
+        static Header _S_written_frozen;
 
         Header *_M_list_first;
         Header *_M_stack_top;
         Header *_M_immortal_list_first;
+        Header *_M_frozen_list_first;
+        Header *_M_written_frozen_list_first;
+        std::vector<Header *> _M_written_frozen_headers;
+        bool _M_is_freezing_before_fork;
         ImplForkHandler _M_gc_fork_handler;
+        unsigned int _M_mark_thread_count;
+        std::unique_ptr<MarkWorker []> _M_mark_workers;
+        std::size_t _M_mark_worker_count;
+        std::vector<ThreadContext *> _M_mark_thread_contexts;
+        std::vector<VirtualMachineContext *> _M_mark_vm_contexts;
+        std::atomic<std::size_t> _M_idle_mark_worker_count;
+        std::atomic<std::size_t> _M_shared_header_count;
+        std::vector<std::thread> _M_mark_threads;
+        std::mutex _M_mark_start_mutex;
+        std::condition_variable _M_mark_start_cv;
+        std::condition_variable _M_mark_end_cv;
+        std::uint64_t _M_mark_number;
+        std::size_t _M_running_mark_thread_count;
+        bool _M_are_mark_threads_stopped;
+        MarkThreadForkHandler _M_mark_thread_fork_handler;
+        bool _M_is_concurrent;
+        bool _M_is_concurrent_sweep;
+        std::atomic<bool> _M_is_marking;
+        std::mutex _M_collection_mutex;
+        Header *_M_marking_list_first;
+        std::vector<Object *> _M_written_objects;
+        std::vector<Header *> _M_deferred_headers;
+        std::vector<ChunkArena> _M_arenas;
+        std::vector<ChunkArena> _M_swept_arenas;
+        std::size_t _M_used_chunk_count;
+        std::vector<Chunk *> _M_empty_chunks;
 
         bool is_emtpy_list()
         { return _M_list_first == &_S_nil; }
@@ -47,16 +137,90 @@ namespace letin
           _M_list_first = header;
         }
 
+        static void add_local_header(ThreadContext *context, Header *header)
+        {
+          Registers &regs = context->regs();
+          regs.gc_local_adding_flag = true;
+          std::atomic_signal_fence(std::memory_order_seq_cst);
+          if(regs.gc_local_last == nullptr) regs.gc_local_last = header;
+          header->list_next = reinterpret_cast<Header *>(regs.gc_local_first);
+          regs.gc_local_first = header;
+          regs.gc_local_count++;
+          std::atomic_signal_fence(std::memory_order_seq_cst);
+          regs.gc_local_adding_flag = false;
+        }
+
+        void add_local_headers(ThreadContext *context)
+        {
+          Registers &regs = context->regs();
+          if(regs.gc_local_first == nullptr) return;
+          reinterpret_cast<Header *>(regs.gc_local_last)->list_next = _M_list_first;
+          std::atomic_thread_fence(std::memory_order_release);
+          _M_list_first = reinterpret_cast<Header *>(regs.gc_local_first);
+          regs.gc_local_first = regs.gc_local_last = nullptr;
+          regs.gc_local_count = 0;
+        }
+
+        static ChunkArena *ptr_to_arena(std::vector<ChunkArena> &arenas, const void *ptr);
+
+        static Chunk *header_to_chunk(std::vector<ChunkArena> &arenas, Header *header)
+        {
+          if(ptr_to_arena(arenas, header) == nullptr) return nullptr;
+          return reinterpret_cast<Chunk *>(reinterpret_cast<std::uintptr_t>(header) & ~static_cast<std::uintptr_t>(CHUNK_SIZE - 1));
+        }
+
+        void release_local_chunk(ThreadContext *context)
+        {
+          Registers &regs = context->regs();
+          if(regs.gc_chunk == nullptr) return;
+          Chunk *chunk = reinterpret_cast<Chunk *>(regs.gc_chunk);
+          if(chunk->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) free_chunk(chunk);
+          regs.gc_chunk = regs.gc_chunk_ptr = regs.gc_chunk_end = nullptr;
+        }
+
+        void free_header(Header *header, Chunk *chunk)
+        {
+          // A chunk is freed after the sweep if its objects are freed and the thread
+          // released it.
+          if(chunk == nullptr)
+            _M_alloc->free(reinterpret_cast<void *>(header));
+          else if(chunk->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            _M_empty_chunks.push_back(chunk);
+        }
+
+        void free_empty_chunks()
+        {
+          for(auto chunk : _M_empty_chunks) free_chunk(chunk);
+          _M_empty_chunks.clear();
+        }
+
         bool is_empty_stack()
         { return _M_stack_top == &_S_nil; }
         
         void mark_and_push_header(Header *header)
-        { header->stack_prev = _M_stack_top; _M_stack_top = header; }
+        { header->stack_prev.store(_M_stack_top, std::memory_order_relaxed); _M_stack_top = header; }
 
         Header *pop_header()
         {
           Header *saved_stack_top = _M_stack_top;
-          _M_stack_top = _M_stack_top->stack_prev;
+          _M_stack_top = _M_stack_top->stack_prev.load(std::memory_order_relaxed);
+          return saved_stack_top;
+        }
+
+        static void mark_and_push_worker_header(MarkWorker &worker, Header *header)
+        {
+          Header *expected = nullptr;
+          if(header->stack_prev.compare_exchange_strong(expected, worker.stack_top, std::memory_order_relaxed)) {
+            worker.stack_top = header;
+            worker.stack_size++;
+          }
+        }
+
+        static Header *pop_worker_header(MarkWorker &worker)
+        {
+          Header *saved_stack_top = worker.stack_top;
+          worker.stack_top = worker.stack_top->stack_prev.load(std::memory_order_relaxed);
+          worker.stack_size--;
           return saved_stack_top;
         }
 
@@ -67,6 +231,12 @@ namespace letin
           _M_immortal_list_first = header;
         }
 
+        static bool is_frozen_header(const Header *header)
+        {
+          Header *stack_prev = header->stack_prev.load(std::memory_order_relaxed);
+          return stack_prev == &_S_frozen || stack_prev == &_S_written_frozen;
+        }
+
         static Header *ptr_to_header(void *ptr)
         { return reinterpret_cast<Header *>(reinterpret_cast<char *>(ptr) - sizeof(Header)); }
 
@@ -82,36 +252,86 @@ namespace letin
             Header *next = header->list_next;
             Object *object = header_to_object(header);
             finalize_object(object);
-            _M_alloc->free(reinterpret_cast<void *>(header));
+            if(ptr_to_arena(_M_arenas, header) == nullptr) _M_alloc->free(reinterpret_cast<void *>(header));
             header = next;
           }
         }
-
-        static void finalize_object(Object *object)
-        {
-          if((object->type() & ~OBJECT_TYPE_UNIQUE) == OBJECT_TYPE_NATIVE_OBJECT)
-            object->raw().ntvo.clazz.finalizator()(reinterpret_cast<void *>(object->raw().ntvo.bs));
-          if(object->type() == OBJECT_TYPE_LAZY_VALUE)
-            object->raw().lzv.mutex.~LazyValueMutex();
-        }
       public:
-        MarkSweepGarbageCollector(Allocator *alloc, unsigned int interval_usecs = 100000);
+        MarkSweepGarbageCollector(Allocator *alloc, unsigned int interval_usecs = 100000, unsigned int mark_thread_count = 1, bool is_concurrent = false, bool is_concurrent_sweep = false, double growth_factor = 0.0, bool is_freezing_before_fork = false);
 
         ~MarkSweepGarbageCollector();
 
         void collect();
 
+        void write_barrier(Object *object, ThreadContext *context = nullptr);
+
+        void prepare_fork();
+
+        void delete_thread_context(ThreadContext *context);
+
         void *allocate(std::size_t size, ThreadContext *context);
 
         void *allocate_immortal_area(std::size_t size);
 
         void mark();
 
+        void add_all_local_headers();
+
+        void unmark_local_headers();
+
         void sweep();
 
         void mark_from_object(Object *object);
 
         std::size_t header_size();
+      private:
+        Chunk *allocate_chunk();
+
+        void free_chunk(Chunk *chunk);
+
+        void *allocate_from_local_chunk(std::size_t size, ThreadContext *context);
+
+        void mark_in_stopped_threads(CollectionTimes &times);
+
+        void mark_concurrently(std::unique_lock<GarbageCollector> &lock, CollectionTimes &times);
+
+        void sweep_concurrently(std::unique_lock<GarbageCollector> &lock);
+
+        Header *sweep_list(Header *header, Header *&last_header, std::size_t &live_byte_count, LiveObjectCounts &live_object_counts);
+
+        void collect_and_freeze();
+
+        void freeze_live_objects();
+
+        bool is_tmp_header(Header *header);
+
+        void mark_written_frozen_objects();
+
+        void mark_roots();
+
+        void mark_tmp_objects();
+
+        void mark_children(Header *header);
+
+        void mark_objects_from_stack();
+
+        void mark_objects_from_stack_concurrently();
+
+        void remark();
+
+        void start_mark_threads();
+
+        void stop_mark_threads();
+
+        void mark_in_thread(std::size_t i, std::uint64_t mark_number);
+
+        void mark_in_parallel();
+
+        void mark_in_worker(std::size_t i);
+
+        void share_worker_headers(MarkWorker &worker);
+
+        bool steal_worker_headers(MarkWorker &worker, std::size_t i);
       };
     }
   }
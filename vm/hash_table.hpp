@@ -1,5 +1,5 @@
 /****************************************************************************
- *   Copyright (C) 2015 Łukasz Szpakowski.                                  *
+ *   Copyright (C) 2015, 2019 Łukasz Szpakowski.                            *
  *                                                                          *
  *   This software is licensed under the GNU Lesser General Public          *
  *   License v3 or later. See the LICENSE file and the GPL file for         *
@@ -13,6 +13,7 @@
 #include <letin/const.hpp>
 #include <letin/vm.hpp>
 #include "priv.hpp"
+#include "thread_stop_cont.hpp"
 #include "vm.hpp"
 
 namespace letin
@@ -100,7 +101,7 @@ namespace letin
           std::uint8_t *bs;          
         };
 
-        std::mutex _M_mutex;
+        SafeRegionMutex _M_mutex;
         Reference _M_r;
         _Hash _M_hash;
         _Equal _M_equal;
@@ -181,7 +182,7 @@ namespace letin
 
         bool get(const _K &key, _V &value)
         {
-          std::lock_guard<std::mutex> guard(_M_mutex);
+          std::lock_guard<SafeRegionMutex> guard(_M_mutex);
           if(_M_r.has_nil()) return false;
           std::size_t i;
           Reference entry_r = find_entry_and_set_bucket_index(key, i);
@@ -192,7 +193,7 @@ namespace letin
 
         bool add(const _K &key, const _V &value, ThreadContext &context)
         {
-          std::lock_guard<std::mutex> mutex_guard(_M_mutex);
+          std::lock_guard<SafeRegionMutex> mutex_guard(_M_mutex);
           if(_M_r.has_nil()) return true;
           std::size_t i;
           Reference entry_r = find_entry_and_set_bucket_index(key, i);
@@ -216,6 +217,8 @@ namespace letin
             Reference &last_entry_r = raw().buckets[i].last_entry_r;
             {
               std::lock_guard<GarbageCollector> gc_guard(*(context.gc()));
+              context.gc()->write_barrier(_M_r.ptr(), &context);
+              if(!last_entry_r.has_nil()) context.gc()->write_barrier(last_entry_r.ptr(), &context);
               entry_raw(new_entry_r).prev_r = last_entry_r;
               entry_raw(new_entry_r).next_r = Reference();
               if(!last_entry_r.has_nil())
@@ -227,14 +230,16 @@ namespace letin
             context.regs().tmp_r.safely_assign_for_gc(Reference());
             context.safely_set_gc_tmp_ptr_for_gc(nullptr);
             raw().entry_count++;
-          } else
+          } else {
+            context.gc()->write_barrier(entry_r.ptr(), &context);
             safely_assign_for_gc(entry_raw(entry_r).value.value(), value);
+          }
           return true;
         }
 
         bool del(const _K &key, ThreadContext &context)
         {
-          std::lock_guard<std::mutex> mutex_guard(_M_mutex);
+          std::lock_guard<SafeRegionMutex> mutex_guard(_M_mutex);
           if(_M_r.has_nil()) return false;
           std::size_t i;
           Reference entry_r = find_entry_and_set_bucket_index(key, i);
@@ -243,6 +248,9 @@ namespace letin
           Reference &last_entry_r = raw().buckets[i].last_entry_r;
           {
             std::lock_guard<GarbageCollector> gc_guard(*(context.gc()));
+            context.gc()->write_barrier(_M_r.ptr(), &context);
+            if(!entry_raw(entry_r).prev_r.has_nil()) context.gc()->write_barrier(entry_raw(entry_r).prev_r.ptr(), &context);
+            if(!entry_raw(entry_r).next_r.has_nil()) context.gc()->write_barrier(entry_raw(entry_r).next_r.ptr(), &context);
             if(first_entry_r == entry_r) first_entry_r = entry_raw(entry_r).next_r;
             if(last_entry_r == entry_r) last_entry_r = entry_raw(entry_r).prev_r;
             Reference prev_r = entry_raw(entry_r).prev_r;
@@ -258,34 +266,36 @@ namespace letin
 
         Reference ref()
         {
-          std::lock_guard<std::mutex> mutex_guard(_M_mutex);
+          std::lock_guard<SafeRegionMutex> mutex_guard(_M_mutex);
           return _M_r;
         }
 
         Reference unsafe_ref() const { return _M_r; }
 
+        Reference &unsafe_ref() { return _M_r; }
+
         std::size_t bucket_count()
         {
-          std::lock_guard<std::mutex> mutex_guard(_M_mutex);
+          std::lock_guard<SafeRegionMutex> mutex_guard(_M_mutex);
           return !_M_r.has_nil() ? raw().bucket_count : 0;
         }
 
         bool set_bucket_count(std::size_t bucket_count, ThreadContext &context)
         {
-          std::lock_guard<std::mutex> mutex_guard(_M_mutex);
+          std::lock_guard<SafeRegionMutex> mutex_guard(_M_mutex);
           return safely_set_bucket_count(bucket_count, context);
         }
 
         bool set_bucket_count_for_nil_ref(std::size_t bucket_count, ThreadContext &context)
         {
-          std::lock_guard<std::mutex> mutex_guard(_M_mutex);
+          std::lock_guard<SafeRegionMutex> mutex_guard(_M_mutex);
           if(_M_r.has_nil()) return safely_set_bucket_count(bucket_count, context);
           return true;
         }
 
         std::size_t size()
         {
-          std::lock_guard<std::mutex> mutex_guard(_M_mutex);
+          std::lock_guard<SafeRegionMutex> mutex_guard(_M_mutex);
           return !_M_r.has_nil() ? raw().entry_count : 0;
         }
 
@@ -293,7 +303,7 @@ namespace letin
 
         void unlock() { _M_mutex.unlock(); }
 
-        void reinitialize_mutex() { new (&_M_mutex) std::mutex; }
+        void reinitialize_mutex() { new (&_M_mutex) SafeRegionMutex; }
       };
 
       template<>
@@ -316,6 +326,8 @@ namespace letin
 
         Reference key_ref() const { return _M_key_r; }
 
+        Reference &key_ref() { return _M_key_r; }
+
         bool set_key(const ArgumentList &key, ThreadContext &context)
         {
           Reference r(context.gc()->new_object(OBJECT_TYPE_TUPLE, key.length(), &context));
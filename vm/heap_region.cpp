@@ -0,0 +1,195 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#ifdef LETIN_COMPRESSED_REFERENCES
+#if defined(__unix__)
+#include <sys/mman.h>
+#elif defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#error "Unsupported operating system."
+#endif
+#include <map>
+#include <mutex>
+#include <new>
+#include <letin/const.hpp>
+#include <letin/vm.hpp>
+#include "heap_region.hpp"
+
+using namespace std;
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace priv
+    {
+      class HeapRegion
+      {
+      public:
+        mutex block_mutex;
+        char *base;
+        size_t top;
+        // The free blocks are indexed by their offsets for merging and by their sizes
+        // for finding the best fitting block.
+        map<size_t, size_t> free_blocks;
+        multimap<size_t, size_t> free_block_offsets;
+        map<size_t, size_t> used_blocks;
+        MutexForkHandler fork_handler;
+
+        HeapRegion();
+
+        ~HeapRegion();
+
+        bool commit(size_t offset, size_t size);
+
+        void decommit(size_t offset, size_t size);
+
+        void add_free_block(size_t offset, size_t size);
+
+        void delete_free_block(map<size_t, size_t>::iterator iter);
+      };
+
+      HeapRegion::HeapRegion() : top(HEAP_REGION_FIRST_BLOCK_OFFSET)
+      {
+        // The region is aligned to the block size because the pool allocator finds the
+        // slab of an object by masking the address of the object.
+#if defined(__unix__)
+        // The region is reserved with a margin and is trimmed to be aligned.
+        size_t region_size = HEAP_REGION_SIZE + HEAP_REGION_BLOCK_SIZE;
+        void *region = mmap(nullptr, region_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(region == MAP_FAILED) throw bad_alloc();
+        uintptr_t region_begin = reinterpret_cast<uintptr_t>(region);
+        uintptr_t begin = (region_begin + HEAP_REGION_BLOCK_SIZE - 1) & ~static_cast<uintptr_t>(HEAP_REGION_BLOCK_SIZE - 1);
+        uintptr_t end = begin + HEAP_REGION_SIZE;
+        if(begin > region_begin) munmap(region, begin - region_begin);
+        if(region_begin + region_size > end) munmap(reinterpret_cast<void *>(end), region_begin + region_size - end);
+        void *ptr = reinterpret_cast<void *>(begin);
+#else
+        // The reserved region is aligned to the allocation granularity that is 64 KiB.
+        void *ptr = ::VirtualAlloc(nullptr, HEAP_REGION_SIZE, MEM_RESERVE, PAGE_NOACCESS);
+        if(ptr == nullptr) throw bad_alloc();
+#endif
+        base = reinterpret_cast<char *>(ptr);
+        if(!commit(0, HEAP_REGION_BLOCK_SIZE)) throw bad_alloc();
+        new(base + Reference::nil_offset()) Object();
+        fork_handler.mutexes().push_back(&block_mutex);
+        // The mutex is locked after the mutexes of the allocators because the allocators
+        // allocate the blocks while they hold their mutexes.
+        add_fork_handler(FORK_HANDLER_PRIO_ALLOC - 1, &fork_handler);
+      }
+
+      HeapRegion::~HeapRegion()
+      { delete_fork_handler(FORK_HANDLER_PRIO_ALLOC - 1, &fork_handler); }
+
+      bool HeapRegion::commit(size_t offset, size_t size)
+      {
+#if defined(__unix__)
+        return mprotect(base + offset, size, PROT_READ | PROT_WRITE) == 0;
+#else
+        return ::VirtualAlloc(base + offset, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#endif
+      }
+
+      void HeapRegion::decommit(size_t offset, size_t size)
+      {
+#if defined(__unix__)
+        // The new mapping discards the pages of the block.
+        mmap(base + offset, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+#else
+        ::VirtualFree(base + offset, size, MEM_DECOMMIT);
+#endif
+      }
+
+      void HeapRegion::add_free_block(size_t offset, size_t size)
+      {
+        free_blocks[offset] = size;
+        free_block_offsets.insert(make_pair(size, offset));
+      }
+
+      void HeapRegion::delete_free_block(map<size_t, size_t>::iterator iter)
+      {
+        auto range = free_block_offsets.equal_range(iter->second);
+        for(auto offset_iter = range.first; offset_iter != range.second; offset_iter++) {
+          if(offset_iter->second == iter->first) {
+            free_block_offsets.erase(offset_iter);
+            break;
+          }
+        }
+        free_blocks.erase(iter);
+      }
+
+      static HeapRegion &heap_region()
+      {
+        static HeapRegion region;
+        return region;
+      }
+
+      char *reserve_heap_region() { return heap_region().base; }
+
+      void *allocate_heap_region_block(size_t size)
+      {
+        HeapRegion &region = heap_region();
+        if(size > HEAP_REGION_SIZE) return nullptr;
+        size = (size + HEAP_REGION_BLOCK_SIZE - 1) & ~(HEAP_REGION_BLOCK_SIZE - 1);
+        lock_guard<mutex> guard(region.block_mutex);
+        size_t offset;
+        auto offset_iter = region.free_block_offsets.lower_bound(size);
+        if(offset_iter != region.free_block_offsets.end()) {
+          offset = offset_iter->second;
+          size_t free_size = offset_iter->first;
+          region.free_block_offsets.erase(offset_iter);
+          region.free_blocks.erase(offset);
+          if(free_size > size) region.add_free_block(offset + size, free_size - size);
+        } else {
+          if(size > HEAP_REGION_SIZE - region.top) return nullptr;
+          offset = region.top;
+          region.top += size;
+        }
+        if(!region.commit(offset, size)) {
+          region.add_free_block(offset, size);
+          return nullptr;
+        }
+        region.used_blocks[offset] = size;
+        return reinterpret_cast<void *>(region.base + offset);
+      }
+
+      void free_heap_region_block(void *ptr)
+      {
+        HeapRegion &region = heap_region();
+        lock_guard<mutex> guard(region.block_mutex);
+        size_t offset = reinterpret_cast<char *>(ptr) - region.base;
+        auto used_iter = region.used_blocks.find(offset);
+        if(used_iter == region.used_blocks.end()) return;
+        size_t size = used_iter->second;
+        region.used_blocks.erase(used_iter);
+        region.decommit(offset, size);
+        // The freed block is merged with the adjacent free blocks.
+        auto next_iter = region.free_blocks.find(offset + size);
+        if(next_iter != region.free_blocks.end()) {
+          size += next_iter->second;
+          region.delete_free_block(next_iter);
+        }
+        auto iter = region.free_blocks.lower_bound(offset);
+        if(iter != region.free_blocks.begin()) {
+          auto prev_iter = prev(iter);
+          if(prev_iter->first + prev_iter->second == offset) {
+            offset = prev_iter->first;
+            size += prev_iter->second;
+            region.delete_free_block(prev_iter);
+          }
+        }
+        if(offset + size == region.top)
+          region.top = offset;
+        else
+          region.add_free_block(offset, size);
+      }
+    }
+  }
+}
+
+#endif
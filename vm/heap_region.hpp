@@ -0,0 +1,42 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#ifndef _HEAP_REGION_HPP
+#define _HEAP_REGION_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace priv
+    {
+      //
+      // The heap region is a reserved range of addresses for the compressed references.
+      // The range is divided into blocks that are aligned to the block size. Memory of
+      // a block is committed when the block is allocated and is decommitted when the
+      // block is freed. The first block is reserved for the nil object. The other blocks
+      // are allocated above the low offsets because small integers on the system stack
+      // could be taken for compressed references by the generational collector.
+      //
+
+      const std::uint64_t HEAP_REGION_SIZE = static_cast<std::uint64_t>(1) << 32;
+      const std::size_t HEAP_REGION_BLOCK_SIZE = 64 * 1024;
+      const std::size_t HEAP_REGION_FIRST_BLOCK_OFFSET = 256 * 1024 * 1024;
+
+      char *reserve_heap_region();
+
+      void *allocate_heap_region_block(std::size_t size);
+
+      void free_heap_region_block(void *ptr);
+    }
+  }
+}
+
+#endif
@@ -5,13 +5,23 @@
  *   License v3 or later. See the LICENSE file and the GPL file for         *
  *   the full licensing terms.                                              *
  ****************************************************************************/
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
+#include <iomanip>
+#include <limits>
+#include <list>
+#include <map>
 #include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
 #include <thread>
+#include <vector>
 #include <letin/vm.hpp>
 #include "impl_gc_base.hpp"
 #include "thread_stop_cont.hpp"
+#include "traverse.hpp"
 #include "vm.hpp"
 
 using namespace std;
@@ -24,25 +34,48 @@ namespace letin
     namespace impl
     {
       ImplGarbageCollectorBase::Threads::Threads(set<ThreadContext *> &contexts) :
-        _M_stop_cont(priv::new_thread_stop_cont()), contexts(contexts) {}
+        _M_stop_cont(priv::new_thread_stop_cont()), contexts(contexts), safepoint_flag(false) {}
 
       ImplGarbageCollectorBase::Threads::~Threads() { priv::delete_thread_stop_cont(_M_stop_cont); }
 
       void ImplGarbageCollectorBase::Threads::lock()
       {
+        if(safepoint_flag) {
+          // The stopped threads set their stack tops at the safepoints.
+          for(auto context : contexts) {
+            if(!must_stop_at_safepoint(context)) context->set_system_stack_top(nullptr);
+          }
+          stop_threads_at_safepoints([this](function<void (Safepoint &)> fun) {
+            for(auto context : contexts) {
+              if(must_stop_at_safepoint(context)) fun(context->safepoint());
+            }
+          });
+          return;
+        }
         for(auto context : contexts) context->interruptible_fun_mutex().lock();
+        for(auto context : contexts) {
+          if(!context->interruptible_fun_flag()) context->set_system_stack_top(nullptr);
+        }
         stop_threads(_M_stop_cont, [this](function<void (thread &)> fun) {
           for(auto context : contexts) {
-            if(!context->interruptible_fun_flag()) fun(context->system_thread());
+            if(must_stop(context)) fun(context->system_thread());
           }
         });
       }
 
       void ImplGarbageCollectorBase::Threads::unlock()
       {
+        if(safepoint_flag) {
+          continue_threads_from_safepoints([this](function<void (Safepoint &)> fun) {
+            for(auto context : contexts) {
+              if(must_stop_at_safepoint(context)) fun(context->safepoint());
+            }
+          });
+          return;
+        }
         continue_threads(_M_stop_cont, [this](function<void (thread &)> fun) {
           for(auto context : contexts) {
-            if(!context->interruptible_fun_flag()) fun(context->system_thread());
+            if(must_stop(context)) fun(context->system_thread());
           }
         });
         for(auto context : contexts) context->interruptible_fun_mutex().unlock();
@@ -52,6 +85,7 @@ namespace letin
 
       void ImplGarbageCollectorBase::ImplForkHandler::pre_fork()
       {
+        SafeRegionGuard guard;
         _M_gc->_M_gc_thread_mutex.lock();
         {
           unique_lock<mutex> lock(_M_gc->_M_interval_mutex);
@@ -61,6 +95,7 @@ namespace letin
         _M_gc->_M_other_thread_mutex.lock();
         _M_gc->_M_interval_mutex.lock();
         _M_gc->_M_gc_mutex.lock();
+        _M_gc->_M_finalization_mutex.lock();
         _M_gc->_M_forking_thread_context = nullptr;
         for(auto context : _M_gc->_M_thread_contexts) {
           context->interruptible_fun_mutex().lock();
@@ -92,6 +127,7 @@ namespace letin
         _M_gc->_M_forking_thread_context = nullptr;
         _M_gc->_M_is_locked_gc_thread = false;
         bool is_started = _M_gc->_M_is_started;
+        bool is_finalization_thread_started = _M_gc->_M_is_finalization_thread_started;
         if(is_child) {
           _M_gc->_M_is_started = false;
           _M_gc->_M_must_stop_from_vm_thread = true;
@@ -100,7 +136,15 @@ namespace letin
           new (&(_M_gc->_M_interval_mutex)) mutex;
           new (&(_M_gc->_M_other_thread_mutex)) mutex;
           new (&(_M_gc->_M_gc_thread_mutex)) mutex;
+          new (&(_M_gc->_M_stats_mutex)) mutex;
+          new (&(_M_gc->_M_collection_cv)) condition_variable;
+          _M_gc->_M_lock_owner_id.store(thread::id(), memory_order_relaxed);
+          _M_gc->_M_lock_depth = 0;
+          _M_gc->_M_is_finalization_thread_started = false;
+          new (&(_M_gc->_M_finalization_mutex)) mutex;
+          new (&(_M_gc->_M_finalization_cv)) condition_variable;
         } else {
+          _M_gc->_M_finalization_mutex.unlock();
           _M_gc->_M_gc_mutex.unlock();
           _M_gc->_M_interval_mutex.unlock();
           _M_gc->_M_other_thread_mutex.unlock();
@@ -110,10 +154,15 @@ namespace letin
           new (&(_M_gc->_M_gc_thread)) thread;
           _M_gc->start_gc_thread();
         }
+        if(is_child && is_finalization_thread_started && is_forking_thread_context) {
+          new (&(_M_gc->_M_finalization_thread)) thread;
+          _M_gc->start_finalization_thread();
+        }
       }
 
       ImplGarbageCollectorBase::~ImplGarbageCollectorBase()
       {
+        stop_finalization_thread();
         if(_M_impl_fork_handler != nullptr)
           delete_fork_handler(FORK_HANDLER_PRIO_GC, _M_impl_fork_handler);
       }
@@ -122,12 +171,14 @@ namespace letin
       {
         lock_guard<GarbageCollector> gaurd(*this);
         _M_thread_contexts.insert(context);
+        context->safepoint().is_enabled = _M_threads.safepoint_flag;
       }
 
       void ImplGarbageCollectorBase::delete_thread_context(ThreadContext *context)
       {
         lock_guard<GarbageCollector> gaurd(*this);
         _M_thread_contexts.erase(context);
+        context->safepoint().is_enabled = false;
       }
 
       size_t ImplGarbageCollectorBase::thread_context_count()
@@ -159,6 +210,15 @@ namespace letin
         if(!is_started) {
           _M_gc_thread = thread([this]() {
             unique_lock<mutex> other_thread_lock(_M_other_thread_mutex);
+            // The thread only is woken by the pacing if the timer is disabled.
+            bool is_timer = (_M_interval_usecs != 0 || _M_growth_factor == 0.0);
+            auto wait = [this, is_timer](unique_lock<mutex> &lock, chrono::microseconds rel_time) {
+              if(!is_timer) {
+                _M_interval_cv.wait(lock);
+                return true;
+              }
+              return _M_interval_cv.wait_for(lock, rel_time) != cv_status::timeout;
+            };
             while(true) {
               // Sleeps.
               auto rel_time = chrono::microseconds(_M_interval_usecs);
@@ -184,10 +244,21 @@ namespace letin
                     abs_time1 = abs_time2;
                   }
                   if(!_M_is_started) return;
-                } while(_M_interval_cv.wait_for(interval_lock, rel_time) != cv_status::timeout);
-              } while(_M_is_locked_gc_thread);
+                  if(_M_is_collection_requested) break;
+                } while(wait(interval_lock, rel_time));
+              } while(_M_is_locked_gc_thread && !_M_is_collection_requested);
               // Collects.
-              collect();
+              bool is_requested;
+              {
+                lock_guard<mutex> guard(_M_interval_mutex);
+                is_requested = _M_is_collection_requested;
+                _M_is_collection_requested = false;
+              }
+              // With the pacing, the timer only is a fallback and it doesn't start the
+              // collection if nothing was allocated since the last collection.
+              if(_M_growth_factor == 0.0 || is_requested ||
+                  (is_timer && _M_allocated_byte_count.load(memory_order_relaxed) > 0))
+                collect();
             }
           });
         }
@@ -203,17 +274,376 @@ namespace letin
         if(_M_gc_thread.joinable()) _M_gc_thread.join();
       }
 
-      void ImplGarbageCollectorBase::start() { start_gc_thread(); }
+      void ImplGarbageCollectorBase::start_finalization_thread()
+      {
+        lock_guard<mutex> guard(_M_finalization_mutex);
+        if(_M_is_finalization_thread_started) return;
+        _M_is_finalization_thread_started = true;
+        _M_finalization_thread = thread([this]() {
+          unique_lock<mutex> lock(_M_finalization_mutex);
+          // The thread finalizes all queued native objects before it stops.
+          while(true) {
+            if(!_M_finalizations.empty()) {
+              NativeObjectFinalization finalization = move(_M_finalizations.front());
+              _M_finalizations.pop_front();
+              lock.unlock();
+              finalization.finalizator(reinterpret_cast<void *>(finalization.bytes.get()));
+              lock.lock();
+            } else if(_M_is_finalization_thread_started)
+              _M_finalization_cv.wait(lock);
+            else
+              break;
+          }
+        });
+      }
 
-      void ImplGarbageCollectorBase::stop() { stop_gc_thread(); }
+      void ImplGarbageCollectorBase::stop_finalization_thread()
+      {
+        {
+          lock_guard<mutex> guard(_M_finalization_mutex);
+          _M_is_finalization_thread_started = false;
+          _M_finalization_cv.notify_one();
+        }
+        if(_M_finalization_thread.joinable()) _M_finalization_thread.join();
+        // The native objects can be queued without the thread in the forked process.
+        for(auto &finalization : _M_finalizations)
+          finalization.finalizator(reinterpret_cast<void *>(finalization.bytes.get()));
+        _M_finalizations.clear();
+      }
+
+      void ImplGarbageCollectorBase::start()
+      {
+        start_finalization_thread();
+        start_gc_thread();
+      }
+
+      void ImplGarbageCollectorBase::stop()
+      {
+        stop_gc_thread();
+        stop_finalization_thread();
+      }
 
-      void ImplGarbageCollectorBase::lock() { _M_gc_mutex.lock(); }
+      // A thread that waits for the lock is in a safe region because the lock can be
+      // held by the garbage collector that waits for the threads at the safepoints.
+      void ImplGarbageCollectorBase::lock()
+      {
+        lock_in_safe_region(_M_gc_mutex);
+        if(_M_lock_depth == 0) _M_lock_owner_id.store(this_thread::get_id(), memory_order_relaxed);
+        _M_lock_depth++;
+      }
 
-      void ImplGarbageCollectorBase::unlock() { _M_gc_mutex.unlock(); }
+      void ImplGarbageCollectorBase::unlock()
+      {
+        _M_lock_depth--;
+        if(_M_lock_depth == 0) _M_lock_owner_id.store(thread::id(), memory_order_relaxed);
+        _M_gc_mutex.unlock();
+      }
 
       thread &ImplGarbageCollectorBase::system_thread() { return _M_gc_thread; }
 
       bool ImplGarbageCollectorBase::must_stop_from_vm_thread() { return _M_must_stop_from_vm_thread; }
+
+      size_t ImplGarbageCollectorBase::allocated_byte_count()
+      { return _M_allocated_byte_count.load(memory_order_relaxed); }
+
+      size_t ImplGarbageCollectorBase::collection_byte_count()
+      { return _M_collection_byte_count.load(memory_order_relaxed); }
+
+      bool ImplGarbageCollectorBase::safepoint_flag() { return _M_threads.safepoint_flag; }
+
+      void ImplGarbageCollectorBase::set_safepoint_flag(bool flag)
+      {
+        lock_guard<GarbageCollector> guard(*this);
+        _M_threads.safepoint_flag = flag;
+        for(auto context : _M_thread_contexts) context->safepoint().is_enabled = flag;
+      }
+
+      bool ImplGarbageCollectorBase::heap_snapshot(HeapSnapshot &snapshot)
+      {
+        lock_guard<GarbageCollector> guard(*this);
+        size_t max_count = 1024 + allocated_byte_count() / 32;
+        {
+          lock_guard<mutex> guard2(_M_stats_mutex);
+          for(size_t i = 0; i <= static_cast<size_t>(OBJECT_TYPE_NATIVE_OBJECT); i++)
+            max_count += _M_stats.live_object_counts[i];
+          max_count += _M_stats.live_internal_object_count;
+        }
+        unique_ptr<HeapSnapshotObjectSet> visited_objects;
+        vector<Object *> stack;
+        // The memory for the traversal is allocated before stopping the threads because
+        // a stopped thread can hold a lock of the allocator.
+        do {
+          snapshot = HeapSnapshot();
+          snapshot.sampling_interval = sampling_interval();
+          visited_objects.reset(nullptr);
+          visited_objects.reset(new HeapSnapshotObjectSet(max_count));
+          stack.clear();
+          stack.reserve(max_count);
+          {
+            lock_guard<Threads> guard2(_M_threads);
+            traverse_heap_for_snapshot(snapshot, *visited_objects, stack);
+          }
+          max_count *= 2;
+        } while(visited_objects->is_full());
+        // The samples of the unreachable objects are deleted because the addresses of
+        // these objects can be reused by other objects. The types and the lengths are
+        // compared for the samples of the freed objects that weren't still deleted.
+        map<size_t, HeapSnapshotEntry> fun_entries;
+        for(auto iter = _M_samples.begin(); iter != _M_samples.end();) {
+          Object *object = iter->first;
+          const Sample &sample = iter->second;
+          if(!visited_objects->contains(object) ||
+              object->type() != sample.type || object->length() != sample.length) {
+            iter = _M_samples.erase(iter);
+            continue;
+          }
+          HeapSnapshotEntry &entry = fun_entries[sample.fun];
+          entry.object_count++;
+          entry.byte_count += object_size(*object);
+          iter++;
+        }
+        for(auto &pair : fun_entries) {
+          string name;
+          for(auto context : _M_vm_contexts) {
+            auto symbol_iter = context->fun_symbols().find(pair.first);
+            if(symbol_iter != context->fun_symbols().end()) {
+              name = symbol_iter->second;
+              break;
+            }
+          }
+          if(name.empty()) {
+            ostringstream oss;
+            oss << "<0x" << hex << setw(8) << setfill('0') << pair.first << ">";
+            name = oss.str();
+          }
+          HeapSnapshotEntry &entry = snapshot.fun_entries[name];
+          entry.object_count += pair.second.object_count;
+          entry.byte_count += pair.second.byte_count;
+        }
+        return true;
+      }
+
+      void ImplGarbageCollectorBase::traverse_heap_for_snapshot(HeapSnapshot &snapshot, HeapSnapshotObjectSet &objects, vector<Object *> &stack)
+      {
+        struct Visitor
+        {
+          HeapSnapshot &snapshot;
+          HeapSnapshotObjectSet &objects;
+          vector<Object *> &stack;
+          int root;
+
+          void visit(Object *object)
+          {
+            if(!objects.insert(object)) return;
+            size_t size = object_size(*object);
+            int type = object->type() & ~OBJECT_TYPE_UNIQUE;
+            HeapSnapshotEntry &type_entry = (type >= 0 && type <= OBJECT_TYPE_NATIVE_OBJECT ? snapshot.type_entries[type] : snapshot.internal_entry);
+            type_entry.object_count++;
+            type_entry.byte_count += size;
+            snapshot.root_entries[root].object_count++;
+            snapshot.root_entries[root].byte_count += size;
+            stack.push_back(object);
+          }
+
+          void visit_children()
+          {
+            while(!stack.empty()) {
+              Object *object = stack.back();
+              stack.pop_back();
+              for_each_child_object<false>(*object, [this](Object *child) { visit(child); });
+            }
+          }
+        };
+        Visitor visitor = { snapshot, objects, stack, HEAP_SNAPSHOT_ROOT_GLOBAL_VARS };
+        // The function only refers to the visitor so that it is stored without the
+        // allocation.
+        function<void (Object *)> fun = [&visitor](Object *object) { visitor.visit(object); };
+        for(auto context : _M_vm_contexts) {
+          for(size_t i = 0; i < context->var_count(); i++) {
+            const Value &var = context->vars()[i];
+            if(is_ref_value_type_for_gc(var.type()) && !var.raw().r.has_nil()) visitor.visit(var.raw().r.ptr());
+          }
+        }
+        visitor.visit_children();
+        visitor.root = HEAP_SNAPSHOT_ROOT_MEMO_CACHES;
+        for(auto context : _M_vm_contexts) {
+          for(auto memo_cache : context->memo_caches()) memo_cache->traverse_root_objects(fun);
+        }
+        visitor.visit_children();
+        visitor.root = HEAP_SNAPSHOT_ROOT_THREADS;
+        for(auto context : _M_thread_contexts) context->traverse_root_objects(fun);
+        visitor.visit_children();
+      }
+
+      ImplGarbageCollectorBase::HeapSnapshotObjectSet::HeapSnapshotObjectSet(size_t max_count) :
+        _M_count(0), _M_max_count(max_count), _M_is_full(false)
+      {
+        size_t size = 1;
+        while(size < max_count * 2) size <<= 1;
+        _M_objects.resize(size, nullptr);
+      }
+
+      void ImplGarbageCollectorBase::prepare_sample_moves()
+      {
+        _M_sample_moves.clear();
+        try {
+          _M_sample_moves.reserve(_M_samples.size());
+        } catch(bad_alloc &) {
+          _M_samples.clear();
+        }
+      }
+
+      void ImplGarbageCollectorBase::apply_sample_moves()
+      {
+        vector<Sample> samples;
+        samples.reserve(_M_sample_moves.size());
+        for(auto &move : _M_sample_moves) {
+          auto iter = _M_samples.find(move.first);
+          samples.push_back(iter->second);
+          _M_samples.erase(iter);
+        }
+        for(size_t i = 0; i < _M_sample_moves.size(); i++) _M_samples[_M_sample_moves[i].second] = samples[i];
+        _M_sample_moves.clear();
+      }
+
+      void ImplGarbageCollectorBase::sample_allocation(Object *object, ThreadContext *context)
+      {
+        size_t fun = context->regs().fp;
+        if(fun == static_cast<size_t>(-1)) return;
+        lock_guard<GarbageCollector> guard(*this);
+        Sample sample = { fun, object->type(), object->length() };
+        _M_samples[object] = sample;
+      }
+
+      size_t ImplGarbageCollectorBase::max_heap_size()
+      { return _M_max_heap_size.load(memory_order_relaxed); }
+
+      void ImplGarbageCollectorBase::set_max_heap_size(size_t size)
+      { _M_max_heap_size.store(size, memory_order_relaxed); }
+
+      GarbageCollectorStatistics ImplGarbageCollectorBase::statistics()
+      {
+        GarbageCollectorStatistics stats;
+        {
+          lock_guard<mutex> guard(_M_stats_mutex);
+          stats = _M_stats;
+        }
+        stats.allocated_byte_count = _M_total_allocated_byte_count.load(memory_order_relaxed);
+        stats.freed_byte_count = _M_freed_byte_count.load(memory_order_relaxed);
+        stats.immortal_byte_count = _M_immortal_byte_count.load(memory_order_relaxed);
+        return stats;
+      }
+
+      void ImplGarbageCollectorBase::add_collection_times(const CollectionTimes &times)
+      {
+        size_t i = 0;
+        while(i + 1 < GarbageCollectorStatistics::PAUSE_HISTOGRAM_SIZE && (times.pause_usecs >> (i + 1)) != 0) i++;
+        lock_guard<mutex> guard(_M_stats_mutex);
+        _M_stats.collection_count++;
+        _M_stats.total_stop_usecs += times.stop_usecs;
+        _M_stats.total_mark_usecs += times.mark_usecs + times.remark_usecs;
+        _M_stats.total_sweep_usecs += times.sweep_usecs;
+        _M_stats.total_pause_usecs += times.pause_usecs;
+        _M_stats.max_pause_usecs = max(_M_stats.max_pause_usecs, times.pause_usecs);
+        _M_stats.pause_histogram[i]++;
+        _M_collection_cv.notify_all();
+      }
+
+      void ImplGarbageCollectorBase::set_live_object_counts(const LiveObjectCounts &counts)
+      {
+        lock_guard<mutex> guard(_M_stats_mutex);
+        for(size_t i = 0; i <= static_cast<size_t>(OBJECT_TYPE_NATIVE_OBJECT); i++)
+          _M_stats.live_object_counts[i] = counts.counts[i];
+        _M_stats.live_internal_object_count = counts.internal_count;
+      }
+
+      void ImplGarbageCollectorBase::set_live_byte_count(size_t count)
+      {
+        {
+          lock_guard<mutex> guard(_M_stats_mutex);
+          _M_stats.live_byte_count = count;
+        }
+        _M_live_byte_count.store(count, memory_order_relaxed);
+        _M_allocated_byte_count.store(0, memory_order_relaxed);
+        if(_M_growth_factor != 0.0) {
+          double tmp_count = static_cast<double>(count) * (_M_growth_factor - 1.0);
+          size_t threshold = MIN_COLLECTION_BYTE_COUNT;
+          if(tmp_count >= static_cast<double>(numeric_limits<size_t>::max()))
+            threshold = numeric_limits<size_t>::max();
+          else if(tmp_count > static_cast<double>(threshold))
+            threshold = static_cast<size_t>(tmp_count);
+          _M_collection_byte_count.store(threshold, memory_order_relaxed);
+        }
+      }
+
+      void ImplGarbageCollectorBase::request_collection()
+      {
+        lock_guard<mutex> guard(_M_interval_mutex);
+        _M_is_collection_requested = true;
+        _M_interval_cv.notify_one();
+      }
+
+      void ImplGarbageCollectorBase::collect_in_emergency()
+      {
+        bool is_started;
+        {
+          lock_guard<mutex> guard(_M_interval_mutex);
+          is_started = _M_is_started;
+        }
+        if(is_started) {
+          // The thread waits for the collection in a safe region so that the garbage
+          // collector thread can scan the system stack of this thread.
+          SafeRegionGuard safe_region_guard;
+          unique_lock<mutex> lock(_M_stats_mutex);
+          uint64_t collection_count = _M_stats.collection_count;
+          request_collection();
+          while(_M_stats.collection_count == collection_count) _M_collection_cv.wait(lock);
+          _M_stats.emergency_collection_count++;
+        } else {
+          collect();
+          lock_guard<mutex> guard(_M_stats_mutex);
+          _M_stats.emergency_collection_count++;
+        }
+      }
+
+      void ImplGarbageCollectorBase::finalize_native_object(Object *object)
+      {
+        NativeObjectFinalizator finalizator = object->raw().ntvo.clazz.finalizator();
+        {
+          lock_guard<mutex> guard(_M_finalization_mutex);
+          if(_M_is_finalization_thread_started) {
+            try {
+              NativeObjectFinalization finalization;
+              finalization.finalizator = finalizator;
+              finalization.bytes = unique_ptr<char []>(new char[object->length()]);
+              copy_n(object->raw().ntvo.bs, object->length(), finalization.bytes.get());
+              _M_finalizations.push_back(move(finalization));
+              _M_finalization_cv.notify_one();
+              return;
+            } catch(bad_alloc &) {
+            }
+          }
+        }
+        finalizator(reinterpret_cast<void *>(object->raw().ntvo.bs));
+      }
+
+      bool ImplGarbageCollectorBase::check_heap_size(size_t count, size_t max_heap_size)
+      {
+        size_t heap_size = heap_byte_count();
+        if(heap_size <= max_heap_size && count <= max_heap_size - heap_size) {
+          // The collection is requested earlier so that the threads rarely have to wait
+          // for the emergency collection.
+          size_t soft_max_heap_size = max_heap_size - max_heap_size / 4;
+          if(heap_size < soft_max_heap_size && heap_size + count >= soft_max_heap_size) request_collection();
+          return true;
+        }
+        // The thread that holds the lock can have allocated objects that aren't referred
+        // by the roots yet so it can't start the emergency collection.
+        if(_M_lock_owner_id.load(memory_order_relaxed) == this_thread::get_id()) return false;
+        collect_in_emergency();
+        heap_size = heap_byte_count();
+        return heap_size <= max_heap_size && count <= max_heap_size - heap_size;
+      }
     }
   }
 }
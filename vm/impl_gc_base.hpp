@@ -1,5 +1,5 @@
 /****************************************************************************
- *   Copyright (C) 2014-2015 Łukasz Szpakowski.                             *
+ *   Copyright (C) 2014-2015, 2019 Łukasz Szpakowski.                       *
  *                                                                          *
  *   This software is licensed under the GNU Lesser General Public          *
  *   License v3 or later. See the LICENSE file and the GPL file for         *
@@ -8,11 +8,18 @@
 #ifndef _IMPL_GC_BASE_HPP
 #define _IMPL_GC_BASE_HPP
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <list>
 #include <memory>
 #include <mutex>
 #include <set>
 #include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <letin/vm.hpp>
 #include "vm.hpp"
 
@@ -29,12 +36,97 @@ namespace letin
     {
       class ImplGarbageCollectorBase : public GarbageCollector
       {
+      public:
+        struct CollectionTimes
+        {
+          std::uint64_t stop_usecs;
+          std::uint64_t mark_usecs;
+          std::uint64_t remark_usecs;
+          std::uint64_t sweep_usecs;
+          std::uint64_t pause_usecs;
+        };
+      private:
+        struct Sample
+        {
+          std::size_t fun;
+          int type;
+          std::size_t length;
+        };
+
+        // The heap snapshot records the visited objects in an open addressing table that
+        // is allocated before stopping the threads. The table never grows so the snapshot
+        // has to be taken again with a larger table if the table is full.
+        class HeapSnapshotObjectSet
+        {
+          std::vector<Object *> _M_objects;
+          std::size_t _M_count;
+          std::size_t _M_max_count;
+          bool _M_is_full;
+
+          std::size_t index(const Object *object) const
+          {
+            std::size_t hash = static_cast<std::size_t>(reinterpret_cast<std::uintptr_t>(object) >> 3);
+            return (hash * static_cast<std::size_t>(0x9e3779b97f4a7c15ULL)) & (_M_objects.size() - 1);
+          }
+        public:
+          HeapSnapshotObjectSet(std::size_t max_count);
+
+          std::size_t max_count() const { return _M_max_count; }
+
+          bool is_full() const { return _M_is_full; }
+
+          bool insert(Object *object)
+          {
+            std::size_t i = index(object);
+            for(; _M_objects[i] != nullptr; i = (i + 1) & (_M_objects.size() - 1))
+              if(_M_objects[i] == object) return false;
+            if(_M_count >= _M_max_count) {
+              _M_is_full = true;
+              return false;
+            }
+            _M_objects[i] = object;
+            _M_count++;
+            return true;
+          }
+
+          bool contains(const Object *object) const
+          {
+            std::size_t i = index(object);
+            for(; _M_objects[i] != nullptr; i = (i + 1) & (_M_objects.size() - 1))
+              if(_M_objects[i] == object) return true;
+            return false;
+          }
+        };
+
+        struct NativeObjectFinalization
+        {
+          NativeObjectFinalizator finalizator;
+          std::unique_ptr<char []> bytes;
+        };
       protected:
+        struct LiveObjectCounts
+        {
+          std::uint64_t counts[OBJECT_TYPE_NATIVE_OBJECT + 1];
+          std::uint64_t internal_count;
+
+          LiveObjectCounts() : counts(), internal_count(0) {}
+
+          void add(const Object *object)
+          {
+            int type = object->type() & ~OBJECT_TYPE_UNIQUE;
+            if(type >= 0 && type <= OBJECT_TYPE_NATIVE_OBJECT)
+              counts[type]++;
+            else
+              internal_count++;
+          }
+        };
+
         class Threads
         {
           priv::ThreadStopCont *_M_stop_cont;
         public:
           std::set<ThreadContext *> &contexts;
+          bool safepoint_flag;
 
           Threads(std::set<ThreadContext *> &contexts);
 
@@ -43,6 +135,18 @@ namespace letin
           void lock();
 
           void unlock();
+        private:
+          static bool must_stop(ThreadContext *context)
+          {
+            return !context->interruptible_fun_flag() && context->system_thread().joinable() &&
+              context->system_thread().get_id() != std::this_thread::get_id();
+          }
+
+          static bool must_stop_at_safepoint(ThreadContext *context)
+          {
+            return context->safepoint().is_enabled && context->system_thread().joinable() &&
+              context->system_thread().get_id() != std::this_thread::get_id();
+          }
         };
 
         class ImplForkHandler : public ForkHandler
@@ -74,12 +178,40 @@ namespace letin
         ImplForkHandler *_M_impl_fork_handler;
         ThreadContext *_M_forking_thread_context;
         bool _M_must_stop_from_vm_thread;
+        double _M_growth_factor;
+        std::atomic<std::size_t> _M_allocated_byte_count;
+        std::atomic<std::size_t> _M_collection_byte_count;
+        bool _M_is_collection_requested;
+        std::atomic<std::uint64_t> _M_total_allocated_byte_count;
+        std::atomic<std::uint64_t> _M_freed_byte_count;
+        std::atomic<std::uint64_t> _M_immortal_byte_count;
+        std::mutex _M_stats_mutex;
+        std::condition_variable _M_collection_cv;
+        GarbageCollectorStatistics _M_stats;
+        std::atomic<std::size_t> _M_live_byte_count;
+        std::atomic<std::size_t> _M_max_heap_size;
+        std::atomic<std::thread::id> _M_lock_owner_id;
+        unsigned _M_lock_depth;
+        std::unordered_map<Object *, Sample> _M_samples;
+        std::vector<std::pair<Object *, Object *>> _M_sample_moves;
+        std::thread _M_finalization_thread;
+        std::mutex _M_finalization_mutex;
+        std::condition_variable _M_finalization_cv;
+        std::list<NativeObjectFinalization> _M_finalizations;
+        bool _M_is_finalization_thread_started;
+      protected:
+        static const std::size_t MIN_COLLECTION_BYTE_COUNT = 4 * 1024 * 1024;
       public:
-        ImplGarbageCollectorBase(Allocator *alloc, unsigned int interval_usecs) :
+        ImplGarbageCollectorBase(Allocator *alloc, unsigned int interval_usecs, double growth_factor = 0.0) :
           GarbageCollector(alloc), _M_threads(_M_thread_contexts), _M_is_started(false),
           _M_interval_usecs(interval_usecs), _M_is_locked_gc_thread(false),
           _M_impl_fork_handler(nullptr), _M_forking_thread_context(nullptr),
-          _M_must_stop_from_vm_thread(false) {}
+          _M_must_stop_from_vm_thread(false), _M_growth_factor(growth_factor),
+          _M_allocated_byte_count(0), _M_collection_byte_count(MIN_COLLECTION_BYTE_COUNT),
+          _M_is_collection_requested(false), _M_total_allocated_byte_count(0),
+          _M_freed_byte_count(0), _M_immortal_byte_count(0), _M_stats(),
+          _M_live_byte_count(0), _M_max_heap_size(0), _M_lock_owner_id(std::thread::id()),
+          _M_lock_depth(0), _M_is_finalization_thread_started(false) {}
 
         ~ImplGarbageCollectorBase();
       protected:
@@ -88,6 +220,87 @@ namespace letin
           _M_impl_fork_handler = handler;
           add_fork_handler(FORK_HANDLER_PRIO_GC, _M_impl_fork_handler);
         }
+
+        // The collection is requested from the garbage collector thread when the number
+        // of bytes that were allocated since the last collection reaches the threshold.
+        // This function returns false if the allocation would exceed the maximal size of
+        // the heap.
+        bool add_allocated_byte_count(std::size_t count)
+        {
+          std::size_t max_heap_size = _M_max_heap_size.load(std::memory_order_relaxed);
+          if(max_heap_size != 0 && !check_heap_size(count, max_heap_size)) return false;
+          _M_total_allocated_byte_count.fetch_add(count, std::memory_order_relaxed);
+          std::size_t old_count = _M_allocated_byte_count.fetch_add(count, std::memory_order_relaxed);
+          if(_M_growth_factor != 0.0) {
+            std::size_t threshold = _M_collection_byte_count.load(std::memory_order_relaxed);
+            if(old_count < threshold && old_count + count >= threshold) request_collection();
+          }
+          return true;
+        }
+
+        void set_live_byte_count(std::size_t count);
+
+        void add_freed_byte_count(std::size_t count)
+        { _M_freed_byte_count.fetch_add(count, std::memory_order_relaxed); }
+
+        void add_immortal_byte_count(std::size_t count)
+        { _M_immortal_byte_count.fetch_add(count, std::memory_order_relaxed); }
+
+        void add_collection_times(const CollectionTimes &times);
+
+        void set_live_object_counts(const LiveObjectCounts &counts);
+
+        // The moving garbage collector has to call the prepare_sample_moves method before
+        // stopping the threads, the move_sample method for each moved object and the
+        // apply_sample_moves method after continuing the threads so that the samples
+        // refer to the objects. The moves are recorded in a buffer that is reserved for
+        // all samples because a stopped thread can hold a lock of the allocator.
+        void prepare_sample_moves();
+
+        void move_sample(Object *old_object, Object *new_object)
+        {
+          if(_M_samples.empty()) return;
+          if(_M_samples.find(old_object) == _M_samples.end()) return;
+          if(_M_sample_moves.size() < _M_sample_moves.capacity())
+            _M_sample_moves.push_back(std::make_pair(old_object, new_object));
+        }
+
+        void apply_sample_moves();
+
+        void sample_allocation(Object *object, ThreadContext *context);
+
+        // The native objects are finalized by the finalization thread when the garbage
+        // collector is started so that slow finalizers don't extend the pauses. Then, a
+        // finalizer gets a copy of the bytes of its native object. A native object is
+        // finalized at once if the copy can't be allocated.
+        void finalize_object(Object *object)
+        {
+          if((object->type() & ~OBJECT_TYPE_UNIQUE) == OBJECT_TYPE_NATIVE_OBJECT)
+            finalize_native_object(object);
+          if(object->type() == OBJECT_TYPE_LAZY_VALUE)
+            object->raw().lzv.mutex.~LazyValueMutex();
+        }
+
+        static std::uint64_t usecs_since(std::chrono::high_resolution_clock::time_point time)
+        {
+          auto time_diff = std::chrono::high_resolution_clock::now() - time;
+          return std::chrono::duration_cast<std::chrono::microseconds>(time_diff).count();
+        }
+      private:
+        void request_collection();
+
+        std::size_t heap_byte_count()
+        {
+          return _M_live_byte_count.load(std::memory_order_relaxed) +
+            _M_allocated_byte_count.load(std::memory_order_relaxed) +
+            _M_immortal_byte_count.load(std::memory_order_relaxed);
+        }
+
+        void collect_in_emergency();
+
+        void finalize_native_object(Object *object);
+
+        bool check_heap_size(std::size_t count, std::size_t max_heap_size);
       public:
         void add_thread_context(ThreadContext *context);
 
@@ -104,6 +317,10 @@ namespace letin
         void start_gc_thread();
 
         void stop_gc_thread();
+
+        void start_finalization_thread();
+
+        void stop_finalization_thread();
       public:
         void start();
 
@@ -116,6 +333,24 @@ namespace letin
         std::thread &system_thread();
 
         bool must_stop_from_vm_thread();
+
+        std::size_t allocated_byte_count();
+
+        std::size_t collection_byte_count();
+
+        GarbageCollectorStatistics statistics();
+
+        bool safepoint_flag();
+
+        void set_safepoint_flag(bool flag);
+
+        std::size_t max_heap_size();
+
+        void set_max_heap_size(std::size_t size);
+
+        bool heap_snapshot(HeapSnapshot &snapshot);
+      private:
+        void traverse_heap_for_snapshot(HeapSnapshot &snapshot, HeapSnapshotObjectSet &objects, std::vector<Object *> &stack);
       };
     }
   }
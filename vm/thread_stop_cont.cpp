@@ -1,5 +1,5 @@
 /****************************************************************************
- *   Copyright (C) 2014-2015 Łukasz Szpakowski.                             *
+ *   Copyright (C) 2014-2015, 2019 Łukasz Szpakowski.                       *
  *                                                                          *
  *   This software is licensed under the GNU Lesser General Public          *
  *   License v3 or later. See the LICENSE file and the GPL file for         *
@@ -19,6 +19,10 @@
 #else
 #error "Unsupported operating system."
 #endif
+#include <condition_variable>
+#include <csetjmp>
+#include <map>
+#include <mutex>
 #include <thread>
 #include "thread_stop_cont.hpp"
 
@@ -59,11 +63,14 @@ namespace letin
 
       static mutex thread_stop_cont_mutex;
       static ThreadStopCont *volatile thread_stop_cont;
+      static thread_local void *volatile *stack_top_ptr = nullptr;
 
       static void usr1_handler(int signum)
       {
         ThreadStopCont *tmp_thread_stop_cont = thread_stop_cont;
         if(tmp_thread_stop_cont->has_stopping) {
+          char stack_top_marker;
+          if(stack_top_ptr != nullptr) *stack_top_ptr = reinterpret_cast<void *>(&stack_top_marker);
           ::sem_post(&(tmp_thread_stop_cont->stopping_sem));
           sigset_t sigmask;
           while(tmp_thread_stop_cont->has_stopping) {
@@ -112,6 +119,8 @@ namespace letin
 
       void delete_thread_stop_cont(ThreadStopCont *stop_cont) { delete stop_cont; }
 
+      void set_thread_stop_cont_stack_top_ptr(void *volatile *ptr) { stack_top_ptr = ptr; }
+
       void stop_threads(ThreadStopCont *stop_cont, function<void (function<void (thread &)>)> fun)
       {
         lock_guard<mutex> guard(thread_stop_cont_mutex);
@@ -144,6 +153,9 @@ namespace letin
       
       class ThreadStopCont {};
 
+      static mutex stack_top_ptr_mutex;
+      static map<thread::id, void *volatile *> stack_top_ptrs;
+
       void initialize_thread_stop_cont() {}
 
       void finalize_thread_stop_cont() {}
@@ -156,8 +168,18 @@ namespace letin
 
       void delete_thread_stop_cont(ThreadStopCont *stop_cont) {}
 
+      void set_thread_stop_cont_stack_top_ptr(void *volatile *ptr)
+      {
+        lock_guard<mutex> guard(stack_top_ptr_mutex);
+        if(ptr != nullptr)
+          stack_top_ptrs[this_thread::get_id()] = ptr;
+        else
+          stack_top_ptrs.erase(this_thread::get_id());
+      }
+
       void stop_threads(ThreadStopCont *stop_cont, function<void (function<void (thread &)>)> fun)
       {
+        lock_guard<mutex> guard(stack_top_ptr_mutex);
         fun([](thread &thr) {
 #if defined(__MINGW32__) || defined(__MINGW64__)
           ::HANDLE handle = reinterpret_cast<::HANDLE>(::pthread_gethandle(thr.native_handle()));
@@ -165,6 +187,18 @@ namespace letin
           ::HANDLE handle = thr.native_handle();
 #endif
           ::SuspendThread(handle);
+          auto iter = stack_top_ptrs.find(thr.get_id());
+          if(iter != stack_top_ptrs.end()) {
+            ::CONTEXT context;
+            context.ContextFlags = CONTEXT_CONTROL;
+            if(::GetThreadContext(handle, &context)) {
+#if defined(_WIN64)
+              *(iter->second) = reinterpret_cast<void *>(context.Rsp);
+#else
+              *(iter->second) = reinterpret_cast<void *>(context.Esp);
+#endif
+            }
+          }
         });
       }
 
@@ -183,6 +217,76 @@ namespace letin
 #else
 #error "Unsupported operating system."
 #endif
+
+      //
+      // An implementation of the safepoints.
+      //
+
+      static mutex safepoint_mutex;
+      static condition_variable safepoint_cv;
+      static thread_local Safepoint *thread_safepoint = nullptr;
+
+      static void enter_safe_region_for_safepoint(Safepoint *safepoint, void *stack_top)
+      {
+        lock_guard<mutex> guard(safepoint_mutex);
+        if(safepoint->safe_region_depth == 0) *(safepoint->stack_top_ptr) = stack_top;
+        safepoint->safe_region_depth++;
+        safepoint_cv.notify_all();
+      }
+
+      static void leave_safe_region_for_safepoint(Safepoint *safepoint)
+      {
+        unique_lock<mutex> lock(safepoint_mutex);
+        if(safepoint->safe_region_depth == 1) {
+          while(safepoint->is_requested.load(memory_order_relaxed)) safepoint_cv.wait(lock);
+        }
+        safepoint->safe_region_depth--;
+      }
+
+      void set_thread_safepoint(Safepoint *safepoint) { thread_safepoint = safepoint; }
+
+      void enter_safe_region()
+      {
+        Safepoint *safepoint = thread_safepoint;
+        if(safepoint == nullptr || !safepoint->is_enabled) return;
+        jmp_buf saved_regs;
+        setjmp(saved_regs);
+        enter_safe_region_for_safepoint(safepoint, reinterpret_cast<void *>(&saved_regs));
+      }
+
+      void leave_safe_region()
+      {
+        Safepoint *safepoint = thread_safepoint;
+        // Only the thread modifies the depth of its safe regions so it can read it
+        // without the lock.
+        if(safepoint == nullptr || safepoint->safe_region_depth == 0) return;
+        leave_safe_region_for_safepoint(safepoint);
+      }
+
+      void stop_at_safepoint(Safepoint *safepoint)
+      {
+        if(!safepoint->is_enabled) return;
+        jmp_buf saved_regs;
+        setjmp(saved_regs);
+        enter_safe_region_for_safepoint(safepoint, reinterpret_cast<void *>(&saved_regs));
+        leave_safe_region_for_safepoint(safepoint);
+      }
+
+      void stop_threads_at_safepoints(function<void (function<void (Safepoint &)>)> fun)
+      {
+        unique_lock<mutex> lock(safepoint_mutex);
+        fun([](Safepoint &safepoint) { safepoint.is_requested.store(true, memory_order_relaxed); });
+        fun([&lock](Safepoint &safepoint) {
+          while(safepoint.safe_region_depth == 0) safepoint_cv.wait(lock);
+        });
+      }
+
+      void continue_threads_from_safepoints(function<void (function<void (Safepoint &)>)> fun)
+      {
+        lock_guard<mutex> guard(safepoint_mutex);
+        fun([](Safepoint &safepoint) { safepoint.is_requested.store(false, memory_order_relaxed); });
+        safepoint_cv.notify_all();
+      }
     }
   }
 }
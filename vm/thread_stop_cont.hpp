@@ -1,5 +1,5 @@
 /****************************************************************************
- *   Copyright (C) 2014-2015 Łukasz Szpakowski.                             *
+ *   Copyright (C) 2014-2015, 2019 Łukasz Szpakowski.                       *
  *                                                                          *
  *   This software is licensed under the GNU Lesser General Public          *
  *   License v3 or later. See the LICENSE file and the GPL file for         *
@@ -8,7 +8,9 @@
 #ifndef _THREAD_STOP_CONT_HPP
 #define _THREAD_STOP_CONT_HPP
 
+#include <atomic>
 #include <functional>
+#include <mutex>
 #include <thread>
 
 namespace letin
@@ -19,6 +21,18 @@ namespace letin
     {
       class ThreadStopCont;
 
+      // A safepoint state of a thread. The thread polls the request flag at the
+      // safepoints and the stopping thread waits until the thread is in a safe region.
+      struct Safepoint
+      {
+        std::atomic<bool> is_requested;
+        bool is_enabled;
+        unsigned safe_region_depth;
+        void *volatile *stack_top_ptr;
+
+        Safepoint() : is_requested(false), is_enabled(false), safe_region_depth(0), stack_top_ptr(nullptr) {}
+      };
+
       void initialize_thread_stop_cont();
 
       void finalize_thread_stop_cont();
@@ -31,9 +45,54 @@ namespace letin
 
       void delete_thread_stop_cont(ThreadStopCont *stop_cont);
 
+      void set_thread_stop_cont_stack_top_ptr(void *volatile *ptr);
+
       void stop_threads(ThreadStopCont *stop_cont, std::function<void (std::function<void (std::thread &)>)> fun);
 
       void continue_threads(ThreadStopCont *stop_cont, std::function<void (std::function<void (std::thread &)>)> fun);
+
+      void set_thread_safepoint(Safepoint *safepoint);
+
+      void enter_safe_region();
+
+      void leave_safe_region();
+
+      void stop_at_safepoint(Safepoint *safepoint);
+
+      void stop_threads_at_safepoints(std::function<void (std::function<void (Safepoint &)>)> fun);
+
+      void continue_threads_from_safepoints(std::function<void (std::function<void (Safepoint &)>)> fun);
+
+      class SafeRegionGuard
+      {
+      public:
+        SafeRegionGuard() { enter_safe_region(); }
+
+        ~SafeRegionGuard() { leave_safe_region(); }
+      };
+
+      // The thread waits for the mutex in a safe region so that it doesn't block
+      // the stopping of the threads if the mutex is held by a stopped thread.
+      template<typename _Mutex>
+      void lock_in_safe_region(_Mutex &mutex)
+      {
+        if(!mutex.try_lock()) {
+          enter_safe_region();
+          mutex.lock();
+          leave_safe_region();
+        }
+      }
+
+      class SafeRegionMutex
+      {
+        std::mutex _M_mutex;
+      public:
+        void lock() { lock_in_safe_region(_M_mutex); }
+
+        bool try_lock() { return _M_mutex.try_lock(); }
+
+        void unlock() { _M_mutex.unlock(); }
+      };
     }
   }
 }
@@ -0,0 +1,211 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#ifndef _TRAVERSE_HPP
+#define _TRAVERSE_HPP
+
+#include <cstddef>
+#include <letin/const.hpp>
+#include <letin/vm.hpp>
+#include "hash_table.hpp"
+#include "vm.hpp"
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace priv
+    {
+      //
+      // The traversal functions are templates so that the garbage collectors can inline
+      // the visiting function for each child. The child objects of the arrays and the
+      // tuples are prefetched a few elements ahead because the visiting function usually
+      // reads the header of a child. The prefetching can be disabled for the collectors
+      // that don't touch the child objects while they visit them.
+      //
+
+      const std::size_t CHILD_PREFETCH_DISTANCE = 4;
+
+      template<bool _IsChildPrefetched>
+      inline void prefetch_child_object(const Reference &ref)
+      {
+#ifdef __GNUC__
+        if(_IsChildPrefetched && !ref.has_nil()) __builtin_prefetch(ref.ptr(), 1);
+#endif
+      }
+
+      template<bool _IsChildPrefetched = true, typename _Function>
+      void for_each_child_object(Object &object, _Function fun)
+      {
+        switch(object.type() & ~OBJECT_TYPE_UNIQUE) {
+          case OBJECT_TYPE_RARRAY:
+          {
+            std::size_t length = object.length();
+            Reference *refs = object.raw().rs;
+            for(std::size_t i = 0; i < length && i < CHILD_PREFETCH_DISTANCE; i++)
+              prefetch_child_object<_IsChildPrefetched>(refs[i]);
+            for(std::size_t i = 0; i < length; i++) {
+              if(i + CHILD_PREFETCH_DISTANCE < length)
+                prefetch_child_object<_IsChildPrefetched>(refs[i + CHILD_PREFETCH_DISTANCE]);
+              if(!refs[i].has_nil()) fun(refs[i].ptr());
+            }
+            break;
+          }
+          case OBJECT_TYPE_TUPLE:
+          {
+            std::size_t length = object.length();
+            TupleElement *elems = object.raw().tes;
+            TupleElementType *elem_types = object.raw().tuple_elem_types();
+            for(std::size_t i = 0; i < length && i < CHILD_PREFETCH_DISTANCE; i++) {
+              if(is_ref_value_type_for_gc(elem_types[i].raw()))
+                prefetch_child_object<_IsChildPrefetched>(elems[i].raw().r);
+            }
+            for(std::size_t i = 0; i < length; i++) {
+              std::size_t j = i + CHILD_PREFETCH_DISTANCE;
+              if(j < length && is_ref_value_type_for_gc(elem_types[j].raw()))
+                prefetch_child_object<_IsChildPrefetched>(elems[j].raw().r);
+              if(is_ref_value_type_for_gc(elem_types[i].raw())) {
+                Reference elem_ref = elems[i].raw().r;
+                if(!elem_ref.has_nil()) fun(elem_ref.ptr());
+              }
+            }
+            break;
+          }
+          case OBJECT_TYPE_LAZY_VALUE:
+            if(is_ref_value_type_for_gc(object.raw().lzv.value.type())) {
+              Reference value_ref = object.raw().lzv.value.raw().r;
+              if(!value_ref.has_nil()) fun(value_ref.ptr());
+            }
+            for(std::size_t i = 0; i < object.length(); i++) {
+              if(is_ref_value_type_for_gc(object.raw().lzv.args[i].type())) {
+                Reference arg_ref = object.raw().lzv.args[i].raw().r;
+                if(!arg_ref.has_nil()) fun(arg_ref.ptr());
+              }
+            }
+            break;
+          case OBJECT_TYPE_HASH_TABLE:
+          {
+            HashTableRaw *raw = reinterpret_cast<HashTableRaw *>(object.raw().bs);
+            for(std::size_t i = 0; i < raw->bucket_count; i++) {
+              Reference entry_ref = raw->buckets[i].first_entry_r;
+              while(!entry_ref.has_nil()) {
+                fun(entry_ref.ptr());
+                HashTableEntryRawBase *raw = reinterpret_cast<HashTableEntryRawBase *>(entry_ref->raw().bs);
+                entry_ref = raw->next_r;
+              }
+            }
+            break;
+          }
+          case OBJECT_TYPE_ALI_HASH_TABLE_ENTRY:
+          {
+            HashTableEntryRaw<ArgumentList, std::int64_t> *raw = reinterpret_cast<HashTableEntryRaw<ArgumentList, std::int64_t> *>(object.raw().bs);
+            if(!raw->key.key_ref().has_nil()) fun(raw->key.key_ref().ptr());
+            break;
+          }
+          case OBJECT_TYPE_ALF_HASH_TABLE_ENTRY:
+          {
+            HashTableEntryRaw<ArgumentList, double> *raw = reinterpret_cast<HashTableEntryRaw<ArgumentList, double> *>(object.raw().bs);
+            if(!raw->key.key_ref().has_nil()) fun(raw->key.key_ref().ptr());
+            break;
+          }
+          case OBJECT_TYPE_ALR_HASH_TABLE_ENTRY:
+          {
+            HashTableEntryRaw<ArgumentList, Reference> *raw = reinterpret_cast<HashTableEntryRaw<ArgumentList, Reference> *>(object.raw().bs);
+            if(!raw->key.key_ref().has_nil()) fun(raw->key.key_ref().ptr());
+            if(!raw->value.value().has_nil()) fun(raw->value.value().ptr());
+            break;
+          }
+        }
+      }
+
+      template<bool _IsChildPrefetched = true, typename _Function>
+      void for_each_child_ref(Object &object, _Function fun)
+      {
+        switch(object.type() & ~OBJECT_TYPE_UNIQUE) {
+          case OBJECT_TYPE_RARRAY:
+          {
+            std::size_t length = object.length();
+            Reference *refs = object.raw().rs;
+            for(std::size_t i = 0; i < length && i < CHILD_PREFETCH_DISTANCE; i++)
+              prefetch_child_object<_IsChildPrefetched>(refs[i]);
+            for(std::size_t i = 0; i < length; i++) {
+              if(i + CHILD_PREFETCH_DISTANCE < length)
+                prefetch_child_object<_IsChildPrefetched>(refs[i + CHILD_PREFETCH_DISTANCE]);
+              fun(VALUE_TYPE_REF, refs[i]);
+            }
+            break;
+          }
+          case OBJECT_TYPE_TUPLE:
+          {
+            std::size_t length = object.length();
+            TupleElement *elems = object.raw().tes;
+            TupleElementType *elem_types = object.raw().tuple_elem_types();
+            for(std::size_t i = 0; i < length && i < CHILD_PREFETCH_DISTANCE; i++) {
+              if(is_ref_value_type_for_gc(elem_types[i].raw()))
+                prefetch_child_object<_IsChildPrefetched>(elems[i].raw().r);
+            }
+            for(std::size_t i = 0; i < length; i++) {
+              std::size_t j = i + CHILD_PREFETCH_DISTANCE;
+              if(j < length && is_ref_value_type_for_gc(elem_types[j].raw()))
+                prefetch_child_object<_IsChildPrefetched>(elems[j].raw().r);
+              fun(elem_types[i].raw(), elems[i].raw().r);
+            }
+            break;
+          }
+          case OBJECT_TYPE_LAZY_VALUE:
+            fun(object.raw().lzv.value.raw().type, object.raw().lzv.value.raw().r);
+            for(std::size_t i = 0; i < object.length(); i++)
+              fun(object.raw().lzv.args[i].raw().type, object.raw().lzv.args[i].raw().r);
+            break;
+          case OBJECT_TYPE_HASH_TABLE:
+          {
+            HashTableRaw *raw = reinterpret_cast<HashTableRaw *>(object.raw().bs);
+            for(std::size_t i = 0; i < raw->bucket_count; i++) {
+              fun(VALUE_TYPE_REF, raw->buckets[i].first_entry_r);
+              fun(VALUE_TYPE_REF, raw->buckets[i].last_entry_r);
+            }
+            break;
+          }
+          case OBJECT_TYPE_HASH_TABLE_ENTRY:
+          {
+            HashTableEntryRawBase *raw = reinterpret_cast<HashTableEntryRawBase *>(object.raw().bs);
+            fun(VALUE_TYPE_REF, raw->prev_r);
+            fun(VALUE_TYPE_REF, raw->next_r);
+            break;
+          }
+          case OBJECT_TYPE_ALI_HASH_TABLE_ENTRY:
+          {
+            HashTableEntryRaw<ArgumentList, std::int64_t> *raw = reinterpret_cast<HashTableEntryRaw<ArgumentList, std::int64_t> *>(object.raw().bs);
+            fun(VALUE_TYPE_REF, raw->prev_r);
+            fun(VALUE_TYPE_REF, raw->next_r);
+            fun(VALUE_TYPE_REF, raw->key.key_ref());
+            break;
+          }
+          case OBJECT_TYPE_ALF_HASH_TABLE_ENTRY:
+          {
+            HashTableEntryRaw<ArgumentList, double> *raw = reinterpret_cast<HashTableEntryRaw<ArgumentList, double> *>(object.raw().bs);
+            fun(VALUE_TYPE_REF, raw->prev_r);
+            fun(VALUE_TYPE_REF, raw->next_r);
+            fun(VALUE_TYPE_REF, raw->key.key_ref());
+            break;
+          }
+          case OBJECT_TYPE_ALR_HASH_TABLE_ENTRY:
+          {
+            HashTableEntryRaw<ArgumentList, Reference> *raw = reinterpret_cast<HashTableEntryRaw<ArgumentList, Reference> *>(object.raw().bs);
+            fun(VALUE_TYPE_REF, raw->prev_r);
+            fun(VALUE_TYPE_REF, raw->next_r);
+            fun(VALUE_TYPE_REF, raw->key.key_ref());
+            fun(VALUE_TYPE_REF, raw->value.value());
+            break;
+          }
+        }
+      }
+    }
+  }
+}
+
+#endif
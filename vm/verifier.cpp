@@ -0,0 +1,164 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#include <cstdint>
+#include <vector>
+#include <letin/opcode.hpp>
+#include <letin/vm.hpp>
+#include "verifier.hpp"
+
+using namespace std;
+using namespace letin::opcode;
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace priv
+    {
+      struct VerifierState
+      {
+        bool is_visited;
+        uint64_t local_var_count;
+        uint64_t lvc;
+        uint64_t evc;
+
+        VerifierState() : is_visited(false), local_var_count(0), lvc(0), evc(0) {}
+      };
+
+      static size_t expr_pop_arg_count(uint32_t arg_type)
+      { return arg_type == ARG_TYPE_POP ? 1 : 0; }
+
+      static bool verify_arg(const Function &fun, size_t global_var_count, const VerifierState &state, uint32_t arg_type, Argument arg, size_t n)
+      {
+        switch(arg_type) {
+          case ARG_TYPE_LVAR:
+            return arg.lvar < state.lvc;
+          case ARG_TYPE_ARG:
+            return arg.arg < fun.arg_count();
+          case ARG_TYPE_IMM:
+            return true;
+          case ARG_TYPE_GVAR:
+            return arg.gvar < global_var_count;
+          case ARG_TYPE_POP:
+            return n <= state.evc;
+          case ARG_TYPE_EVAL:
+            return arg.eval + n < state.evc;
+          default:
+            return false;
+        }
+      }
+
+      static void merge_state(vector<VerifierState> &states, vector<size_t> &ips, size_t ip, const VerifierState &state)
+      {
+        // The instruction after the last instruction only reports a lack of instruction.
+        if(ip >= states.size()) return;
+        VerifierState &old_state = states[ip];
+        if(old_state.is_visited) {
+          // The lower bounds of the counters are the minimums of the counters for all
+          // paths that go to the instruction.
+          if(state.local_var_count >= old_state.local_var_count && state.lvc >= old_state.lvc && state.evc >= old_state.evc)
+            return;
+          old_state.local_var_count = min(old_state.local_var_count, state.local_var_count);
+          old_state.lvc = min(old_state.lvc, state.lvc);
+          old_state.evc = min(old_state.evc, state.evc);
+        } else {
+          old_state = state;
+          old_state.is_visited = true;
+        }
+        ips.push_back(ip);
+      }
+
+      static bool check_jump(const Function &fun, size_t ip, int32_t offset, size_t &target_ip)
+      {
+        int64_t target = static_cast<int64_t>(ip) + 1 + offset;
+        if(target < 0 || static_cast<uint64_t>(target) > fun.instr_count()) return false;
+        target_ip = static_cast<size_t>(target);
+        return true;
+      }
+
+      bool verify_fun(const Function &fun, size_t global_var_count)
+      {
+        if(fun.is_error()) return false;
+        vector<VerifierState> states(fun.instr_count());
+        vector<size_t> ips;
+        merge_state(states, ips, 0, VerifierState());
+        while(!ips.empty()) {
+          size_t ip = ips.back();
+          ips.pop_back();
+          VerifierState state = states[ip];
+          const Instruction &instr = fun.instr(ip);
+          uint32_t arg_type1 = opcode_to_arg_type1(instr.opcode);
+          uint32_t arg_type2 = opcode_to_arg_type2(instr.opcode);
+          size_t n1 = expr_pop_arg_count(arg_type1);
+          size_t n2 = n1 + expr_pop_arg_count(arg_type2);
+          size_t target_ip;
+          switch(opcode_to_instr(instr.opcode)) {
+            case INSTR_LET:
+            case INSTR_RET:
+            case INSTR_ARG:
+            case INSTR_LETTUPLE:
+            case INSTR_PUSH:
+              // Both arguments are verified for the operation because some operations
+              // only use the first argument.
+              if(!verify_arg(fun, global_var_count, state, arg_type1, instr.arg1, n2)) return false;
+              if(!verify_arg(fun, global_var_count, state, arg_type2, instr.arg2, n2)) return false;
+              state.evc -= n2;
+              switch(opcode_to_instr(instr.opcode)) {
+                case INSTR_RET:
+                  continue;
+                case INSTR_LET:
+                  state.local_var_count++;
+                  break;
+                case INSTR_LETTUPLE:
+                  state.local_var_count += opcode_to_local_var_count(instr.opcode);
+                  break;
+                case INSTR_PUSH:
+                  state.evc++;
+                  break;
+              }
+              merge_state(states, ips, ip + 1, state);
+              break;
+            case INSTR_IN:
+              state.lvc = state.local_var_count;
+              merge_state(states, ips, ip + 1, state);
+              break;
+            case INSTR_JC:
+              if(!verify_arg(fun, global_var_count, state, arg_type1, instr.arg1, n1)) return false;
+              if(!check_jump(fun, ip, instr.arg2.i, target_ip)) return false;
+              state.evc -= n1;
+              merge_state(states, ips, ip + 1, state);
+              merge_state(states, ips, target_ip, state);
+              break;
+            case INSTR_JUMP:
+              if(!check_jump(fun, ip, instr.arg1.i, target_ip)) return false;
+              merge_state(states, ips, target_ip, state);
+              break;
+            case INSTR_RETRY:
+              // The retry instruction goes to the first instruction with the empty stack
+              // of the local variables and the expression values.
+              merge_state(states, ips, 0, VerifierState());
+              break;
+            case INSTR_THROW:
+            case INSTR_RETHROW:
+              if(!verify_arg(fun, global_var_count, state, arg_type1, instr.arg1, n1)) return false;
+              break;
+            case INSTR_POP:
+              if(instr.arg1.eval > state.evc) return false;
+              state.evc -= instr.arg1.eval;
+              merge_state(states, ips, ip + 1, state);
+              break;
+            default:
+              // The incorrect instruction reports an error.
+              break;
+          }
+        }
+        return true;
+      }
+    }
+  }
+}
@@ -0,0 +1,34 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#ifndef _VERIFIER_HPP
+#define _VERIFIER_HPP
+
+#include <cstddef>
+#include <letin/vm.hpp>
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace priv
+    {
+      //
+      // The verifier follows all paths of the function and computes the lower bounds of
+      // the number of local variables and the number of expression values for each
+      // instruction. The function is verified if each instruction refers only to the
+      // existent arguments, local variables, global variables and expression values, and
+      // each jump goes to an instruction of the function or just after the last
+      // instruction.
+      //
+
+      bool verify_fun(const Function &fun, std::size_t global_var_count);
+    }
+  }
+}
+
+#endif
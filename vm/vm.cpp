@@ -9,6 +9,7 @@
 #include <sys/stat.h>
 #include <algorithm>
 #include <atomic>
+#include <csetjmp>
 #include <cstddef>
 #include <cstring>
 #include <fstream>
@@ -29,7 +30,10 @@
 #include <letin/const.hpp>
 #include <letin/vm.hpp>
 #include "alloc/new_alloc.hpp"
+#include "alloc/pool_alloc.hpp"
 #include "cache/ht_memo_cache.hpp"
+#include "gc/bitmap_gc.hpp"
+#include "gc/gen_gc.hpp"
 #include "gc/mark_sweep_gc.hpp"
 #include "strategy/eager_eval_strategy.hpp"
 #include "strategy/fun_eval_strategy.hpp"
@@ -37,11 +41,14 @@
 #include "strategy/memo_eval_strategy.hpp"
 #include "strategy/memo_lazy_eval_strategy.hpp"
 #include "vm/interp_vm.hpp"
+#include "vm/jit_vm.hpp"
 #include "hash_table.hpp"
+#include "heap_region.hpp"
 #include "impl_loader.hpp"
 #include "impl_nfh_loader.hpp"
 #include "priv.hpp"
 #include "thread_stop_cont.hpp"
+#include "traverse.hpp"
 #include "vm.hpp"
 
 using namespace std;
@@ -71,6 +78,7 @@ namespace letin
       size_t header_size = offsetof(ObjectRaw, is8);
       size_t elem_size;
       if(static_cast<uint64_t>(length) > static_cast<uint64_t>(numeric_limits<int64_t>::max())) return 0;
+      if(static_cast<uint64_t>(length) > static_cast<uint64_t>(numeric_limits<ObjectLength>::max())) return 0;
       switch(type & ~OBJECT_TYPE_UNIQUE) {
         case OBJECT_TYPE_IARRAY8:
           elem_size = 1;
@@ -124,7 +132,11 @@ namespace letin
     // A Reference class.
     //
 
+#ifdef LETIN_COMPRESSED_REFERENCES
+    char *Reference::_S_heap_base = reserve_heap_region();
+#else
     Object Reference::_S_nil;
+#endif
 
     //
     // A Value class.
@@ -167,7 +179,7 @@ namespace letin
     {
       if(_S_locked_mutex_count == 0) lazy_value_mutex_sem.op(-1);
       _S_locked_mutex_count++;
-      _M_mutex.lock();
+      lock_in_safe_region(_M_mutex);
     }
 
     bool LazyValueMutex::try_lock()
@@ -469,12 +481,17 @@ namespace letin
     InterruptibleFunctionAround::InterruptibleFunctionAround(ThreadContext *context) :
       _M_context(context)
     {
+      jmp_buf saved_regs;
+      setjmp(saved_regs);
       lock_guard<mutex> guard(_M_context->interruptible_fun_mutex());
+      _M_context->set_system_stack_top(reinterpret_cast<void *>(&saved_regs));
       _M_context->interruptible_fun_flag() = true;
+      enter_safe_region();
     }
 
     InterruptibleFunctionAround::~InterruptibleFunctionAround()
     {
+      leave_safe_region();
       lock_guard<mutex> guard(_M_context->interruptible_fun_mutex());
       _M_context->interruptible_fun_flag() = false;
     }
@@ -546,6 +563,7 @@ namespace letin
         RegisteredReference tmp_r(object.elem(i).raw().r, context);
         Value tmp_value = object.elem(i);
         force(context, tmp_value);
+        _M_gc->write_barrier(&object, context);
         object.set_elem(i, tmp_value);
       }
       return ERROR_SUCCESS;
@@ -558,11 +576,18 @@ namespace letin
         RegisteredReference tmp_r(object.elem(i).raw().r, context);
         Value tmp_value = object.elem(i);
         fully_force(context, tmp_value);
+        _M_gc->write_barrier(&object, context);
         object.set_elem(i, tmp_value);
       }
       return ERROR_SUCCESS;
     }
 
+    bool VirtualMachine::profiling_flag() { return false; }
+
+    void VirtualMachine::set_profiling_flag(bool flag) {}
+
+    bool VirtualMachine::instr_profile(InstructionProfile &profile) { return false; }
+
     //
     // A Loader class.
     //
@@ -581,22 +606,54 @@ namespace letin
 
     GarbageCollector::~GarbageCollector() {}
 
+    void GarbageCollector::write_barrier(Object *object, ThreadContext *context) {}
+
+    void GarbageCollector::prepare_fork() {}
+
+    GarbageCollectorStatistics GarbageCollector::statistics()
+    {
+      GarbageCollectorStatistics stats;
+      memset(&stats, 0, sizeof(GarbageCollectorStatistics));
+      return stats;
+    }
+
+    bool GarbageCollector::safepoint_flag() { return false; }
+
+    void GarbageCollector::set_safepoint_flag(bool flag) {}
+
+    size_t GarbageCollector::max_heap_size() { return 0; }
+
+    void GarbageCollector::set_max_heap_size(size_t size) {}
+
+    bool GarbageCollector::heap_snapshot(HeapSnapshot &snapshot) { return false; }
+
+    void GarbageCollector::sample_allocation(Object *object, ThreadContext *context) {}
+
     Object *GarbageCollector::new_object(int type, size_t length, ThreadContext *context)
     {
+      if(context != nullptr && type == (OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE) &&
+          !context->regs().reusable_tuple_r.has_nil()) {
+        Object *object = context->reuse_unique_tuple(length);
+        if(object != nullptr) return object;
+      }
       size_t size = object_size(type, length);
-      if(size != 0)
-        return new(allocate(size, context)) Object(type, length);
-      else
-        return nullptr;
+      if(size == 0) return nullptr;
+      void *ptr = allocate(size, context);
+      if(ptr == nullptr) return nullptr;
+      Object *object = new(ptr) Object(type, length);
+      size_t sampling_interval = _M_sampling_interval.load(memory_order_relaxed);
+      if(sampling_interval != 0 && context != nullptr && context->must_sample_allocation(size, sampling_interval))
+        sample_allocation(object, context);
+      return object;
     }
 
     Object *GarbageCollector::new_immortal_object(int type, std::size_t length)
     {
       size_t size = object_size(type, length);
-      if(size != 0)
-        return new(allocate_immortal_area(size)) Object(type, length);
-      else
-        return nullptr;
+      if(size == 0) return nullptr;
+      void *ptr = allocate_immortal_area(size);
+      if(ptr == nullptr) return nullptr;
+      return new(ptr) Object(type, length);
     }
 
     Object *GarbageCollector::new_pair(const Value &value1, const Value &value2, ThreadContext *context)
@@ -790,7 +847,7 @@ namespace letin
             lock_guard<mutex> guard(io_stream_mutex);
             getline(cin, str);
           }
-          context->regs().tmp_r.safely_assign_for_gc(vm->gc()->new_object(OBJECT_TYPE_IARRAY8, str.length(), context));
+          context->assign_for_gc(context->regs().tmp_r, vm->gc()->new_object(OBJECT_TYPE_IARRAY8, str.length(), context));
           if(context->regs().tmp_r.is_null())
             return ReturnValue(0, 0.0, Reference(), ERROR_OUT_OF_MEMORY);
           copy(str.begin(), str.end(), context->regs().tmp_r->raw().is8);
@@ -800,7 +857,7 @@ namespace letin
           r->set_elem(0, Value(context->regs().tmp_r));
           r->set_elem(1, args[0]);
           args[0].cancel_ref();
-          context->regs().tmp_r.safely_assign_for_gc(r);
+          context->assign_for_gc(context->regs().tmp_r, r);
           return ReturnValue(0, 0.0, r, ERROR_SUCCESS);
         }
         case NATIVE_FUN_PUT_STRING:
@@ -1230,9 +1287,15 @@ namespace letin
       _M_regs.ac = _M_regs.lvc = _M_regs.ac2 = _M_regs.evc = 0;
       _M_regs.fp = static_cast<size_t>(-1);
       _M_regs.ip = 0;
+      _M_unsampled_byte_count = 0;
       _M_regs.rv = ReturnValue();
       _M_regs.ai = 0;
       _M_regs.gc_tmp_ptr = nullptr;
+      _M_regs.gc_written_object = nullptr;
+      _M_regs.gc_local_first = _M_regs.gc_local_last = nullptr;
+      _M_regs.gc_local_count = 0;
+      _M_regs.gc_local_adding_flag = false;
+      _M_regs.gc_chunk = _M_regs.gc_chunk_ptr = _M_regs.gc_chunk_end = nullptr;
       _M_regs.tmp_r = Reference();
       _M_regs.after_leaving_flags[0] = false;
       _M_regs.after_leaving_flags[1] = false;
@@ -1254,21 +1317,44 @@ namespace letin
       _M_regs.cutc = 0;
       _M_regs.tmp_expr_values[0] = Value();
       _M_regs.tmp_expr_values[1] = Value();
+      _M_regs.reusable_tuple_r = Reference();
+      _M_regs.reusable_tuple_count = 0;
       _M_first_registered_r = _M_last_registered_r = nullptr;
+      _M_interruptible_fun_flag = false;
+      _M_system_stack_bottom = _M_system_stack_top = nullptr;
+      _M_safepoint.stack_top_ptr = &_M_system_stack_top;
       _M_stack = new Value[stack_size];
       _M_stack_size = stack_size;
       _M_expr_stack = new Value[expr_stack_size];
       _M_expr_stack_size = expr_stack_size;
+      // The garbage collector can conservatively scan the stack elements above the stack
+      // top so these elements can't contain garbage pointers.
+      for(size_t i = 0; i < stack_size; i++) _M_stack[i].raw().r = Reference();
+      for(size_t i = 0; i < expr_stack_size; i++) _M_expr_stack[i].raw().r = Reference();
+    }
+
+    void ThreadContext::start(function<void ()> fun)
+    {
+      _M_thread = thread([this, fun]() {
+        char stack_bottom_marker;
+        _M_system_stack_bottom = reinterpret_cast<void *>(&stack_bottom_marker);
+        set_thread_stop_cont_stack_top_ptr(&_M_system_stack_top);
+        set_thread_safepoint(&_M_safepoint);
+        fun();
+        set_thread_safepoint(nullptr);
+        set_thread_stop_cont_stack_top_ptr(nullptr);
+      });
     }
 
     bool ThreadContext::enter_to_fun(size_t i)
     {
+      check_safepoint();
       if(_M_regs.abp2 + _M_regs.ac2 + 4 < _M_stack_size) {
-        _M_stack[_M_regs.abp2 + _M_regs.ac2 + 0].safely_assign_for_gc(Value(_M_regs.abp, _M_regs.ac));
-        _M_stack[_M_regs.abp2 + _M_regs.ac2 + 1].safely_assign_for_gc(Value(_M_regs.lvc, _M_regs.ip - 1));
-        _M_stack[_M_regs.abp2 + _M_regs.ac2 + 2].safely_assign_for_gc(Value(static_cast<int64_t>((static_cast<int64_t>(_M_regs.fp) << 8) | (_M_regs.after_leaving_flag_index & 1) | ((_M_regs.cached_fun_result_flag & 1) << 1))));
-        _M_stack[_M_regs.abp2 + _M_regs.ac2 + 3].safely_assign_for_gc(Value(_M_regs.evbp, _M_regs.evc));
-        atomic_thread_fence(memory_order_release);
+        assign_for_gc(_M_stack[_M_regs.abp2 + _M_regs.ac2 + 0], Value(_M_regs.abp, _M_regs.ac));
+        assign_for_gc(_M_stack[_M_regs.abp2 + _M_regs.ac2 + 1], Value(_M_regs.lvc, _M_regs.ip - 1));
+        assign_for_gc(_M_stack[_M_regs.abp2 + _M_regs.ac2 + 2], Value(static_cast<int64_t>((static_cast<int64_t>(_M_regs.fp) << 8) | (_M_regs.after_leaving_flag_index & 1) | ((_M_regs.cached_fun_result_flag & 1) << 1))));
+        assign_for_gc(_M_stack[_M_regs.abp2 + _M_regs.ac2 + 3], Value(_M_regs.evbp, _M_regs.evc));
+        release_fence_for_gc();
         _M_regs.abp = _M_regs.abp2;
         _M_regs.ac = _M_regs.ac2;
         _M_regs.abp2 = lvbp();
@@ -1282,7 +1368,7 @@ namespace letin
         _M_regs.after_leaving_flags[0] = false;
         _M_regs.after_leaving_flags[1] = false;
         _M_regs.after_leaving_flag_index = 0;
-        atomic_thread_fence(memory_order_release);
+        release_fence_for_gc();
         return true;
       } else
         return false;
@@ -1310,7 +1396,7 @@ namespace letin
         _M_regs.evbp = _M_stack[fbp + 3].raw().p.first;
         _M_regs.evc = _M_stack[fbp + 3].raw().p.second;
         _M_regs.esec = _M_regs.evbp + _M_regs.evc;
-        atomic_thread_fence(memory_order_release);
+        release_fence_for_gc();
         return true;
       } else
         return false;
@@ -1322,7 +1408,12 @@ namespace letin
       if(!save_regs_and_set_regs(saved_regs))
         return ReturnValue(0, 0.0, Reference(), ERROR_STACK_OVERFLOW);
       ReturnValue value;
-      _M_regs.rv.safely_assign_for_gc(ReturnValue());
+      assign_for_gc(_M_regs.rv, ReturnValue());
+      if(_M_gc != nullptr) {
+        for(size_t i = 0; i < args.length(); i++) {
+          if(args[i].is_unique()) _M_gc->write_barrier(args[i].raw().r.ptr(), this);
+        }
+      }
       try {
         value = _M_native_fun_handler->invoke(vm, this, nfi, args);
       } catch(bad_alloc &e) {
@@ -1397,7 +1488,7 @@ namespace letin
       _M_regs.rv = ReturnValue(0, 0.0, r, error);
       _M_regs.after_leaving_flags[0] = false;
       _M_regs.after_leaving_flags[1] = false;
-      atomic_thread_fence(memory_order_release);
+      release_fence_for_gc();
     }
 
     void ThreadContext::set_error(int error, const Reference &r, bool is_new_stack_trace)
@@ -1467,6 +1558,8 @@ namespace letin
         if(is_ref_value_type_for_gc(_M_regs.tmp_expr_values[i].type()) && !_M_regs.tmp_expr_values[i].raw().r.has_nil())
           fun(_M_regs.tmp_expr_values[i].raw().r.ptr());
       }
+      if(!_M_regs.reusable_tuple_r.has_nil())
+        fun(_M_regs.reusable_tuple_r.ptr());
     }
 
     bool ThreadContext::save_regs_and_set_regs(SavedRegisters &saved_regs)
@@ -1497,13 +1590,13 @@ namespace letin
       saved_regs.evc = _M_regs.evc;
       uint32_t sec = saved_regs.sec;
       if(sec + 7 > _M_stack_size) return false;
-      _M_stack[sec + 0].safely_assign_for_gc(_M_regs.try_arg2);
-      _M_stack[sec + 1].safely_assign_for_gc(Value(_M_regs.try_io_r));
-      _M_stack[sec + 2].safely_assign_for_gc(Value(_M_regs.force_tmp_rv.raw().r));
-      _M_stack[sec + 3].safely_assign_for_gc(Value(_M_regs.force_tmp_r));
-      _M_stack[sec + 4].safely_assign_for_gc(Value(_M_regs.force_tmp_r2));
-      _M_stack[sec + 5].safely_assign_for_gc(Value(_M_regs.force_tmp_rv2.raw().r));
-      _M_stack[sec + 6].safely_assign_for_gc(Value(_M_regs.try_catch_r));
+      assign_for_gc(_M_stack[sec + 0], _M_regs.try_arg2);
+      assign_for_gc(_M_stack[sec + 1], Value(_M_regs.try_io_r));
+      assign_for_gc(_M_stack[sec + 2], Value(_M_regs.force_tmp_rv.raw().r));
+      assign_for_gc(_M_stack[sec + 3], Value(_M_regs.force_tmp_r));
+      assign_for_gc(_M_stack[sec + 4], Value(_M_regs.force_tmp_r2));
+      assign_for_gc(_M_stack[sec + 5], Value(_M_regs.force_tmp_rv2.raw().r));
+      assign_for_gc(_M_stack[sec + 6], Value(_M_regs.try_catch_r));
       _M_regs.nfbp = sec + 7;
       _M_regs.enfbp = _M_regs.esec;
       _M_regs.abp = _M_regs.abp2 = _M_regs.sec = _M_regs.nfbp;
@@ -1521,7 +1614,7 @@ namespace letin
       _M_regs.try_io_r = Reference();
       _M_regs.try_abp = _M_regs.nfbp;
       _M_regs.try_ac = 0;
-      atomic_thread_fence(memory_order_release);
+      release_fence_for_gc();
       return true;
     }
 
@@ -1529,8 +1622,8 @@ namespace letin
     {
       uint32_t sec = saved_regs.sec;
       bool result = true;
-      _M_regs.force_tmp_rv.safely_assign_for_gc(saved_regs.force_tmp_rv);
-      _M_regs.force_tmp_rv2.safely_assign_for_gc(saved_regs.force_tmp_rv2);
+      assign_for_gc(_M_regs.force_tmp_rv, saved_regs.force_tmp_rv);
+      assign_for_gc(_M_regs.force_tmp_rv2, saved_regs.force_tmp_rv2);
       if(_M_stack[sec + 6].type() == VALUE_TYPE_REF &&
           _M_stack[sec + 5].type() == VALUE_TYPE_REF &&
           _M_stack[sec + 5].raw().r == _M_regs.force_tmp_rv2.raw().r &&
@@ -1539,11 +1632,11 @@ namespace letin
           _M_stack[sec + 2].type() == VALUE_TYPE_REF &&
           _M_stack[sec + 2].raw().r == _M_regs.force_tmp_rv.raw().r &&
           _M_stack[sec + 1].type() == VALUE_TYPE_REF) {
-        _M_regs.try_catch_r.safely_assign_for_gc(_M_stack[sec + 6].raw().r);
-        _M_regs.force_tmp_r2.safely_assign_for_gc(_M_stack[sec + 4].raw().r);
-        _M_regs.force_tmp_r.safely_assign_for_gc(_M_stack[sec + 3].raw().r);
+        assign_for_gc(_M_regs.try_catch_r, _M_stack[sec + 6].raw().r);
+        assign_for_gc(_M_regs.force_tmp_r2, _M_stack[sec + 4].raw().r);
+        assign_for_gc(_M_regs.force_tmp_r, _M_stack[sec + 3].raw().r);
         _M_regs.try_io_r = _M_stack[sec + 1].raw().r;
-        _M_regs.try_arg2.safely_assign_for_gc(_M_stack[sec + 0]);
+        assign_for_gc(_M_regs.try_arg2, _M_stack[sec + 0]);
         _M_regs.try_catch_error = saved_regs.try_catch_error;
         _M_regs.try_ac = saved_regs.try_ac;
         _M_regs.try_abp = saved_regs.try_abp;
@@ -1580,7 +1673,7 @@ namespace letin
       _M_regs.abp = saved_regs.abp;
       _M_regs.enfbp = saved_regs.enfbp;
       _M_regs.nfbp = saved_regs.nfbp;
-      atomic_thread_fence(memory_order_release);
+      release_fence_for_gc();
       return result;
     }
     
@@ -1590,12 +1683,12 @@ namespace letin
         Object *object = _M_gc->new_object(OBJECT_TYPE_RARRAY, _M_try_catch_stack_trace->size(), this);
         if(object == nullptr) return nullptr;
         for(size_t i = 0; i < object->length(); i++) object->set_elem(i, Value(Reference()));
-        _M_regs.tmp_r.safely_assign_for_gc(object);
+        assign_for_gc(_M_regs.tmp_r, object);
         size_t i = 0;
         for(auto &stack_trace_elem : *_M_try_catch_stack_trace) {
           RegisteredReference stack_trace_elem_r(_M_gc->new_object(OBJECT_TYPE_TUPLE, 4, this), this, false);
           if(stack_trace_elem_r.is_null()) {
-            _M_regs.tmp_r.safely_assign_for_gc(Reference());
+            assign_for_gc(_M_regs.tmp_r, Reference());
             return nullptr;
           }
           stack_trace_elem_r->set_elem(0, Value(stack_trace_elem.has_native_fun() ? 1 : 0));
@@ -1607,20 +1700,20 @@ namespace letin
           if(stack_trace_elem.fun_name() != nullptr) {
             RegisteredReference fun_name_r(_M_gc->new_string(*(stack_trace_elem.fun_name()), this), this, false);
             if(fun_name_r.is_null()) {
-              _M_regs.tmp_r.safely_assign_for_gc(Reference());
+              assign_for_gc(_M_regs.tmp_r, Reference());
               return nullptr;
             }
             fun_name_r.register_ref();
             fun_name_opt_r = _M_gc->new_pair(Value(1), Value(fun_name_r), this);
             if(fun_name_opt_r.is_null()) {
-              _M_regs.tmp_r.safely_assign_for_gc(Reference());
+              assign_for_gc(_M_regs.tmp_r, Reference());
               return nullptr;
             }
             fun_name_opt_r.register_ref();
           } else {
             fun_name_opt_r = _M_gc->new_object(OBJECT_TYPE_TUPLE, 1, this);
             if(fun_name_opt_r.is_null()) {
-              _M_regs.tmp_r.safely_assign_for_gc(Reference());
+              assign_for_gc(_M_regs.tmp_r, Reference());
               return nullptr;
             }
             fun_name_opt_r->set_elem(0, Value(0));
@@ -1633,11 +1726,90 @@ namespace letin
         return object;
       } else {
         Object *object = _M_gc->new_object(OBJECT_TYPE_RARRAY, 0);
-        _M_regs.tmp_r.safely_assign_for_gc(object);
+        assign_for_gc(_M_regs.tmp_r, object);
         return object;
       }
     }
 
+    void ThreadContext::traverse_root_refs(function<void (int, Reference &)> fun)
+    {
+      for(size_t i = 0; i < _M_regs.sec; i++)
+        fun(_M_stack[i].raw().type, _M_stack[i].raw().r);
+      for(size_t i = 0; i < _M_regs.esec; i++)
+        fun(_M_expr_stack[i].raw().type, _M_expr_stack[i].raw().r);
+      fun(VALUE_TYPE_REF, _M_regs.rv.raw().r);
+      fun(VALUE_TYPE_REF, _M_regs.tmp_r);
+      fun(_M_regs.try_arg2.raw().type, _M_regs.try_arg2.raw().r);
+      fun(VALUE_TYPE_REF, _M_regs.try_io_r);
+      fun(VALUE_TYPE_REF, _M_regs.try_catch_r);
+      fun(VALUE_TYPE_REF, _M_regs.force_tmp_rv.raw().r);
+      fun(VALUE_TYPE_REF, _M_regs.force_tmp_r);
+      fun(VALUE_TYPE_REF, _M_regs.force_tmp_r2);
+      fun(VALUE_TYPE_REF, _M_regs.force_tmp_rv2.raw().r);
+      if(_M_first_registered_r != nullptr) {
+        RegisteredReference *r = _M_first_registered_r; 
+        do {
+          fun(VALUE_TYPE_REF, *r);
+          r = r->_M_next;
+        } while(r != _M_first_registered_r);
+      }
+      for(size_t i = 0; i < 2; i++)
+        fun(_M_regs.tmp_expr_values[i].raw().type, _M_regs.tmp_expr_values[i].raw().r);
+      fun(VALUE_TYPE_REF, _M_regs.reusable_tuple_r);
+    }
+
+    // The consumed unique tuples are linked by their first elements. A tuple of the
+    // list doesn't refer to other objects so it doesn't keep them alive. The unique
+    // arrays aren't reused because a canceled reference only moves an array to the
+    // result of an instruction or a native function so the array still is alive.
+    void ThreadContext::add_reusable_unique_tuple(Object *object)
+    {
+      if(_M_regs.reusable_tuple_count >= MAX_REUSABLE_TUPLE_COUNT || object->length() == 0) return;
+      _M_gc->write_barrier(object, this);
+      for(size_t i = 0; i < object->length(); i++) {
+        object->raw().tuple_elem_types()[i].safely_assign_for_gc(VALUE_TYPE_INT);
+        object->raw().tes[i].safely_assign_for_gc(TupleElement(0));
+      }
+      if(!_M_regs.reusable_tuple_r.has_nil()) {
+        object->raw().tes[0].safely_assign_for_gc(TupleElement(_M_regs.reusable_tuple_r));
+        object->raw().tuple_elem_types()[0].safely_assign_for_gc(VALUE_TYPE_REF);
+      }
+      assign_for_gc(_M_regs.reusable_tuple_r, Reference(object));
+      _M_regs.reusable_tuple_count++;
+    }
+
+    Object *ThreadContext::reuse_unique_tuple(size_t length)
+    {
+      Object *prev_object = nullptr;
+      Reference r = _M_regs.reusable_tuple_r;
+      while(!r.has_nil()) {
+        Reference next_r;
+        if(r->raw().tuple_elem_types()[0].raw() == VALUE_TYPE_REF) next_r = r->raw().tes[0].raw().r;
+        if(r->length() == length) {
+          // The reused tuple is protected like a new object until it is referred.
+          safely_set_gc_tmp_ptr_for_gc(r.ptr());
+          if(prev_object != nullptr) {
+            _M_gc->write_barrier(prev_object, this);
+            if(!next_r.has_nil()) {
+              prev_object->raw().tes[0].safely_assign_for_gc(TupleElement(next_r));
+            } else {
+              prev_object->raw().tuple_elem_types()[0].safely_assign_for_gc(VALUE_TYPE_INT);
+              prev_object->raw().tes[0].safely_assign_for_gc(TupleElement(0));
+            }
+          } else
+            assign_for_gc(_M_regs.reusable_tuple_r, next_r);
+          _M_regs.reusable_tuple_count--;
+          _M_gc->write_barrier(r.ptr(), this);
+          r->raw().tuple_elem_types()[0].safely_assign_for_gc(VALUE_TYPE_INT);
+          r->raw().tes[0].safely_assign_for_gc(TupleElement(0));
+          return r.ptr();
+        }
+        prev_object = r.ptr();
+        r = next_r;
+      }
+      return nullptr;
+    }
+
     //
     // A VirtualMachineContext class.
     //
@@ -1655,6 +1827,15 @@ namespace letin
       }
     }
 
+    void VirtualMachineContext::traverse_root_refs(function<void (int, Reference &)> fun)
+    {
+      for(size_t i = 0; i < var_count(); i++)
+        fun(vars()[i].raw().type, vars()[i].raw().r);
+      for(auto iter = memo_caches().begin(); iter != memo_caches().end(); iter++) {
+        (*iter)->traverse_root_refs(fun);
+      }
+    }
+
     //
     // A MemoizationCache class.
     //
@@ -1667,10 +1848,16 @@ namespace letin
 
     Loader *new_loader() { return new impl::ImplLoader(); }
 
-    Allocator *new_allocator() { return new impl::NewAllocator(); }
+    Allocator *new_allocator() { return new impl::PoolAllocator(); }
+
+    GarbageCollector *new_garbage_collector(Allocator *alloc, unsigned int mark_thread_count, bool is_concurrent, bool is_concurrent_sweep, double growth_factor, unsigned int interval_usecs, bool is_freezing_before_fork)
+    { return new impl::MarkSweepGarbageCollector(alloc, interval_usecs, mark_thread_count, is_concurrent, is_concurrent_sweep, growth_factor, is_freezing_before_fork); }
+
+    GarbageCollector *new_generational_garbage_collector(Allocator *alloc, size_t nursery_size, double growth_factor, unsigned int interval_usecs, double compaction_threshold)
+    { return new impl::GenerationalGarbageCollector(alloc, interval_usecs, nursery_size, growth_factor, compaction_threshold); }
 
-    GarbageCollector *new_garbage_collector(Allocator *alloc)
-    { return new impl::MarkSweepGarbageCollector(alloc); }
+    GarbageCollector *new_bitmap_garbage_collector(Allocator *alloc, double growth_factor, unsigned int interval_usecs)
+    { return new impl::BitmapGarbageCollector(alloc, interval_usecs, growth_factor); }
 
     MemoizationCacheFactory *new_memoization_cache_factory(size_t bucket_count)
     { return new impl::HashTableMemoizationCacheFactory(bucket_count); }
@@ -1681,6 +1868,9 @@ namespace letin
     VirtualMachine *new_virtual_machine(Loader *loader, GarbageCollector *gc, NativeFunctionHandler *native_fun_handler, EvaluationStrategy *eval_strategy, function<void ()> exit_fun)
     { return new impl::InterpreterVirtualMachine(loader, gc, native_fun_handler, eval_strategy, exit_fun); }
 
+    VirtualMachine *new_jit_virtual_machine(Loader *loader, GarbageCollector *gc, NativeFunctionHandler *native_fun_handler, EvaluationStrategy *eval_strategy, function<void ()> exit_fun, unsigned int compilation_threshold)
+    { return new impl::JitVirtualMachine(loader, gc, native_fun_handler, eval_strategy, exit_fun, compilation_threshold); }
+
     NativeFunctionHandlerLoader *new_native_function_handler_loader()
     { return new impl::ImplNativeFunctionHandlerLoader(); }
 
@@ -1719,7 +1909,7 @@ namespace letin
     }
 
     void set_temporary_root_object(ThreadContext *context, Reference ref)
-    { context->regs().tmp_r.safely_assign_for_gc(ref); }
+    { context->assign_for_gc(context->regs().tmp_r, ref); }
 
     NativeLibrary *new_native_library_without_throwing(const vector<NativeFunction> &funs, ForkHandler *fork_handler, int min_nfi)
     { try { return new NativeLibrary(funs, fork_handler, min_nfi); } catch(...) { return nullptr; } }
@@ -1977,6 +2167,62 @@ namespace letin
       }
     }
 
+    void write_heap_snapshot(ostream &os, const HeapSnapshot &snapshot)
+    {
+      os << "letin_heap_snapshot 1" << endl;
+      os << "sampling_interval " << snapshot.sampling_interval << endl;
+      for(int i = 0; i <= OBJECT_TYPE_NATIVE_OBJECT; i++) {
+        const HeapSnapshotEntry &entry = snapshot.type_entries[i];
+        os << "type " << i << " " << entry.object_count << " " << entry.byte_count << endl;
+      }
+      os << "internal " << snapshot.internal_entry.object_count << " " << snapshot.internal_entry.byte_count << endl;
+      for(int i = 0; i <= MAX_HEAP_SNAPSHOT_ROOT; i++) {
+        const HeapSnapshotEntry &entry = snapshot.root_entries[i];
+        os << "root " << i << " " << entry.object_count << " " << entry.byte_count << endl;
+      }
+      // The function name is the rest of the line because it can contain any characters
+      // except the newline.
+      for(auto &pair : snapshot.fun_entries)
+        os << "fun " << pair.second.object_count << " " << pair.second.byte_count << " " << pair.first << endl;
+    }
+
+    bool read_heap_snapshot(istream &is, HeapSnapshot &snapshot)
+    {
+      snapshot = HeapSnapshot();
+      string line;
+      if(!getline(is, line) || line != "letin_heap_snapshot 1") return false;
+      while(getline(is, line)) {
+        istringstream iss(line);
+        string keyword;
+        iss >> keyword;
+        HeapSnapshotEntry entry;
+        if(keyword == "sampling_interval") {
+          iss >> snapshot.sampling_interval;
+        } else if(keyword == "type" || keyword == "root") {
+          int i;
+          iss >> i >> entry.object_count >> entry.byte_count;
+          if(iss.fail()) return false;
+          if(keyword == "type" && i >= 0 && i <= OBJECT_TYPE_NATIVE_OBJECT)
+            snapshot.type_entries[i] = entry;
+          else if(keyword == "root" && i >= 0 && i <= MAX_HEAP_SNAPSHOT_ROOT)
+            snapshot.root_entries[i] = entry;
+          else
+            return false;
+        } else if(keyword == "internal") {
+          iss >> snapshot.internal_entry.object_count >> snapshot.internal_entry.byte_count;
+        } else if(keyword == "fun") {
+          iss >> entry.object_count >> entry.byte_count;
+          if(iss.get() != ' ') return false;
+          string name;
+          getline(iss, name);
+          snapshot.fun_entries[name] = entry;
+        } else
+          return false;
+        if(iss.fail()) return false;
+      }
+      return true;
+    }
+
     Reference user_exception_ref(ThreadContext *vm)
     { return vm->regs().rv.error() == ERROR_USER_EXCEPTION ? vm->regs().rv.r() : Reference(); }
 
@@ -2106,68 +2352,14 @@ namespace letin
         return true;
       }
 
+      size_t object_size(const Object &object)
+      { return vm::object_size(object.type(), object.length()); }
+
       void traverse_child_objects(Object &object, function<void (Object *)> fun)
-      {
-        switch(object.type() & ~OBJECT_TYPE_UNIQUE) {
-          case OBJECT_TYPE_RARRAY:
-            for(size_t i = 0; i < object.length(); i++) {
-              if(!object.raw().rs[i].has_nil()) fun(object.raw().rs[i].ptr());
-            }
-            break;
-          case OBJECT_TYPE_TUPLE:
-            for(size_t i = 0; i < object.length(); i++) {
-              if(is_ref_value_type_for_gc(object.raw().tuple_elem_types()[i].raw())) {
-                Reference elem_ref = object.raw().tes[i].raw().r;
-                if(!elem_ref.has_nil()) fun(elem_ref.ptr());
-              }
-            }
-            break;
-          case OBJECT_TYPE_LAZY_VALUE:
-            if(is_ref_value_type_for_gc(object.raw().lzv.value.type())) {
-              Reference value_ref = object.raw().lzv.value.raw().r;
-              if(!value_ref.has_nil()) fun(value_ref.ptr());
-            }
-            for(size_t i = 0; i < object.length(); i++) {
-              if(is_ref_value_type_for_gc(object.raw().lzv.args[i].type())) {
-                Reference arg_ref = object.raw().lzv.args[i].raw().r;
-                if(!arg_ref.has_nil()) fun(arg_ref.ptr());
-              }
-            }
-            break;
-          case OBJECT_TYPE_HASH_TABLE:
-          {
-            HashTableRaw *raw = reinterpret_cast<HashTableRaw *>(object.raw().bs);
-            for(size_t i = 0; i < raw->bucket_count; i++) {
-              Reference entry_ref = raw->buckets[i].first_entry_r;
-              while(!entry_ref.has_nil()) {
-                fun(entry_ref.ptr());
-                HashTableEntryRawBase *raw = reinterpret_cast<HashTableEntryRawBase *>(entry_ref->raw().bs);
-                entry_ref = raw->next_r;
-              }
-            }
-            break;
-          }
-          case OBJECT_TYPE_ALI_HASH_TABLE_ENTRY:
-          {
-            HashTableEntryRaw<ArgumentList, int64_t> *raw = reinterpret_cast<HashTableEntryRaw<ArgumentList, int64_t> *>(object.raw().bs);
-            if(!raw->key.key_ref().has_nil()) fun(raw->key.key_ref().ptr());
-            break;
-          }
-          case OBJECT_TYPE_ALF_HASH_TABLE_ENTRY:
-          {
-            HashTableEntryRaw<ArgumentList, double> *raw = reinterpret_cast<HashTableEntryRaw<ArgumentList, double> *>(object.raw().bs);
-            if(!raw->key.key_ref().has_nil()) fun(raw->key.key_ref().ptr());
-            break;
-          }
-          case OBJECT_TYPE_ALR_HASH_TABLE_ENTRY:
-          {
-            HashTableEntryRaw<ArgumentList, Reference> *raw = reinterpret_cast<HashTableEntryRaw<ArgumentList, Reference> *>(object.raw().bs);
-            if(!raw->key.key_ref().has_nil()) fun(raw->key.key_ref().ptr());
-            if(!raw->value.value().has_nil()) fun(raw->value.value().ptr());
-            break;
-          }
-        }
-      }
+      { for_each_child_object(object, fun); }
+
+      void traverse_child_refs(Object &object, function<void (int, Reference &)> fun)
+      { for_each_child_ref(object, fun); }
     }
   }
 }
@@ -18,6 +18,7 @@
 #include <letin/format.hpp>
 #include <letin/vm.hpp>
 #include "sem.hpp"
+#include "thread_stop_cont.hpp"
 
 namespace letin
 {
@@ -138,6 +139,14 @@ namespace letin
       ReturnValue rv;
       std::uint64_t ai;
       void *gc_tmp_ptr;
+      Object *gc_written_object;
+      void *gc_local_first;
+      void *gc_local_last;
+      std::size_t gc_local_count;
+      bool gc_local_adding_flag;
+      void *gc_chunk;
+      void *gc_chunk_ptr;
+      void *gc_chunk_end;
       Reference tmp_r;
       bool after_leaving_flags[2];
       unsigned after_leaving_flag_index;
@@ -159,6 +168,8 @@ namespace letin
       std::size_t cutc;
       int *cancelation_undo_types[4];
       Value tmp_expr_values[2];
+      Reference reusable_tuple_r;
+      std::size_t reusable_tuple_count;
     };
 
     struct SavedRegisters
@@ -210,8 +221,14 @@ namespace letin
       RegisteredReference *_M_last_registered_r;
       std::mutex _M_interruptible_fun_mutex;
       bool _M_interruptible_fun_flag;
+      void *_M_system_stack_bottom;
+      void *volatile _M_system_stack_top;
+      priv::Safepoint _M_safepoint;
       std::unique_ptr<std::vector<StackTraceElement>> _M_stack_trace;
       std::unique_ptr<std::vector<StackTraceElement>> _M_try_catch_stack_trace;
+      std::size_t _M_unsampled_byte_count;
+
+      static const std::size_t MAX_REUSABLE_TUPLE_COUNT = 8;
     public:
       ThreadContext(const VirtualMachineContext &vm_context, std::size_t stack_size = 32 * 1024, std::size_t expr_stack_size = 16 * 1024);
 
@@ -232,7 +249,35 @@ namespace letin
 
       std::thread &system_thread() { return _M_thread; }
 
-      void start(std::function<void ()> fun) { _M_thread = std::thread(fun); }
+      void start(std::function<void ()> fun);
+
+      void *system_stack_bottom() const { return _M_system_stack_bottom; }
+
+      void *system_stack_top() const { return _M_system_stack_top; }
+
+      void set_system_stack_top(void *ptr) { _M_system_stack_top = ptr; }
+
+      priv::Safepoint &safepoint() { return _M_safepoint; }
+
+      void check_safepoint()
+      {
+        if(_M_safepoint.is_requested.load(std::memory_order_relaxed))
+          priv::stop_at_safepoint(&_M_safepoint);
+      }
+
+      // The garbage collector doesn't interrupt the thread between the safepoints so
+      // the stack and the registers can be modified by the plain stores if the
+      // safepoints are enabled.
+      void release_fence_for_gc()
+      { if(!_M_safepoint.is_enabled) std::atomic_thread_fence(std::memory_order_release); }
+
+      template<typename _T, typename _U>
+      void assign_for_gc(_T &dst, const _U &src)
+      { if(_M_safepoint.is_enabled) dst = src; else dst.safely_assign_for_gc(src); }
+    private:
+      void push_stack_elem_for_gc(Value &elem, const Value &value)
+      { elem = value; release_fence_for_gc(); }
+    public:
 
       const Registers &regs() const { return _M_regs; }
 
@@ -240,10 +285,14 @@ namespace letin
 
       const Value &stack_elem(std::size_t i) const { return _M_stack[i]; }
 
+      Value &stack_elem(std::size_t i) { return _M_stack[i]; }
+
       std::size_t stack_size() const { return _M_stack_size; }
 
       const Value &expr_stack_elem(std::size_t i) const { return _M_expr_stack[i]; }
 
+      Value &expr_stack_elem(std::size_t i) { return _M_expr_stack[i]; }
+
       std::size_t expr_stack_size() const { return _M_expr_stack_size; }
 
       const Function &fun(std::size_t i) const { return _M_funs[i]; }
@@ -291,12 +340,12 @@ namespace letin
       bool push_local_var(const Value &value)
       {
         if(_M_regs.abp2 < _M_stack_size) {
-          _M_stack[_M_regs.abp2].safely_assign_for_gc(value);
+          assign_for_gc(_M_stack[_M_regs.abp2], value);
           _M_regs.abp2++;
           _M_regs.ac2 = 0;
-          std::atomic_thread_fence(std::memory_order_release);
+          release_fence_for_gc();
           _M_regs.sec = _M_regs.abp2;
-          std::atomic_thread_fence(std::memory_order_release);
+          release_fence_for_gc();
           return true;
         } else
           return false;
@@ -305,10 +354,10 @@ namespace letin
       bool push_arg(const Value &value)
       {
         if(_M_regs.abp2 + _M_regs.ac2 < _M_stack_size) {
-          _M_stack[_M_regs.abp2 + _M_regs.ac2].safely_assign_for_push(value);
+          push_stack_elem_for_gc(_M_stack[_M_regs.abp2 + _M_regs.ac2], value);
           _M_regs.ac2++;
           _M_regs.sec++;
-          std::atomic_thread_fence(std::memory_order_release);
+          release_fence_for_gc();
           return true;
         } else
           return false;
@@ -318,7 +367,7 @@ namespace letin
       {
         _M_regs.ac2 = 0;
         _M_regs.sec = _M_regs.abp2;
-        std::atomic_thread_fence(std::memory_order_release);
+        release_fence_for_gc();
       }
 
       const Value &pushed_arg(std::size_t i) const { return _M_stack[_M_regs.abp2 + i]; }
@@ -330,7 +379,7 @@ namespace letin
         _M_regs.abp2 = lvbp();
         _M_regs.lvc = _M_regs.ac2 = 0;
         _M_regs.sec = _M_regs.abp2;
-        std::atomic_thread_fence(std::memory_order_release);
+        release_fence_for_gc();
       }
 
       bool enter_to_fun(std::size_t i);
@@ -363,7 +412,7 @@ namespace letin
         _M_regs.abp2 -= _M_regs.tmp_ac2;
         _M_regs.ac2 = _M_regs.tmp_ac2;
         _M_regs.sec = _M_regs.abp2 + _M_regs.ac2;
-        std::atomic_thread_fence(std::memory_order_release);
+        release_fence_for_gc();
       }
 
       bool push_tmp_ac2()
@@ -374,7 +423,7 @@ namespace letin
         if(_M_regs.abp2 > 0 && _M_stack[_M_regs.abp2 - 1].type() == VALUE_TYPE_INT) {
           _M_regs.sec--;
           _M_regs.abp2--;
-          std::atomic_thread_fence(std::memory_order_release);
+          release_fence_for_gc();
           _M_regs.tmp_ac2 = _M_stack[_M_regs.abp2].raw().i;
           return true;
         } else
@@ -389,7 +438,7 @@ namespace letin
         if(_M_regs.abp2 > 0 && _M_stack[_M_regs.abp2 - 1].type() == VALUE_TYPE_PAIR) {
           _M_regs.sec--;
           _M_regs.abp2--;
-          std::atomic_thread_fence(std::memory_order_release);
+          release_fence_for_gc();
           _M_regs.tmp_ac2 = static_cast<std::int32_t>(_M_stack[_M_regs.abp2].raw().p.first);
           _M_regs.after_leaving_flags[0] = (_M_stack[_M_regs.abp2].raw().p.second != 0);
           return true;
@@ -402,17 +451,17 @@ namespace letin
         _M_regs.try_flag = true;
         _M_regs.try_catch_flag = false;
         _M_regs.try_abp = _M_regs.abp2; _M_regs.try_ac = _M_regs.ac2;
-        _M_regs.try_arg2.safely_assign_for_gc(arg2);
-        _M_regs.try_io_r.safely_assign_for_gc(io_r);
+        assign_for_gc(_M_regs.try_arg2, arg2);
+        assign_for_gc(_M_regs.try_io_r, io_r);
         _M_regs.try_catch_error = ERROR_SUCCESS;
-        _M_regs.try_catch_r.safely_assign_for_gc(Reference());
-        std::atomic_thread_fence(std::memory_order_release);
+        assign_for_gc(_M_regs.try_catch_r, Reference());
+        release_fence_for_gc();
       }
 
       void set_try_regs_for_force()
       {
         _M_regs.try_abp = _M_regs.abp2; _M_regs.try_ac = _M_regs.ac2;
-        std::atomic_thread_fence(std::memory_order_release);
+        release_fence_for_gc();
       }
 
       bool push_try_regs()
@@ -437,11 +486,11 @@ namespace letin
             _M_stack[abp2 + 5].type() == VALUE_TYPE_REF) {
           _M_regs.sec -= 6;
           _M_regs.abp2 -= 6;
-          std::atomic_thread_fence(std::memory_order_release);
-          _M_regs.try_catch_r.safely_assign_for_gc(_M_stack[_M_regs.abp2 + 5].raw().r);
+          release_fence_for_gc();
+          assign_for_gc(_M_regs.try_catch_r, _M_stack[_M_regs.abp2 + 5].raw().r);
           _M_regs.try_catch_error = _M_stack[_M_regs.abp2 + 4].raw().i;
-          _M_regs.try_io_r.safely_assign_for_gc(_M_stack[_M_regs.abp2 + 3].raw().r);
-          _M_regs.try_arg2.safely_assign_for_gc(_M_stack[_M_regs.abp2 + 2]);
+          assign_for_gc(_M_regs.try_io_r, _M_stack[_M_regs.abp2 + 3].raw().r);
+          assign_for_gc(_M_regs.try_arg2, _M_stack[_M_regs.abp2 + 2]);
           _M_regs.try_abp = _M_stack[_M_regs.abp2 + 1].raw().i >> 32;
           _M_regs.try_ac = _M_stack[_M_regs.abp2 + 1].raw().i & 0xffffffff;
           _M_regs.try_flag = ((_M_stack[_M_regs.abp2 + 0].raw().i & 1) != 0);
@@ -476,7 +525,7 @@ namespace letin
         if(_M_regs.abp2 > 0 && _M_stack[_M_regs.abp2 - 1].type() == VALUE_TYPE_LOCKED_LAZY_VALUE_REF) {
           _M_regs.sec--;
           _M_regs.abp2--;
-          std::atomic_thread_fence(std::memory_order_release);
+          release_fence_for_gc();
           return true;
         } else
           return false;
@@ -499,7 +548,7 @@ namespace letin
         if(_M_regs.abp2 > 0) {
           _M_regs.sec--;
           _M_regs.abp2--;
-          std::atomic_thread_fence(std::memory_order_release);
+          release_fence_for_gc();
           return true;
         } else
           return false;
@@ -523,10 +572,10 @@ namespace letin
       bool push_expr_value(Value &value)
       {
         if(_M_regs.evbp + _M_regs.evc < _M_expr_stack_size) {
-          _M_expr_stack[_M_regs.evbp + _M_regs.evc].safely_assign_for_push(value);
+          push_stack_elem_for_gc(_M_expr_stack[_M_regs.evbp + _M_regs.evc], value);
           _M_regs.evc++;
           _M_regs.esec++;
-          std::atomic_thread_fence(std::memory_order_release);
+          release_fence_for_gc();
           return true;
         } else
           return false;        
@@ -537,7 +586,7 @@ namespace letin
         if(_M_regs.evc >= n) {
           _M_regs.evc -= n;
           _M_regs.esec -= n;
-          std::atomic_thread_fence(std::memory_order_release);
+          release_fence_for_gc();
           return true;
         } else
           return false;
@@ -547,7 +596,7 @@ namespace letin
       {
         _M_regs.evc = 0;
         _M_regs.esec = _M_regs.evbp;
-        std::atomic_thread_fence(std::memory_order_release);
+        release_fence_for_gc();
       }
       
       Value &expr_value(std::size_t i) { return _M_expr_stack[_M_regs.evbp + _M_regs.evc - i - 1]; }
@@ -556,7 +605,7 @@ namespace letin
       {
         if(_M_regs.evc > i) {
           value.safely_assign_for_gc(_M_expr_stack[_M_regs.evbp + _M_regs.evc - i - 1]);
-          std::atomic_thread_fence(std::memory_order_release);
+          release_fence_for_gc();
           return true;
         } else
           return false;
@@ -565,17 +614,31 @@ namespace letin
       bool set_expr_value(std::size_t i, const Value &value)
       {
         if(_M_regs.evc > i) {
-          _M_expr_stack[_M_regs.evbp + _M_regs.evc - i - 1].safely_assign_for_gc(value);
-          std::atomic_thread_fence(std::memory_order_release);
+          assign_for_gc(_M_expr_stack[_M_regs.evbp + _M_regs.evc - i - 1], value);
+          release_fence_for_gc();
           return true;
         } else
           return false;
       }
 
       bool add_stack_trace_elem_for_native_fun(int native_fun);
+
+      bool must_sample_allocation(std::size_t size, std::size_t sampling_interval)
+      {
+        _M_unsampled_byte_count += size;
+        if(_M_unsampled_byte_count < sampling_interval) return false;
+        _M_unsampled_byte_count = 0;
+        return true;
+      }
+
+      void add_reusable_unique_tuple(Object *object);
+
+      Object *reuse_unique_tuple(std::size_t length);
       
       void traverse_root_objects(std::function<void (Object *)> fun);
 
+      void traverse_root_refs(std::function<void (int, Reference &)> fun);
+
       void safely_set_gc_tmp_ptr_for_gc(void *ptr)
       {
         std::atomic_thread_fence(std::memory_order_release);
@@ -659,6 +722,8 @@ namespace letin
       virtual const std::list<MemoizationCache *> &memo_caches() const = 0;
 
       void traverse_root_objects(std::function<void (Object *)> fun);
+
+      void traverse_root_refs(std::function<void (int, Reference &)> fun);
     };
 
     class MemoizationCache
@@ -673,6 +738,8 @@ namespace letin
       virtual bool add_fun_result(std::size_t i, int value_type, const ArgumentList &args, const Value &fun_result, ThreadContext &context) = 0;
 
       virtual void traverse_root_objects(std::function<void (Object *)> fun) = 0;
+
+      virtual void traverse_root_refs(std::function<void (int, Reference &)> fun) = 0;
       
       virtual ForkHandler *fork_handler() = 0;
     };
@@ -715,7 +782,11 @@ namespace letin
 
       bool is_memoizable_fun_result(const Value &value);
 
+      std::size_t object_size(const Object &object);
+
       void traverse_child_objects(Object &object, std::function<void (Object *)> fun);
+
+      void traverse_child_refs(Object &object, std::function<void (int, Reference &)> fun);
     }
   }
 }
@@ -10,17 +10,21 @@
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
+#include <mutex>
+#include <unordered_map>
 #include <letin/const.hpp>
 #include <letin/opcode.hpp>
 #include <letin/vm.hpp>
 #include "interp_vm.hpp"
 #include "impl_vm_base.hpp"
+#include "verifier.hpp"
 #include "vm.hpp"
 #include "util.hpp"
 
 using namespace std;
 using namespace letin::opcode;
 using namespace letin::util;
+using namespace letin::vm::priv;
 
 namespace letin
 {
@@ -96,17 +100,18 @@ namespace letin
         return true;
       }
 
-      static inline bool get_int_value(ThreadContext &context, Value &value, uint32_t arg_type, Argument arg, size_t &j, size_t n)
+      template<uint32_t _ArgType, bool _IsChecked>
+      static inline bool get_int_value(ThreadContext &context, Value &value, Argument arg, size_t &j, size_t n)
       {
-        switch(arg_type) {
+        switch(_ArgType) {
           case ARG_TYPE_LVAR:
-            if(arg.lvar >= context.regs().lvc) {
+            if(_IsChecked && arg.lvar >= context.regs().lvc) {
               context.set_error(ERROR_NO_LOCAL_VAR);
               return false;
             }
             return get_int_value(context, value, context.local_var(arg.lvar));
           case ARG_TYPE_ARG:
-            if(arg.arg >= context.regs().ac) {
+            if(_IsChecked && arg.arg >= context.regs().ac) {
               context.set_error(ERROR_NO_ARG);
               return false;
             }
@@ -115,7 +120,7 @@ namespace letin
             value = Value(arg.i);
             return true;
           case ARG_TYPE_GVAR:
-            if(arg.gvar >= context.global_var_count()) {
+            if(_IsChecked && arg.gvar >= context.global_var_count()) {
               context.set_error(ERROR_NO_GLOBAL_VAR);
               return false;
             }
@@ -131,7 +136,7 @@ namespace letin
             return result;
           }
           case ARG_TYPE_EVAL:
-            if(arg.eval + n >= context.regs().evc) {
+            if(_IsChecked && arg.eval + n >= context.regs().evc) {
               context.set_error(ERROR_NO_EXPR_VALUE);
               return false;
             }
@@ -157,17 +162,18 @@ namespace letin
         return true;
       }
 
-      static inline bool get_float_value(ThreadContext &context, Value &value, uint32_t arg_type, Argument arg, size_t &j, size_t n)
+      template<uint32_t _ArgType, bool _IsChecked>
+      static inline bool get_float_value(ThreadContext &context, Value &value, Argument arg, size_t &j, size_t n)
       {
-        switch(arg_type) {
+        switch(_ArgType) {
           case opcode::ARG_TYPE_LVAR:
-            if(arg.lvar >= context.regs().lvc) {
+            if(_IsChecked && arg.lvar >= context.regs().lvc) {
               context.set_error(ERROR_NO_LOCAL_VAR);
               return false;
             }
             return get_float_value(context, value, context.local_var(arg.lvar));
           case opcode::ARG_TYPE_ARG:
-            if(arg.arg >= context.regs().ac) {
+            if(_IsChecked && arg.arg >= context.regs().ac) {
               context.set_error(ERROR_NO_ARG);
               return false;
             }
@@ -176,7 +182,7 @@ namespace letin
             value = Value(format_float_to_float(arg.f));
             return true;
           case opcode::ARG_TYPE_GVAR:
-            if(arg.gvar >= context.global_var_count()) {
+            if(_IsChecked && arg.gvar >= context.global_var_count()) {
               context.set_error(ERROR_NO_GLOBAL_VAR);
               return false;
             }
@@ -192,7 +198,7 @@ namespace letin
             return result;
           }
           case ARG_TYPE_EVAL:
-            if(arg.eval + n >= context.regs().evc) {
+            if(_IsChecked && arg.eval + n >= context.regs().evc) {
               context.set_error(ERROR_NO_EXPR_VALUE);
               return false;
             }
@@ -243,23 +249,24 @@ namespace letin
         return true;
       }
 
-      static inline bool get_ref_value(ThreadContext &context, Value &value, uint32_t arg_type, Argument arg, size_t &j, size_t n)
+      template<uint32_t _ArgType, bool _IsChecked>
+      static inline bool get_ref_value(ThreadContext &context, Value &value, Argument arg, size_t &j, size_t n)
       {
-        switch(arg_type) {
+        switch(_ArgType) {
           case opcode::ARG_TYPE_LVAR:
-            if(arg.lvar >= context.regs().lvc) {
+            if(_IsChecked && arg.lvar >= context.regs().lvc) {
               context.set_error(ERROR_NO_LOCAL_VAR);
               return false;
             }
             return get_ref_value(context, value, context.local_var(arg.lvar));
           case opcode::ARG_TYPE_ARG:
-            if(arg.arg >= context.regs().ac) {
+            if(_IsChecked && arg.arg >= context.regs().ac) {
               context.set_error(ERROR_NO_ARG);
               return false;
             }
             return get_ref_value(context, value, context.arg(arg.arg));
           case opcode::ARG_TYPE_GVAR:
-            if(arg.gvar >= context.global_var_count()) {
+            if(_IsChecked && arg.gvar >= context.global_var_count()) {
               context.set_error(ERROR_NO_GLOBAL_VAR);
               return false;
             }
@@ -275,7 +282,7 @@ namespace letin
             return result;
           }
           case ARG_TYPE_EVAL:
-            if(arg.eval + n >= context.regs().evc) {
+            if(_IsChecked && arg.eval + n >= context.regs().evc) {
               context.set_error(ERROR_NO_EXPR_VALUE);
               return false;
             }
@@ -286,6 +293,15 @@ namespace letin
         }
       }
 
+      static inline bool get_int_value(ThreadContext &context, Value &value, const DecodedArgument &arg, size_t &j, size_t n)
+      { return arg.getters->get_int_value(context, value, arg.value, j, n); }
+
+      static inline bool get_float_value(ThreadContext &context, Value &value, const DecodedArgument &arg, size_t &j, size_t n)
+      { return arg.getters->get_float_value(context, value, arg.value, j, n); }
+
+      static inline bool get_ref_value(ThreadContext &context, Value &value, const DecodedArgument &arg, size_t &j, size_t n)
+      { return arg.getters->get_ref_value(context, value, arg.value, j, n); }
+
       static inline bool pop_expr_values(ThreadContext &context, size_t n)
       {
         if(!context.pop_expr_values(n)) {
@@ -297,6 +313,7 @@ namespace letin
       
       static inline Object *new_object(ThreadContext &context, int type, int64_t length)
       {
+        context.check_safepoint();
         Object *object = context.gc()->new_object_for_length64(type, length, &context);
         if(object == nullptr) {
           context.set_error(ERROR_OUT_OF_MEMORY);
@@ -584,6 +601,94 @@ namespace letin
         return object;
       }
       
+      template<uint32_t _Op>
+      static inline Value apply_int_op(ThreadContext &context, int64_t i1, int64_t i2)
+      {
+        switch(_Op) {
+          case OP_INEG:
+            return Value(-i1);
+          case OP_IADD:
+            return Value(i1 + i2);
+          case OP_ISUB:
+            return Value(i1 - i2);
+          case OP_IMUL:
+            return Value(i1 * i2);
+          case OP_IDIV:
+            if(i2 == 0) {
+              context.set_error(ERROR_DIV_BY_ZERO);
+              return Value();
+            }
+            return Value(i1 / i2);
+          case OP_IMOD:
+            if(i2 == 0) {
+              context.set_error(ERROR_DIV_BY_ZERO);
+              return Value();
+            }
+            return Value(i1 % i2);
+          case OP_INOT:
+            return Value(~i1);
+          case OP_IAND:
+            return Value(i1 & i2);
+          case OP_IOR:
+            return Value(i1 | i2);
+          case OP_IXOR:
+            return Value(i1 ^ i2);
+          case OP_ISHL:
+            return Value(i1 << i2);
+          case OP_ISHR:
+            return Value(i1 >> i2);
+          case OP_ISHRU:
+            return Value(static_cast<std::int64_t>(static_cast<std::uint64_t>(i1) >> i2));
+          case OP_IEQ:
+            return Value(i1 == i2 ? 1 : 0);
+          case OP_INE:
+            return Value(i1 != i2 ? 1 : 0);
+          case OP_ILT:
+            return Value(i1 < i2 ? 1 : 0);
+          case OP_IGE:
+            return Value(i1 >= i2 ? 1 : 0);
+          case OP_IGT:
+            return Value(i1 > i2 ? 1 : 0);
+          case OP_ILE:
+            return Value(i1 <= i2 ? 1 : 0);
+          default:
+            context.set_error(ERROR_INCORRECT_INSTR);
+            return Value();
+        }
+      }
+
+      template<uint32_t _Op>
+      static inline Value apply_float_op(ThreadContext &context, double f1, double f2)
+      {
+        switch(_Op) {
+          case OP_FNEG:
+            return Value(-f1);
+          case OP_FADD:
+            return Value(f1 + f2);
+          case OP_FSUB:
+            return Value(f1 - f2);
+          case OP_FMUL:
+            return Value(f1 * f2);
+          case OP_FDIV:
+            return Value(f1 / f2);
+          case OP_FEQ:
+            return Value(f1 == f2 ? 1 : 0);
+          case OP_FNE:
+            return Value(f1 != f2 ? 1 : 0);
+          case OP_FLT:
+            return Value(f1 < f2 ? 1 : 0);
+          case OP_FGE:
+            return Value(f1 >= f2 ? 1 : 0);
+          case OP_FGT:
+            return Value(f1 > f2 ? 1 : 0);
+          case OP_FLE:
+            return Value(f1 <= f2 ? 1 : 0);
+          default:
+            context.set_error(ERROR_INCORRECT_INSTR);
+            return Value();
+        }
+      }
+
       //
       // Static functions.
       //
@@ -625,8 +730,128 @@ namespace letin
       // An InterpreterVirtualMachine class.
       //
 
+      // The last getters are for an incorrect argument type.
+      const ArgumentGetters InterpreterVirtualMachine::_S_arg_getters[7] = {
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_LVAR, true>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_LVAR, true>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_LVAR, true>,
+          get_int_value<ARG_TYPE_LVAR, true>,
+          get_float_value<ARG_TYPE_LVAR, true>,
+          get_ref_value<ARG_TYPE_LVAR, true>
+        },
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_ARG, true>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_ARG, true>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_ARG, true>,
+          get_int_value<ARG_TYPE_ARG, true>,
+          get_float_value<ARG_TYPE_ARG, true>,
+          get_ref_value<ARG_TYPE_ARG, true>
+        },
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_IMM, true>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_IMM, true>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_IMM, true>,
+          get_int_value<ARG_TYPE_IMM, true>,
+          get_float_value<ARG_TYPE_IMM, true>,
+          get_ref_value<ARG_TYPE_IMM, true>
+        },
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_GVAR, true>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_GVAR, true>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_GVAR, true>,
+          get_int_value<ARG_TYPE_GVAR, true>,
+          get_float_value<ARG_TYPE_GVAR, true>,
+          get_ref_value<ARG_TYPE_GVAR, true>
+        },
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_POP, true>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_POP, true>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_POP, true>,
+          get_int_value<ARG_TYPE_POP, true>,
+          get_float_value<ARG_TYPE_POP, true>,
+          get_ref_value<ARG_TYPE_POP, true>
+        },
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_EVAL, true>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_EVAL, true>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_EVAL, true>,
+          get_int_value<ARG_TYPE_EVAL, true>,
+          get_float_value<ARG_TYPE_EVAL, true>,
+          get_ref_value<ARG_TYPE_EVAL, true>
+        },
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_EVAL + 1, true>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_EVAL + 1, true>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_EVAL + 1, true>,
+          get_int_value<ARG_TYPE_EVAL + 1, true>,
+          get_float_value<ARG_TYPE_EVAL + 1, true>,
+          get_ref_value<ARG_TYPE_EVAL + 1, true>
+        }
+      };
+
+      // The getters for the verified functions don't check the arguments.
+      const ArgumentGetters InterpreterVirtualMachine::_S_verified_arg_getters[7] = {
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_LVAR, false>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_LVAR, false>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_LVAR, false>,
+          get_int_value<ARG_TYPE_LVAR, false>,
+          get_float_value<ARG_TYPE_LVAR, false>,
+          get_ref_value<ARG_TYPE_LVAR, false>
+        },
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_ARG, false>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_ARG, false>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_ARG, false>,
+          get_int_value<ARG_TYPE_ARG, false>,
+          get_float_value<ARG_TYPE_ARG, false>,
+          get_ref_value<ARG_TYPE_ARG, false>
+        },
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_IMM, false>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_IMM, false>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_IMM, false>,
+          get_int_value<ARG_TYPE_IMM, false>,
+          get_float_value<ARG_TYPE_IMM, false>,
+          get_ref_value<ARG_TYPE_IMM, false>
+        },
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_GVAR, false>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_GVAR, false>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_GVAR, false>,
+          get_int_value<ARG_TYPE_GVAR, false>,
+          get_float_value<ARG_TYPE_GVAR, false>,
+          get_ref_value<ARG_TYPE_GVAR, false>
+        },
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_POP, false>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_POP, false>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_POP, false>,
+          get_int_value<ARG_TYPE_POP, false>,
+          get_float_value<ARG_TYPE_POP, false>,
+          get_ref_value<ARG_TYPE_POP, false>
+        },
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_EVAL, false>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_EVAL, false>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_EVAL, false>,
+          get_int_value<ARG_TYPE_EVAL, false>,
+          get_float_value<ARG_TYPE_EVAL, false>,
+          get_ref_value<ARG_TYPE_EVAL, false>
+        },
+        {
+          &InterpreterVirtualMachine::get_int<ARG_TYPE_EVAL + 1, false>,
+          &InterpreterVirtualMachine::get_float<ARG_TYPE_EVAL + 1, false>,
+          &InterpreterVirtualMachine::get_ref<ARG_TYPE_EVAL + 1, false>,
+          get_int_value<ARG_TYPE_EVAL + 1, false>,
+          get_float_value<ARG_TYPE_EVAL + 1, false>,
+          get_ref_value<ARG_TYPE_EVAL + 1, false>
+        }
+      };
+
       InterpreterVirtualMachine::InterpreterVirtualMachine(Loader *loader, GarbageCollector *gc, NativeFunctionHandler *native_fun_handler, EvaluationStrategy *eval_strategy, function<void ()> exit_fun) :
-        ImplVirtualMachineBase(loader, gc, native_fun_handler, eval_strategy, exit_fun)
+        ImplVirtualMachineBase(loader, gc, native_fun_handler, eval_strategy, exit_fun), _M_profiling_flag(false)
       {
         if(_M_eval_strategy->is_eager()) {
           _M_return_value_to_int_value = return_value_to_int_value_for_eager_eval;
@@ -639,10 +864,21 @@ namespace letin
           _M_return_value_to_ref_value = return_value_to_ref_value_for_lazy_eval;
           _M_force_pushed_args = &InterpreterVirtualMachine::force_pushed_args_for_lazy_eval;
         }
+        interpret_decoded_instrs(nullptr, nullptr);
       }
 
       InterpreterVirtualMachine::~InterpreterVirtualMachine() {}
 
+      bool InterpreterVirtualMachine::load(const vector<pair<void *, size_t>> &pairs, list<LoadingError> *errors, bool is_auto_freeing)
+      {
+        if(!ImplVirtualMachineBase::load(pairs, errors, is_auto_freeing)) {
+          _M_decoded_funs.reset();
+          return false;
+        }
+        decode_funs();
+        return true;
+      }
+
       int InterpreterVirtualMachine::force(ThreadContext *context, Value &value)
       {
         if(!force_value_and_interpret(*context, value)) return context->regs().rv.error();
@@ -672,6 +908,17 @@ namespace letin
         return ERROR_SUCCESS;
       }
 
+      bool InterpreterVirtualMachine::profiling_flag() { return _M_profiling_flag; }
+
+      void InterpreterVirtualMachine::set_profiling_flag(bool flag) { _M_profiling_flag = flag; }
+
+      bool InterpreterVirtualMachine::instr_profile(InstructionProfile &profile)
+      {
+        lock_guard<mutex> guard(_M_instr_profile_mutex);
+        profile = _M_instr_profile;
+        return true;
+      }
+
       ReturnValue InterpreterVirtualMachine::start_in_thread(size_t i, const vector<Value> &args, ThreadContext &context, bool is_force)
       {
         for(auto arg : args) if(!push_arg(context, arg)) return context.regs().rv;
@@ -686,7 +933,16 @@ namespace letin
       }
 
       void InterpreterVirtualMachine::interpret(ThreadContext &context)
-      { while(interpret_instr(context)); }
+      {
+        if(!_M_profiling_flag) {
+          interpret_decoded_instrs(&context, nullptr);
+          return;
+        }
+        // The sequences are counted by the thread and then are added to the profile.
+        unordered_map<uint64_t, uint64_t> seq_counts;
+        interpret_decoded_instrs(&context, &seq_counts);
+        add_seq_counts_to_instr_profile(seq_counts);
+      }
 
       inline bool InterpreterVirtualMachine::get_int(ThreadContext &context, int64_t &i, Value &value)
       {
@@ -702,17 +958,18 @@ namespace letin
         return true;
       }
 
-      inline bool InterpreterVirtualMachine::get_int(ThreadContext &context, int64_t &i, uint32_t arg_type, Argument arg, size_t &j, size_t n)
+      template<uint32_t _ArgType, bool _IsChecked>
+      inline bool InterpreterVirtualMachine::get_int(ThreadContext &context, int64_t &i, Argument arg, size_t &j, size_t n)
       {
-        switch(arg_type) {
+        switch(_ArgType) {
           case ARG_TYPE_LVAR:
-            if(arg.lvar >= context.regs().lvc) {
+            if(_IsChecked && arg.lvar >= context.regs().lvc) {
               context.set_error(ERROR_NO_LOCAL_VAR);
               return false;
             }
             return get_int(context, i, context.local_var(arg.lvar));
           case ARG_TYPE_ARG:
-            if(arg.arg >= context.regs().ac) {
+            if(_IsChecked && arg.arg >= context.regs().ac) {
               context.set_error(ERROR_NO_ARG);
               return false;
             }
@@ -721,7 +978,7 @@ namespace letin
             i = arg.i;
             return true;
           case ARG_TYPE_GVAR:
-            if(arg.gvar >= context.global_var_count()) {
+            if(_IsChecked && arg.gvar >= context.global_var_count()) {
               context.set_error(ERROR_NO_GLOBAL_VAR);
               return false;
             }
@@ -743,7 +1000,7 @@ namespace letin
             return result;
           }
           case ARG_TYPE_EVAL:
-            if(arg.eval + n >= context.regs().evc) {
+            if(_IsChecked && arg.eval + n >= context.regs().evc) {
               context.set_error(ERROR_NO_EXPR_VALUE);
               return false;
             }
@@ -768,17 +1025,18 @@ namespace letin
         return true;
       }
 
-      inline bool InterpreterVirtualMachine::get_float(ThreadContext &context, double &f, uint32_t arg_type, Argument arg, size_t &j, size_t n)
+      template<uint32_t _ArgType, bool _IsChecked>
+      inline bool InterpreterVirtualMachine::get_float(ThreadContext &context, double &f, Argument arg, size_t &j, size_t n)
       {
-        switch(arg_type) {
+        switch(_ArgType) {
           case opcode::ARG_TYPE_LVAR:
-            if(arg.lvar >= context.regs().lvc) {
+            if(_IsChecked && arg.lvar >= context.regs().lvc) {
               context.set_error(ERROR_NO_LOCAL_VAR);
               return false;
             }
             return get_float(context, f, context.local_var(arg.lvar));
           case opcode::ARG_TYPE_ARG:
-            if(arg.arg >= context.regs().ac) {
+            if(_IsChecked && arg.arg >= context.regs().ac) {
               context.set_error(ERROR_NO_ARG);
               return false;
             }
@@ -787,7 +1045,7 @@ namespace letin
             f = format_float_to_float(arg.f);
             return true;
           case opcode::ARG_TYPE_GVAR:
-            if(arg.gvar >= context.global_var_count()) {
+            if(_IsChecked && arg.gvar >= context.global_var_count()) {
               context.set_error(ERROR_NO_GLOBAL_VAR);
               return false;
             }
@@ -809,7 +1067,7 @@ namespace letin
             return result;
           }
           case ARG_TYPE_EVAL:
-            if(arg.eval + n >= context.regs().evc) {
+            if(_IsChecked && arg.eval + n >= context.regs().evc) {
               context.set_error(ERROR_NO_EXPR_VALUE);
               return false;
             }
@@ -841,23 +1099,24 @@ namespace letin
         return true;
       }
 
-      inline bool InterpreterVirtualMachine::get_ref(ThreadContext &context, Reference &r, uint32_t arg_type, Argument arg, size_t &j, size_t n)
+      template<uint32_t _ArgType, bool _IsChecked>
+      inline bool InterpreterVirtualMachine::get_ref(ThreadContext &context, Reference &r, Argument arg, size_t &j, size_t n)
       {
-        switch(arg_type) {
+        switch(_ArgType) {
           case opcode::ARG_TYPE_LVAR:
-            if(arg.lvar >= context.regs().lvc) {
+            if(_IsChecked && arg.lvar >= context.regs().lvc) {
               context.set_error(ERROR_NO_LOCAL_VAR);
               return false;
             }
             return get_ref(context, r, context.local_var(arg.lvar));
           case opcode::ARG_TYPE_ARG:
-            if(arg.arg >= context.regs().ac) {
+            if(_IsChecked && arg.arg >= context.regs().ac) {
               context.set_error(ERROR_NO_ARG);
               return false;
             }
             return get_ref(context, r, context.arg(arg.arg));
           case opcode::ARG_TYPE_GVAR:
-            if(arg.gvar >= context.global_var_count()) {
+            if(_IsChecked && arg.gvar >= context.global_var_count()) {
               context.set_error(ERROR_NO_GLOBAL_VAR);
               return false;
             }
@@ -879,7 +1138,7 @@ namespace letin
             return result;
           }
           case ARG_TYPE_EVAL:
-            if(arg.eval + n >= context.regs().evc) {
+            if(_IsChecked && arg.eval + n >= context.regs().evc) {
               context.set_error(ERROR_NO_EXPR_VALUE);
               return false;
             }
@@ -890,2060 +1149,2595 @@ namespace letin
         }
       }
 
-      bool InterpreterVirtualMachine::interpret_instr(ThreadContext &context)
+      //
+      // The operations that are executed very often have the handlers that are specialized
+      // for the argument types. These handlers are selected for the instructions during the
+      // decoding. The unary operations are only specialized for the first argument type.
+      // The specialized handlers don't check the arguments so they are only selected for
+      // the verified functions.
+      //
+
+      template<uint32_t _Op, uint32_t _ArgType1, uint32_t _ArgType2>
+      Value InterpreterVirtualMachine::interpret_specialized_op(ThreadContext &context, const DecodedInstruction &instr)
       {
-        if(context.regs().fp == static_cast<size_t>(-1)) return false;
-        const Function &fun = context.fun(context.regs().fp);
-        if(context.regs().ip >= fun.raw().instr_count) {
-          context.set_error(ERROR_NO_INSTR);
-          return true;
-        }
-        const Instruction &instr = fun.raw().instrs[context.regs().ip];
-        context.regs().ip++;
-        if(context.regs().after_leaving_flags[1]) {
-          if(context.regs().rv.raw().error == ERROR_SUCCESS) {
-            Reference locked_lazy_value_r;
-            if(!get_locked_lazy_value_ref(context, locked_lazy_value_r)) return false;
-            if(!_M_eval_strategy->post_leave_from_fun_for_force(this, &context, locked_lazy_value_r->raw().lzv.fun, locked_lazy_value_r->raw().lzv.value_type))
-              return false;
-          }
-          if(opcode_to_instr(instr.opcode) == INSTR_ARG) context.regs().arg_instr_flag = true;
-          if(!restore_and_pop_regs_for_force(context)) return false;
-          if(opcode_to_instr(instr.opcode) == INSTR_ARG) {
-            context.regs().arg_instr_flag = false;
-            context.restore_abp2_and_ac2();
-          }
-        }
-        context.regs().cutc = 0;
-        switch(opcode_to_instr(instr.opcode)) {
-          case INSTR_LET:
-          {
-            Value value = interpret_op(context, instr);
-            context.pop_args();
-            if(!value.is_error())
-              if(!context.push_local_var(value)) context.set_error(ERROR_STACK_OVERFLOW);
-            context.regs().rv.raw().r = Reference();
-            context.regs().gc_tmp_ptr = nullptr;
-            context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
-            context.regs().tmp_expr_values[1].safely_assign_for_gc(Value());
-            break;
-          }
-          case INSTR_IN:
-            context.in();
-            break;
-          case INSTR_RET:
+        size_t j = 0;
+        size_t n = expr_pop_arg_count(_ArgType1, _ArgType2);
+        // The expression values aren't popped for the operations without the popped arguments.
+        switch(_Op) {
+          case OP_ILOAD:
+          case OP_FLOAD:
+          case OP_RLOAD:
           {
-            Value value = interpret_op(context, instr);
-            if(!value.is_error()) {
-              if(!leave_from_fun(context)) context.set_error(ERROR_EMPTY_STACK);
-              context.regs().rv = value;
-            }
-            context.regs().gc_tmp_ptr = nullptr;
-            context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
-            context.regs().tmp_expr_values[1].safely_assign_for_gc(Value());
-            break;
+            Value value;
+            bool is_success;
+            if(_Op == OP_ILOAD)
+              is_success = get_int_value<_ArgType1, false>(context, value, instr.arg1.value, j, n);
+            else if(_Op == OP_FLOAD)
+              is_success = get_float_value<_ArgType1, false>(context, value, instr.arg1.value, j, n);
+            else
+              is_success = get_ref_value<_ArgType1, false>(context, value, instr.arg1.value, j, n);
+            if(!is_success) return Value();
+            if(n != 0 && !pop_expr_values(context, n)) return Value();
+            return value;
           }
-          case INSTR_JC:
+          case OP_INEG:
+          case OP_INOT:
           {
             int64_t i;
-            size_t j = 0;
-            size_t n =  expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) {
-              if(!pop_expr_values(context, n)) {
-                context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
-                break;
-              }
-              if(i != 0) context.regs().ip += instr.arg2.i;
-            }
-            context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
-            break;
-          }
-          case INSTR_JUMP:
-            context.regs().ip += instr.arg1.i;
-            break;
-          case INSTR_ARG:
-          {
-            context.hide_args();
-            context.regs().arg_instr_flag = true;
-            Value value = interpret_op(context, instr);
-            context.regs().arg_instr_flag = false;
-            if(!value.is_error()) {
-              context.restore_abp2_and_ac2();
-              if(!context.push_arg(value)) context.set_error(ERROR_STACK_OVERFLOW);
-            }
-            context.regs().rv.raw().r = Reference();
-            context.regs().gc_tmp_ptr = nullptr;
-            context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
-            context.regs().tmp_expr_values[1].safely_assign_for_gc(Value());
-            break;
+            if(!get_int<_ArgType1, false>(context, i, instr.arg1.value, j, n)) return Value();
+            if(n != 0 && !pop_expr_values(context, n)) return Value();
+            return apply_int_op<_Op>(context, i, 0);
           }
-          case INSTR_RETRY:
-            if(context.regs().ac == context.regs().ac2) {
-              for(size_t i = 0; i < context.regs().ac; i++)
-                context.arg(i).safely_assign_for_gc(context.pushed_arg(i));
-              context.pop_args_and_local_vars();
-              context.pop_expr_values();
-            } else
-              context.set_error(ERROR_INCORRECT_ARG_COUNT);
-            context.regs().ip = 0;
-            break;
-          case INSTR_LETTUPLE:
+          case OP_FNEG:
           {
-            Value value;
-            if(!context.regs().after_leaving_flags[1]) context.regs().ai = 0;
-            if(!context.regs().after_leaving_flags[1] || context.regs().ai != static_cast<uint64_t>(-1)) {
-              value = interpret_op(context, instr);
-              context.pop_args();
-              context.regs().ai = static_cast<uint64_t>(-1);
-              if(!value.is_error()) {
-                if(!push_tmp_value(context, value)) value = Value();
-              }
-            } else {
-              if(!get_tmp_value(context, value)) value = Value();
-            }
-            if(!value.is_error()) {
-              Reference r;
-              if(get_ref(context, r, value)) {
-                if(pop_tmp_value(context)) { 
-                  if((r->type() & ~OBJECT_TYPE_UNIQUE) == OBJECT_TYPE_TUPLE) {
-                    uint32_t local_var_count = opcode_to_local_var_count(instr.opcode);
-                    if(r->length() == local_var_count) {
-                      for(size_t i = 0; i < local_var_count; i++) {
-                        Value elem_value(r->raw().tuple_elem_types()[i], r->raw().tes[i]);
-                        if(!context.push_local_var(elem_value)) context.set_error(ERROR_STACK_OVERFLOW);
-                      }
-                    } else
-                      context.set_error(ERROR_INCORRECT_OBJECT);
-                  } else
-                    context.set_error(ERROR_INCORRECT_OBJECT);
-                }
-              }
-            }
-            context.regs().rv.raw().r = Reference();
-            context.regs().gc_tmp_ptr = nullptr;
-            context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
-            context.regs().tmp_expr_values[1].safely_assign_for_gc(Value());
-            break;
+            double f;
+            if(!get_float<_ArgType1, false>(context, f, instr.arg1.value, j, n)) return Value();
+            if(n != 0 && !pop_expr_values(context, n)) return Value();
+            return apply_float_op<_Op>(context, f, 0.0);
           }
-          case INSTR_THROW:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n =  expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) {
-              if(!pop_expr_values(context, n)) {
-                context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
-                break;
-              }
-              context.set_error(ERROR_USER_EXCEPTION, r);
-            }
-            context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
-            break;
-          }          
-          case INSTR_PUSH:
+          case OP_FADD:
+          case OP_FSUB:
+          case OP_FMUL:
+          case OP_FDIV:
+          case OP_FEQ:
+          case OP_FNE:
+          case OP_FLT:
+          case OP_FGE:
+          case OP_FGT:
+          case OP_FLE:
           {
-            Value value = interpret_op(context, instr);
-            context.pop_args();
-            if(!value.is_error())
-              if(!context.push_expr_value(value)) context.set_error(ERROR_STACK_OVERFLOW);
-            context.regs().rv.raw().r = Reference();
-            context.regs().gc_tmp_ptr = nullptr;
-            context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
-            context.regs().tmp_expr_values[1].safely_assign_for_gc(Value());
-            break;
+            double f1, f2;
+            if(!get_float<_ArgType1, false>(context, f1, instr.arg1.value, j, n)) return Value();
+            if(!get_float<_ArgType2, false>(context, f2, instr.arg2.value, j, n)) return Value();
+            if(n != 0 && !pop_expr_values(context, n)) return Value();
+            return apply_float_op<_Op>(context, f1, f2);
           }
-          case INSTR_POP:
-            if(!context.pop_expr_values(instr.arg1.eval)) context.set_error(ERROR_EMPTY_STACK);
-            break;
-          case INSTR_RETHROW:
+          default:
           {
-            Reference r;
-            size_t j = 0;
-            size_t n =  expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) {
-              if(!pop_expr_values(context, n)) {
-                context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
-                break;
-              }
-              if(check_object_type(context, *r, OBJECT_TYPE_IO | OBJECT_TYPE_UNIQUE)) {
-                if(context.regs().try_catch_flag) {
-                  context.move_try_catch_stack_trace_to_stack_trace();
-                  context.set_error(context.regs().try_catch_error, context.regs().try_catch_r, false);
-                } else {
-                  context.set_error(ERROR_NO_ERROR, r);
-                }
-              } else {
-                context.set_error(ERROR_INCORRECT_OBJECT, r);
-              }
-            }
-            context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
-            break;
+            int64_t i1, i2;
+            if(!get_int<_ArgType1, false>(context, i1, instr.arg1.value, j, n)) return Value();
+            if(!get_int<_ArgType2, false>(context, i2, instr.arg2.value, j, n)) return Value();
+            if(n != 0 && !pop_expr_values(context, n)) return Value();
+            return apply_int_op<_Op>(context, i1, i2);
           }
+        }
+      }
+
+      template<uint32_t _Op, uint32_t _ArgType1>
+      SpecializedOperation InterpreterVirtualMachine::specialized_op_for_arg_type2(uint32_t arg_type2)
+      {
+        switch(arg_type2) {
+          case ARG_TYPE_LVAR:
+            return &InterpreterVirtualMachine::interpret_specialized_op<_Op, _ArgType1, ARG_TYPE_LVAR>;
+          case ARG_TYPE_ARG:
+            return &InterpreterVirtualMachine::interpret_specialized_op<_Op, _ArgType1, ARG_TYPE_ARG>;
+          case ARG_TYPE_IMM:
+            return &InterpreterVirtualMachine::interpret_specialized_op<_Op, _ArgType1, ARG_TYPE_IMM>;
+          case ARG_TYPE_GVAR:
+            return &InterpreterVirtualMachine::interpret_specialized_op<_Op, _ArgType1, ARG_TYPE_GVAR>;
+          case ARG_TYPE_POP:
+            return &InterpreterVirtualMachine::interpret_specialized_op<_Op, _ArgType1, ARG_TYPE_POP>;
+          case ARG_TYPE_EVAL:
+            return &InterpreterVirtualMachine::interpret_specialized_op<_Op, _ArgType1, ARG_TYPE_EVAL>;
           default:
-            context.set_error(ERROR_INCORRECT_INSTR);
-            break;
+            return nullptr;
+        }
+      }
+
+      template<uint32_t _Op>
+      SpecializedOperation InterpreterVirtualMachine::specialized_op_for_arg_types(uint32_t arg_type1, uint32_t arg_type2)
+      {
+        switch(arg_type1) {
+          case ARG_TYPE_LVAR:
+            return specialized_op_for_arg_type2<_Op, ARG_TYPE_LVAR>(arg_type2);
+          case ARG_TYPE_ARG:
+            return specialized_op_for_arg_type2<_Op, ARG_TYPE_ARG>(arg_type2);
+          case ARG_TYPE_IMM:
+            return specialized_op_for_arg_type2<_Op, ARG_TYPE_IMM>(arg_type2);
+          case ARG_TYPE_GVAR:
+            return specialized_op_for_arg_type2<_Op, ARG_TYPE_GVAR>(arg_type2);
+          case ARG_TYPE_POP:
+            return specialized_op_for_arg_type2<_Op, ARG_TYPE_POP>(arg_type2);
+          case ARG_TYPE_EVAL:
+            return specialized_op_for_arg_type2<_Op, ARG_TYPE_EVAL>(arg_type2);
+          default:
+            return nullptr;
         }
-        atomic_thread_fence(memory_order_release);
-        return true;
       }
 
-      Value InterpreterVirtualMachine::interpret_op(ThreadContext &context, const Instruction &instr)
+      SpecializedOperation InterpreterVirtualMachine::find_specialized_op(uint32_t op, uint32_t arg_type1, uint32_t arg_type2)
       {
-        switch(opcode_to_op(instr.opcode)) {
+        switch(op) {
           case OP_ILOAD:
-          {
-            Value value;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_int_value(context, value, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return value;
-          }
-          case OP_ILOAD2:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value((i1 << 32) | (i2 & 0xffffffff));
-          }
+            return specialized_op_for_arg_types<OP_ILOAD>(arg_type1, ARG_TYPE_LVAR);
           case OP_INEG:
-          {
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(-i);
-          }
+            return specialized_op_for_arg_types<OP_INEG>(arg_type1, ARG_TYPE_LVAR);
           case OP_IADD:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 + i2);
-          }
+            return specialized_op_for_arg_types<OP_IADD>(arg_type1, arg_type2);
           case OP_ISUB:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 - i2);
-          }
+            return specialized_op_for_arg_types<OP_ISUB>(arg_type1, arg_type2);
           case OP_IMUL:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 * i2);
-          }
+            return specialized_op_for_arg_types<OP_IMUL>(arg_type1, arg_type2);
           case OP_IDIV:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(i2 == 0) {
-              context.set_error(ERROR_DIV_BY_ZERO);
-              return Value();
-            }
-            return Value(i1 / i2);
-          }
+            return specialized_op_for_arg_types<OP_IDIV>(arg_type1, arg_type2);
           case OP_IMOD:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(i2 == 0) {
-              context.set_error(ERROR_DIV_BY_ZERO);
-              return Value();
-            }
-            return Value(i1 % i2);
-          }
+            return specialized_op_for_arg_types<OP_IMOD>(arg_type1, arg_type2);
           case OP_INOT:
-          {
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(~i);
-          }
+            return specialized_op_for_arg_types<OP_INOT>(arg_type1, ARG_TYPE_LVAR);
           case OP_IAND:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 & i2);
-          }
+            return specialized_op_for_arg_types<OP_IAND>(arg_type1, arg_type2);
           case OP_IOR:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 | i2);
-          }
+            return specialized_op_for_arg_types<OP_IOR>(arg_type1, arg_type2);
           case OP_IXOR:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 ^ i2);
-          }
+            return specialized_op_for_arg_types<OP_IXOR>(arg_type1, arg_type2);
           case OP_ISHL:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 << i2);
-          }
+            return specialized_op_for_arg_types<OP_ISHL>(arg_type1, arg_type2);
           case OP_ISHR:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 >> i2);
-          }
+            return specialized_op_for_arg_types<OP_ISHR>(arg_type1, arg_type2);
           case OP_ISHRU:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(static_cast<std::int64_t>(static_cast<std::uint64_t>(i1) >> i2));
-          }
+            return specialized_op_for_arg_types<OP_ISHRU>(arg_type1, arg_type2);
           case OP_IEQ:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 == i2 ? 1 : 0);
-          }
+            return specialized_op_for_arg_types<OP_IEQ>(arg_type1, arg_type2);
           case OP_INE:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 != i2 ? 1 : 0);
-          }
+            return specialized_op_for_arg_types<OP_INE>(arg_type1, arg_type2);
           case OP_ILT:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 < i2 ? 1 : 0);
-          }
+            return specialized_op_for_arg_types<OP_ILT>(arg_type1, arg_type2);
           case OP_IGE:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 >= i2 ? 1 : 0);
-          }
+            return specialized_op_for_arg_types<OP_IGE>(arg_type1, arg_type2);
           case OP_IGT:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 > i2 ? 1 : 0);
-          }
+            return specialized_op_for_arg_types<OP_IGT>(arg_type1, arg_type2);
           case OP_ILE:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i1 <= i2 ? 1 : 0);
-          }
+            return specialized_op_for_arg_types<OP_ILE>(arg_type1, arg_type2);
           case OP_FLOAD:
-          {
-            Value value;
-            size_t j = 0;
-            size_t n =  expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float_value(context, value, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return value;
-          }
-          case OP_FLOAD2:
-          {
-            std::int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            format::Double x;
-            x.dword = (i1 << 32) | (i2 & 0xffffffff);
-            return format_double_to_double(x);
-          }
+            return specialized_op_for_arg_types<OP_FLOAD>(arg_type1, ARG_TYPE_LVAR);
           case OP_FNEG:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(-f);
-          }
+            return specialized_op_for_arg_types<OP_FNEG>(arg_type1, ARG_TYPE_LVAR);
           case OP_FADD:
-          {
-            double f1, f2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_float(context, f1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(f1 + f2);
-          }
+            return specialized_op_for_arg_types<OP_FADD>(arg_type1, arg_type2);
           case OP_FSUB:
-          {
-            double f1, f2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_float(context, f1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(f1 - f2);
-          }
+            return specialized_op_for_arg_types<OP_FSUB>(arg_type1, arg_type2);
           case OP_FMUL:
-          {
-            double f1, f2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_float(context, f1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(f1 * f2);
-          }
+            return specialized_op_for_arg_types<OP_FMUL>(arg_type1, arg_type2);
           case OP_FDIV:
-          {
-            double f1, f2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_float(context, f1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(f1 / f2);
-          }
+            return specialized_op_for_arg_types<OP_FDIV>(arg_type1, arg_type2);
           case OP_FEQ:
-          {
-            double f1, f2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_float(context, f1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(f1 == f2 ? 1 : 0);
-          }
+            return specialized_op_for_arg_types<OP_FEQ>(arg_type1, arg_type2);
           case OP_FNE:
-          {
-            double f1, f2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_float(context, f1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(f1 != f2 ? 1 : 0);
-          }
+            return specialized_op_for_arg_types<OP_FNE>(arg_type1, arg_type2);
           case OP_FLT:
-          {
-            double f1, f2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_float(context, f1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(f1 < f2 ? 1 : 0);
-          }
+            return specialized_op_for_arg_types<OP_FLT>(arg_type1, arg_type2);
           case OP_FGE:
-          {
-            double f1, f2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_float(context, f1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(f1 >= f2 ? 1 : 0);
-          }
+            return specialized_op_for_arg_types<OP_FGE>(arg_type1, arg_type2);
           case OP_FGT:
-          {
-            double f1, f2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_float(context, f1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(f1 > f2 ? 1 : 0);
-          }
+            return specialized_op_for_arg_types<OP_FGT>(arg_type1, arg_type2);
           case OP_FLE:
-          {
-            double f1, f2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_float(context, f1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(f1 <= f2 ? 1 : 0);
-          }
+            return specialized_op_for_arg_types<OP_FLE>(arg_type1, arg_type2);
           case OP_RLOAD:
-          {
-            Value value;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref_value(context, value, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return value;
-          }
-          case OP_REQ:
-          {
-            Reference r1, r2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));            
-            if(opcode_to_arg_type1(instr.opcode) != ARG_TYPE_GVAR && opcode_to_arg_type2(instr.opcode) != ARG_TYPE_GVAR) {
-              context.set_error(ERROR_INCORRECT_INSTR);
-              return Value();
-            }
-            if(!get_ref(context, r1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_ref(context, r2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(r1 == r2 ? 1 : 0);
-          }
-          case OP_RNE:
-          {
-            Reference r1, r2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(opcode_to_arg_type1(instr.opcode) != ARG_TYPE_GVAR && opcode_to_arg_type2(instr.opcode) != ARG_TYPE_GVAR) {
-              context.set_error(ERROR_INCORRECT_INSTR);
-              return Value();
-            }
-            if(!get_ref(context, r1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_ref(context, r2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(r1 != r2 ? 1 : 0);
-          }
-          case OP_RIARRAY8:
-          {
-            if(!(this->*_M_force_pushed_args)(context)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_IARRAY8, context.regs().ac2));
-            if(r.is_null()) return Value();
-            for(size_t i = 0; i < context.regs().ac2; i++) {
-              if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_INT)) return Value();
-              r->raw().is8[i] = context.pushed_arg(i).raw().i;
-            }
-            return Value(r);
-          }
-          case OP_RIARRAY16:
-          {
-            if(!(this->*_M_force_pushed_args)(context)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_IARRAY16, context.regs().ac2));
-            if(r.is_null()) return Value();
-            for(size_t i = 0; i < context.regs().ac2; i++) {
-              if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_INT)) return Value();
-              r->raw().is16[i] = context.pushed_arg(i).raw().i;
-            }
-            return Value(r);
-          }
-          case OP_RIARRAY32:
-          {
-            if(!(this->*_M_force_pushed_args)(context)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_IARRAY32, context.regs().ac2));
-            if(r.is_null()) return Value();
-            for(size_t i = 0; i < context.regs().ac2; i++) {
-              if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_INT)) return Value();
-              r->raw().is32[i] = context.pushed_arg(i).raw().i;
-            }
-            return Value(r);
-          }
-          case OP_RIARRAY64:
-          {
-            if(!(this->*_M_force_pushed_args)(context)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_IARRAY64, context.regs().ac2));
-            if(r.is_null()) return Value();
-            for(size_t i = 0; i < context.regs().ac2; i++) {
-              if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_INT)) return Value();
-              r->raw().is64[i] = context.pushed_arg(i).raw().i;
-            }
-            return Value(r);
-          }
-          case OP_RSFARRAY:
-          {
-            if(!(this->*_M_force_pushed_args)(context)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_SFARRAY, context.regs().ac2));
-            if(r.is_null()) return Value();
-            for(size_t i = 0; i < context.regs().ac2; i++) {
-              if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_FLOAT)) return Value();
-              r->raw().sfs[i] = context.pushed_arg(i).raw().f;
-            }
-            return Value(r);
-          }
-          case OP_RDFARRAY:
-          {
-            if(!(this->*_M_force_pushed_args)(context)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_DFARRAY, context.regs().ac2));
-            if(r.is_null()) return Value();
-            for(size_t i = 0; i < context.regs().ac2; i++) {
-              if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_FLOAT)) return Value();
-              r->raw().dfs[i] = context.pushed_arg(i).raw().f;
-            }
-            return Value(r);
-          }
-          case OP_RRARRAY:
-          {
-            if(!(this->*_M_force_pushed_args)(context)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_RARRAY, context.regs().ac2));
-            if(r.is_null()) return Value();
-            for(size_t i = 0; i < context.regs().ac2; i++) {
-              if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_REF)) return Value();
-              if(!check_shared_for_object(context, *(context.pushed_arg(i).raw().r))) return Value();
-              r->raw().rs[i] = context.pushed_arg(i).raw().r;
-            }
-            atomic_thread_fence(memory_order_release);
-            return Value(r);
-          }
-          case OP_RTUPLE:
-          {
-            Reference r(new_object(context, OBJECT_TYPE_TUPLE, context.regs().ac2));
-            if(r.is_null()) return Value();
-            for(size_t i = 0; i < context.regs().ac2; i++) {
-              if(!check_shared_for_value(context, context.pushed_arg(i))) return Value();
-              if(!set_lazy_values_as_shared(context, context.pushed_arg(i))) return Value();
-              r->raw().tes[i] = context.pushed_arg(i).tuple_elem();
-              r->raw().tuple_elem_types()[i] = context.pushed_arg(i).tuple_elem_type();
-            }
-            atomic_thread_fence(memory_order_release);
-            return Value(r);
-          }
-          case OP_RIANTH8:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY8)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            return Value(r->raw().is8[i]);
-          }
-          case OP_RIANTH16:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY16)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            return Value(r->raw().is16[i]);
-          }
-          case OP_RIANTH32:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY32)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            return Value(r->raw().is32[i]);
-          }
-          case OP_RIANTH64:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY64)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            return Value(r->raw().is64[i]);
-          }
-          case OP_RSFANTH:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_SFARRAY)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            return Value(r->raw().sfs[i]);
-          }
-          case OP_RDFANTH:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_DFARRAY)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            return Value(r->raw().dfs[i]);
-          }
-          case OP_RRANTH:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_RARRAY)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            return Value(r->raw().rs[i]);
-          }
-          case OP_RTNTH:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_TUPLE)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            return Value(r->raw().tuple_elem_types()[i], r->raw().tes[i]);
-          }
-          case OP_RIALEN8:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY8)) return Value();
-            return Value(static_cast<int64_t>(r->length()));
-          }
-          case OP_RIALEN16:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY16)) return Value();
-            return Value(static_cast<int64_t>(r->length()));
-          }
-          case OP_RIALEN32:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY32)) return Value();
-            return Value(static_cast<int64_t>(r->length()));
-          }
-          case OP_RIALEN64:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY64)) return Value();
-            return Value(static_cast<int64_t>(r->length()));
-          }
-          case OP_RSFALEN:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_SFARRAY)) return Value();
-            return Value(static_cast<int64_t>(r->length()));
-          }
-          case OP_RDFALEN:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_DFARRAY)) return Value();
-            return Value(static_cast<int64_t>(r->length()));
-          }
-          case OP_RRALEN:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_RARRAY)) return Value();
-            return Value(static_cast<int64_t>(r->length()));
-          }
-          case OP_RTLEN:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_TUPLE)) return Value();
-            return Value(static_cast<int64_t>(r->length()));
-          }
-          case OP_RIACAT8:
-          {
-            Reference r1, r2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_ref(context, r2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r1, OBJECT_TYPE_IARRAY8)) return Value();            
-            if(!check_object_type(context, *r2, OBJECT_TYPE_IARRAY8)) return Value();
-            size_t object_length;
-            if(!add_object_lengths(context, object_length, r1->length(), r2->length())) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_IARRAY8, object_length));
-            if(r.is_null()) return Value();
-            copy_n(r1->raw().is8, r1->length(), r->raw().is8);
-            copy_n(r2->raw().is8, r2->length(), r->raw().is8 + r1->length());
-            return Value(r);
-          }
-          case OP_RIACAT16:
-          {
-            Reference r1, r2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_ref(context, r2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r1, OBJECT_TYPE_IARRAY16)) return Value();
-            if(!check_object_type(context, *r2, OBJECT_TYPE_IARRAY16)) return Value();
-            size_t object_length;
-            if(!add_object_lengths(context, object_length, r1->length(), r2->length())) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_IARRAY16, object_length));
-            if(r.is_null()) return Value();
-            copy_n(r1->raw().is16, r1->length(), r->raw().is16);
-            copy_n(r2->raw().is16, r2->length(), r->raw().is16 + r1->length());
-            return Value(r);
-          }
-          case OP_RIACAT32:
-          {
-            Reference r1, r2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_ref(context, r2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r1, OBJECT_TYPE_IARRAY32)) return Value();
-            if(!check_object_type(context, *r2, OBJECT_TYPE_IARRAY32)) return Value();
-            size_t object_length;
-            if(!add_object_lengths(context, object_length, r1->length(), r2->length())) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_IARRAY32, object_length));
-            if(r.is_null()) return Value();
-            copy_n(r1->raw().is32, r1->length(), r->raw().is32);
-            copy_n(r2->raw().is32, r2->length(), r->raw().is32 + r1->length());
-            return Value(r);
-          }
-          case OP_RIACAT64:
-          {
-            Reference r1, r2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_ref(context, r2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r1, OBJECT_TYPE_IARRAY64)) return Value();
-            if(!check_object_type(context, *r2, OBJECT_TYPE_IARRAY64)) return Value();
-            size_t object_length;
-            if(!add_object_lengths(context, object_length, r1->length(), r2->length())) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_IARRAY64, object_length));
-            if(r.is_null()) return Value();
-            copy_n(r1->raw().is64, r1->length(), r->raw().is64);
-            copy_n(r2->raw().is64, r2->length(), r->raw().is64 + r1->length());
-            return Value(r);
-          }
-          case OP_RSFACAT:
-          {
-            Reference r1, r2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_ref(context, r2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r1, OBJECT_TYPE_SFARRAY)) return Value();
-            if(!check_object_type(context, *r2, OBJECT_TYPE_SFARRAY)) return Value();
-            size_t object_length;
-            if(!add_object_lengths(context, object_length, r1->length(), r2->length())) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_SFARRAY, object_length));
-            if(r.is_null()) return Value();
-            copy_n(r1->raw().sfs, r1->length(), r->raw().sfs);
-            copy_n(r2->raw().sfs, r2->length(), r->raw().sfs + r1->length());
-            return Value(r);
-          }
-          case OP_RDFACAT:
-          {
-            Reference r1, r2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_ref(context, r2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r1, OBJECT_TYPE_DFARRAY)) return Value();
-            if(!check_object_type(context, *r2, OBJECT_TYPE_DFARRAY)) return Value();
-            size_t object_length;
-            if(!add_object_lengths(context, object_length, r1->length(), r2->length())) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_DFARRAY, object_length));
-            if(r.is_null()) return Value();
-            copy_n(r1->raw().dfs, r1->length(), r->raw().dfs);
-            copy_n(r2->raw().dfs, r2->length(), r->raw().dfs + r1->length());
-            return Value(r);
-          }
-          case OP_RRACAT:
-          {
-            Reference r1, r2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_ref(context, r2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r1, OBJECT_TYPE_RARRAY)) return Value();
-            if(!check_object_type(context, *r2, OBJECT_TYPE_RARRAY)) return Value();
-            size_t object_length;
-            if(!add_object_lengths(context, object_length, r1->length(), r2->length())) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_RARRAY, object_length));
-            if(r.is_null()) return Value();
-            copy_n(r1->raw().rs, r1->length(), r->raw().rs);
-            copy_n(r2->raw().rs, r2->length(), r->raw().rs + r1->length());
-            atomic_thread_fence(memory_order_release);
-            return Value(r);
-          }
-          case OP_RTCAT:
-          {
-            Reference r1, r2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_ref(context, r2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r1, OBJECT_TYPE_TUPLE)) return Value();
-            if(!check_object_type(context, *r2, OBJECT_TYPE_TUPLE)) return Value();
-            size_t object_length;
-            if(!add_object_lengths(context, object_length, r1->length(), r2->length())) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_TUPLE, object_length));
-            if(r.is_null()) return Value();
-            copy_n(r1->raw().tes, r1->length(), r->raw().tes);
-            copy_n(r2->raw().tes, r2->length(), r->raw().tes + r1->length());
-            copy_n(r1->raw().tuple_elem_types(), r1->length(), r->raw().tuple_elem_types());
-            copy_n(r2->raw().tuple_elem_types(), r2->length(), r->raw().tuple_elem_types() + r1->length());
-            atomic_thread_fence(memory_order_release);
-            return Value(r);
-          }
-          case OP_RTYPE:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(r->type());
-          }
-          case OP_ICALL:
-          {
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!context.regs().after_leaving_flags[0]) {
-              if(context.regs().arg_instr_flag) if(!push_tmp_ac2(context)) return Value();
-              if(!call_fun(context, static_cast<uint32_t>(i), VALUE_TYPE_INT)) return Value();
-            }
-            if(!pop_expr_values(context, n)) return Value();
-            context.regs().after_leaving_flags[0] = false;
-            if(context.regs().arg_instr_flag) if(!pop_tmp_ac2(context)) return Value();
-            if(!_M_eval_strategy->post_leave_from_fun(this, &context, static_cast<uint32_t>(i), VALUE_TYPE_INT)) return Value();
-            context.pop_args();
-            return _M_return_value_to_int_value(context.regs().rv);
+            return specialized_op_for_arg_types<OP_RLOAD>(arg_type1, ARG_TYPE_LVAR);
+          default:
+            return nullptr;
+        }
+      }
+
+      void InterpreterVirtualMachine::decode_funs()
+      {
+        size_t fun_count = _M_env.fun_count();
+        _M_decoded_funs = unique_ptr<DecodedFunction []>(new DecodedFunction[fun_count]);
+        for(size_t i = 0; i < fun_count; i++) {
+          Function fun = _M_env.fun(i);
+          DecodedFunction &decoded_fun = _M_decoded_funs[i];
+          decoded_fun.instr_count = fun.raw().instr_count;
+          decoded_fun.instrs = unique_ptr<DecodedInstruction []>(new DecodedInstruction[decoded_fun.instr_count + 1]);
+          // The verified functions are interpreted without checking the arguments and
+          // the jumps.
+          decoded_fun.is_verified = verify_fun(fun, _M_env.var_count());
+          for(size_t ip = 0; ip < decoded_fun.instr_count; ip++)
+            decode_instr(decoded_fun.instrs[ip], fun.raw().instrs[ip], decoded_fun.is_verified);
+          if(decoded_fun.is_verified && !_M_profiling_flag) fuse_instrs(decoded_fun);
+          // The instruction after the last instruction reports a lack of instruction so that
+          // the instruction pointer doesn't have to be checked for each instruction.
+          decoded_fun.instrs[decoded_fun.instr_count] = DecodedInstruction();
+          decoded_fun.instrs[decoded_fun.instr_count].handler = _M_instr_handlers[_M_instr_handler_count + 1];
+        }
+      }
+
+      void InterpreterVirtualMachine::decode_instr(DecodedInstruction &decoded_instr, const Instruction &instr, bool is_verified)
+      {
+        uint32_t arg_type1 = opcode_to_arg_type1(instr.opcode);
+        uint32_t arg_type2 = opcode_to_arg_type2(instr.opcode);
+        // The handlers of an incorrect instruction and an incorrect operation follow the
+        // handlers of the instructions and the operations. The handler of the specialized
+        // operations follows the handler of an incorrect operation.
+        const void *const *instr_handlers = (is_verified ? _M_verified_instr_handlers : _M_instr_handlers);
+        const ArgumentGetters *arg_getters = (is_verified ? _S_verified_arg_getters : _S_arg_getters);
+        decoded_instr.handler = instr_handlers[min<size_t>(opcode_to_instr(instr.opcode), _M_instr_handler_count)];
+        if(is_verified)
+          decoded_instr.specialized_op = find_specialized_op(opcode_to_op(instr.opcode), arg_type1, arg_type2);
+        else
+          decoded_instr.specialized_op = nullptr;
+        if(decoded_instr.specialized_op == nullptr)
+          decoded_instr.op_handler = _M_op_handlers[min<size_t>(opcode_to_op(instr.opcode), _M_op_handler_count)];
+        else
+          decoded_instr.op_handler = _M_op_handlers[_M_op_handler_count + 1];
+        decoded_instr.arg1.getters = &(arg_getters[min<uint32_t>(arg_type1, ARG_TYPE_EVAL + 1)]);
+        decoded_instr.arg1.value = instr.arg1;
+        decoded_instr.arg1.type = arg_type1;
+        decoded_instr.arg2.getters = &(arg_getters[min<uint32_t>(arg_type2, ARG_TYPE_EVAL + 1)]);
+        decoded_instr.arg2.value = instr.arg2;
+        decoded_instr.arg2.type = arg_type2;
+        decoded_instr.instr = opcode_to_instr(instr.opcode);
+        decoded_instr.local_var_count = opcode_to_local_var_count(instr.opcode);
+        decoded_instr.pop_arg_count1 = expr_pop_arg_count(arg_type1);
+        decoded_instr.pop_arg_count2 = expr_pop_arg_count(arg_type1, arg_type2);
+        // Each instruction is counted with the previous instructions in the profiling mode.
+        if(_M_profiling_flag) decoded_instr.handler = _M_superinstr_handlers[SUPERINSTR_ARG_ARG + 1];
+      }
+
+      void InterpreterVirtualMachine::fuse_instrs(DecodedFunction &decoded_fun)
+      {
+        // The handler of the first instruction of a sequence is replaced by the handler of
+        // the superinstruction. The other instructions of the sequence keep their handlers
+        // because they can be targets of the jumps.
+        for(size_t ip = 0; ip + 1 < decoded_fun.instr_count; ip++) {
+          DecodedInstruction *instrs = decoded_fun.instrs.get() + ip;
+          uint32_t next_next_instr = (ip + 2 < decoded_fun.instr_count ? instrs[2].instr : INSTR_IN);
+          if(instrs[0].instr == INSTR_LET && instrs[1].instr == INSTR_IN) {
+            if(next_next_instr == INSTR_JC)
+              instrs[0].handler = _M_superinstr_handlers[SUPERINSTR_LET_IN_JC];
+            else if(next_next_instr == INSTR_RET)
+              instrs[0].handler = _M_superinstr_handlers[SUPERINSTR_LET_IN_RET];
+            else
+              instrs[0].handler = _M_superinstr_handlers[SUPERINSTR_LET_IN];
+          } else if(instrs[0].instr == INSTR_ARG && instrs[1].instr == INSTR_ARG)
+            instrs[0].handler = _M_superinstr_handlers[SUPERINSTR_ARG_ARG];
+        }
+      }
+
+      void InterpreterVirtualMachine::hook_instr(size_t i, size_t ip)
+      {
+        // The handler is replaced after the preparation of the hook because the function
+        // can be interpreted by other threads.
+        atomic_thread_fence(memory_order_release);
+        _M_decoded_funs[i].instrs[ip].handler = _M_instr_handlers[_M_instr_handler_count + 2];
+        atomic_thread_fence(memory_order_release);
+      }
+
+      void InterpreterVirtualMachine::unhook_instr(size_t i, size_t ip)
+      {
+        DecodedFunction &decoded_fun = _M_decoded_funs[i];
+        const void *const *instr_handlers = (decoded_fun.is_verified ? _M_verified_instr_handlers : _M_instr_handlers);
+        atomic_thread_fence(memory_order_release);
+        decoded_fun.instrs[ip].handler = instr_handlers[min<size_t>(decoded_fun.instrs[ip].instr, _M_instr_handler_count)];
+        atomic_thread_fence(memory_order_release);
+      }
+
+      void InterpreterVirtualMachine::interpret_hooked_instr(ThreadContext &context) {}
+
+      void InterpreterVirtualMachine::add_seq_counts_to_instr_profile(const unordered_map<uint64_t, uint64_t> &seq_counts)
+      {
+        lock_guard<mutex> guard(_M_instr_profile_mutex);
+        for(auto &pair : seq_counts) {
+          size_t length = pair.first >> 48;
+          vector<uint32_t> opcodes;
+          for(size_t i = 0; i < length; i++) {
+            uint32_t code = (pair.first >> ((length - i - 1) * 16)) & 0xffff;
+            opcodes.push_back(opcode::opcode(code & 0xff, code >> 8));
+          }
+          _M_instr_profile.seq_counts[opcodes] += pair.second;
+        }
+      }
+
+#define DISPATCH_INSTR()                                                        \
+  do {                                                                          \
+    context.release_fence_for_gc();                                             \
+    if(context.regs().fp != fp || context.regs().after_leaving_flags[1])        \
+      goto fetch_instr;                                                         \
+    instr = fun->instrs.get() + context.regs().ip;                              \
+    context.regs().ip++;                                                        \
+    context.regs().cutc = 0;                                                    \
+    goto *(instr->handler);                                                     \
+  } while(false)
+
+#define DISPATCH_INSTR_AFTER_JUMP()                                             \
+  do {                                                                          \
+    if(context.regs().ip > fun->instr_count) {                                  \
+      context.release_fence_for_gc();                                           \
+      goto fetch_instr;                                                         \
+    }                                                                           \
+    DISPATCH_INSTR();                                                           \
+  } while(false)
+
+#define CALL_OP(return_label)                                                   \
+  do {                                                                          \
+    op_return = &&return_label;                                                 \
+    goto *(instr->op_handler);                                                  \
+  } while(false)
+
+#define OP_RETURN(value)                                                        \
+  do {                                                                          \
+    op_value = (value);                                                         \
+    goto op_returned;                                                           \
+  } while(false)
+
+#define FUSE_INSTR()                                                            \
+  do {                                                                          \
+    context.release_fence_for_gc();                                             \
+    if(context.regs().fp != fp || context.regs().after_leaving_flags[1] ||      \
+      context.regs().ip != static_cast<size_t>(instr - fun->instrs.get()) + 1)  \
+      goto fetch_instr;                                                         \
+    instr++;                                                                    \
+    context.regs().ip++;                                                        \
+    context.regs().cutc = 0;                                                    \
+  } while(false)
+
+#define LET_INSTR(op_returned_label)                                            \
+  CALL_OP(op_returned_label);                                                   \
+  op_returned_label:                                                            \
+  context.pop_args();                                                           \
+  if(!op_value.is_error())                                                      \
+    if(!context.push_local_var(op_value)) context.set_error(ERROR_STACK_OVERFLOW); \
+  context.regs().rv.raw().r = Reference();                                      \
+  context.regs().gc_tmp_ptr = nullptr;                                          \
+  context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());              \
+  context.regs().tmp_expr_values[1].safely_assign_for_gc(Value())
+
+#define ARG_INSTR(op_returned_label)                                            \
+  context.hide_args();                                                          \
+  context.regs().arg_instr_flag = true;                                         \
+  CALL_OP(op_returned_label);                                                   \
+  op_returned_label:                                                            \
+  context.regs().arg_instr_flag = false;                                        \
+  if(!op_value.is_error()) {                                                    \
+    context.restore_abp2_and_ac2();                                             \
+    if(!context.push_arg(op_value)) context.set_error(ERROR_STACK_OVERFLOW);    \
+  }                                                                             \
+  context.regs().rv.raw().r = Reference();                                      \
+  context.regs().gc_tmp_ptr = nullptr;                                          \
+  context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());              \
+  context.regs().tmp_expr_values[1].safely_assign_for_gc(Value())
+
+      void InterpreterVirtualMachine::interpret_decoded_instrs(ThreadContext *context_ptr, unordered_map<uint64_t, uint64_t> *seq_counts)
+      {
+        static const void *const instr_handlers[] = {
+          &&instr_let, &&instr_in, &&instr_ret, &&instr_jc, &&instr_jump, &&instr_arg,
+          &&instr_retry, &&instr_lettuple, &&instr_throw, &&instr_push, &&instr_pop, &&instr_rethrow,
+          &&instr_incorrect, &&no_instr, &&instr_hooked
+        };
+        // The jump instructions of the verified functions don't check the instruction pointer.
+        static const void *const verified_instr_handlers[] = {
+          &&instr_let, &&instr_in, &&instr_ret, &&instr_verified_jc, &&instr_verified_jump, &&instr_arg,
+          &&instr_retry, &&instr_lettuple, &&instr_throw, &&instr_push, &&instr_pop, &&instr_rethrow,
+          &&instr_incorrect, &&no_instr, &&instr_hooked
+        };
+        static const void *const op_handlers[] = {
+          &&op_iload, &&op_iload2, &&op_ineg, &&op_iadd, &&op_isub, &&op_imul,
+          &&op_idiv, &&op_imod, &&op_inot, &&op_iand, &&op_ior, &&op_ixor,
+          &&op_ishl, &&op_ishr, &&op_ishru, &&op_ieq, &&op_ine, &&op_ilt,
+          &&op_ige, &&op_igt, &&op_ile, &&op_fload, &&op_fload2, &&op_fneg,
+          &&op_fadd, &&op_fsub, &&op_fmul, &&op_fdiv, &&op_feq, &&op_fne,
+          &&op_flt, &&op_fge, &&op_fgt, &&op_fle, &&op_rload, &&op_req,
+          &&op_rne, &&op_riarray8, &&op_riarray16, &&op_riarray32, &&op_riarray64, &&op_rsfarray,
+          &&op_rdfarray, &&op_rrarray, &&op_rtuple, &&op_rianth8, &&op_rianth16, &&op_rianth32,
+          &&op_rianth64, &&op_rsfanth, &&op_rdfanth, &&op_rranth, &&op_rtnth, &&op_rialen8,
+          &&op_rialen16, &&op_rialen32, &&op_rialen64, &&op_rsfalen, &&op_rdfalen, &&op_rralen,
+          &&op_rtlen, &&op_riacat8, &&op_riacat16, &&op_riacat32, &&op_riacat64, &&op_rsfacat,
+          &&op_rdfacat, &&op_rracat, &&op_rtcat, &&op_rtype, &&op_icall, &&op_fcall,
+          &&op_rcall, &&op_itof, &&op_ftoi, &&op_incall, &&op_fncall, &&op_rncall,
+          &&op_ruiafill8, &&op_ruiafill16, &&op_ruiafill32, &&op_ruiafill64, &&op_rusfafill, &&op_rudfafill,
+          &&op_rurafill, &&op_rutfilli, &&op_rutfillf, &&op_rutfillr, &&op_ruianth8, &&op_ruianth16,
+          &&op_ruianth32, &&op_ruianth64, &&op_rusfanth, &&op_rudfanth, &&op_ruranth, &&op_rutnth,
+          &&op_ruiasnth8, &&op_ruiasnth16, &&op_ruiasnth32, &&op_ruiasnth64, &&op_rusfasnth, &&op_rudfasnth,
+          &&op_rurasnth, &&op_rutsnth, &&op_ruialen8, &&op_ruialen16, &&op_ruialen32, &&op_ruialen64,
+          &&op_rusfalen, &&op_rudfalen, &&op_ruralen, &&op_rutlen, &&op_rutype, &&op_ruiatoia8,
+          &&op_ruiatoia16, &&op_ruiatoia32, &&op_ruiatoia64, &&op_rusfatosfa, &&op_rudfatodfa, &&op_ruratora,
+          &&op_ruttot, &&op_fpow, &&op_fsqrt, &&op_fexp, &&op_flog, &&op_fcos,
+          &&op_fsin, &&op_ftan, &&op_facos, &&op_fasin, &&op_fatan, &&op_fceil,
+          &&op_ffloor, &&op_fround, &&op_ftrunc, &&op_try, &&op_iforce, &&op_fforce,
+          &&op_rforce, &&op_stacktrace, &&op_incorrect, &&op_specialized
+        };
+        static const void *const superinstr_handlers[] = {
+          &&instr_let_in, &&instr_let_in_jc, &&instr_let_in_ret, &&instr_arg_arg,
+          &&instr_profiled
+        };
+        if(context_ptr == nullptr) {
+          // The handler addresses are only exported for the decoding of the functions.
+          _M_instr_handlers = instr_handlers;
+          _M_verified_instr_handlers = verified_instr_handlers;
+          // The handler of the hooked instructions follows the handler of a lack of
+          // instruction.
+          _M_instr_handler_count = sizeof(instr_handlers) / sizeof(instr_handlers[0]) - 3;
+          _M_op_handlers = op_handlers;
+          _M_op_handler_count = sizeof(op_handlers) / sizeof(op_handlers[0]) - 2;
+          // The handler for the profiling mode follows the handlers of the superinstructions.
+          _M_superinstr_handlers = superinstr_handlers;
+          return;
+        }
+        ThreadContext &context = *context_ptr;
+        size_t fp = static_cast<size_t>(-1);
+        const DecodedFunction *fun = nullptr;
+        const DecodedInstruction *instr = nullptr;
+        const void *op_return = nullptr;
+        Value op_value;
+        size_t profiled_fp = static_cast<size_t>(-1);
+        size_t profiled_abp = 0;
+        size_t profiled_ip = 0;
+        uint64_t profiled_seq = 0;
+        size_t profiled_seq_length = 0;
+        // The instructions are fetched by the slow path when the function is changed or
+        // after leaving from the function for forcing.
+        fetch_instr:
+        if(context.regs().fp == static_cast<size_t>(-1)) return;
+        if(context.regs().fp != fp) {
+          fp = context.regs().fp;
+          fun = &(_M_decoded_funs[fp]);
+        }
+        if(context.regs().ip >= fun->instr_count) {
+          context.set_error(ERROR_NO_INSTR);
+          DISPATCH_INSTR();
+        }
+        instr = fun->instrs.get() + context.regs().ip;
+        context.regs().ip++;
+        if(context.regs().after_leaving_flags[1]) {
+          if(context.regs().rv.raw().error == ERROR_SUCCESS) {
+            Reference locked_lazy_value_r;
+            if(!get_locked_lazy_value_ref(context, locked_lazy_value_r)) return;
+            if(!_M_eval_strategy->post_leave_from_fun_for_force(this, &context, locked_lazy_value_r->raw().lzv.fun, locked_lazy_value_r->raw().lzv.value_type))
+              return;
           }
-          case OP_FCALL:
-          {
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!context.regs().after_leaving_flags[0]) {
-              if(context.regs().arg_instr_flag) if(!push_tmp_ac2(context)) return Value();
-              if(!call_fun(context, static_cast<uint32_t>(i), VALUE_TYPE_FLOAT)) return Value();
-            }
-            if(!pop_expr_values(context, n)) return Value();
-            context.regs().after_leaving_flags[0] = false;
-            if(context.regs().arg_instr_flag) if(!pop_tmp_ac2(context)) return Value();
-            if(!_M_eval_strategy->post_leave_from_fun(this, &context, static_cast<uint32_t>(i), VALUE_TYPE_FLOAT)) return Value();
-            context.pop_args();
-            return _M_return_value_to_float_value(context.regs().rv);
+          if(instr->instr == INSTR_ARG) context.regs().arg_instr_flag = true;
+          if(!restore_and_pop_regs_for_force(context)) return;
+          if(instr->instr == INSTR_ARG) {
+            context.regs().arg_instr_flag = false;
+            context.restore_abp2_and_ac2();
           }
-          case OP_RCALL:
-          {
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!context.regs().after_leaving_flags[0]) {
-              if(context.regs().arg_instr_flag) if(!push_tmp_ac2(context)) return Value();
-              if(!call_fun(context, static_cast<uint32_t>(i), VALUE_TYPE_REF)) return Value();
+        }
+        context.regs().cutc = 0;
+        goto *(instr->handler);
+
+        instr_let:
+        LET_INSTR(instr_let_op_returned);
+        DISPATCH_INSTR();
+
+        instr_in:
+        context.in();
+        DISPATCH_INSTR();
+
+        instr_ret:
+        CALL_OP(instr_ret_op_returned);
+        instr_ret_op_returned:
+        if(!op_value.is_error()) {
+          if(!leave_from_fun(context)) context.set_error(ERROR_EMPTY_STACK);
+          context.regs().rv = op_value;
+        }
+        context.regs().gc_tmp_ptr = nullptr;
+        context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
+        context.regs().tmp_expr_values[1].safely_assign_for_gc(Value());
+        DISPATCH_INSTR();
+
+        instr_jc:
+        {
+          int64_t i;
+          size_t j = 0;
+          if(get_int(context, i, instr->arg1, j, instr->pop_arg_count1)) {
+            if(pop_expr_values(context, instr->pop_arg_count1)) {
+              if(i != 0) {
+                context.regs().ip += instr->arg2.value.i;
+                if(instr->arg2.value.i < 0) context.check_safepoint();
+              }
             }
-            if(!pop_expr_values(context, n)) return Value();
-            context.regs().after_leaving_flags[0] = false;
-            if(context.regs().arg_instr_flag) if(!pop_tmp_ac2(context)) return Value();
-            if(!_M_eval_strategy->post_leave_from_fun(this, &context, static_cast<uint32_t>(i), VALUE_TYPE_REF)) return Value();
-            context.pop_args();
-            return _M_return_value_to_ref_value(context.regs().rv);
           }
-          case OP_ITOF:
-          {
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(static_cast<double>(i));
-          }
-          case OP_FTOI:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(static_cast<int64_t>(f));
-          }
-          case OP_INCALL:
-          {
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(context.regs().arg_instr_flag) if(!push_tmp_ac2(context)) return Value();
-            ArgumentList args = context.pushed_args();
-            ReturnValue rv = context.invoke_native_fun(this, i, args);
-            if(rv.raw().error != ERROR_SUCCESS) {
-              context.add_stack_trace_elem_for_native_fun(i);
-              context.set_error(rv.raw().error, rv.raw().r, false);
-              return Value();
+          context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
+        }
+        DISPATCH_INSTR_AFTER_JUMP();
+
+        instr_jump:
+        context.regs().ip += instr->arg1.value.i;
+        if(instr->arg1.value.i < 0) context.check_safepoint();
+        DISPATCH_INSTR_AFTER_JUMP();
+
+        instr_verified_jc:
+        {
+          int64_t i;
+          size_t j = 0;
+          if(get_int(context, i, instr->arg1, j, instr->pop_arg_count1)) {
+            if(pop_expr_values(context, instr->pop_arg_count1)) {
+              if(i != 0) {
+                context.regs().ip += instr->arg2.value.i;
+                if(instr->arg2.value.i < 0) context.check_safepoint();
+              }
             }
-            context.regs().tmp_r.safely_assign_for_gc(Reference());
-            if(context.regs().arg_instr_flag) if(!pop_tmp_ac2(context)) return Value();
-            return Value(rv.raw().i);
           }
-          case OP_FNCALL:
-          {
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(context.regs().arg_instr_flag) if(!push_tmp_ac2(context)) return Value();
-            ArgumentList args = context.pushed_args();
-            ReturnValue rv = context.invoke_native_fun(this, i, args);
-            if(rv.raw().error != ERROR_SUCCESS) {
-              context.add_stack_trace_elem_for_native_fun(i);
-              context.set_error(rv.raw().error, rv.raw().r, false);
-              return Value();
-            }
-            context.regs().tmp_r.safely_assign_for_gc(Reference());
-            if(context.regs().arg_instr_flag) if(!pop_tmp_ac2(context)) return Value();
-            return Value(rv.raw().f);
+          context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
+        }
+        DISPATCH_INSTR();
+
+        instr_verified_jump:
+        context.regs().ip += instr->arg1.value.i;
+        if(instr->arg1.value.i < 0) context.check_safepoint();
+        DISPATCH_INSTR();
+
+        // The superinstructions go to the next instruction of the sequence only if the
+        // previous instruction didn't enter to or leave from a function. The instruction
+        // pointer is also checked because a recursive call doesn't change the function.
+        // The superinstructions are only used for the verified functions.
+        instr_let_in:
+        LET_INSTR(instr_let_in_op_returned);
+        FUSE_INSTR();
+        context.in();
+        DISPATCH_INSTR();
+
+        instr_let_in_jc:
+        LET_INSTR(instr_let_in_jc_op_returned);
+        FUSE_INSTR();
+        context.in();
+        FUSE_INSTR();
+        goto instr_verified_jc;
+
+        instr_let_in_ret:
+        LET_INSTR(instr_let_in_ret_op_returned);
+        FUSE_INSTR();
+        context.in();
+        FUSE_INSTR();
+        goto instr_ret;
+
+        instr_arg_arg:
+        ARG_INSTR(instr_arg_arg_op_returned);
+        FUSE_INSTR();
+        goto instr_arg;
+
+        // The instructions are executed by their handlers after the counting in the
+        // profiling mode.
+        instr_profiled:
+        if(seq_counts != nullptr) {
+          size_t ip = context.regs().ip - 1;
+          const Instruction &raw_instr = context.fun(fp).instr(ip);
+          uint32_t code = opcode_to_instr(raw_instr.opcode);
+          if(code == INSTR_LET || code == INSTR_RET || code == INSTR_ARG || code == INSTR_LETTUPLE || code == INSTR_PUSH)
+            code |= opcode_to_op(raw_instr.opcode) << 8;
+          if(fp == profiled_fp && context.regs().abp == profiled_abp && ip == profiled_ip + 1) {
+            profiled_seq = ((profiled_seq << 16) | code) & ((UINT64_C(1) << 48) - 1);
+            if(profiled_seq_length < 3) profiled_seq_length++;
+          } else {
+            profiled_seq = code;
+            profiled_seq_length = 1;
           }
-          case OP_RNCALL:
-          {
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(context.regs().arg_instr_flag) if(!push_tmp_ac2(context)) return Value();
-            ArgumentList args = context.pushed_args();
-            ReturnValue rv = context.invoke_native_fun(this, i, args);
-            if(rv.raw().error != ERROR_SUCCESS) {
-              context.add_stack_trace_elem_for_native_fun(i);
-              context.set_error(rv.raw().error, rv.raw().r, false);
-              return Value();
+          if(profiled_seq_length >= 2) (*seq_counts)[(UINT64_C(2) << 48) | (profiled_seq & 0xffffffff)]++;
+          if(profiled_seq_length >= 3) (*seq_counts)[(UINT64_C(3) << 48) | profiled_seq]++;
+          profiled_fp = fp;
+          profiled_abp = context.regs().abp;
+          profiled_ip = ip;
+        }
+        if(fun->is_verified)
+          goto *(verified_instr_handlers[min<size_t>(instr->instr, _M_instr_handler_count)]);
+        else
+          goto *(instr_handlers[min<size_t>(instr->instr, _M_instr_handler_count)]);
+
+        // The hook of the hooked instruction can execute any number of instructions of the
+        // function. The instruction that is pointed by the instruction pointer after the
+        // hook is executed by its handler without the hook.
+        instr_hooked:
+        context.regs().ip--;
+        interpret_hooked_instr(context);
+        context.release_fence_for_gc();
+        if(context.regs().fp != fp || context.regs().ip >= fun->instr_count) goto fetch_instr;
+        instr = fun->instrs.get() + context.regs().ip;
+        context.regs().ip++;
+        context.regs().cutc = 0;
+        if(fun->is_verified)
+          goto *(verified_instr_handlers[min<size_t>(instr->instr, _M_instr_handler_count)]);
+        else
+          goto *(instr_handlers[min<size_t>(instr->instr, _M_instr_handler_count)]);
+
+        instr_arg:
+        ARG_INSTR(instr_arg_op_returned);
+        DISPATCH_INSTR();
+
+        instr_retry:
+        if(context.regs().ac == context.regs().ac2) {
+          for(size_t i = 0; i < context.regs().ac; i++)
+            context.arg(i).safely_assign_for_gc(context.pushed_arg(i));
+          context.pop_args_and_local_vars();
+          context.pop_expr_values();
+        } else
+          context.set_error(ERROR_INCORRECT_ARG_COUNT);
+        context.regs().ip = 0;
+        context.check_safepoint();
+        DISPATCH_INSTR();
+
+        instr_lettuple:
+        if(!context.regs().after_leaving_flags[1]) context.regs().ai = 0;
+        if(!context.regs().after_leaving_flags[1] || context.regs().ai != static_cast<uint64_t>(-1))
+          CALL_OP(instr_lettuple_op_returned);
+        if(!get_tmp_value(context, op_value)) op_value = Value();
+        goto instr_lettuple_value;
+        instr_lettuple_op_returned:
+        context.pop_args();
+        context.regs().ai = static_cast<uint64_t>(-1);
+        if(!op_value.is_error()) {
+          if(!push_tmp_value(context, op_value)) op_value = Value();
+        }
+        instr_lettuple_value:
+        if(!op_value.is_error()) {
+          Reference r;
+          // Only the directly referred unique tuple has no other referent after the
+          // destructuring because a forced lazy value still refers to its tuple.
+          bool is_ref = (op_value.type() == VALUE_TYPE_REF);
+          if(get_ref(context, r, op_value)) {
+            if(pop_tmp_value(context)) { 
+              if((r->type() & ~OBJECT_TYPE_UNIQUE) == OBJECT_TYPE_TUPLE) {
+                uint32_t local_var_count = instr->local_var_count;
+                if(r->length() == local_var_count) {
+                  bool are_pushed = true;
+                  for(size_t i = 0; i < local_var_count; i++) {
+                    Value elem_value(r->raw().tuple_elem_types()[i], r->raw().tes[i]);
+                    if(!context.push_local_var(elem_value)) {
+                      context.set_error(ERROR_STACK_OVERFLOW);
+                      are_pushed = false;
+                    }
+                  }
+                  if(is_ref && are_pushed && r->type() == (OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE))
+                    context.add_reusable_unique_tuple(r.ptr());
+                } else
+                  context.set_error(ERROR_INCORRECT_OBJECT);
+              } else
+                context.set_error(ERROR_INCORRECT_OBJECT);
             }
-            context.regs().rv.safely_assign_for_gc(Value(rv.raw().r));
-            context.regs().tmp_r.safely_assign_for_gc(Reference());
-            if(context.regs().arg_instr_flag) if(!pop_tmp_ac2(context)) return Value();
-            return Value(rv.raw().r);
-          }
-          case OP_RUIAFILL8:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_IARRAY8 | OBJECT_TYPE_UNIQUE, i1));
-            if(r.is_null()) return Value();
-            fill_n(r->raw().is8, i1, i2);
-            return Value(r);
-          }
-          case OP_RUIAFILL16:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_IARRAY16 | OBJECT_TYPE_UNIQUE, i1));
-            if(r.is_null()) return Value();
-            fill_n(r->raw().is16, i1, i2);
-            return Value(r);
           }
-          case OP_RUIAFILL32:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_IARRAY32 | OBJECT_TYPE_UNIQUE, i1));
-            if(r.is_null()) return Value();
-            fill_n(r->raw().is32, i1, i2);
-            return Value(r);
-          }
-          case OP_RUIAFILL64:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_IARRAY64 | OBJECT_TYPE_UNIQUE, i1));
-            if(r.is_null()) return Value();
-            fill_n(r->raw().is64, i1, i2);
-            return Value(r);
-          }
-          case OP_RUSFAFILL:
-          {
-            int64_t i;
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_SFARRAY | OBJECT_TYPE_UNIQUE, i));
-            if(r.is_null()) return Value();
-            fill_n(r->raw().sfs, i, f);
-            return Value(r);
-          }
-          case OP_RUDFAFILL:
-          {
-            int64_t i;
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_DFARRAY | OBJECT_TYPE_UNIQUE, i));
-            if(r.is_null()) return Value();
-            fill_n(r->raw().dfs, i, f);
-            return Value(r);
-          }
-          case OP_RURAFILL:
-          {
-            int64_t i;
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_ref(context, r, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_shared_for_object(context, *r)) return Value(); 
-            Reference r2(new_object(context, OBJECT_TYPE_RARRAY | OBJECT_TYPE_UNIQUE, i));
-            if(r2.is_null()) return Value();
-            fill_n(r->raw().rs, i, r);
-            return Value(r2);
-          }
-          case OP_RUTFILLI:
-          {
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE, i1));
-            if(r.is_null()) return Value();
-            fill_n(r->raw().tes, i1, TupleElement(i2));
-            fill_n(r->raw().tuple_elem_types(), i1, VALUE_TYPE_INT);
-            return Value(r);
-          }
-          case OP_RUTFILLF:
-          {
-            int64_t i;
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            Reference r(new_object(context, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE, i));
-            if(r.is_null()) return Value();
-            fill_n(r->raw().tes, i, TupleElement(f));
-            fill_n(r->raw().tuple_elem_types(), i, VALUE_TYPE_FLOAT);
-            return Value(r);
+        }
+        context.regs().rv.raw().r = Reference();
+        context.regs().gc_tmp_ptr = nullptr;
+        context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
+        context.regs().tmp_expr_values[1].safely_assign_for_gc(Value());
+        DISPATCH_INSTR();
+
+        instr_throw:
+        {
+          Reference r;
+          size_t j = 0;
+          if(get_ref(context, r, instr->arg1, j, instr->pop_arg_count1)) {
+            if(pop_expr_values(context, instr->pop_arg_count1))
+              context.set_error(ERROR_USER_EXCEPTION, r);
           }
-          case OP_RUTFILLR:
-          {
-            int64_t i;
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_ref(context, r, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            Reference r2(new_object(context, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE, i));
-            if(r2.is_null()) return Value();
-            if(static_cast<size_t>(i) > 1U && !check_shared_for_object(context, *r)) {
-              context.set_error(ERROR_AGAIN_USED_UNIQUE);
-              return Value();
+          context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
+        }
+        DISPATCH_INSTR();
+
+        instr_push:
+        CALL_OP(instr_push_op_returned);
+        instr_push_op_returned:
+        context.pop_args();
+        if(!op_value.is_error())
+          if(!context.push_expr_value(op_value)) context.set_error(ERROR_STACK_OVERFLOW);
+        context.regs().rv.raw().r = Reference();
+        context.regs().gc_tmp_ptr = nullptr;
+        context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
+        context.regs().tmp_expr_values[1].safely_assign_for_gc(Value());
+        DISPATCH_INSTR();
+
+        instr_pop:
+        if(!context.pop_expr_values(instr->arg1.value.eval)) context.set_error(ERROR_EMPTY_STACK);
+        DISPATCH_INSTR();
+
+        instr_rethrow:
+        {
+          Reference r;
+          size_t j = 0;
+          if(get_ref(context, r, instr->arg1, j, instr->pop_arg_count1)) {
+            if(pop_expr_values(context, instr->pop_arg_count1)) {
+              if(check_object_type(context, *r, OBJECT_TYPE_IO | OBJECT_TYPE_UNIQUE)) {
+                if(context.regs().try_catch_flag) {
+                  context.move_try_catch_stack_trace_to_stack_trace();
+                  context.set_error(context.regs().try_catch_error, context.regs().try_catch_r, false);
+                } else {
+                  context.set_error(ERROR_NO_ERROR, r);
+                }
+              } else {
+                context.set_error(ERROR_INCORRECT_OBJECT, r);
+              }
             }
-            fill_n(r2->raw().tes, i, TupleElement(r));
-            fill_n(r2->raw().tuple_elem_types(), i, VALUE_TYPE_REF);
-            return Value(r2);
-          }
-          case OP_RUIANTH8:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY8 | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            Reference r2(new_unique_pair(context, Value(r->raw().is8[i]), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
-          }
-          case OP_RUIANTH16:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY16 | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            Reference r2(new_unique_pair(context, Value(r->raw().is16[i]), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
-          }
-          case OP_RUIANTH32:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY32 | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            Reference r2(new_unique_pair(context, Value(r->raw().is32[i]), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
-          }
-          case OP_RUIANTH64:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY64 | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            Reference r2(new_unique_pair(context, Value(r->raw().is64[i]), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
           }
-          case OP_RUSFANTH:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_SFARRAY | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            Reference r2(new_unique_pair(context, Value(r->raw().sfs[i]), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
-          }
-          case OP_RUDFANTH:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_DFARRAY | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            Reference r2(new_unique_pair(context, Value(r->raw().dfs[i]), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
+          context.regs().tmp_expr_values[0].safely_assign_for_gc(Value());
+        }
+        DISPATCH_INSTR();
+
+        instr_incorrect:
+        context.set_error(ERROR_INCORRECT_INSTR);
+        DISPATCH_INSTR();
+
+        no_instr:
+        context.regs().ip--;
+        context.set_error(ERROR_NO_INSTR);
+        DISPATCH_INSTR();
+
+        // The operation handlers return to the instruction handlers by the computed goto.
+        op_iload:
+        {
+          Value value;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_int_value(context, value, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(value);
+        }
+        op_iload2:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value((i1 << 32) | (i2 & 0xffffffff)));
+        }
+        op_ineg:
+        {
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(-i));
+        }
+        op_iadd:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 + i2));
+        }
+        op_isub:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 - i2));
+        }
+        op_imul:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 * i2));
+        }
+        op_idiv:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(i2 == 0) {
+            context.set_error(ERROR_DIV_BY_ZERO);
+            OP_RETURN(Value());
+          }
+          OP_RETURN(Value(i1 / i2));
+        }
+        op_imod:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(i2 == 0) {
+            context.set_error(ERROR_DIV_BY_ZERO);
+            OP_RETURN(Value());
+          }
+          OP_RETURN(Value(i1 % i2));
+        }
+        op_inot:
+        {
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(~i));
+        }
+        op_iand:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 & i2));
+        }
+        op_ior:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 | i2));
+        }
+        op_ixor:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 ^ i2));
+        }
+        op_ishl:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 << i2));
+        }
+        op_ishr:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 >> i2));
+        }
+        op_ishru:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(static_cast<std::int64_t>(static_cast<std::uint64_t>(i1) >> i2)));
+        }
+        op_ieq:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 == i2 ? 1 : 0));
+        }
+        op_ine:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 != i2 ? 1 : 0));
+        }
+        op_ilt:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 < i2 ? 1 : 0));
+        }
+        op_ige:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 >= i2 ? 1 : 0));
+        }
+        op_igt:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 > i2 ? 1 : 0));
+        }
+        op_ile:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i1 <= i2 ? 1 : 0));
+        }
+        op_fload:
+        {
+          Value value;
+          size_t j = 0;
+          size_t n =  instr->pop_arg_count1;
+          if(!get_float_value(context, value, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(value);
+        }
+        op_fload2:
+        {
+          std::int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          format::Double x;
+          x.dword = (i1 << 32) | (i2 & 0xffffffff);
+          OP_RETURN(format_double_to_double(x));
+        }
+        op_fneg:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(-f));
+        }
+        op_fadd:
+        {
+          double f1, f2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_float(context, f1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(f1 + f2));
+        }
+        op_fsub:
+        {
+          double f1, f2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_float(context, f1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(f1 - f2));
+        }
+        op_fmul:
+        {
+          double f1, f2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_float(context, f1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(f1 * f2));
+        }
+        op_fdiv:
+        {
+          double f1, f2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_float(context, f1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(f1 / f2));
+        }
+        op_feq:
+        {
+          double f1, f2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_float(context, f1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(f1 == f2 ? 1 : 0));
+        }
+        op_fne:
+        {
+          double f1, f2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_float(context, f1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(f1 != f2 ? 1 : 0));
+        }
+        op_flt:
+        {
+          double f1, f2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_float(context, f1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(f1 < f2 ? 1 : 0));
+        }
+        op_fge:
+        {
+          double f1, f2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_float(context, f1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(f1 >= f2 ? 1 : 0));
+        }
+        op_fgt:
+        {
+          double f1, f2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_float(context, f1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(f1 > f2 ? 1 : 0));
+        }
+        op_fle:
+        {
+          double f1, f2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_float(context, f1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(f1 <= f2 ? 1 : 0));
+        }
+        op_rload:
+        {
+          Value value;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref_value(context, value, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(value);
+        }
+        op_req:
+        {
+          Reference r1, r2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;            
+          if(instr->arg1.type != ARG_TYPE_GVAR && instr->arg2.type != ARG_TYPE_GVAR) {
+            context.set_error(ERROR_INCORRECT_INSTR);
+            OP_RETURN(Value());
+          }
+          if(!get_ref(context, r1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_ref(context, r2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(r1 == r2 ? 1 : 0));
+        }
+        op_rne:
+        {
+          Reference r1, r2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(instr->arg1.type != ARG_TYPE_GVAR && instr->arg2.type != ARG_TYPE_GVAR) {
+            context.set_error(ERROR_INCORRECT_INSTR);
+            OP_RETURN(Value());
+          }
+          if(!get_ref(context, r1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_ref(context, r2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(r1 != r2 ? 1 : 0));
+        }
+        op_riarray8:
+        {
+          if(!(this->*_M_force_pushed_args)(context)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_IARRAY8, context.regs().ac2));
+          if(r.is_null()) OP_RETURN(Value());
+          for(size_t i = 0; i < context.regs().ac2; i++) {
+            if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_INT)) OP_RETURN(Value());
+            r->raw().is8[i] = context.pushed_arg(i).raw().i;
+          }
+          OP_RETURN(Value(r));
+        }
+        op_riarray16:
+        {
+          if(!(this->*_M_force_pushed_args)(context)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_IARRAY16, context.regs().ac2));
+          if(r.is_null()) OP_RETURN(Value());
+          for(size_t i = 0; i < context.regs().ac2; i++) {
+            if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_INT)) OP_RETURN(Value());
+            r->raw().is16[i] = context.pushed_arg(i).raw().i;
+          }
+          OP_RETURN(Value(r));
+        }
+        op_riarray32:
+        {
+          if(!(this->*_M_force_pushed_args)(context)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_IARRAY32, context.regs().ac2));
+          if(r.is_null()) OP_RETURN(Value());
+          for(size_t i = 0; i < context.regs().ac2; i++) {
+            if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_INT)) OP_RETURN(Value());
+            r->raw().is32[i] = context.pushed_arg(i).raw().i;
+          }
+          OP_RETURN(Value(r));
+        }
+        op_riarray64:
+        {
+          if(!(this->*_M_force_pushed_args)(context)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_IARRAY64, context.regs().ac2));
+          if(r.is_null()) OP_RETURN(Value());
+          for(size_t i = 0; i < context.regs().ac2; i++) {
+            if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_INT)) OP_RETURN(Value());
+            r->raw().is64[i] = context.pushed_arg(i).raw().i;
+          }
+          OP_RETURN(Value(r));
+        }
+        op_rsfarray:
+        {
+          if(!(this->*_M_force_pushed_args)(context)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_SFARRAY, context.regs().ac2));
+          if(r.is_null()) OP_RETURN(Value());
+          for(size_t i = 0; i < context.regs().ac2; i++) {
+            if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_FLOAT)) OP_RETURN(Value());
+            r->raw().sfs[i] = context.pushed_arg(i).raw().f;
+          }
+          OP_RETURN(Value(r));
+        }
+        op_rdfarray:
+        {
+          if(!(this->*_M_force_pushed_args)(context)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_DFARRAY, context.regs().ac2));
+          if(r.is_null()) OP_RETURN(Value());
+          for(size_t i = 0; i < context.regs().ac2; i++) {
+            if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_FLOAT)) OP_RETURN(Value());
+            r->raw().dfs[i] = context.pushed_arg(i).raw().f;
+          }
+          OP_RETURN(Value(r));
+        }
+        op_rrarray:
+        {
+          if(!(this->*_M_force_pushed_args)(context)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_RARRAY, context.regs().ac2));
+          if(r.is_null()) OP_RETURN(Value());
+          for(size_t i = 0; i < context.regs().ac2; i++) {
+            if(!check_value_type(context, context.pushed_arg(i), VALUE_TYPE_REF)) OP_RETURN(Value());
+            if(!check_shared_for_object(context, *(context.pushed_arg(i).raw().r))) OP_RETURN(Value());
+            r->raw().rs[i] = context.pushed_arg(i).raw().r;
+          }
+          context.release_fence_for_gc();
+          OP_RETURN(Value(r));
+        }
+        op_rtuple:
+        {
+          Reference r(new_object(context, OBJECT_TYPE_TUPLE, context.regs().ac2));
+          if(r.is_null()) OP_RETURN(Value());
+          for(size_t i = 0; i < context.regs().ac2; i++) {
+            if(!check_shared_for_value(context, context.pushed_arg(i))) OP_RETURN(Value());
+            if(!set_lazy_values_as_shared(context, context.pushed_arg(i))) OP_RETURN(Value());
+            r->raw().tes[i] = context.pushed_arg(i).tuple_elem();
+            r->raw().tuple_elem_types()[i] = context.pushed_arg(i).tuple_elem_type();
+          }
+          context.release_fence_for_gc();
+          OP_RETURN(Value(r));
+        }
+        op_rianth8:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY8)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          OP_RETURN(Value(r->raw().is8[i]));
+        }
+        op_rianth16:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY16)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          OP_RETURN(Value(r->raw().is16[i]));
+        }
+        op_rianth32:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY32)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          OP_RETURN(Value(r->raw().is32[i]));
+        }
+        op_rianth64:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY64)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          OP_RETURN(Value(r->raw().is64[i]));
+        }
+        op_rsfanth:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_SFARRAY)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          OP_RETURN(Value(r->raw().sfs[i]));
+        }
+        op_rdfanth:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_DFARRAY)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          OP_RETURN(Value(r->raw().dfs[i]));
+        }
+        op_rranth:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_RARRAY)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          OP_RETURN(Value(r->raw().rs[i]));
+        }
+        op_rtnth:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_TUPLE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          OP_RETURN(Value(r->raw().tuple_elem_types()[i], r->raw().tes[i]));
+        }
+        op_rialen8:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY8)) OP_RETURN(Value());
+          OP_RETURN(Value(static_cast<int64_t>(r->length())));
+        }
+        op_rialen16:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY16)) OP_RETURN(Value());
+          OP_RETURN(Value(static_cast<int64_t>(r->length())));
+        }
+        op_rialen32:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY32)) OP_RETURN(Value());
+          OP_RETURN(Value(static_cast<int64_t>(r->length())));
+        }
+        op_rialen64:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY64)) OP_RETURN(Value());
+          OP_RETURN(Value(static_cast<int64_t>(r->length())));
+        }
+        op_rsfalen:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_SFARRAY)) OP_RETURN(Value());
+          OP_RETURN(Value(static_cast<int64_t>(r->length())));
+        }
+        op_rdfalen:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_DFARRAY)) OP_RETURN(Value());
+          OP_RETURN(Value(static_cast<int64_t>(r->length())));
+        }
+        op_rralen:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_RARRAY)) OP_RETURN(Value());
+          OP_RETURN(Value(static_cast<int64_t>(r->length())));
+        }
+        op_rtlen:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_TUPLE)) OP_RETURN(Value());
+          OP_RETURN(Value(static_cast<int64_t>(r->length())));
+        }
+        op_riacat8:
+        {
+          Reference r1, r2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_ref(context, r2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r1, OBJECT_TYPE_IARRAY8)) OP_RETURN(Value());            
+          if(!check_object_type(context, *r2, OBJECT_TYPE_IARRAY8)) OP_RETURN(Value());
+          size_t object_length;
+          if(!add_object_lengths(context, object_length, r1->length(), r2->length())) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_IARRAY8, object_length));
+          if(r.is_null()) OP_RETURN(Value());
+          copy_n(r1->raw().is8, r1->length(), r->raw().is8);
+          copy_n(r2->raw().is8, r2->length(), r->raw().is8 + r1->length());
+          OP_RETURN(Value(r));
+        }
+        op_riacat16:
+        {
+          Reference r1, r2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_ref(context, r2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r1, OBJECT_TYPE_IARRAY16)) OP_RETURN(Value());
+          if(!check_object_type(context, *r2, OBJECT_TYPE_IARRAY16)) OP_RETURN(Value());
+          size_t object_length;
+          if(!add_object_lengths(context, object_length, r1->length(), r2->length())) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_IARRAY16, object_length));
+          if(r.is_null()) OP_RETURN(Value());
+          copy_n(r1->raw().is16, r1->length(), r->raw().is16);
+          copy_n(r2->raw().is16, r2->length(), r->raw().is16 + r1->length());
+          OP_RETURN(Value(r));
+        }
+        op_riacat32:
+        {
+          Reference r1, r2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_ref(context, r2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r1, OBJECT_TYPE_IARRAY32)) OP_RETURN(Value());
+          if(!check_object_type(context, *r2, OBJECT_TYPE_IARRAY32)) OP_RETURN(Value());
+          size_t object_length;
+          if(!add_object_lengths(context, object_length, r1->length(), r2->length())) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_IARRAY32, object_length));
+          if(r.is_null()) OP_RETURN(Value());
+          copy_n(r1->raw().is32, r1->length(), r->raw().is32);
+          copy_n(r2->raw().is32, r2->length(), r->raw().is32 + r1->length());
+          OP_RETURN(Value(r));
+        }
+        op_riacat64:
+        {
+          Reference r1, r2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_ref(context, r2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r1, OBJECT_TYPE_IARRAY64)) OP_RETURN(Value());
+          if(!check_object_type(context, *r2, OBJECT_TYPE_IARRAY64)) OP_RETURN(Value());
+          size_t object_length;
+          if(!add_object_lengths(context, object_length, r1->length(), r2->length())) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_IARRAY64, object_length));
+          if(r.is_null()) OP_RETURN(Value());
+          copy_n(r1->raw().is64, r1->length(), r->raw().is64);
+          copy_n(r2->raw().is64, r2->length(), r->raw().is64 + r1->length());
+          OP_RETURN(Value(r));
+        }
+        op_rsfacat:
+        {
+          Reference r1, r2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_ref(context, r2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r1, OBJECT_TYPE_SFARRAY)) OP_RETURN(Value());
+          if(!check_object_type(context, *r2, OBJECT_TYPE_SFARRAY)) OP_RETURN(Value());
+          size_t object_length;
+          if(!add_object_lengths(context, object_length, r1->length(), r2->length())) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_SFARRAY, object_length));
+          if(r.is_null()) OP_RETURN(Value());
+          copy_n(r1->raw().sfs, r1->length(), r->raw().sfs);
+          copy_n(r2->raw().sfs, r2->length(), r->raw().sfs + r1->length());
+          OP_RETURN(Value(r));
+        }
+        op_rdfacat:
+        {
+          Reference r1, r2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_ref(context, r2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r1, OBJECT_TYPE_DFARRAY)) OP_RETURN(Value());
+          if(!check_object_type(context, *r2, OBJECT_TYPE_DFARRAY)) OP_RETURN(Value());
+          size_t object_length;
+          if(!add_object_lengths(context, object_length, r1->length(), r2->length())) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_DFARRAY, object_length));
+          if(r.is_null()) OP_RETURN(Value());
+          copy_n(r1->raw().dfs, r1->length(), r->raw().dfs);
+          copy_n(r2->raw().dfs, r2->length(), r->raw().dfs + r1->length());
+          OP_RETURN(Value(r));
+        }
+        op_rracat:
+        {
+          Reference r1, r2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_ref(context, r2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r1, OBJECT_TYPE_RARRAY)) OP_RETURN(Value());
+          if(!check_object_type(context, *r2, OBJECT_TYPE_RARRAY)) OP_RETURN(Value());
+          size_t object_length;
+          if(!add_object_lengths(context, object_length, r1->length(), r2->length())) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_RARRAY, object_length));
+          if(r.is_null()) OP_RETURN(Value());
+          copy_n(r1->raw().rs, r1->length(), r->raw().rs);
+          copy_n(r2->raw().rs, r2->length(), r->raw().rs + r1->length());
+          context.release_fence_for_gc();
+          OP_RETURN(Value(r));
+        }
+        op_rtcat:
+        {
+          Reference r1, r2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_ref(context, r2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r1, OBJECT_TYPE_TUPLE)) OP_RETURN(Value());
+          if(!check_object_type(context, *r2, OBJECT_TYPE_TUPLE)) OP_RETURN(Value());
+          size_t object_length;
+          if(!add_object_lengths(context, object_length, r1->length(), r2->length())) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_TUPLE, object_length));
+          if(r.is_null()) OP_RETURN(Value());
+          copy_n(r1->raw().tes, r1->length(), r->raw().tes);
+          copy_n(r2->raw().tes, r2->length(), r->raw().tes + r1->length());
+          copy_n(r1->raw().tuple_elem_types(), r1->length(), r->raw().tuple_elem_types());
+          copy_n(r2->raw().tuple_elem_types(), r2->length(), r->raw().tuple_elem_types() + r1->length());
+          context.release_fence_for_gc();
+          OP_RETURN(Value(r));
+        }
+        op_rtype:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(r->type()));
+        }
+        op_icall:
+        {
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!context.regs().after_leaving_flags[0]) {
+            if(context.regs().arg_instr_flag) if(!push_tmp_ac2(context)) OP_RETURN(Value());
+            if(!call_fun(context, static_cast<uint32_t>(i), VALUE_TYPE_INT)) OP_RETURN(Value());
+          }
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          context.regs().after_leaving_flags[0] = false;
+          if(context.regs().arg_instr_flag) if(!pop_tmp_ac2(context)) OP_RETURN(Value());
+          if(!_M_eval_strategy->post_leave_from_fun(this, &context, static_cast<uint32_t>(i), VALUE_TYPE_INT)) OP_RETURN(Value());
+          context.pop_args();
+          OP_RETURN(_M_return_value_to_int_value(context.regs().rv));
+        }
+        op_fcall:
+        {
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!context.regs().after_leaving_flags[0]) {
+            if(context.regs().arg_instr_flag) if(!push_tmp_ac2(context)) OP_RETURN(Value());
+            if(!call_fun(context, static_cast<uint32_t>(i), VALUE_TYPE_FLOAT)) OP_RETURN(Value());
+          }
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          context.regs().after_leaving_flags[0] = false;
+          if(context.regs().arg_instr_flag) if(!pop_tmp_ac2(context)) OP_RETURN(Value());
+          if(!_M_eval_strategy->post_leave_from_fun(this, &context, static_cast<uint32_t>(i), VALUE_TYPE_FLOAT)) OP_RETURN(Value());
+          context.pop_args();
+          OP_RETURN(_M_return_value_to_float_value(context.regs().rv));
+        }
+        op_rcall:
+        {
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!context.regs().after_leaving_flags[0]) {
+            if(context.regs().arg_instr_flag) if(!push_tmp_ac2(context)) OP_RETURN(Value());
+            if(!call_fun(context, static_cast<uint32_t>(i), VALUE_TYPE_REF)) OP_RETURN(Value());
+          }
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          context.regs().after_leaving_flags[0] = false;
+          if(context.regs().arg_instr_flag) if(!pop_tmp_ac2(context)) OP_RETURN(Value());
+          if(!_M_eval_strategy->post_leave_from_fun(this, &context, static_cast<uint32_t>(i), VALUE_TYPE_REF)) OP_RETURN(Value());
+          context.pop_args();
+          OP_RETURN(_M_return_value_to_ref_value(context.regs().rv));
+        }
+        op_itof:
+        {
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(static_cast<double>(i)));
+        }
+        op_ftoi:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(static_cast<int64_t>(f)));
+        }
+        op_incall:
+        {
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(context.regs().arg_instr_flag) if(!push_tmp_ac2(context)) OP_RETURN(Value());
+          ArgumentList args = context.pushed_args();
+          ReturnValue rv = context.invoke_native_fun(this, i, args);
+          if(rv.raw().error != ERROR_SUCCESS) {
+            context.add_stack_trace_elem_for_native_fun(i);
+            context.set_error(rv.raw().error, rv.raw().r, false);
+            OP_RETURN(Value());
           }
-          case OP_RURANTH:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_RARRAY | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            if(!check_shared_for_object(context, *(r->raw().rs[i]))) return Value();
-            Reference r2(new_unique_pair(context, Value(r->raw().rs[i]), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
+          context.regs().tmp_r.safely_assign_for_gc(Reference());
+          if(context.regs().arg_instr_flag) if(!pop_tmp_ac2(context)) OP_RETURN(Value());
+          OP_RETURN(Value(rv.raw().i));
+        }
+        op_fncall:
+        {
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(context.regs().arg_instr_flag) if(!push_tmp_ac2(context)) OP_RETURN(Value());
+          ArgumentList args = context.pushed_args();
+          ReturnValue rv = context.invoke_native_fun(this, i, args);
+          if(rv.raw().error != ERROR_SUCCESS) {
+            context.add_stack_trace_elem_for_native_fun(i);
+            context.set_error(rv.raw().error, rv.raw().r, false);
+            OP_RETURN(Value());
           }
-          case OP_RUTNTH:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
+          context.regs().tmp_r.safely_assign_for_gc(Reference());
+          if(context.regs().arg_instr_flag) if(!pop_tmp_ac2(context)) OP_RETURN(Value());
+          OP_RETURN(Value(rv.raw().f));
+        }
+        op_rncall:
+        {
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(context.regs().arg_instr_flag) if(!push_tmp_ac2(context)) OP_RETURN(Value());
+          ArgumentList args = context.pushed_args();
+          ReturnValue rv = context.invoke_native_fun(this, i, args);
+          if(rv.raw().error != ERROR_SUCCESS) {
+            context.add_stack_trace_elem_for_native_fun(i);
+            context.set_error(rv.raw().error, rv.raw().r, false);
+            OP_RETURN(Value());
+          }
+          context.regs().rv.safely_assign_for_gc(Value(rv.raw().r));
+          context.regs().tmp_r.safely_assign_for_gc(Reference());
+          if(context.regs().arg_instr_flag) if(!pop_tmp_ac2(context)) OP_RETURN(Value());
+          OP_RETURN(Value(rv.raw().r));
+        }
+        op_ruiafill8:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_IARRAY8 | OBJECT_TYPE_UNIQUE, i1));
+          if(r.is_null()) OP_RETURN(Value());
+          fill_n(r->raw().is8, i1, i2);
+          OP_RETURN(Value(r));
+        }
+        op_ruiafill16:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_IARRAY16 | OBJECT_TYPE_UNIQUE, i1));
+          if(r.is_null()) OP_RETURN(Value());
+          fill_n(r->raw().is16, i1, i2);
+          OP_RETURN(Value(r));
+        }
+        op_ruiafill32:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_IARRAY32 | OBJECT_TYPE_UNIQUE, i1));
+          if(r.is_null()) OP_RETURN(Value());
+          fill_n(r->raw().is32, i1, i2);
+          OP_RETURN(Value(r));
+        }
+        op_ruiafill64:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_IARRAY64 | OBJECT_TYPE_UNIQUE, i1));
+          if(r.is_null()) OP_RETURN(Value());
+          fill_n(r->raw().is64, i1, i2);
+          OP_RETURN(Value(r));
+        }
+        op_rusfafill:
+        {
+          int64_t i;
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_SFARRAY | OBJECT_TYPE_UNIQUE, i));
+          if(r.is_null()) OP_RETURN(Value());
+          fill_n(r->raw().sfs, i, f);
+          OP_RETURN(Value(r));
+        }
+        op_rudfafill:
+        {
+          int64_t i;
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_DFARRAY | OBJECT_TYPE_UNIQUE, i));
+          if(r.is_null()) OP_RETURN(Value());
+          fill_n(r->raw().dfs, i, f);
+          OP_RETURN(Value(r));
+        }
+        op_rurafill:
+        {
+          int64_t i;
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_ref(context, r, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_shared_for_object(context, *r)) OP_RETURN(Value()); 
+          Reference r2(new_object(context, OBJECT_TYPE_RARRAY | OBJECT_TYPE_UNIQUE, i));
+          if(r2.is_null()) OP_RETURN(Value());
+          fill_n(r->raw().rs, i, r);
+          OP_RETURN(Value(r2));
+        }
+        op_rutfilli:
+        {
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE, i1));
+          if(r.is_null()) OP_RETURN(Value());
+          fill_n(r->raw().tes, i1, TupleElement(i2));
+          fill_n(r->raw().tuple_elem_types(), i1, VALUE_TYPE_INT);
+          OP_RETURN(Value(r));
+        }
+        op_rutfillf:
+        {
+          int64_t i;
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          Reference r(new_object(context, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE, i));
+          if(r.is_null()) OP_RETURN(Value());
+          fill_n(r->raw().tes, i, TupleElement(f));
+          fill_n(r->raw().tuple_elem_types(), i, VALUE_TYPE_FLOAT);
+          OP_RETURN(Value(r));
+        }
+        op_rutfillr:
+        {
+          int64_t i;
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_ref(context, r, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          Reference r2(new_object(context, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE, i));
+          if(r2.is_null()) OP_RETURN(Value());
+          if(static_cast<size_t>(i) > 1U && !check_shared_for_object(context, *r)) {
+            context.set_error(ERROR_AGAIN_USED_UNIQUE);
+            OP_RETURN(Value());
+          }
+          fill_n(r2->raw().tes, i, TupleElement(r));
+          fill_n(r2->raw().tuple_elem_types(), i, VALUE_TYPE_REF);
+          OP_RETURN(Value(r2));
+        }
+        op_ruianth8:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY8 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(r->raw().is8[i]), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_ruianth16:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY16 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(r->raw().is16[i]), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_ruianth32:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY32 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(r->raw().is32[i]), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_ruianth64:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY64 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(r->raw().is64[i]), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_rusfanth:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_SFARRAY | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(r->raw().sfs[i]), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_rudfanth:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_DFARRAY | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(r->raw().dfs[i]), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_ruranth:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_RARRAY | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          if(!check_shared_for_object(context, *(r->raw().rs[i]))) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(r->raw().rs[i]), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_rutnth:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          Value value(r->raw().tuple_elem_types()[i], r->raw().tes[i]);
+          Reference r2(new_unique_pair(context, value, Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          if(value.is_unique())
+            r->raw().tuple_elem_types()[i].raw() = VALUE_TYPE_CANCELED_REF;
+          else if(value.is_lazy())
+            r->raw().tuple_elem_types()[i].raw() |= VALUE_TYPE_LAZILY_CANCELED;
+          OP_RETURN(Value(r2));
+        }
+        op_ruiasnth8:
+        {
+          Reference r;
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i1, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_pushed_arg_count(context, 1)) OP_RETURN(Value());
+          if(!get_int(context, i2, context.pushed_arg(0))) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY8 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i1)) OP_RETURN(Value());
+          r->raw().is8[i1] = i2;
+          OP_RETURN(Value(r));
+        }
+        op_ruiasnth16:
+        {
+          Reference r;
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i1, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_pushed_arg_count(context, 1)) OP_RETURN(Value());
+          if(!get_int(context, i2, context.pushed_arg(0))) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY16 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i1)) OP_RETURN(Value());
+          r->raw().is16[i1] = i2;
+          OP_RETURN(Value(r));
+        }
+        op_ruiasnth32:
+        {
+          Reference r;
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i1, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_pushed_arg_count(context, 1)) OP_RETURN(Value());
+          if(!get_int(context, i2, context.pushed_arg(0))) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY32 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i1)) OP_RETURN(Value());
+          r->raw().is32[i1] = i2;
+          OP_RETURN(Value(r));
+        }
+        op_ruiasnth64:
+        {
+          Reference r;
+          int64_t i1, i2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i1, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_pushed_arg_count(context, 1)) OP_RETURN(Value());
+          if(!get_int(context, i2, context.pushed_arg(0))) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY64 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i1)) OP_RETURN(Value());
+          r->raw().is64[i1] = i2;
+          OP_RETURN(Value(r));
+        }
+        op_rusfasnth:
+        {
+          Reference r;
+          int64_t i;
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_pushed_arg_count(context, 1)) OP_RETURN(Value());
+          if(!get_float(context, f, context.pushed_arg(0))) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_SFARRAY | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          r->raw().sfs[i] = f;
+          OP_RETURN(Value(r));
+        }
+        op_rudfasnth:
+        {
+          Reference r;
+          int64_t i;
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_pushed_arg_count(context, 1)) OP_RETURN(Value());
+          if(!get_float(context, f, context.pushed_arg(0))) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_DFARRAY | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          r->raw().dfs[i] = f;
+          OP_RETURN(Value(r));
+        }
+        op_rurasnth:
+        {
+          Reference r1, r2;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_pushed_arg_count(context, 1)) OP_RETURN(Value());
+          if(!get_ref(context, r2, context.pushed_arg(0))) OP_RETURN(Value());
+          if(!check_object_type(context, *r1, OBJECT_TYPE_RARRAY | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r1, i)) OP_RETURN(Value());
+          context.gc()->write_barrier(r1.ptr(), &context);
+          r1->raw().rs[i].safely_assign_for_gc(r2);
+          OP_RETURN(Value(r1));
+        }
+        op_rutsnth:
+        {
+          Reference r;
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_int(context, i, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_pushed_arg_count(context, 1)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          if(!check_object_elem_index(context, *r, i)) OP_RETURN(Value());
+          Value value = context.pushed_arg(0);
+          cancel_ref_for_unique(context.pushed_arg(0));
+          context.gc()->write_barrier(r.ptr(), &context);
+          r->raw().tuple_elem_types()[i].safely_assign_for_gc(VALUE_TYPE_ERROR);
+          r->raw().tes[i].safely_assign_for_gc(value.tuple_elem());
+          r->raw().tuple_elem_types()[i].safely_assign_for_gc(value.tuple_elem_type());
+          OP_RETURN(Value(r));
+        }
+        op_ruialen8:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY8 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_ruialen16:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY16 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_ruialen32:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY32 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_ruialen64:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY64 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_rusfalen:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_SFARRAY | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_rudfalen:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_DFARRAY | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_ruralen:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_RARRAY | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_rutlen:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_rutype:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          Reference r2(new_unique_pair(context, Value(r->type()), Value(r)));
+          if(r2.is_null()) OP_RETURN(Value());
+          OP_RETURN(Value(r2));
+        }
+        op_ruiatoia8:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY8 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_object(context, OBJECT_TYPE_IARRAY8, context.regs().ac2));
+          if(r2.is_null()) OP_RETURN(Value());
+          copy_n(r->raw().is8, r->length(), r2->raw().is8);
+          context.regs().tmp_r = r2;
+          Reference r3(new_unique_pair(context, Value(r2), Value(r)));
+          if(r3.is_null()) OP_RETURN(Value());
+          context.regs().rv.safely_assign_for_gc(Value(r3));
+          context.regs().tmp_r.safely_assign_for_gc(Reference());
+          OP_RETURN(Value(r3));
+        }
+        op_ruiatoia16:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY16 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_object(context, OBJECT_TYPE_IARRAY16, context.regs().ac2));
+          if(r2.is_null()) OP_RETURN(Value());
+          copy_n(r->raw().is16, r->length(), r2->raw().is16);
+          context.regs().tmp_r = r2;
+          Reference r3(new_unique_pair(context, Value(r2), Value(r)));
+          if(r3.is_null()) OP_RETURN(Value());
+          context.regs().rv.safely_assign_for_gc(Value(r3));
+          context.regs().tmp_r.safely_assign_for_gc(Reference());
+          OP_RETURN(Value(r3));
+        }
+        op_ruiatoia32:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY32 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_object(context, OBJECT_TYPE_IARRAY32, context.regs().ac2));
+          if(r2.is_null()) OP_RETURN(Value());
+          copy_n(r->raw().is32, r->length(), r2->raw().is32);
+          context.regs().tmp_r = r2;
+          Reference r3(new_unique_pair(context, Value(r2), Value(r)));
+          if(r3.is_null()) OP_RETURN(Value());
+          context.regs().rv.safely_assign_for_gc(Value(r3));
+          context.regs().tmp_r.safely_assign_for_gc(Reference());
+          OP_RETURN(Value(r3));
+        }
+        op_ruiatoia64:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY64 | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_object(context, OBJECT_TYPE_IARRAY64, context.regs().ac2));
+          if(r2.is_null()) OP_RETURN(Value());
+          copy_n(r->raw().is64, r->length(), r2->raw().is64);
+          context.regs().tmp_r = r2;
+          Reference r3(new_unique_pair(context, Value(r2), Value(r)));
+          if(r3.is_null()) OP_RETURN(Value());
+          context.regs().rv.safely_assign_for_gc(Value(r3));
+          context.regs().tmp_r.safely_assign_for_gc(Reference());
+          OP_RETURN(Value(r3));
+        }
+        op_rusfatosfa:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_SFARRAY | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_object(context, OBJECT_TYPE_SFARRAY, context.regs().ac2));
+          if(r2.is_null()) OP_RETURN(Value());
+          copy_n(r->raw().sfs, r->length(), r2->raw().sfs);
+          context.regs().tmp_r = r2;
+          Reference r3(new_unique_pair(context, Value(r2), Value(r)));
+          if(r3.is_null()) OP_RETURN(Value());
+          context.regs().rv.safely_assign_for_gc(Value(r3));
+          context.regs().tmp_r.safely_assign_for_gc(Reference());
+          OP_RETURN(Value(r3));
+        }
+        op_rudfatodfa:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_DFARRAY | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_object(context, OBJECT_TYPE_DFARRAY, context.regs().ac2));
+          if(r2.is_null()) OP_RETURN(Value());
+          copy_n(r->raw().dfs, r->length(), r2->raw().dfs);
+          context.regs().tmp_r = r2;
+          Reference r3(new_unique_pair(context, Value(r2), Value(r)));
+          if(r3.is_null()) OP_RETURN(Value());
+          context.regs().rv.safely_assign_for_gc(Value(r3));
+          context.regs().tmp_r.safely_assign_for_gc(Reference());
+          OP_RETURN(Value(r3));
+        }
+        op_ruratora:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_RARRAY | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_object(context, OBJECT_TYPE_RARRAY, context.regs().ac2));
+          if(r2.is_null()) OP_RETURN(Value());
+          for(size_t i = 0; i < r->length(); i++) {
+            if(!check_shared_for_object(context, *(r2->raw().rs[i]))) OP_RETURN(Value());
+            r2->raw().rs[i] = r->raw().rs[i];
+          }
+          context.regs().tmp_r = r2;
+          Reference r3(new_unique_pair(context, Value(r2), Value(r)));
+          if(r3.is_null()) OP_RETURN(Value());
+          context.regs().rv.safely_assign_for_gc(Value(r3));
+          context.regs().tmp_r.safely_assign_for_gc(Reference());
+          OP_RETURN(Value(r3));
+        }
+        op_ruttot:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(new_object(context, OBJECT_TYPE_TUPLE, context.regs().ac2));
+          if(r2.is_null()) OP_RETURN(Value());
+          for(size_t i = 0; i < r->length(); i++) {
             Value value(r->raw().tuple_elem_types()[i], r->raw().tes[i]);
-            Reference r2(new_unique_pair(context, value, Value(r)));
-            if(r2.is_null()) return Value();
-            if(value.is_unique())
-              r->raw().tuple_elem_types()[i].raw() = VALUE_TYPE_CANCELED_REF;
-            else if(value.is_lazy())
-              r->raw().tuple_elem_types()[i].raw() |= VALUE_TYPE_LAZILY_CANCELED;
-            return Value(r2);
-          }
-          case OP_RUIASNTH8:
-          {
-            Reference r;
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i1, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_pushed_arg_count(context, 1)) return Value();
-            if(!get_int(context, i2, context.pushed_arg(0))) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY8 | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i1)) return Value();
-            r->raw().is8[i1] = i2;
-            return Value(r);
-          }
-          case OP_RUIASNTH16:
-          {
-            Reference r;
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i1, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_pushed_arg_count(context, 1)) return Value();
-            if(!get_int(context, i2, context.pushed_arg(0))) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY16 | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i1)) return Value();
-            r->raw().is16[i1] = i2;
-            return Value(r);
-          }
-          case OP_RUIASNTH32:
-          {
-            Reference r;
-            int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i1, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_pushed_arg_count(context, 1)) return Value();
-            if(!get_int(context, i2, context.pushed_arg(0))) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY32 | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i1)) return Value();
-            r->raw().is32[i1] = i2;
-            return Value(r);
-          }
-          case OP_RUIASNTH64:
-          {
-            Reference r;
+            if(!check_shared_for_value(context, value)) OP_RETURN(Value());
+            if(!set_lazy_values_as_shared(context, value)) OP_RETURN(Value());
+            r2->raw().tes[i] = r->raw().tes[i];
+            r2->raw().tuple_elem_types()[i] = r->raw().tuple_elem_types()[i];
+          }
+          context.regs().tmp_r = r2;
+          Reference r3(new_unique_pair(context, Value(r2), Value(r)));
+          if(r3.is_null()) OP_RETURN(Value());
+          context.regs().rv.safely_assign_for_gc(Value(r3));
+          context.regs().tmp_r.safely_assign_for_gc(Reference());
+          OP_RETURN(Value(r3));
+        }
+        op_fpow:
+        {
+          double f1, f2;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count2;
+          if(!get_float(context, f1, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!get_float(context, f2, instr->arg2, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(pow(f1, f2)));
+        }
+        op_fsqrt:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(sqrt(f)));
+        }
+        op_fexp:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(exp(f)));
+        }
+        op_flog:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(log(f)));
+        }
+        op_fcos:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(cos(f)));
+        }
+        op_fsin:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(sin(f)));
+        }
+        op_ftan:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(tan(f)));
+        }
+        op_facos:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(acos(f)));
+        }
+        op_fasin:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(asin(f)));
+        }
+        op_fatan:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(atan(f)));
+        }
+        op_fceil:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(ceil(f)));
+        }
+        op_ffloor:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(floor(f)));
+        }
+        op_fround:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(round(f)));
+        }
+        op_ftrunc:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(trunc(f)));
+        }
+        op_try:
+        {
+          size_t j, n;
+          if(!context.regs().after_leaving_flags[0]) {
             int64_t i1, i2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i1, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_pushed_arg_count(context, 1)) return Value();
-            if(!get_int(context, i2, context.pushed_arg(0))) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY64 | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i1)) return Value();
-            r->raw().is64[i1] = i2;
-            return Value(r);
-          }
-          case OP_RUSFASNTH:
-          {
-            Reference r;
-            int64_t i;
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_pushed_arg_count(context, 1)) return Value();
-            if(!get_float(context, f, context.pushed_arg(0))) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_SFARRAY | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            r->raw().sfs[i] = f;
-            return Value(r);
-          }
-          case OP_RUDFASNTH:
-          {
-            Reference r;
-            int64_t i;
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_pushed_arg_count(context, 1)) return Value();
-            if(!get_float(context, f, context.pushed_arg(0))) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_DFARRAY | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            r->raw().dfs[i] = f;
-            return Value(r);
-          }
-          case OP_RURASNTH:
-          {
-            Reference r1, r2;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_pushed_arg_count(context, 1)) return Value();
-            if(!get_ref(context, r2, context.pushed_arg(0))) return Value();
-            if(!check_object_type(context, *r1, OBJECT_TYPE_RARRAY | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r1, i)) return Value();
-            r1->raw().rs[i].safely_assign_for_gc(r2);
-            return Value(r1);
-          }
-          case OP_RUTSNTH:
-          {
-            Reference r;
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_int(context, i, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_pushed_arg_count(context, 1)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE)) return Value();
-            if(!check_object_elem_index(context, *r, i)) return Value();
-            Value value = context.pushed_arg(0);
+            j = 0;
+            n = instr->pop_arg_count2;
+            if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+            if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+            if(!check_pushed_arg_count(context, 3)) OP_RETURN(Value());
+            Value arg1 = context.pushed_arg(0);
+            Value arg2 = context.pushed_arg(1);
+            Value io = context.pushed_arg(2);
             cancel_ref_for_unique(context.pushed_arg(0));
-            r->raw().tuple_elem_types()[i].safely_assign_for_gc(VALUE_TYPE_ERROR);
-            r->raw().tes[i].safely_assign_for_gc(value.tuple_elem());
-            r->raw().tuple_elem_types()[i].safely_assign_for_gc(value.tuple_elem_type());
-            return Value(r);
-          }
-          case OP_RUIALEN8:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY8 | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
-          }
-          case OP_RUIALEN16:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY16 | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
-          }
-          case OP_RUIALEN32:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY32 | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
-          }
-          case OP_RUIALEN64:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY64 | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
-          }
-          case OP_RUSFALEN:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_SFARRAY | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
-          }
-          case OP_RUDFALEN:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_DFARRAY | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
-          }
-          case OP_RURALEN:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_RARRAY | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
-          }
-          case OP_RUTLEN:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_unique_pair(context, Value(static_cast<int64_t>(r->length())), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
-          }
-          case OP_RUTYPE:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            Reference r2(new_unique_pair(context, Value(r->type()), Value(r)));
-            if(r2.is_null()) return Value();
-            return Value(r2);
-          }
-          case OP_RUIATOIA8:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY8 | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_object(context, OBJECT_TYPE_IARRAY8, context.regs().ac2));
-            if(r2.is_null()) return Value();
-            copy_n(r->raw().is8, r->length(), r2->raw().is8);
-            context.regs().tmp_r = r2;
-            Reference r3(new_unique_pair(context, Value(r2), Value(r)));
-            if(r3.is_null()) return Value();
-            context.regs().rv.safely_assign_for_gc(Value(r3));
-            context.regs().tmp_r.safely_assign_for_gc(Reference());
-            return Value(r3);
-          }
-          case OP_RUIATOIA16:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY16 | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_object(context, OBJECT_TYPE_IARRAY16, context.regs().ac2));
-            if(r2.is_null()) return Value();
-            copy_n(r->raw().is16, r->length(), r2->raw().is16);
-            context.regs().tmp_r = r2;
-            Reference r3(new_unique_pair(context, Value(r2), Value(r)));
-            if(r3.is_null()) return Value();
-            context.regs().rv.safely_assign_for_gc(Value(r3));
-            context.regs().tmp_r.safely_assign_for_gc(Reference());
-            return Value(r3);
-          }
-          case OP_RUIATOIA32:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY32 | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_object(context, OBJECT_TYPE_IARRAY32, context.regs().ac2));
-            if(r2.is_null()) return Value();
-            copy_n(r->raw().is32, r->length(), r2->raw().is32);
-            context.regs().tmp_r = r2;
-            Reference r3(new_unique_pair(context, Value(r2), Value(r)));
-            if(r3.is_null()) return Value();
-            context.regs().rv.safely_assign_for_gc(Value(r3));
-            context.regs().tmp_r.safely_assign_for_gc(Reference());
-            return Value(r3);
-          }
-          case OP_RUIATOIA64:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IARRAY64 | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_object(context, OBJECT_TYPE_IARRAY64, context.regs().ac2));
-            if(r2.is_null()) return Value();
-            copy_n(r->raw().is64, r->length(), r2->raw().is64);
-            context.regs().tmp_r = r2;
-            Reference r3(new_unique_pair(context, Value(r2), Value(r)));
-            if(r3.is_null()) return Value();
-            context.regs().rv.safely_assign_for_gc(Value(r3));
-            context.regs().tmp_r.safely_assign_for_gc(Reference());
-            return Value(r3);
-          }
-          case OP_RUSFATOSFA:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_SFARRAY | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_object(context, OBJECT_TYPE_SFARRAY, context.regs().ac2));
-            if(r2.is_null()) return Value();
-            copy_n(r->raw().sfs, r->length(), r2->raw().sfs);
-            context.regs().tmp_r = r2;
-            Reference r3(new_unique_pair(context, Value(r2), Value(r)));
-            if(r3.is_null()) return Value();
-            context.regs().rv.safely_assign_for_gc(Value(r3));
-            context.regs().tmp_r.safely_assign_for_gc(Reference());
-            return Value(r3);
-          }
-          case OP_RUDFATODFA:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_DFARRAY | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_object(context, OBJECT_TYPE_DFARRAY, context.regs().ac2));
-            if(r2.is_null()) return Value();
-            copy_n(r->raw().dfs, r->length(), r2->raw().dfs);
-            context.regs().tmp_r = r2;
-            Reference r3(new_unique_pair(context, Value(r2), Value(r)));
-            if(r3.is_null()) return Value();
-            context.regs().rv.safely_assign_for_gc(Value(r3));
-            context.regs().tmp_r.safely_assign_for_gc(Reference());
-            return Value(r3);
-          }
-          case OP_RURATORA:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_RARRAY | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_object(context, OBJECT_TYPE_RARRAY, context.regs().ac2));
-            if(r2.is_null()) return Value();
-            for(size_t i = 0; i < r->length(); i++) {
-              if(!check_shared_for_object(context, *(r2->raw().rs[i]))) return Value();
-              r2->raw().rs[i] = r->raw().rs[i];
-            }
-            context.regs().tmp_r = r2;
-            Reference r3(new_unique_pair(context, Value(r2), Value(r)));
-            if(r3.is_null()) return Value();
-            context.regs().rv.safely_assign_for_gc(Value(r3));
-            context.regs().tmp_r.safely_assign_for_gc(Reference());
-            return Value(r3);
-          }
-          case OP_RUTTOT:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(new_object(context, OBJECT_TYPE_TUPLE, context.regs().ac2));
-            if(r2.is_null()) return Value();
-            for(size_t i = 0; i < r->length(); i++) {
-              Value value(r->raw().tuple_elem_types()[i], r->raw().tes[i]);
-              if(!check_shared_for_value(context, value)) return Value();
-              if(!set_lazy_values_as_shared(context, value)) return Value();
-              r2->raw().tes[i] = r->raw().tes[i];
-              r2->raw().tuple_elem_types()[i] = r->raw().tuple_elem_types()[i];
-            }
-            context.regs().tmp_r = r2;
-            Reference r3(new_unique_pair(context, Value(r2), Value(r)));
-            if(r3.is_null()) return Value();
-            context.regs().rv.safely_assign_for_gc(Value(r3));
-            context.regs().tmp_r.safely_assign_for_gc(Reference());
-            return Value(r3);
-          }
-          case OP_FPOW:
-          {
-            double f1, f2;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-            if(!get_float(context, f1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!get_float(context, f2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(pow(f1, f2));
-          }
-          case OP_FSQRT:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(sqrt(f));
-          }
-          case OP_FEXP:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(exp(f));
-          }
-          case OP_FLOG:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(log(f));
-          }
-          case OP_FCOS:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(cos(f));
-          }
-          case OP_FSIN:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(sin(f));
-          }
-          case OP_FTAN:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(tan(f));
-          }
-          case OP_FACOS:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(acos(f));
-          }
-          case OP_FASIN:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(asin(f));
-          }
-          case OP_FATAN:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(atan(f));
-          }
-          case OP_FCEIL:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(ceil(f));
-          }
-          case OP_FFLOOR:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(floor(f));
-          }
-          case OP_FROUND:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(round(f));
-          }
-          case OP_FTRUNC:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(trunc(f));
-          }
-          case OP_TRY:
-          {
-            size_t j, n;
-            if(!context.regs().after_leaving_flags[0]) {
-              int64_t i1, i2;
-              j = 0;
-              n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-              if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-              if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-              if(!check_pushed_arg_count(context, 3)) return Value();
-              Value arg1 = context.pushed_arg(0);
-              Value arg2 = context.pushed_arg(1);
-              Value io = context.pushed_arg(2);
-              cancel_ref_for_unique(context.pushed_arg(0));
-              cancel_ref_for_unique(context.pushed_arg(1));
-              cancel_ref_for_unique(context.pushed_arg(2));
-              if(!check_value_type(context, io, VALUE_TYPE_REF)) return Value();
-              if(!check_object_type(context, *(io.raw().r), OBJECT_TYPE_IO | OBJECT_TYPE_UNIQUE)) return Value(); 
-              if(!context.regs().arg_instr_flag) context.hide_args();
-              if(!push_tmp_ac2(context)) return Value();
-              if(!push_try_regs(context)) return Value();
-              if(!push_arg(context, arg1)) return Value();
-              if(!push_arg(context, io)) return Value();
-              context.set_try_regs(arg2, io.raw().r);
-              if(!call_fun_for_force(context, static_cast<uint32_t>(i1))) return Value();
-            }
-            bool must_repeat = false;
-            do {
-              int error = context.regs().rv.error();
-              Value arg2 = context.regs().try_arg2;
-              Reference io_r = context.regs().try_io_r;
-              int64_t i1, i2;
-              j = 0;
-              n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode), opcode_to_arg_type2(instr.opcode));
-              if(!get_int(context, i1, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-              if(!get_int(context, i2, opcode_to_arg_type2(instr.opcode), instr.arg2, j, n)) return Value();
-              if(!force_rv(context, !context.regs().try_catch_flag)) return Value();
-              if(context.regs().try_catch_flag) context.reset_try_catch_stack_trace();
-              context.regs().after_leaving_flags[0] = false;
-              if(!pop_try_regs(context)) return Value();
-              if(!pop_tmp_ac2(context)) return Value();
-              if(!context.regs().arg_instr_flag) context.restore_abp2_and_ac2();
-              Reference r = context.regs().rv.raw().r;
-              if(error == ERROR_SUCCESS) {
-                if(!pop_expr_values(context, n)) return Value();
-                // Checks and returns the reference for the arg1 function or the arg2 function. 
-                if(r->type() != (OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE) ||
-                    r->length() != 2 ||
-                    r->elem(1).type() != VALUE_TYPE_REF ||
-                    r->elem(1).raw().r->type() != (OBJECT_TYPE_IO | OBJECT_TYPE_UNIQUE)) {
-                  context.set_error(ERROR_INCORRECT_OBJECT);
-                  return Value();
-                }
-                return Value(r);
-              } else {
-                context.regs().rv.raw().error = ERROR_SUCCESS;
-                if(!context.regs().arg_instr_flag) context.hide_args();
-                if(!push_tmp_ac2(context)) return Value();
-                if(!push_try_regs(context)) return Value();
-                if(!push_arg(context, Value(error))) return Value();
-                if(!push_arg(context, Value(r))) return Value();
-                if(!push_arg(context, arg2)) return Value();
-                if(!push_arg(context, io_r)) return Value();
-                context.regs().try_catch_flag = true;
-                context.regs().try_catch_error = error;
-                context.regs().try_catch_r.safely_assign_for_gc(r);
-                context.move_stack_trace_to_try_catch_stack_trace();
-                if(!call_fun_for_force(context, static_cast<uint32_t>(i2))) return Value();
-                must_repeat = true;
+            cancel_ref_for_unique(context.pushed_arg(1));
+            cancel_ref_for_unique(context.pushed_arg(2));
+            if(!check_value_type(context, io, VALUE_TYPE_REF)) OP_RETURN(Value());
+            if(!check_object_type(context, *(io.raw().r), OBJECT_TYPE_IO | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value()); 
+            if(!context.regs().arg_instr_flag) context.hide_args();
+            if(!push_tmp_ac2(context)) OP_RETURN(Value());
+            if(!push_try_regs(context)) OP_RETURN(Value());
+            if(!push_arg(context, arg1)) OP_RETURN(Value());
+            if(!push_arg(context, io)) OP_RETURN(Value());
+            context.set_try_regs(arg2, io.raw().r);
+            if(!call_fun_for_force(context, static_cast<uint32_t>(i1))) OP_RETURN(Value());
+          }
+          bool must_repeat = false;
+          do {
+            int error = context.regs().rv.error();
+            Value arg2 = context.regs().try_arg2;
+            Reference io_r = context.regs().try_io_r;
+            int64_t i1, i2;
+            j = 0;
+            n = instr->pop_arg_count2;
+            if(!get_int(context, i1, instr->arg1, j, n)) OP_RETURN(Value());
+            if(!get_int(context, i2, instr->arg2, j, n)) OP_RETURN(Value());
+            if(!force_rv(context, !context.regs().try_catch_flag)) OP_RETURN(Value());
+            if(context.regs().try_catch_flag) context.reset_try_catch_stack_trace();
+            context.regs().after_leaving_flags[0] = false;
+            if(!pop_try_regs(context)) OP_RETURN(Value());
+            if(!pop_tmp_ac2(context)) OP_RETURN(Value());
+            if(!context.regs().arg_instr_flag) context.restore_abp2_and_ac2();
+            Reference r = context.regs().rv.raw().r;
+            if(error == ERROR_SUCCESS) {
+              if(!pop_expr_values(context, n)) OP_RETURN(Value());
+              // Checks and returns the reference for the arg1 function or the arg2 function. 
+              if(r->type() != (OBJECT_TYPE_TUPLE | OBJECT_TYPE_UNIQUE) ||
+                  r->length() != 2 ||
+                  r->elem(1).type() != VALUE_TYPE_REF ||
+                  r->elem(1).raw().r->type() != (OBJECT_TYPE_IO | OBJECT_TYPE_UNIQUE)) {
+                context.set_error(ERROR_INCORRECT_OBJECT);
+                OP_RETURN(Value());
               }
-            } while(must_repeat);
-          }
-          case OP_IFORCE:
-          {
-            int64_t i;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_int(context, i, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(i);
-          }
-          case OP_FFORCE:
-          {
-            double f;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_float(context, f, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(f);
-          }
-          case OP_RFORCE:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            return Value(r);
-          }
-          case OP_STACKTRACE:
-          {
-            Reference r;
-            size_t j = 0;
-            size_t n = expr_pop_arg_count(opcode_to_arg_type1(instr.opcode));
-            if(!get_ref(context, r, opcode_to_arg_type1(instr.opcode), instr.arg1, j, n)) return Value();
-            if(!pop_expr_values(context, n)) return Value();
-            if(!check_object_type(context, *r, OBJECT_TYPE_IO | OBJECT_TYPE_UNIQUE)) return Value();
-            Reference r2(try_catch_stack_trace_to_object(context));
-            if(r2.is_null()) return Value();
-            Reference r3(new_unique_pair(context, Value(r2), Value(r)));
-            if(r3.is_null()) return Value();
-            context.regs().rv.safely_assign_for_gc(Value(r3));
-            context.regs().tmp_r.safely_assign_for_gc(Reference());
-            return Value(r3);            
-          }
-          default:
-          {
-            context.set_error(ERROR_INCORRECT_INSTR);
-            return Value();
-          }
+              OP_RETURN(Value(r));
+            } else {
+              context.regs().rv.raw().error = ERROR_SUCCESS;
+              if(!context.regs().arg_instr_flag) context.hide_args();
+              if(!push_tmp_ac2(context)) OP_RETURN(Value());
+              if(!push_try_regs(context)) OP_RETURN(Value());
+              if(!push_arg(context, Value(error))) OP_RETURN(Value());
+              if(!push_arg(context, Value(r))) OP_RETURN(Value());
+              if(!push_arg(context, arg2)) OP_RETURN(Value());
+              if(!push_arg(context, io_r)) OP_RETURN(Value());
+              context.regs().try_catch_flag = true;
+              context.regs().try_catch_error = error;
+              context.regs().try_catch_r.safely_assign_for_gc(r);
+              context.move_stack_trace_to_try_catch_stack_trace();
+              if(!call_fun_for_force(context, static_cast<uint32_t>(i2))) OP_RETURN(Value());
+              must_repeat = true;
+            }
+          } while(must_repeat);
+        }
+        op_iforce:
+        {
+          int64_t i;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_int(context, i, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(i));
+        }
+        op_fforce:
+        {
+          double f;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_float(context, f, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(f));
+        }
+        op_rforce:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          OP_RETURN(Value(r));
+        }
+        op_stacktrace:
+        {
+          Reference r;
+          size_t j = 0;
+          size_t n = instr->pop_arg_count1;
+          if(!get_ref(context, r, instr->arg1, j, n)) OP_RETURN(Value());
+          if(!pop_expr_values(context, n)) OP_RETURN(Value());
+          if(!check_object_type(context, *r, OBJECT_TYPE_IO | OBJECT_TYPE_UNIQUE)) OP_RETURN(Value());
+          Reference r2(try_catch_stack_trace_to_object(context));
+          if(r2.is_null()) OP_RETURN(Value());
+          Reference r3(new_unique_pair(context, Value(r2), Value(r)));
+          if(r3.is_null()) OP_RETURN(Value());
+          context.regs().rv.safely_assign_for_gc(Value(r3));
+          context.regs().tmp_r.safely_assign_for_gc(Reference());
+          OP_RETURN(Value(r3));            
         }
+        op_incorrect:
+        {
+          context.set_error(ERROR_INCORRECT_INSTR);
+          OP_RETURN(Value());
+        }
+        op_specialized:
+        OP_RETURN((this->*(instr->specialized_op))(context, *instr));
+
+        op_returned:
+        goto *op_return;
       }
-      
+
+#undef DISPATCH_INSTR
+#undef DISPATCH_INSTR_AFTER_JUMP
+#undef CALL_OP
+#undef OP_RETURN
+#undef FUSE_INSTR
+#undef LET_INSTR
+#undef ARG_INSTR
+
       bool InterpreterVirtualMachine::enter_to_fun(ThreadContext &context, size_t i, bool &is_fun_result)
       {
         is_fun_result = false;
@@ -3033,6 +3827,7 @@ namespace letin
                 if(!restore_and_pop_regs_for_force(context)) return false;
               }
               context.regs().after_leaving_flags[1] = false;
+              context.gc()->write_barrier(&object, &context);
               if(!context.regs().rv.raw().r->is_lazy()) {
                 switch(object.raw().lzv.value_type) {
                   case VALUE_TYPE_INT:
@@ -3207,9 +4002,11 @@ namespace letin
               context.safely_set_gc_tmp_ptr_for_gc(nullptr);
               for(size_t i = 0; i < r->length(); i++) {
                 Value tmp_elem_value = value.raw().r->elem(i);
-                if(!fully_force_value(context, tmp_elem_value, [r, i](Reference elem_r) {
+                if(!fully_force_value(context, tmp_elem_value, [&context, r, i](Reference elem_r) {
+                  context.gc()->write_barrier(r.ptr(), &context);
                   r->set_elem(i, Value(elem_r));
                 })) return false;
+                context.gc()->write_barrier(r.ptr(), &context);
                 r->set_elem(i, tmp_elem_value);
               }
               value.safely_assign_for_gc(Value(r));
@@ -3222,6 +4019,7 @@ namespace letin
                 if(!fully_force_value(context, tmp_elem_value, [&context, i](Reference elem_r) {
                   context.regs().force_tmp_r2.safely_assign_for_gc(elem_r);
                 })) return false;
+                context.gc()->write_barrier(value.raw().r.ptr(), &context);
                 value.raw().r->set_elem(i, tmp_elem_value);
                 context.regs().force_tmp_r2.safely_assign_for_gc(Reference()); 
               }
@@ -3236,9 +4034,11 @@ namespace letin
               context.safely_set_gc_tmp_ptr_for_gc(nullptr);
               for(size_t i = 0; i < r->length(); i++) {
                 Value tmp_elem_value = value.raw().r->elem(i);
-                if(!fully_force_value(context, tmp_elem_value, [r, i](Reference elem_r) {
+                if(!fully_force_value(context, tmp_elem_value, [&context, r, i](Reference elem_r) {
+                  context.gc()->write_barrier(r.ptr(), &context);
                   r->set_elem(i, Value(elem_r));
                 })) return false;
+                context.gc()->write_barrier(r.ptr(), &context);
                 r->set_elem(i, tmp_elem_value);
               }
               value.safely_assign_for_gc(Value(r));
@@ -3252,6 +4052,7 @@ namespace letin
                   context.regs().force_tmp_r2.safely_assign_for_gc(elem_r);
                 })) return false;
                 context.regs().tmp_r.safely_assign_for_gc(tmp_elem_value.r());
+                context.gc()->write_barrier(value.raw().r.ptr(), &context);
                 value.raw().r->set_elem(i, tmp_elem_value);
                 context.regs().tmp_r.safely_assign_for_gc(Reference());
                 context.regs().force_tmp_r2.safely_assign_for_gc(Reference()); 
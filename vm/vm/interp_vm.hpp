@@ -9,6 +9,9 @@
 #define _VM_INTERP_VM_HPP
 
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <letin/const.hpp>
 #include <letin/opcode.hpp>
 #include <letin/vm.hpp>
@@ -21,17 +24,81 @@ namespace letin
   {
     namespace impl
     {
+      // The superinstructions are the fused sequences of the instructions.
+      const std::size_t SUPERINSTR_LET_IN = 0;
+      const std::size_t SUPERINSTR_LET_IN_JC = 1;
+      const std::size_t SUPERINSTR_LET_IN_RET = 2;
+      const std::size_t SUPERINSTR_ARG_ARG = 3;
+
+      class InterpreterVirtualMachine;
+
+      struct ArgumentGetters
+      {
+        bool (InterpreterVirtualMachine::*get_int)(ThreadContext &, std::int64_t &, Argument, std::size_t &, std::size_t);
+        bool (InterpreterVirtualMachine::*get_float)(ThreadContext &, double &, Argument, std::size_t &, std::size_t);
+        bool (InterpreterVirtualMachine::*get_ref)(ThreadContext &, Reference &, Argument, std::size_t &, std::size_t);
+        bool (*get_int_value)(ThreadContext &, Value &, Argument, std::size_t &, std::size_t);
+        bool (*get_float_value)(ThreadContext &, Value &, Argument, std::size_t &, std::size_t);
+        bool (*get_ref_value)(ThreadContext &, Value &, Argument, std::size_t &, std::size_t);
+      };
+
+      struct DecodedInstruction;
+
+      typedef Value (InterpreterVirtualMachine::*SpecializedOperation)(ThreadContext &, const DecodedInstruction &);
+
+      struct DecodedArgument
+      {
+        const ArgumentGetters *getters;
+        Argument value;
+        std::uint32_t type;
+      };
+
+      struct DecodedInstruction
+      {
+        const void *handler;
+        const void *op_handler;
+        SpecializedOperation specialized_op;
+        DecodedArgument arg1;
+        DecodedArgument arg2;
+        std::uint32_t instr;
+        std::uint32_t local_var_count;
+        std::uint32_t pop_arg_count1;
+        std::uint32_t pop_arg_count2;
+      };
+
+      struct DecodedFunction
+      {
+        std::unique_ptr<DecodedInstruction []> instrs;
+        std::uint32_t instr_count;
+        bool is_verified;
+      };
+
       class InterpreterVirtualMachine : public ImplVirtualMachineBase
       {
+        static const ArgumentGetters _S_arg_getters[7];
+        static const ArgumentGetters _S_verified_arg_getters[7];
+
         Value (*_M_return_value_to_int_value)(const ReturnValue &);
         Value (*_M_return_value_to_float_value)(const ReturnValue &);
         Value (*_M_return_value_to_ref_value)(const ReturnValue &);
         bool (InterpreterVirtualMachine::*_M_force_pushed_args)(ThreadContext &);
+        std::unique_ptr<DecodedFunction []> _M_decoded_funs;
+        const void *const *_M_instr_handlers;
+        const void *const *_M_verified_instr_handlers;
+        std::size_t _M_instr_handler_count;
+        const void *const *_M_op_handlers;
+        std::size_t _M_op_handler_count;
+        const void *const *_M_superinstr_handlers;
+        bool _M_profiling_flag;
+        std::mutex _M_instr_profile_mutex;
+        InstructionProfile _M_instr_profile;
       public:
         InterpreterVirtualMachine(Loader *loader, GarbageCollector *gc, NativeFunctionHandler *native_fun_handler, EvaluationStrategy *eval_strategy, std::function<void ()> exit_fun = []() {});
 
         ~InterpreterVirtualMachine();
 
+        bool load(const std::vector<std::pair<void *, std::size_t>> &pairs, std::list<LoadingError> *errors, bool is_auto_freeing);
+
         int force(ThreadContext *context, Value &value);
 
         int fully_force(ThreadContext *context, Value &value);
@@ -39,6 +106,12 @@ namespace letin
         ReturnValue invoke_fun(ThreadContext *context, std::size_t i, const ArgumentList &args);
 
         int fully_force_return_value(ThreadContext *context);
+
+        bool profiling_flag();
+
+        void set_profiling_flag(bool flag);
+
+        bool instr_profile(InstructionProfile &profile);
       protected:
         ReturnValue start_in_thread(std::size_t i, const std::vector<Value> &args, ThreadContext &context, bool is_force);
 
@@ -46,20 +119,57 @@ namespace letin
       private:
         bool get_int(ThreadContext &context, std::int64_t &i, Value &value);
 
-        bool get_int(ThreadContext &context, std::int64_t &i, std::uint32_t arg_type, Argument arg, std::size_t &j, std::size_t n);
+        template<std::uint32_t _ArgType, bool _IsChecked>
+        bool get_int(ThreadContext &context, std::int64_t &i, Argument arg, std::size_t &j, std::size_t n);
+
+        bool get_int(ThreadContext &context, std::int64_t &i, const DecodedArgument &arg, std::size_t &j, std::size_t n)
+        { return (this->*(arg.getters->get_int))(context, i, arg.value, j, n); }
 
         bool get_float(ThreadContext &context, double &f, Value &value);
 
-        bool get_float(ThreadContext &context, double &f, std::uint32_t arg_type, Argument arg, std::size_t &j, std::size_t n);
+        template<std::uint32_t _ArgType, bool _IsChecked>
+        bool get_float(ThreadContext &context, double &f, Argument arg, std::size_t &j, std::size_t n);
+
+        bool get_float(ThreadContext &context, double &f, const DecodedArgument &arg, std::size_t &j, std::size_t n)
+        { return (this->*(arg.getters->get_float))(context, f, arg.value, j, n); }
 
         bool get_ref(ThreadContext &context, Reference &r, Value &value);
 
-        bool get_ref(ThreadContext &context, Reference &r, std::uint32_t arg_type, Argument arg, std::size_t &j, std::size_t n);
+        template<std::uint32_t _ArgType, bool _IsChecked>
+        bool get_ref(ThreadContext &context, Reference &r, Argument arg, std::size_t &j, std::size_t n);
+
+        bool get_ref(ThreadContext &context, Reference &r, const DecodedArgument &arg, std::size_t &j, std::size_t n)
+        { return (this->*(arg.getters->get_ref))(context, r, arg.value, j, n); }
+
+        template<std::uint32_t _Op, std::uint32_t _ArgType1, std::uint32_t _ArgType2>
+        Value interpret_specialized_op(ThreadContext &context, const DecodedInstruction &instr);
+
+        template<std::uint32_t _Op, std::uint32_t _ArgType1>
+        static SpecializedOperation specialized_op_for_arg_type2(std::uint32_t arg_type2);
+
+        template<std::uint32_t _Op>
+        static SpecializedOperation specialized_op_for_arg_types(std::uint32_t arg_type1, std::uint32_t arg_type2);
+
+        static SpecializedOperation find_specialized_op(std::uint32_t op, std::uint32_t arg_type1, std::uint32_t arg_type2);
+
+        void decode_funs();
+
+        void decode_instr(DecodedInstruction &decoded_instr, const Instruction &instr, bool is_verified);
+
+        void fuse_instrs(DecodedFunction &decoded_fun);
+
+        void add_seq_counts_to_instr_profile(const std::unordered_map<std::uint64_t, std::uint64_t> &seq_counts);
       protected:
-        bool interpret_instr(ThreadContext &context);
-      private:
-        Value interpret_op(ThreadContext &context, const Instruction &instr);
+        bool is_verified_fun(std::size_t i) const { return _M_decoded_funs[i].is_verified; }
 
+        void hook_instr(std::size_t i, std::size_t ip);
+
+        void unhook_instr(std::size_t i, std::size_t ip);
+
+        virtual void interpret_hooked_instr(ThreadContext &context);
+
+        void interpret_decoded_instrs(ThreadContext *context_ptr, std::unordered_map<std::uint64_t, std::uint64_t> *seq_counts);
+      private:
         Value interpret_icall_for_eager_eval(ThreadContext &context, const Instruction &instr);
 
         Value interpret_fcall_for_eager_eval(ThreadContext &context, const Instruction &instr);
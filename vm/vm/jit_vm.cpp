@@ -0,0 +1,902 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <vector>
+#include <letin/const.hpp>
+#include <letin/opcode.hpp>
+#include <letin/vm.hpp>
+#include "jit_vm.hpp"
+#include "vm.hpp"
+#include "util.hpp"
+#if defined(_VM_JIT_VM_X86_64)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace letin::opcode;
+using namespace letin::util;
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace impl
+    {
+#if defined(_VM_JIT_VM_X86_64)
+      //
+      // The native code is called with the frame that has the pointers to the registers
+      // and the stack of the thread. The native code of the function is entered at the
+      // instruction that is passed as the entry and returns after the setting of the
+      // instruction pointer to the instruction that has to be executed by the interpreter.
+      //
+
+      struct NativeFrame
+      {
+        Registers *regs;
+        Value *stack;
+        Value *args;
+        Value *local_vars;
+        const atomic<bool> *is_safepoint_requested;
+        uint64_t stack_size;
+      };
+
+      typedef void (*NativeCodeFunction)(const NativeFrame *frame, const void *entry);
+
+      const uint8_t REG_RAX = 0;
+      const uint8_t REG_RCX = 1;
+      const uint8_t REG_RDX = 2;
+      const uint8_t REG_RBX = 3;
+      const uint8_t REG_RBP = 5;
+      const uint8_t REG_RSI = 6;
+      const uint8_t REG_RDI = 7;
+      const uint8_t REG_R12 = 12;
+      const uint8_t REG_R13 = 13;
+      const uint8_t REG_R14 = 14;
+      const uint8_t REG_R15 = 15;
+
+      const uint8_t REG_XMM0 = 0;
+      const uint8_t REG_XMM1 = 1;
+
+      const uint8_t COND_E = 0x4;
+      const uint8_t COND_NE = 0x5;
+      const uint8_t COND_AE = 0x3;
+      const uint8_t COND_A = 0x7;
+      const uint8_t COND_P = 0xa;
+      const uint8_t COND_NP = 0xb;
+      const uint8_t COND_L = 0xc;
+      const uint8_t COND_GE = 0xd;
+      const uint8_t COND_LE = 0xe;
+      const uint8_t COND_G = 0xf;
+
+      // The native code holds the pointer to the stack in RBX, the pointer to the
+      // registers in R12, the pointer to the safepoint flag in R13, the stack size in R14,
+      // the pointer to the arguments in R15, and the pointer to the local variables in RBP.
+      const uint8_t REG_STACK = REG_RBX;
+      const uint8_t REG_REGS = REG_R12;
+      const uint8_t REG_SAFEPOINT = REG_R13;
+      const uint8_t REG_STACK_SIZE = REG_R14;
+      const uint8_t REG_ARGS = REG_R15;
+      const uint8_t REG_LOCAL_VARS = REG_RBP;
+
+      const int32_t VALUE_TYPE_OFFSET = offsetof(ValueRaw, type);
+      const int32_t VALUE_I_OFFSET = offsetof(ValueRaw, i);
+
+      class X86_64Assembler
+      {
+        vector<uint8_t> _M_code;
+        vector<size_t> _M_label_poses;
+        vector<pair<size_t, size_t>> _M_fixups;
+      public:
+        const vector<uint8_t> &code() const { return _M_code; }
+
+        size_t pos() const { return _M_code.size(); }
+
+        size_t new_label()
+        {
+          _M_label_poses.push_back(numeric_limits<size_t>::max());
+          return _M_label_poses.size() - 1;
+        }
+
+        bool is_bound(size_t label) const { return _M_label_poses[label] != numeric_limits<size_t>::max(); }
+
+        size_t label_pos(size_t label) const { return _M_label_poses[label]; }
+
+        void bind(size_t label) { _M_label_poses[label] = pos(); }
+
+        void resolve_fixups()
+        {
+          for(auto &fixup : _M_fixups) {
+            int32_t rel = static_cast<int32_t>(_M_label_poses[fixup.second] - (fixup.first + 4));
+            memcpy(_M_code.data() + fixup.first, &rel, 4);
+          }
+        }
+
+        void byte(uint8_t x) { _M_code.push_back(x); }
+
+        void dword(uint32_t x)
+        { for(int i = 0; i < 4; i++) byte((x >> (i * 8)) & 0xff); }
+
+        void qword(uint64_t x)
+        { for(int i = 0; i < 8; i++) byte((x >> (i * 8)) & 0xff); }
+
+        void rex(bool is_wide, uint8_t reg, uint8_t rm)
+        {
+          uint8_t x = 0x40 | (is_wide ? 8 : 0) | ((reg & 8) != 0 ? 4 : 0) | ((rm & 8) != 0 ? 1 : 0);
+          if(x != 0x40) byte(x);
+        }
+
+        // The memory operands are always encoded with the 32-bit displacement.
+        void op_reg_mem(uint8_t prefix, bool is_wide, initializer_list<uint8_t> opcode, uint8_t reg, uint8_t base, int32_t disp)
+        {
+          if(prefix != 0) byte(prefix);
+          rex(is_wide, reg, base);
+          for(auto x : opcode) byte(x);
+          byte(0x80 | ((reg & 7) << 3) | (base & 7));
+          if((base & 7) == 4) byte(0x24);
+          dword(static_cast<uint32_t>(disp));
+        }
+
+        void op_reg_reg(uint8_t prefix, bool is_wide, initializer_list<uint8_t> opcode, uint8_t reg, uint8_t rm)
+        {
+          if(prefix != 0) byte(prefix);
+          rex(is_wide, reg, rm);
+          for(auto x : opcode) byte(x);
+          byte(0xc0 | ((reg & 7) << 3) | (rm & 7));
+        }
+
+        void mov_r32_mem(uint8_t reg, uint8_t base, int32_t disp) { op_reg_mem(0, false, { 0x8b }, reg, base, disp); }
+
+        void mov_mem_r32(uint8_t base, int32_t disp, uint8_t reg) { op_reg_mem(0, false, { 0x89 }, reg, base, disp); }
+
+        void mov_r64_mem(uint8_t reg, uint8_t base, int32_t disp) { op_reg_mem(0, true, { 0x8b }, reg, base, disp); }
+
+        void mov_mem_r64(uint8_t base, int32_t disp, uint8_t reg) { op_reg_mem(0, true, { 0x89 }, reg, base, disp); }
+
+        void mov_mem_imm32(uint8_t base, int32_t disp, int32_t imm)
+        { op_reg_mem(0, false, { 0xc7 }, 0, base, disp); dword(static_cast<uint32_t>(imm)); }
+
+        void cmp_mem_imm32(uint8_t base, int32_t disp, int32_t imm)
+        { op_reg_mem(0, false, { 0x81 }, 7, base, disp); dword(static_cast<uint32_t>(imm)); }
+
+        void cmp_mem8_imm8(uint8_t base, int32_t disp, uint8_t imm)
+        { op_reg_mem(0, false, { 0x80 }, 7, base, disp); byte(imm); }
+
+        void cmp_r32_mem(uint8_t reg, uint8_t base, int32_t disp) { op_reg_mem(0, false, { 0x3b }, reg, base, disp); }
+
+        void mov_r64_r64(uint8_t dst, uint8_t src) { op_reg_reg(0, true, { 0x89 }, src, dst); }
+
+        void mov_r64_imm(uint8_t reg, int64_t imm)
+        {
+          if(imm >= numeric_limits<int32_t>::min() && imm <= numeric_limits<int32_t>::max()) {
+            op_reg_reg(0, true, { 0xc7 }, 0, reg);
+            dword(static_cast<uint32_t>(imm));
+          } else {
+            rex(true, 0, reg);
+            byte(0xb8 | (reg & 7));
+            qword(static_cast<uint64_t>(imm));
+          }
+        }
+
+        void add_r32_r32(uint8_t dst, uint8_t src) { op_reg_reg(0, false, { 0x01 }, src, dst); }
+
+        void sub_r32_r32(uint8_t dst, uint8_t src) { op_reg_reg(0, false, { 0x29 }, src, dst); }
+
+        void inc_r32(uint8_t reg) { op_reg_reg(0, false, { 0xff }, 0, reg); }
+
+        void alu_r64_r64(uint8_t opcode, uint8_t dst, uint8_t src) { op_reg_reg(0, true, { opcode }, src, dst); }
+
+        void add_r64_r64(uint8_t dst, uint8_t src) { alu_r64_r64(0x01, dst, src); }
+
+        void sub_r64_r64(uint8_t dst, uint8_t src) { alu_r64_r64(0x29, dst, src); }
+
+        void cmp_r64_r64(uint8_t reg1, uint8_t reg2) { alu_r64_r64(0x39, reg1, reg2); }
+
+        void test_r64_r64(uint8_t reg1, uint8_t reg2) { alu_r64_r64(0x85, reg1, reg2); }
+
+        void cmp_r64_imm8(uint8_t reg, int8_t imm)
+        { op_reg_reg(0, true, { 0x83 }, 7, reg); byte(static_cast<uint8_t>(imm)); }
+
+        void imul_r64_r64(uint8_t dst, uint8_t src) { op_reg_reg(0, true, { 0x0f, 0xaf }, dst, src); }
+
+        void unary_r64(uint8_t ext, uint8_t reg) { op_reg_reg(0, true, { 0xf7 }, ext, reg); }
+
+        void shift_r64_cl(uint8_t ext, uint8_t reg) { op_reg_reg(0, true, { 0xd3 }, ext, reg); }
+
+        void shift_r64_imm8(uint8_t ext, uint8_t reg, uint8_t imm)
+        { op_reg_reg(0, true, { 0xc1 }, ext, reg); byte(imm); }
+
+        void cqo() { byte(0x48); byte(0x99); }
+
+        void setcc_r8(uint8_t cond, uint8_t reg) { op_reg_reg(0, false, { 0x0f, static_cast<uint8_t>(0x90 | cond) }, 0, reg); }
+
+        void and_r8_r8(uint8_t dst, uint8_t src) { op_reg_reg(0, false, { 0x20 }, src, dst); }
+
+        void or_r8_r8(uint8_t dst, uint8_t src) { op_reg_reg(0, false, { 0x08 }, src, dst); }
+
+        void movzx_r32_r8(uint8_t dst, uint8_t src) { op_reg_reg(0, false, { 0x0f, 0xb6 }, dst, src); }
+
+        void movq_xmm_r64(uint8_t xmm, uint8_t reg) { op_reg_reg(0x66, true, { 0x0f, 0x6e }, xmm, reg); }
+
+        void movq_r64_xmm(uint8_t reg, uint8_t xmm) { op_reg_reg(0x66, true, { 0x0f, 0x7e }, xmm, reg); }
+
+        void sse_sd(uint8_t opcode, uint8_t dst, uint8_t src) { op_reg_reg(0xf2, false, { 0x0f, opcode }, dst, src); }
+
+        void ucomisd(uint8_t xmm1, uint8_t xmm2) { op_reg_reg(0x66, false, { 0x0f, 0x2e }, xmm1, xmm2); }
+
+        void cvtsi2sd(uint8_t xmm, uint8_t reg) { op_reg_reg(0xf2, true, { 0x0f, 0x2a }, xmm, reg); }
+
+        void cvttsd2si(uint8_t reg, uint8_t xmm) { op_reg_reg(0xf2, true, { 0x0f, 0x2c }, reg, xmm); }
+
+        void push(uint8_t reg) { rex(false, 0, reg); byte(0x50 | (reg & 7)); }
+
+        void pop(uint8_t reg) { rex(false, 0, reg); byte(0x58 | (reg & 7)); }
+
+        void ret() { byte(0xc3); }
+
+        void jmp_r64(uint8_t reg) { op_reg_reg(0, false, { 0xff }, 4, reg); }
+
+        void jmp(size_t label)
+        {
+          byte(0xe9);
+          _M_fixups.push_back(make_pair(pos(), label));
+          dword(0);
+        }
+
+        void jcc(uint8_t cond, size_t label)
+        {
+          byte(0x0f);
+          byte(0x80 | cond);
+          _M_fixups.push_back(make_pair(pos(), label));
+          dword(0);
+        }
+      };
+
+      //
+      // A NativeCodeGenerator class.
+      //
+
+      class NativeCodeGenerator
+      {
+        const Function &_M_fun;
+        X86_64Assembler _M_asm;
+        vector<bool> _M_supported_instr_flags;
+        vector<size_t> _M_instr_labels;
+        vector<size_t> _M_exit_labels;
+        size_t _M_epilogue_label;
+      public:
+        NativeCodeGenerator(const Function &fun) : _M_fun(fun) {}
+
+        bool generate(vector<uint8_t> &code, vector<size_t> &entry_offsets);
+      private:
+        static bool is_supported_arg(uint32_t arg_type, Argument arg);
+
+        static bool is_supported_op(uint32_t op, uint32_t arg_type1, Argument arg1, uint32_t arg_type2, Argument arg2);
+
+        bool is_supported_instr(const Instruction &instr);
+
+        size_t exit_label(size_t ip);
+
+        void emit_prologue();
+
+        void emit_epilogue();
+
+        void emit_exit(size_t ip);
+
+        void emit_arg(uint8_t reg, uint32_t arg_type, Argument arg, int value_type, size_t ip);
+
+        int emit_op(uint32_t op, uint32_t arg_type1, Argument arg1, uint32_t arg_type2, Argument arg2, size_t ip);
+
+        void emit_jump(size_t ip, int32_t offset);
+
+        void emit_instr(const Instruction &instr, size_t ip);
+      };
+
+      bool NativeCodeGenerator::generate(vector<uint8_t> &code, vector<size_t> &entry_offsets)
+      {
+        size_t instr_count = _M_fun.instr_count();
+        bool is_supported_instr_flag = false;
+        _M_supported_instr_flags.resize(instr_count + 1);
+        for(size_t ip = 0; ip < instr_count; ip++) {
+          _M_supported_instr_flags[ip] = is_supported_instr(_M_fun.instr(ip));
+          is_supported_instr_flag |= _M_supported_instr_flags[ip];
+        }
+        _M_supported_instr_flags[instr_count] = false;
+        if(!is_supported_instr_flag) return false;
+        for(size_t ip = 0; ip < instr_count + 1; ip++) {
+          _M_instr_labels.push_back(_M_asm.new_label());
+          _M_exit_labels.push_back(_M_asm.new_label());
+        }
+        _M_epilogue_label = _M_asm.new_label();
+        emit_prologue();
+        // The unsupported instruction and the instruction after the last instruction only
+        // exit from the native code.
+        for(size_t ip = 0; ip < instr_count + 1; ip++) {
+          _M_asm.bind(_M_instr_labels[ip]);
+          if(_M_supported_instr_flags[ip])
+            emit_instr(_M_fun.instr(ip), ip);
+          else
+            emit_exit(ip);
+        }
+        for(size_t ip = 0; ip < instr_count; ip++) {
+          if(_M_supported_instr_flags[ip] && !_M_asm.is_bound(_M_exit_labels[ip])) {
+            _M_asm.bind(_M_exit_labels[ip]);
+            emit_exit(ip);
+          }
+        }
+        _M_asm.bind(_M_epilogue_label);
+        emit_epilogue();
+        _M_asm.resolve_fixups();
+        code = _M_asm.code();
+        entry_offsets.clear();
+        for(size_t ip = 0; ip < instr_count; ip++) {
+          if(_M_supported_instr_flags[ip])
+            entry_offsets.push_back(_M_asm.label_pos(_M_instr_labels[ip]));
+          else
+            entry_offsets.push_back(numeric_limits<size_t>::max());
+        }
+        return true;
+      }
+
+      bool NativeCodeGenerator::is_supported_arg(uint32_t arg_type, Argument arg)
+      {
+        switch(arg_type) {
+          case ARG_TYPE_LVAR:
+            return arg.lvar < (static_cast<uint32_t>(numeric_limits<int32_t>::max()) - sizeof(Value)) / sizeof(Value);
+          case ARG_TYPE_ARG:
+            return arg.arg < (static_cast<uint32_t>(numeric_limits<int32_t>::max()) - sizeof(Value)) / sizeof(Value);
+          case ARG_TYPE_IMM:
+            return true;
+          default:
+            return false;
+        }
+      }
+
+      bool NativeCodeGenerator::is_supported_op(uint32_t op, uint32_t arg_type1, Argument arg1, uint32_t arg_type2, Argument arg2)
+      {
+        switch(op) {
+          case OP_ILOAD:
+          case OP_INEG:
+          case OP_INOT:
+          case OP_FLOAD:
+          case OP_FNEG:
+          case OP_ITOF:
+          case OP_FTOI:
+            return is_supported_arg(arg_type1, arg1);
+          case OP_IADD:
+          case OP_ISUB:
+          case OP_IMUL:
+          case OP_IDIV:
+          case OP_IMOD:
+          case OP_IAND:
+          case OP_IOR:
+          case OP_IXOR:
+          case OP_ISHL:
+          case OP_ISHR:
+          case OP_ISHRU:
+          case OP_IEQ:
+          case OP_INE:
+          case OP_ILT:
+          case OP_IGE:
+          case OP_IGT:
+          case OP_ILE:
+          case OP_FADD:
+          case OP_FSUB:
+          case OP_FMUL:
+          case OP_FDIV:
+          case OP_FEQ:
+          case OP_FNE:
+          case OP_FLT:
+          case OP_FGE:
+          case OP_FGT:
+          case OP_FLE:
+            return is_supported_arg(arg_type1, arg1) && is_supported_arg(arg_type2, arg2);
+          default:
+            return false;
+        }
+      }
+
+      bool NativeCodeGenerator::is_supported_instr(const Instruction &instr)
+      {
+        uint32_t arg_type1 = opcode_to_arg_type1(instr.opcode);
+        uint32_t arg_type2 = opcode_to_arg_type2(instr.opcode);
+        switch(opcode_to_instr(instr.opcode)) {
+          case INSTR_LET:
+          case INSTR_ARG:
+            return is_supported_op(opcode_to_op(instr.opcode), arg_type1, instr.arg1, arg_type2, instr.arg2);
+          case INSTR_IN:
+          case INSTR_JUMP:
+            return true;
+          case INSTR_JC:
+            return is_supported_arg(arg_type1, instr.arg1);
+          case INSTR_RETRY:
+            return _M_fun.arg_count() < (static_cast<uint32_t>(numeric_limits<int32_t>::max()) - sizeof(Value)) / sizeof(Value);
+          default:
+            return false;
+        }
+      }
+
+      size_t NativeCodeGenerator::exit_label(size_t ip)
+      {
+        // The native code of the unsupported instruction only exits from the native code.
+        if(!_M_supported_instr_flags[ip]) return _M_instr_labels[ip];
+        return _M_exit_labels[ip];
+      }
+
+      void NativeCodeGenerator::emit_prologue()
+      {
+        _M_asm.push(REG_RBX);
+        _M_asm.push(REG_RBP);
+        _M_asm.push(REG_R12);
+        _M_asm.push(REG_R13);
+        _M_asm.push(REG_R14);
+        _M_asm.push(REG_R15);
+        _M_asm.mov_r64_mem(REG_REGS, REG_RDI, offsetof(NativeFrame, regs));
+        _M_asm.mov_r64_mem(REG_STACK, REG_RDI, offsetof(NativeFrame, stack));
+        _M_asm.mov_r64_mem(REG_ARGS, REG_RDI, offsetof(NativeFrame, args));
+        _M_asm.mov_r64_mem(REG_LOCAL_VARS, REG_RDI, offsetof(NativeFrame, local_vars));
+        _M_asm.mov_r64_mem(REG_SAFEPOINT, REG_RDI, offsetof(NativeFrame, is_safepoint_requested));
+        _M_asm.mov_r64_mem(REG_STACK_SIZE, REG_RDI, offsetof(NativeFrame, stack_size));
+        _M_asm.jmp_r64(REG_RSI);
+      }
+
+      void NativeCodeGenerator::emit_epilogue()
+      {
+        _M_asm.pop(REG_R15);
+        _M_asm.pop(REG_R14);
+        _M_asm.pop(REG_R13);
+        _M_asm.pop(REG_R12);
+        _M_asm.pop(REG_RBP);
+        _M_asm.pop(REG_RBX);
+        _M_asm.ret();
+      }
+
+      void NativeCodeGenerator::emit_exit(size_t ip)
+      {
+        _M_asm.mov_mem_imm32(REG_REGS, offsetof(Registers, ip), static_cast<int32_t>(ip));
+        _M_asm.jmp(_M_epilogue_label);
+      }
+
+      void NativeCodeGenerator::emit_arg(uint8_t reg, uint32_t arg_type, Argument arg, int value_type, size_t ip)
+      {
+        switch(arg_type) {
+          case ARG_TYPE_LVAR:
+          case ARG_TYPE_ARG:
+          {
+            uint8_t base = (arg_type == ARG_TYPE_LVAR ? REG_LOCAL_VARS : REG_ARGS);
+            int32_t disp = static_cast<int32_t>((arg_type == ARG_TYPE_LVAR ? arg.lvar : arg.arg) * sizeof(Value));
+            // The value of other type, for example a lazy value, is passed to the interpreter.
+            _M_asm.cmp_mem_imm32(base, disp + VALUE_TYPE_OFFSET, value_type);
+            _M_asm.jcc(COND_NE, exit_label(ip));
+            _M_asm.mov_r64_mem(reg, base, disp + VALUE_I_OFFSET);
+            break;
+          }
+          case ARG_TYPE_IMM:
+            if(value_type == VALUE_TYPE_INT) {
+              _M_asm.mov_r64_imm(reg, arg.i);
+            } else {
+              double f = format_float_to_float(arg.f);
+              int64_t i;
+              memcpy(&i, &f, sizeof(double));
+              _M_asm.mov_r64_imm(reg, i);
+            }
+            break;
+        }
+      }
+
+      int NativeCodeGenerator::emit_op(uint32_t op, uint32_t arg_type1, Argument arg1, uint32_t arg_type2, Argument arg2, size_t ip)
+      {
+        // The first argument is loaded to RAX and the second argument is loaded to RCX. The
+        // result is returned in RAX.
+        switch(op) {
+          case OP_ILOAD:
+          case OP_INEG:
+          case OP_INOT:
+          case OP_ITOF:
+            emit_arg(REG_RAX, arg_type1, arg1, VALUE_TYPE_INT, ip);
+            break;
+          case OP_FLOAD:
+          case OP_FNEG:
+          case OP_FTOI:
+            emit_arg(REG_RAX, arg_type1, arg1, VALUE_TYPE_FLOAT, ip);
+            break;
+          case OP_FADD:
+          case OP_FSUB:
+          case OP_FMUL:
+          case OP_FDIV:
+          case OP_FEQ:
+          case OP_FNE:
+          case OP_FLT:
+          case OP_FGE:
+          case OP_FGT:
+          case OP_FLE:
+            emit_arg(REG_RAX, arg_type1, arg1, VALUE_TYPE_FLOAT, ip);
+            emit_arg(REG_RCX, arg_type2, arg2, VALUE_TYPE_FLOAT, ip);
+            _M_asm.movq_xmm_r64(REG_XMM0, REG_RAX);
+            _M_asm.movq_xmm_r64(REG_XMM1, REG_RCX);
+            break;
+          default:
+            emit_arg(REG_RAX, arg_type1, arg1, VALUE_TYPE_INT, ip);
+            emit_arg(REG_RCX, arg_type2, arg2, VALUE_TYPE_INT, ip);
+            break;
+        }
+        switch(op) {
+          case OP_ILOAD:
+          case OP_FLOAD:
+            return op == OP_ILOAD ? VALUE_TYPE_INT : VALUE_TYPE_FLOAT;
+          case OP_INEG:
+            _M_asm.unary_r64(3, REG_RAX);
+            return VALUE_TYPE_INT;
+          case OP_INOT:
+            _M_asm.unary_r64(2, REG_RAX);
+            return VALUE_TYPE_INT;
+          case OP_ITOF:
+            _M_asm.cvtsi2sd(REG_XMM0, REG_RAX);
+            _M_asm.movq_r64_xmm(REG_RAX, REG_XMM0);
+            return VALUE_TYPE_FLOAT;
+          case OP_FNEG:
+            _M_asm.mov_r64_imm(REG_RCX, numeric_limits<int64_t>::min());
+            _M_asm.alu_r64_r64(0x31, REG_RAX, REG_RCX);
+            return VALUE_TYPE_FLOAT;
+          case OP_FTOI:
+            _M_asm.movq_xmm_r64(REG_XMM0, REG_RAX);
+            _M_asm.cvttsd2si(REG_RAX, REG_XMM0);
+            return VALUE_TYPE_INT;
+          case OP_IADD:
+            _M_asm.add_r64_r64(REG_RAX, REG_RCX);
+            return VALUE_TYPE_INT;
+          case OP_ISUB:
+            _M_asm.sub_r64_r64(REG_RAX, REG_RCX);
+            return VALUE_TYPE_INT;
+          case OP_IMUL:
+            _M_asm.imul_r64_r64(REG_RAX, REG_RCX);
+            return VALUE_TYPE_INT;
+          case OP_IDIV:
+          case OP_IMOD:
+            // The division by zero is reported by the interpreter. The division by -1 is
+            // also left to the interpreter because it can overflow.
+            _M_asm.test_r64_r64(REG_RCX, REG_RCX);
+            _M_asm.jcc(COND_E, exit_label(ip));
+            _M_asm.cmp_r64_imm8(REG_RCX, -1);
+            _M_asm.jcc(COND_E, exit_label(ip));
+            _M_asm.cqo();
+            _M_asm.unary_r64(7, REG_RCX);
+            if(op == OP_IMOD) _M_asm.mov_r64_r64(REG_RAX, REG_RDX);
+            return VALUE_TYPE_INT;
+          case OP_IAND:
+            _M_asm.alu_r64_r64(0x21, REG_RAX, REG_RCX);
+            return VALUE_TYPE_INT;
+          case OP_IOR:
+            _M_asm.alu_r64_r64(0x09, REG_RAX, REG_RCX);
+            return VALUE_TYPE_INT;
+          case OP_IXOR:
+            _M_asm.alu_r64_r64(0x31, REG_RAX, REG_RCX);
+            return VALUE_TYPE_INT;
+          case OP_ISHL:
+            _M_asm.shift_r64_cl(4, REG_RAX);
+            return VALUE_TYPE_INT;
+          case OP_ISHR:
+            _M_asm.shift_r64_cl(7, REG_RAX);
+            return VALUE_TYPE_INT;
+          case OP_ISHRU:
+            _M_asm.shift_r64_cl(5, REG_RAX);
+            return VALUE_TYPE_INT;
+          case OP_IEQ:
+          case OP_INE:
+          case OP_ILT:
+          case OP_IGE:
+          case OP_IGT:
+          case OP_ILE:
+          {
+            uint8_t cond;
+            switch(op) {
+              case OP_IEQ: cond = COND_E; break;
+              case OP_INE: cond = COND_NE; break;
+              case OP_ILT: cond = COND_L; break;
+              case OP_IGE: cond = COND_GE; break;
+              case OP_IGT: cond = COND_G; break;
+              default: cond = COND_LE; break;
+            }
+            _M_asm.cmp_r64_r64(REG_RAX, REG_RCX);
+            _M_asm.setcc_r8(cond, REG_RAX);
+            _M_asm.movzx_r32_r8(REG_RAX, REG_RAX);
+            return VALUE_TYPE_INT;
+          }
+          case OP_FADD:
+            _M_asm.sse_sd(0x58, REG_XMM0, REG_XMM1);
+            _M_asm.movq_r64_xmm(REG_RAX, REG_XMM0);
+            return VALUE_TYPE_FLOAT;
+          case OP_FSUB:
+            _M_asm.sse_sd(0x5c, REG_XMM0, REG_XMM1);
+            _M_asm.movq_r64_xmm(REG_RAX, REG_XMM0);
+            return VALUE_TYPE_FLOAT;
+          case OP_FMUL:
+            _M_asm.sse_sd(0x59, REG_XMM0, REG_XMM1);
+            _M_asm.movq_r64_xmm(REG_RAX, REG_XMM0);
+            return VALUE_TYPE_FLOAT;
+          case OP_FDIV:
+            _M_asm.sse_sd(0x5e, REG_XMM0, REG_XMM1);
+            _M_asm.movq_r64_xmm(REG_RAX, REG_XMM0);
+            return VALUE_TYPE_FLOAT;
+          case OP_FEQ:
+          case OP_FNE:
+            // The comparison with NaN is unordered and sets the parity flag.
+            _M_asm.ucomisd(REG_XMM0, REG_XMM1);
+            if(op == OP_FEQ) {
+              _M_asm.setcc_r8(COND_E, REG_RAX);
+              _M_asm.setcc_r8(COND_NP, REG_RCX);
+              _M_asm.and_r8_r8(REG_RAX, REG_RCX);
+            } else {
+              _M_asm.setcc_r8(COND_NE, REG_RAX);
+              _M_asm.setcc_r8(COND_P, REG_RCX);
+              _M_asm.or_r8_r8(REG_RAX, REG_RCX);
+            }
+            _M_asm.movzx_r32_r8(REG_RAX, REG_RAX);
+            return VALUE_TYPE_INT;
+          default:
+            // The "above" conditions are false for the unordered comparison so the
+            // operands are swapped for the "less" operations.
+            if(op == OP_FLT || op == OP_FLE)
+              _M_asm.ucomisd(REG_XMM1, REG_XMM0);
+            else
+              _M_asm.ucomisd(REG_XMM0, REG_XMM1);
+            _M_asm.setcc_r8((op == OP_FLT || op == OP_FGT) ? COND_A : COND_AE, REG_RAX);
+            _M_asm.movzx_r32_r8(REG_RAX, REG_RAX);
+            return VALUE_TYPE_INT;
+        }
+      }
+
+      void NativeCodeGenerator::emit_jump(size_t ip, int32_t offset)
+      {
+        size_t target_ip = static_cast<size_t>(static_cast<int64_t>(ip) + 1 + offset);
+        // The thread is stopped by the interpreter at the safepoint of the backward jump.
+        if(offset < 0) {
+          _M_asm.cmp_mem8_imm8(REG_SAFEPOINT, 0, 0);
+          _M_asm.jcc(COND_NE, exit_label(target_ip));
+        }
+        _M_asm.jmp(_M_instr_labels[target_ip]);
+      }
+
+      void NativeCodeGenerator::emit_instr(const Instruction &instr, size_t ip)
+      {
+        uint32_t arg_type1 = opcode_to_arg_type1(instr.opcode);
+        uint32_t arg_type2 = opcode_to_arg_type2(instr.opcode);
+        switch(opcode_to_instr(instr.opcode)) {
+          case INSTR_LET:
+          {
+            int value_type = emit_op(opcode_to_op(instr.opcode), arg_type1, instr.arg1, arg_type2, instr.arg2, ip);
+            // The value is pushed after the popping of the pushed arguments.
+            _M_asm.mov_r32_mem(REG_RDX, REG_REGS, offsetof(Registers, abp2));
+            _M_asm.cmp_r64_r64(REG_RDX, REG_STACK_SIZE);
+            _M_asm.jcc(COND_AE, exit_label(ip));
+            _M_asm.mov_r64_r64(REG_RCX, REG_RDX);
+            _M_asm.shift_r64_imm8(4, REG_RCX, 4);
+            _M_asm.add_r64_r64(REG_RCX, REG_STACK);
+            _M_asm.mov_mem_imm32(REG_RCX, VALUE_TYPE_OFFSET, value_type);
+            _M_asm.mov_mem_r64(REG_RCX, VALUE_I_OFFSET, REG_RAX);
+            _M_asm.inc_r32(REG_RDX);
+            _M_asm.mov_mem_r32(REG_REGS, offsetof(Registers, abp2), REG_RDX);
+            _M_asm.mov_mem_imm32(REG_REGS, offsetof(Registers, ac2), 0);
+            _M_asm.mov_mem_r32(REG_REGS, offsetof(Registers, sec), REG_RDX);
+            break;
+          }
+          case INSTR_ARG:
+          {
+            int value_type = emit_op(opcode_to_op(instr.opcode), arg_type1, instr.arg1, arg_type2, instr.arg2, ip);
+            _M_asm.mov_r32_mem(REG_RDX, REG_REGS, offsetof(Registers, abp2));
+            _M_asm.mov_r32_mem(REG_RSI, REG_REGS, offsetof(Registers, ac2));
+            _M_asm.add_r32_r32(REG_RDX, REG_RSI);
+            _M_asm.cmp_r64_r64(REG_RDX, REG_STACK_SIZE);
+            _M_asm.jcc(COND_AE, exit_label(ip));
+            _M_asm.mov_r64_r64(REG_RCX, REG_RDX);
+            _M_asm.shift_r64_imm8(4, REG_RCX, 4);
+            _M_asm.add_r64_r64(REG_RCX, REG_STACK);
+            _M_asm.mov_mem_imm32(REG_RCX, VALUE_TYPE_OFFSET, value_type);
+            _M_asm.mov_mem_r64(REG_RCX, VALUE_I_OFFSET, REG_RAX);
+            _M_asm.mov_mem_r32(REG_REGS, offsetof(Registers, tmp_ac2), REG_RSI);
+            _M_asm.inc_r32(REG_RSI);
+            _M_asm.mov_mem_r32(REG_REGS, offsetof(Registers, ac2), REG_RSI);
+            _M_asm.inc_r32(REG_RDX);
+            _M_asm.mov_mem_r32(REG_REGS, offsetof(Registers, sec), REG_RDX);
+            break;
+          }
+          case INSTR_IN:
+            // The index of the first local variable is computed from the pointer to the
+            // local variables.
+            _M_asm.mov_r32_mem(REG_RAX, REG_REGS, offsetof(Registers, abp2));
+            _M_asm.mov_r64_r64(REG_RCX, REG_LOCAL_VARS);
+            _M_asm.sub_r64_r64(REG_RCX, REG_STACK);
+            _M_asm.shift_r64_imm8(5, REG_RCX, 4);
+            _M_asm.sub_r32_r32(REG_RAX, REG_RCX);
+            _M_asm.mov_mem_r32(REG_REGS, offsetof(Registers, lvc), REG_RAX);
+            break;
+          case INSTR_JC:
+            if(arg_type1 == ARG_TYPE_IMM) {
+              if(instr.arg1.i != 0) emit_jump(ip, instr.arg2.i);
+            } else {
+              size_t next_label = _M_asm.new_label();
+              emit_arg(REG_RAX, arg_type1, instr.arg1, VALUE_TYPE_INT, ip);
+              _M_asm.test_r64_r64(REG_RAX, REG_RAX);
+              _M_asm.jcc(COND_E, next_label);
+              emit_jump(ip, instr.arg2.i);
+              _M_asm.bind(next_label);
+            }
+            break;
+          case INSTR_JUMP:
+            emit_jump(ip, instr.arg1.i);
+            break;
+          case INSTR_RETRY:
+          {
+            int32_t arg_count = static_cast<int32_t>(_M_fun.arg_count());
+            _M_asm.cmp_mem_imm32(REG_REGS, offsetof(Registers, ac), arg_count);
+            _M_asm.jcc(COND_NE, exit_label(ip));
+            _M_asm.cmp_mem_imm32(REG_REGS, offsetof(Registers, ac2), arg_count);
+            _M_asm.jcc(COND_NE, exit_label(ip));
+            _M_asm.mov_r32_mem(REG_RDX, REG_REGS, offsetof(Registers, abp2));
+            _M_asm.shift_r64_imm8(4, REG_RDX, 4);
+            _M_asm.add_r64_r64(REG_RDX, REG_STACK);
+            // The arguments are assigned such as by the safely_assign_for_gc method.
+            for(int32_t i = 0; i < arg_count; i++) {
+              int32_t disp = static_cast<int32_t>(i * sizeof(Value));
+              _M_asm.mov_r32_mem(REG_RAX, REG_RDX, disp + VALUE_TYPE_OFFSET);
+              _M_asm.mov_r64_mem(REG_RCX, REG_RDX, disp + VALUE_I_OFFSET);
+              _M_asm.mov_mem_imm32(REG_ARGS, disp + VALUE_TYPE_OFFSET, VALUE_TYPE_ERROR);
+              _M_asm.mov_mem_r64(REG_ARGS, disp + VALUE_I_OFFSET, REG_RCX);
+              _M_asm.mov_mem_r32(REG_ARGS, disp + VALUE_TYPE_OFFSET, REG_RAX);
+            }
+            _M_asm.mov_r64_r64(REG_RCX, REG_LOCAL_VARS);
+            _M_asm.sub_r64_r64(REG_RCX, REG_STACK);
+            _M_asm.shift_r64_imm8(5, REG_RCX, 4);
+            _M_asm.mov_mem_r32(REG_REGS, offsetof(Registers, abp2), REG_RCX);
+            _M_asm.mov_mem_imm32(REG_REGS, offsetof(Registers, lvc), 0);
+            _M_asm.mov_mem_imm32(REG_REGS, offsetof(Registers, ac2), 0);
+            _M_asm.mov_mem_r32(REG_REGS, offsetof(Registers, sec), REG_RCX);
+            _M_asm.mov_mem_imm32(REG_REGS, offsetof(Registers, evc), 0);
+            _M_asm.mov_r32_mem(REG_RAX, REG_REGS, offsetof(Registers, evbp));
+            _M_asm.mov_mem_r32(REG_REGS, offsetof(Registers, esec), REG_RAX);
+            _M_asm.cmp_mem8_imm8(REG_SAFEPOINT, 0, 0);
+            _M_asm.jcc(COND_NE, exit_label(0));
+            _M_asm.jmp(_M_instr_labels[0]);
+            break;
+          }
+        }
+      }
+
+      static void *new_native_code(const vector<uint8_t> &code, size_t &code_size)
+      {
+        size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        code_size = (code.size() + page_size - 1) & ~(page_size - 1);
+        void *ptr = mmap(nullptr, code_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(ptr == MAP_FAILED) return nullptr;
+        memcpy(ptr, code.data(), code.size());
+        if(mprotect(ptr, code_size, PROT_READ | PROT_EXEC) == -1) {
+          munmap(ptr, code_size);
+          return nullptr;
+        }
+        return ptr;
+      }
+
+      static void delete_native_code(void *ptr, size_t code_size)
+      { munmap(ptr, code_size); }
+#endif
+
+      //
+      // A CompiledFunction structure.
+      //
+
+      CompiledFunction::~CompiledFunction()
+      {
+#if defined(_VM_JIT_VM_X86_64)
+        if(code != nullptr) delete_native_code(code, code_size);
+#endif
+      }
+
+      //
+      // A JitVirtualMachine class.
+      //
+
+      JitVirtualMachine::JitVirtualMachine(Loader *loader, GarbageCollector *gc, NativeFunctionHandler *native_fun_handler, EvaluationStrategy *eval_strategy, function<void ()> exit_fun, unsigned int compilation_threshold) :
+        InterpreterVirtualMachine(loader, gc, native_fun_handler, eval_strategy, exit_fun), _M_compilation_threshold(compilation_threshold) {}
+
+      JitVirtualMachine::~JitVirtualMachine() {}
+
+      bool JitVirtualMachine::load(const vector<pair<void *, size_t>> &pairs, list<LoadingError> *errors, bool is_auto_freeing)
+      {
+        _M_compiled_funs.reset();
+        if(!InterpreterVirtualMachine::load(pairs, errors, is_auto_freeing)) return false;
+        size_t fun_count = _M_env.fun_count();
+        _M_compiled_funs = unique_ptr<CompiledFunction []>(new CompiledFunction[fun_count]);
+#if defined(_VM_JIT_VM_X86_64)
+        // The calls and the retries are counted by the hooks of the first instructions of
+        // the verified functions because the native code doesn't check the arguments. The
+        // functions aren't compiled in the profiling mode.
+        if(!profiling_flag()) {
+          for(size_t i = 0; i < fun_count; i++) {
+            if(is_verified_fun(i) && _M_env.fun(i).instr_count() > 0) hook_instr(i, 0);
+          }
+        }
+#endif
+        return true;
+      }
+
+      size_t JitVirtualMachine::compiled_fun_count()
+      {
+        size_t count = 0;
+        for(size_t i = 0; i < _M_env.fun_count(); i++) {
+          if(_M_compiled_funs[i].is_compiled.load(memory_order_acquire)) count++;
+        }
+        return count;
+      }
+
+      void JitVirtualMachine::interpret_hooked_instr(ThreadContext &context)
+      {
+#if defined(_VM_JIT_VM_X86_64)
+        CompiledFunction &compiled_fun = _M_compiled_funs[context.regs().fp];
+        if(!compiled_fun.is_compiled.load(memory_order_acquire)) {
+          if(compiled_fun.call_count.fetch_add(1, memory_order_relaxed) < _M_compilation_threshold) return;
+          compile_fun(context.regs().fp);
+          if(!compiled_fun.is_compiled.load(memory_order_acquire)) return;
+        }
+        const void *entry = compiled_fun.entries[context.regs().ip];
+        if(entry == nullptr) return;
+        NativeFrame frame;
+        frame.regs = &(context.regs());
+        frame.stack = &(context.stack_elem(0));
+        frame.args = &(context.arg(0));
+        frame.local_vars = &(context.local_var(0));
+        frame.is_safepoint_requested = &(context.safepoint().is_requested);
+        frame.stack_size = context.stack_size();
+        reinterpret_cast<NativeCodeFunction>(compiled_fun.code)(&frame, entry);
+        context.check_safepoint();
+#endif
+      }
+
+      void JitVirtualMachine::compile_fun(size_t i)
+      {
+#if defined(_VM_JIT_VM_X86_64)
+        lock_guard<mutex> guard(_M_compilation_mutex);
+        CompiledFunction &compiled_fun = _M_compiled_funs[i];
+        if(compiled_fun.is_compilation_tried) return;
+        compiled_fun.is_compilation_tried = true;
+        Function fun = _M_env.fun(i);
+        vector<uint8_t> code;
+        vector<size_t> entry_offsets;
+        NativeCodeGenerator generator(fun);
+        if(sizeof(Value) == 16 && generator.generate(code, entry_offsets)) {
+          compiled_fun.code = new_native_code(code, compiled_fun.code_size);
+          if(compiled_fun.code != nullptr) {
+            compiled_fun.entries = unique_ptr<const void *[]>(new const void *[fun.instr_count()]);
+            for(size_t ip = 0; ip < fun.instr_count(); ip++) {
+              if(entry_offsets[ip] != numeric_limits<size_t>::max())
+                compiled_fun.entries[ip] = static_cast<const uint8_t *>(compiled_fun.code) + entry_offsets[ip];
+              else
+                compiled_fun.entries[ip] = nullptr;
+            }
+            compiled_fun.is_compiled.store(true, memory_order_release);
+            // The native code is entered from each supported instruction so that the
+            // native code continues the execution after the instructions that are executed
+            // by the interpreter.
+            for(size_t ip = 1; ip < fun.instr_count(); ip++) {
+              if(compiled_fun.entries[ip] != nullptr) hook_instr(i, ip);
+            }
+            if(compiled_fun.entries[0] == nullptr) unhook_instr(i, 0);
+            return;
+          }
+        }
+        unhook_instr(i, 0);
+#endif
+      }
+    }
+  }
+}
@@ -0,0 +1,75 @@
+/****************************************************************************
+ *   Copyright (C) 2019 Łukasz Szpakowski.                                  *
+ *                                                                          *
+ *   This software is licensed under the GNU Lesser General Public          *
+ *   License v3 or later. See the LICENSE file and the GPL file for         *
+ *   the full licensing terms.                                              *
+ ****************************************************************************/
+#ifndef _VM_JIT_VM_HPP
+#define _VM_JIT_VM_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <letin/vm.hpp>
+#include "interp_vm.hpp"
+#include "vm.hpp"
+
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(_WIN64)
+#define _VM_JIT_VM_X86_64
+#endif
+
+namespace letin
+{
+  namespace vm
+  {
+    namespace impl
+    {
+      struct CompiledFunction
+      {
+        std::atomic<std::uint32_t> call_count;
+        std::atomic<bool> is_compiled;
+        bool is_compilation_tried;
+        void *code;
+        std::size_t code_size;
+        std::unique_ptr<const void *[]> entries;
+
+        CompiledFunction() : call_count(0), is_compiled(false), is_compilation_tried(false), code(nullptr), code_size(0) {}
+
+        ~CompiledFunction();
+      };
+
+      //
+      // The JIT virtual machine compiles the hot functions to the native code by the
+      // templates of the instructions. The native code only executes the integer and
+      // floating-point operations on the arguments, the local variables and the
+      // immediates, the jumps and the retries. The other instructions, the lazy values, and
+      // the errors are left to the interpreter that continues the execution of the
+      // function from the instruction where the native code stopped.
+      //
+      class JitVirtualMachine : public InterpreterVirtualMachine
+      {
+        unsigned int _M_compilation_threshold;
+        std::unique_ptr<CompiledFunction []> _M_compiled_funs;
+        std::mutex _M_compilation_mutex;
+      public:
+        JitVirtualMachine(Loader *loader, GarbageCollector *gc, NativeFunctionHandler *native_fun_handler, EvaluationStrategy *eval_strategy, std::function<void ()> exit_fun = []() {}, unsigned int compilation_threshold = 16);
+
+        ~JitVirtualMachine();
+
+        bool load(const std::vector<std::pair<void *, std::size_t>> &pairs, std::list<LoadingError> *errors, bool is_auto_freeing);
+
+        std::size_t compiled_fun_count();
+      protected:
+        void interpret_hooked_instr(ThreadContext &context);
+      private:
+        void compile_fun(std::size_t i);
+      };
+    }
+  }
+}
+
+#endif